@@ -0,0 +1,303 @@
+#pragma once
+#include <bit>
+#include <utility>
+
+// Define KF_ALLOCATION_STATS to 1 for the whole driver to compile in allocation accounting
+#ifndef KF_ALLOCATION_STATS
+#define KF_ALLOCATION_STATS 0
+#endif
+
+namespace kf
+{
+    //////////////////////////////////////////////////////////////////////////
+    // AllocationStats - opt-in accounting of pool allocations by pool tag to find out which container
+    // drives pool growth.
+    //
+    // Allocations made by allocatePool/freePool are counted: kf::Allocator (and so kf::vector, VariableSizeStruct),
+    // UStringAllocator and PoolNodeAllocator (tree containers) use them and take a pool tag template parameter,
+    // give every container type or call site its own tag to attribute its usage. Allocations made with
+    // `new(poolType)` are not counted.
+    //
+    // Accounting is compiled in with KF_ALLOCATION_STATS and started with initialize(), otherwise it's a no-op.
+    // Counters are per CPU and updated with interlocked operations on the current CPU's cache lines only, so they
+    // don't contend. Live bytes of a single CPU can be negative as a block may be freed on another CPU, the sum is exact.
+    //
+    // snapshot() sums counters into a flat structure that can be sent over a communication port as is.
+    // The allocation rate is the difference of allocation counts of two snapshots divided by the difference
+    // of their timestamps, see allocationsPerSecond(). Snapshot is several KB, don't put it on the stack.
+
+    class AllocationStats
+    {
+    public:
+        static constexpr bool kEnabled = KF_ALLOCATION_STATS != 0;
+        static constexpr size_t kMaxTags = 64;
+        static constexpr size_t kHistogramBuckets = 12;
+        static constexpr ULONG kOtherTag = 0; // counts tags that don't fit kMaxTags
+
+        struct TagStats
+        {
+            ULONG tag;
+            LONG64 liveBytes;
+            LONG64 allocations;
+            LONG64 frees;
+            LONG64 failures;
+            LONG64 histogram[kHistogramBuckets]; // bucket i counts allocations up to (16 << i) bytes, the last one counts larger ones too
+        };
+
+        struct Snapshot
+        {
+            ULONG64 interruptTime; // in 100ns units
+            ULONG tagCount;
+            TagStats tags[kMaxTags];
+        };
+
+        // Starts accounting. Allocations made before it are not counted, so live bytes may go below zero when they are freed.
+        _IRQL_requires_max_(APC_LEVEL)
+        static NTSTATUS initialize() noexcept
+        {
+            if constexpr (kEnabled)
+            {
+                if (s_counters)
+                {
+                    return STATUS_SUCCESS;
+                }
+
+                const ULONG cpuCount = ::KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS);
+
+                // The pool aligns only blocks of PAGE_SIZE or more to a page, the block size is a multiple of it,
+                // so every Counters starts at a cache line
+                static_assert(kMaxTags * sizeof(Counters) % PAGE_SIZE == 0, "Counters of a CPU must take whole pages");
+
+// 28160: Must succeed pool allocations are forbidden. Allocation failures cause a system crash.
+// 4996: ExAllocatePoolWithTag is deprecated, use ExAllocatePool2
+#pragma warning(suppress: 28160 4996)
+                auto counters = static_cast<Counters*>(::ExAllocatePoolWithTag(NonPagedPoolNx, cpuCount * kMaxTags * sizeof(Counters), kPoolTag));
+                if (!counters)
+                {
+                    return STATUS_INSUFFICIENT_RESOURCES;
+                }
+
+                RtlZeroMemory(counters, cpuCount * kMaxTags * sizeof(Counters));
+
+                s_cpuCount = cpuCount;
+                publish(counters);
+
+                return STATUS_SUCCESS;
+            }
+            else
+            {
+                return STATUS_NOT_SUPPORTED;
+            }
+        }
+
+        // Stops accounting. Must not run concurrently with allocations, call it on driver unload.
+        _IRQL_requires_max_(APC_LEVEL)
+        static void uninitialize() noexcept
+        {
+            if (auto counters = static_cast<Counters*>(InterlockedExchangePointer(reinterpret_cast<PVOID volatile*>(&s_counters), nullptr)))
+            {
+                ::ExFreePoolWithTag(counters, kPoolTag);
+            }
+
+            // Tags are forgotten only here as tagSlot() doesn't run concurrently
+            RtlZeroMemory(const_cast<LONG*>(s_tags), sizeof(s_tags));
+        }
+
+        static bool isActive() noexcept
+        {
+            return kEnabled && s_counters;
+        }
+
+        static void onAllocate(ULONG tag, size_t size, bool succeeded) noexcept
+        {
+            if constexpr (kEnabled)
+            {
+                Counters* counters = currentCounters(tag);
+                if (!counters)
+                {
+                    return;
+                }
+
+                if (!succeeded)
+                {
+                    InterlockedIncrement64(&counters->failures);
+                    return;
+                }
+
+                InterlockedIncrement64(&counters->allocations);
+                InterlockedAdd64(&counters->liveBytes, static_cast<LONG64>(size));
+                InterlockedIncrement64(&counters->histogram[histogramBucket(size)]);
+            }
+        }
+
+        static void onFree(ULONG tag, size_t size) noexcept
+        {
+            if constexpr (kEnabled)
+            {
+                if (Counters* counters = currentCounters(tag))
+                {
+                    InterlockedIncrement64(&counters->frees);
+                    InterlockedAdd64(&counters->liveBytes, -static_cast<LONG64>(size));
+                }
+            }
+        }
+
+        // Sums per-CPU counters. Counters are read without stopping allocations, so a snapshot is not atomic,
+        // but every counter is consistent on its own.
+        static void snapshot(_Out_ Snapshot& snapshot) noexcept
+        {
+            RtlZeroMemory(&snapshot, sizeof(snapshot));
+            snapshot.interruptTime = ::KeQueryInterruptTime();
+
+            Counters* counters = s_counters;
+            if (!counters)
+            {
+                return;
+            }
+
+            for (size_t slot = 0; slot < kMaxTags; ++slot)
+            {
+                const ULONG tag = static_cast<ULONG>(s_tags[slot]);
+                if (!tag && slot != kOtherSlot)
+                {
+                    continue;
+                }
+
+                TagStats stats = {};
+                stats.tag = tag;
+
+                for (ULONG cpu = 0; cpu < s_cpuCount; ++cpu)
+                {
+                    const Counters& cpuCounters = counters[cpu * kMaxTags + slot];
+
+                    stats.liveBytes += ReadNoFence64(&cpuCounters.liveBytes);
+                    stats.allocations += ReadNoFence64(&cpuCounters.allocations);
+                    stats.frees += ReadNoFence64(&cpuCounters.frees);
+                    stats.failures += ReadNoFence64(&cpuCounters.failures);
+
+                    for (size_t bucket = 0; bucket < kHistogramBuckets; ++bucket)
+                    {
+                        stats.histogram[bucket] += ReadNoFence64(&cpuCounters.histogram[bucket]);
+                    }
+                }
+
+                if (tag || stats.allocations || stats.failures)
+                {
+                    snapshot.tags[snapshot.tagCount++] = stats;
+                }
+            }
+        }
+
+        static LONG64 allocationsPerSecond(const TagStats& previous, ULONG64 previousTime, const TagStats& current, ULONG64 currentTime) noexcept
+        {
+            const ULONG64 interval = currentTime - previousTime;
+
+            return interval ? (current.allocations - previous.allocations) * 10'000'000 / static_cast<LONG64>(interval) : 0;
+        }
+
+        static size_t histogramBucket(size_t size) noexcept
+        {
+            const size_t bucket = size > 16 ? std::bit_width(size - 1) - 4 : 0;
+            return bucket < kHistogramBuckets ? bucket : kHistogramBuckets - 1;
+        }
+
+    private:
+        static constexpr ULONG kPoolTag = 'sA+K';
+        static constexpr size_t kOtherSlot = 0;
+
+        // Counters of a CPU fill whole cache lines, so counters of different CPUs don't share one
+        struct Counters
+        {
+            LONG64 liveBytes;
+            LONG64 allocations;
+            LONG64 frees;
+            LONG64 failures;
+            LONG64 histogram[kHistogramBuckets];
+        };
+
+        static_assert(sizeof(Counters) % SYSTEM_CACHE_ALIGNMENT_SIZE == 0, "Counters must be a multiple of the cache line size");
+
+        // Concurrent initialize() calls allocate their own blocks, the first published one is used
+        static void publish(_In_ Counters* counters) noexcept
+        {
+            if (InterlockedCompareExchangePointer(reinterpret_cast<PVOID volatile*>(&s_counters), counters, nullptr))
+            {
+                ::ExFreePoolWithTag(counters, kPoolTag);
+            }
+        }
+
+        static Counters* currentCounters(ULONG tag) noexcept
+        {
+            Counters* counters = s_counters;
+            if (!counters)
+            {
+                return nullptr;
+            }
+
+            return &counters[::KeGetCurrentProcessorNumberEx(nullptr) * kMaxTags + tagSlot(tag)];
+        }
+
+        // Tags are registered on first use in an open addressing table, slots are never released
+        static size_t tagSlot(ULONG tag) noexcept
+        {
+            if (tag == kOtherTag)
+            {
+                return kOtherSlot;
+            }
+
+            const size_t start = (tag * 2654435761u) % (kMaxTags - 1);
+
+            for (size_t i = 0; i < kMaxTags - 1; ++i)
+            {
+                const size_t slot = 1 + (start + i) % (kMaxTags - 1);
+                const LONG current = s_tags[slot];
+
+                if (current == static_cast<LONG>(tag))
+                {
+                    return slot;
+                }
+
+                if (!current)
+                {
+                    const LONG previous = InterlockedCompareExchange(&s_tags[slot], static_cast<LONG>(tag), 0);
+                    if (!previous || previous == static_cast<LONG>(tag))
+                    {
+                        return slot;
+                    }
+                }
+            }
+
+            return kOtherSlot;
+        }
+
+    private:
+        static inline Counters* volatile s_counters = nullptr;
+        static inline ULONG s_cpuCount = 0;
+        static inline volatile LONG s_tags[kMaxTags] = {};
+    };
+
+    //////////////////////////////////////////////////////////////////////////
+    // allocatePool/freePool - tagged pool allocation counted by AllocationStats.
+    // freePool must get the same size and tag as allocatePool.
+
+    _Must_inspect_result_
+    inline void* allocatePool(POOL_TYPE poolType, size_t size, ULONG tag) noexcept
+    {
+// 28160: Must succeed pool allocations are forbidden. Allocation failures cause a system crash.
+// 4996: ExAllocatePoolWithTag is deprecated, use ExAllocatePool2
+#pragma warning(suppress: 28160 4996)
+        void* p = ::ExAllocatePoolWithTag(poolType, size ? size : 1, tag);
+        AllocationStats::onAllocate(tag, size, p != nullptr);
+
+        return p;
+    }
+
+    inline void freePool(_In_opt_ void* p, size_t size, ULONG tag) noexcept
+    {
+        if (p)
+        {
+            AllocationStats::onFree(tag, size);
+            ::ExFreePoolWithTag(p, tag);
+        }
+    }
+}
@@ -1,12 +1,15 @@
 #pragma once
 #include "stl/new"
+#include "AllocationStats.h"
 
 namespace kf
 {
     //////////////////////////////////////////////////////////////////////////
     // Allocator
+    //
+    // PoolTag marks pool blocks and attributes them in AllocationStats, give a container its own tag to track it.
 
-    template <class T, POOL_TYPE PoolType>
+    template <class T, POOL_TYPE PoolType, ULONG PoolTag = 'n++C'>
     class Allocator
     {
     public:
@@ -22,22 +25,22 @@ namespace kf
         Allocator(const Allocator&) noexcept = default;
 
         template <typename Other>
-        constexpr Allocator(const Allocator<Other, PoolType>&) noexcept {}
+        constexpr Allocator(const Allocator<Other, PoolType, PoolTag>&) noexcept {}
 
-        constexpr void deallocate(T* const p, size_t) noexcept
+        constexpr void deallocate(T* const p, const size_t count) noexcept
         {
-            operator delete(p);
+            freePool(p, count * sizeof(T), PoolTag);
         }
 
         [[nodiscard]] constexpr T* allocate(const size_t count) noexcept
         {
-            return static_cast<value_type*>(operator new(count * sizeof(T), PoolType));
+            return static_cast<value_type*>(allocatePool(PoolType, count * sizeof(T), PoolTag));
         }
 
         template <typename Other>
         struct rebind
         {
-            using other = Allocator<Other, PoolType>;
+            using other = Allocator<Other, PoolType, PoolTag>;
         };
     };
 }
@@ -0,0 +1,56 @@
+#pragma once
+#include "QueuedSpinLock.h"
+
+namespace kf
+{
+    //////////////////////////////////////////////////////////////////////////
+    // AutoQueuedSpinLock - acquires QueuedSpinLock with a handle that lives in the guard
+
+    class AutoQueuedSpinLock
+    {
+    public:
+        _IRQL_requires_max_(DISPATCH_LEVEL)
+        _IRQL_raises_(DISPATCH_LEVEL)
+        AutoQueuedSpinLock(_In_ QueuedSpinLock& spinLock)
+        {
+            KeAcquireInStackQueuedSpinLock(spinLock, &m_handle);
+        }
+
+        ~AutoQueuedSpinLock()
+        {
+            KeReleaseInStackQueuedSpinLock(&m_handle);
+        }
+
+    private:
+        AutoQueuedSpinLock(const AutoQueuedSpinLock&) = delete;
+        AutoQueuedSpinLock& operator=(const AutoQueuedSpinLock&) = delete;
+
+    private:
+        KLOCK_QUEUE_HANDLE m_handle;
+    };
+
+    //////////////////////////////////////////////////////////////////////////
+    // AutoQueuedSpinLockAtDpcLevel - the same for callers that already run at DISPATCH_LEVEL
+
+    class AutoQueuedSpinLockAtDpcLevel
+    {
+    public:
+        _IRQL_requires_(DISPATCH_LEVEL)
+        AutoQueuedSpinLockAtDpcLevel(_In_ QueuedSpinLock& spinLock)
+        {
+            KeAcquireInStackQueuedSpinLockAtDpcLevel(spinLock, &m_handle);
+        }
+
+        ~AutoQueuedSpinLockAtDpcLevel()
+        {
+            KeReleaseInStackQueuedSpinLockFromDpcLevel(&m_handle);
+        }
+
+    private:
+        AutoQueuedSpinLockAtDpcLevel(const AutoQueuedSpinLockAtDpcLevel&) = delete;
+        AutoQueuedSpinLockAtDpcLevel& operator=(const AutoQueuedSpinLockAtDpcLevel&) = delete;
+
+    private:
+        KLOCK_QUEUE_HANDLE m_handle;
+    };
+}
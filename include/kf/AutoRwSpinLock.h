@@ -0,0 +1,61 @@
+#pragma once
+#include "RwSpinLock.h"
+
+namespace kf
+{
+    //////////////////////////////////////////////////////////////////////////
+    // AutoRwSpinLockShared - holds RwSpinLock shared at IRQL <= DISPATCH_LEVEL
+
+    class AutoRwSpinLockShared
+    {
+    public:
+        _IRQL_requires_max_(DISPATCH_LEVEL)
+        _IRQL_raises_(DISPATCH_LEVEL)
+        AutoRwSpinLockShared(_In_ RwSpinLock& spinLock)
+            : m_spinLock(spinLock)
+            , m_oldIrql(spinLock.acquireShared())
+        {
+        }
+
+        ~AutoRwSpinLockShared()
+        {
+            m_spinLock.releaseShared(m_oldIrql);
+        }
+
+    private:
+        AutoRwSpinLockShared(const AutoRwSpinLockShared&) = delete;
+        AutoRwSpinLockShared& operator=(const AutoRwSpinLockShared&) = delete;
+
+    private:
+        RwSpinLock& m_spinLock;
+        KIRQL       m_oldIrql;
+    };
+
+    //////////////////////////////////////////////////////////////////////////
+    // AutoRwSpinLockExclusive - holds RwSpinLock exclusive at IRQL <= DISPATCH_LEVEL
+
+    class AutoRwSpinLockExclusive
+    {
+    public:
+        _IRQL_requires_max_(DISPATCH_LEVEL)
+        _IRQL_raises_(DISPATCH_LEVEL)
+        AutoRwSpinLockExclusive(_In_ RwSpinLock& spinLock)
+            : m_spinLock(spinLock)
+            , m_oldIrql(spinLock.acquireExclusive())
+        {
+        }
+
+        ~AutoRwSpinLockExclusive()
+        {
+            m_spinLock.releaseExclusive(m_oldIrql);
+        }
+
+    private:
+        AutoRwSpinLockExclusive(const AutoRwSpinLockExclusive&) = delete;
+        AutoRwSpinLockExclusive& operator=(const AutoRwSpinLockExclusive&) = delete;
+
+    private:
+        RwSpinLock& m_spinLock;
+        KIRQL       m_oldIrql;
+    };
+}
@@ -0,0 +1,141 @@
+#pragma once
+#include <kf/ObjectPool.h>
+#include <bit>
+#include <utility>
+
+namespace kf
+{
+    //////////////////////////////////////////////////////////////////////////
+    // BufferPool - cache of byte buffers in power-of-two size classes from kMinSize to kMaxSize
+    // (for example, variable-length ACLs and messages).
+    //
+    // A buffer is rounded up to its size class and is taken from the class cache, see ObjectPool for watermarks.
+    // Larger buffers are allocated from the pool directly. Use BufferPoolAllocator to plug it into
+    // VariableSizeStruct and UString.
+
+    template<POOL_TYPE poolType, size_t kMinSize = 64, size_t kMaxSize = 4096>
+    class BufferPool
+    {
+    public:
+        static_assert(std::has_single_bit(kMinSize) && std::has_single_bit(kMaxSize) && kMinSize <= kMaxSize, "Size classes must be powers of two");
+
+        static constexpr size_t kClassCount = std::countr_zero(kMaxSize / kMinSize) + 1;
+        static constexpr USHORT kDefaultHighWatermark = 16;
+
+        BufferPool() noexcept : BufferPool(std::make_index_sequence<kClassCount>())
+        {
+        }
+
+        BufferPool(const BufferPool&) = delete;
+        BufferPool& operator=(const BufferPool&) = delete;
+
+        // Watermarks apply to every size class
+        _IRQL_requires_max_(APC_LEVEL)
+        NTSTATUS initialize(USHORT lowWatermark = 0, USHORT highWatermark = kDefaultHighWatermark) noexcept
+        {
+            for (size_t i = 0; i < kClassCount; ++i)
+            {
+                const NTSTATUS status = m_classes[i].initialize(lowWatermark, highWatermark);
+                if (!NT_SUCCESS(status))
+                {
+                    return status;
+                }
+            }
+
+            return STATUS_SUCCESS;
+        }
+
+        _Must_inspect_result_
+        std::byte* allocate(_In_ size_t size) noexcept
+        {
+            if (size > kMaxSize)
+            {
+                return static_cast<std::byte*>(operator new(size, poolType));
+            }
+
+            return static_cast<std::byte*>(m_classes[classOf(size)].allocate());
+        }
+
+        // size must be the same as passed to allocate
+        void deallocate(_In_opt_ std::byte* buffer, _In_ size_t size) noexcept
+        {
+            if (size > kMaxSize)
+            {
+                operator delete(buffer);
+                return;
+            }
+
+            m_classes[classOf(size)].deallocate(buffer);
+        }
+
+        void trim() noexcept
+        {
+            for (auto& sizeClass : m_classes)
+            {
+                sizeClass.trim();
+            }
+        }
+
+        USHORT cachedCount(_In_ size_t size) noexcept
+        {
+            return size > kMaxSize ? 0 : m_classes[classOf(size)].cachedCount();
+        }
+
+    private:
+        template<size_t... kClasses>
+        explicit BufferPool(std::index_sequence<kClasses...>) noexcept
+            : m_classes{ detail::BlockPool<poolType>(kMinSize << kClasses, kDefaultHighWatermark)... }
+        {
+        }
+
+        static size_t classOf(size_t size) noexcept
+        {
+            return std::countr_zero(std::bit_ceil((std::max)(size, kMinSize)) / kMinSize);
+        }
+
+    private:
+        detail::BlockPool<poolType> m_classes[kClassCount];
+    };
+
+    //////////////////////////////////////////////////////////////////////////
+    // BufferPoolAllocator - byte allocator that takes buffers from a BufferPool, for example:
+    //
+    //     kf::BufferPool<PagedPool> pool;
+    //     kf::VariableSizeStruct<ACL, PagedPool, kf::BufferPoolAllocator<PagedPool>> acl(pool);
+
+    template<POOL_TYPE poolType, size_t kMinSize = 64, size_t kMaxSize = 4096>
+    class BufferPoolAllocator
+    {
+    public:
+        using value_type = std::byte;
+        using Pool = BufferPool<poolType, kMinSize, kMaxSize>;
+
+        BufferPoolAllocator(_In_ Pool& pool) noexcept : m_pool(&pool)
+        {
+        }
+
+        [[nodiscard]] std::byte* allocate(const size_t count) noexcept
+        {
+            return m_pool->allocate(count);
+        }
+
+        void deallocate(std::byte* const p, const size_t count) noexcept
+        {
+            m_pool->deallocate(p, count);
+        }
+
+        Pool* pool() const noexcept
+        {
+            return m_pool;
+        }
+
+    private:
+        Pool* m_pool;
+    };
+
+    template<POOL_TYPE poolType, size_t kMinSize, size_t kMaxSize>
+    bool operator==(const BufferPoolAllocator<poolType, kMinSize, kMaxSize>& left, const BufferPoolAllocator<poolType, kMinSize, kMaxSize>& right) noexcept
+    {
+        return left.pool() == right.pool();
+    }
+}
@@ -0,0 +1,233 @@
+#pragma once
+#include "TreeMap.h"
+#include "LockPolicy.h"
+#include <bit>
+#include <functional>
+#include <optional>
+
+namespace kf
+{
+    ///////////////////////////////////////////////////////////////////////////////////////////////////
+    // ConcurrentHashMap - thread-safe map container for NT kernel, inspired by
+    // https://docs.oracle.com/javase/8/docs/api/java/util/concurrent/ConcurrentHashMap.html
+    //
+    // Keys are spread by Hash over kShardCount shards (a power of two). Every shard is a TreeMap with its own
+    // lock (see LockPolicy.h), so operations on different shards don't contend. Shards are cache-line aligned,
+    // allocate the map itself cache-line aligned (e.g. a global or a pool allocation of PAGE_SIZE or more)
+    // to avoid false sharing at the object boundary.
+    //
+    // Values are never returned by pointer as they can be removed by another thread as soon as the shard
+    // lock is released: use get to copy a value or pass a function that is called under the shard lock.
+
+    template<class K, class V, POOL_TYPE poolType, class LockPolicy = PushLockPolicy, size_t kShardCount = 64, class Hash = std::hash<K>, class LessComparer = std::less<K>>
+    class ConcurrentHashMap
+    {
+    public:
+        static_assert(std::has_single_bit(kShardCount), "kShardCount must be a power of two");
+
+        ConcurrentHashMap() = default;
+
+        ConcurrentHashMap(const ConcurrentHashMap&) = delete;
+        ConcurrentHashMap& operator=(const ConcurrentHashMap&) = delete;
+
+        bool containsKey(const K& key) const
+        {
+            const Shard& shard = shardOf(key);
+            typename LockPolicy::SharedGuard guard(shard.lock);
+
+            return shard.map.containsKey(key);
+        }
+
+        // Returns a copy of the value
+        std::optional<V> get(const K& key) const
+        {
+            const Shard& shard = shardOf(key);
+            typename LockPolicy::SharedGuard guard(shard.lock);
+
+            const V* value = shard.map.get(key);
+            if (!value)
+            {
+                return std::nullopt;
+            }
+
+            return *value;
+        }
+
+        // Calls function(const V&) under the shared shard lock, returns false if there is no such key
+        template<class Function>
+        bool find(const K& key, Function function) const
+        {
+            const Shard& shard = shardOf(key);
+            typename LockPolicy::SharedGuard guard(shard.lock);
+
+            const V* value = shard.map.get(key);
+            if (!value)
+            {
+                return false;
+            }
+
+            function(*value);
+            return true;
+        }
+
+        NTSTATUS put(const K& key, const V& value)
+        {
+            V tmp(value);
+            return put(key, std::move(tmp));
+        }
+
+        NTSTATUS put(const K& key, V&& value)
+        {
+            Shard& shard = shardOf(key);
+            typename LockPolicy::ExclusiveGuard guard(shard.lock);
+
+            return shard.map.put(key, std::move(value));
+        }
+
+        bool remove(const K& key)
+        {
+            Shard& shard = shardOf(key);
+            typename LockPolicy::ExclusiveGuard guard(shard.lock);
+
+            return shard.map.remove(key);
+        }
+
+        // Inserts the value returned by compute() if there is no such key. compute is called at most once,
+        // under the exclusive shard lock, and only when the value is really inserted.
+        template<class Compute>
+        NTSTATUS computeIfAbsent(const K& key, Compute compute)
+        {
+            return computeIfAbsent(key, compute, [](V&) {});
+        }
+
+        // Same as above and then calls function(V&) for the existing or the inserted value under the shard lock
+        template<class Compute, class Function>
+        NTSTATUS computeIfAbsent(const K& key, Compute compute, Function function)
+        {
+            Shard& shard = shardOf(key);
+            typename LockPolicy::ExclusiveGuard guard(shard.lock);
+
+            V* value = shard.map.tryEmplace(key, ComputedValue<Compute>{ compute });
+            if (!value)
+            {
+                return STATUS_INSUFFICIENT_RESOURCES;
+            }
+
+            function(*value);
+            return STATUS_SUCCESS;
+        }
+
+        // Calls function(const K&, const V&) for all entries visiting one shard at a time under its shared lock,
+        // so it's not a snapshot of the whole map. The enumeration stops if the function returns false.
+        template<class Function>
+        void forEach(Function function) const
+        {
+            for (const Shard& shard : m_shards)
+            {
+                typename LockPolicy::SharedGuard guard(shard.lock);
+
+                for (auto it = const_cast<Map&>(shard.map).iterator(); it.hasNext();)
+                {
+                    const auto& entry = it.next();
+
+                    if (!detail::invokeForEach(function, entry.key(), entry.value()))
+                    {
+                        return;
+                    }
+                }
+            }
+        }
+
+        // The sum of shard sizes, it's not atomic in respect to concurrent modifications
+        int size() const
+        {
+            int size = 0;
+
+            for (const Shard& shard : m_shards)
+            {
+                typename LockPolicy::SharedGuard guard(shard.lock);
+                size += shard.map.size();
+            }
+
+            return size;
+        }
+
+        bool isEmpty() const
+        {
+            return size() == 0;
+        }
+
+        void clear()
+        {
+            for (Shard& shard : m_shards)
+            {
+                typename LockPolicy::ExclusiveGuard guard(shard.lock);
+                shard.map.clear();
+            }
+        }
+
+        static constexpr size_t shardCount()
+        {
+            return kShardCount;
+        }
+
+    private:
+        using Map = TreeMap<K, V, poolType, LessComparer>;
+
+        struct ShardData
+        {
+            mutable typename LockPolicy::Lock lock;
+            Map map;
+        };
+
+        // The padding keeps locks of neighbouring shards at least a cache line apart
+        struct Shard : ShardData
+        {
+            char padding[SYSTEM_CACHE_ALIGNMENT_SIZE - sizeof(ShardData) % SYSTEM_CACHE_ALIGNMENT_SIZE];
+        };
+
+        static_assert(sizeof(Shard) % SYSTEM_CACHE_ALIGNMENT_SIZE == 0, "Shards must take whole cache lines");
+
+        // Converts to V by calling compute, so the value is built only when the node is already inserted
+        template<class Compute>
+        struct ComputedValue
+        {
+            operator V() const
+            {
+                return compute();
+            }
+
+            Compute& compute;
+        };
+
+        static size_t shardIndex(const K& key)
+        {
+            if constexpr (kShardCount == 1)
+            {
+                UNREFERENCED_PARAMETER(key);
+                return 0;
+            }
+            else
+            {
+                // Fibonacci hashing takes the high bits, so weak hashes (like the identity hash of integers) are spread well
+                constexpr int kShardBits = std::countr_zero(kShardCount);
+                const ULONG64 hash = static_cast<ULONG64>(Hash()(key)) * 0x9E3779B97F4A7C15ull;
+
+                return static_cast<size_t>(hash >> (64 - kShardBits));
+            }
+        }
+
+        Shard& shardOf(const K& key)
+        {
+            return m_shards[shardIndex(key)];
+        }
+
+        const Shard& shardOf(const K& key) const
+        {
+            return m_shards[shardIndex(key)];
+        }
+
+    private:
+        Shard m_shards[kShardCount];
+    };
+}
@@ -1,18 +1,40 @@
 #pragma once
-
 #include "EResource.h"
-#include "Semaphore.h"
+#include "Event.h"
+#include "SpinLock.h"
+#include "AutoSpinLock.h"
+#include <algorithm>
+#include <type_traits>
 
 namespace kf
 {
     //////////////////////////////////////////////////////////////////////////
-    // ConditionVariable
-
+    // ConditionVariable - condition variable over any Lockable/SharedLockable Mutex.
+    //
+    // Waiters pass std::unique_lock<Mutex> or std::shared_lock<Mutex>, the lock is reacquired in the same mode
+    // it was held. Every waiter queues a wait block with its own event, notifyOne() wakes the longest waiting
+    // one and notifyAll() wakes the ones that are queued at the moment of the call, no other thread is woken.
+    //
+    //     kf::ConditionVariable<kf::EResource> m_cv;
+    //     ...
+    //     std::unique_lock lock(m_resource);
+    //     m_cv.wait(lock, [&] { return !m_queue.isEmpty(); });
+    //
+    // Timeouts are in 100ns units, deadlines are KeQueryInterruptTime() values. wait*() must be called at
+    // IRQL <= APC_LEVEL, notify*() at IRQL <= DISPATCH_LEVEL.
+
+    template<class Mutex = EResource>
     class ConditionVariable
     {
     public:
-        ConditionVariable() : m_semaphore(0, MAXLONG)
+        ConditionVariable()
+        {
+            InitializeListHead(&m_waiters);
+        }
+
+        ~ConditionVariable()
         {
+            ASSERT(IsListEmpty(&m_waiters));
         }
 
         ConditionVariable(const ConditionVariable&) = delete;
@@ -24,36 +46,38 @@ namespace kf
             Success
         };
 
-        void wait(EResource& external)
+        template<class Lock>
+        _IRQL_requires_max_(APC_LEVEL)
+        void wait(Lock& lock)
         {
-            waitFor(external, nullptr);
+            waitBlock(lock, nullptr);
         }
 
-        template<class Predicate>
-        void wait(EResource& external, Predicate predicate)
+        template<class Lock, class Predicate>
+        _IRQL_requires_max_(APC_LEVEL)
+        void wait(Lock& lock, Predicate predicate)
         {
-            waitFor(external, nullptr, predicate);
+            while (!predicate())
+            {
+                wait(lock);
+            }
         }
 
-        Status waitFor(EResource& external, PLARGE_INTEGER timeout)
+        template<class Lock>
+        _IRQL_requires_max_(APC_LEVEL)
+        Status wait_until(Lock& lock, ULONGLONG deadline)
         {
-            ++m_waitersCount;
-
-            external.release();
-            auto status = NT_SUCCESS(m_semaphore.wait(timeout)) ? Status::Success : Status::Timeout;
-            external.acquireExclusive();
-
-            --m_waitersCount;
-
-            return status;
+            return waitBlock(lock, &deadline);
         }
 
-        template<class Predicate>
-        bool waitFor(EResource& external, PLARGE_INTEGER timeout, Predicate predicate)
+        // Returns the predicate's value, false only if it's still false at the deadline
+        template<class Lock, class Predicate>
+        _IRQL_requires_max_(APC_LEVEL)
+        bool wait_until(Lock& lock, ULONGLONG deadline, Predicate predicate)
         {
             while (!predicate())
             {
-                if (waitFor(external, timeout) == Status::Timeout)
+                if (wait_until(lock, deadline) == Status::Timeout)
                 {
                     return predicate();
                 }
@@ -62,26 +86,120 @@ namespace kf
             return true;
         }
 
+        template<class Lock>
+        _IRQL_requires_max_(APC_LEVEL)
+        Status wait_for(Lock& lock, LONGLONG timeout)
+        {
+            return wait_until(lock, deadlineOf(timeout));
+        }
+
+        template<class Lock, class Predicate>
+        _IRQL_requires_max_(APC_LEVEL)
+        bool wait_for(Lock& lock, LONGLONG timeout, Predicate predicate)
+        {
+            return wait_until(lock, deadlineOf(timeout), predicate);
+        }
+
+        _IRQL_requires_max_(DISPATCH_LEVEL)
         void notifyOne()
         {
-            auto waitersCount = m_waitersCount.load();
-            if (waitersCount > 0)
+            AutoSpinLock guard(m_lock);
+
+            if (!IsListEmpty(&m_waiters))
             {
-                m_semaphore.release();
+                wake(RemoveHeadList(&m_waiters));
             }
         }
 
+        _IRQL_requires_max_(DISPATCH_LEVEL)
         void notifyAll()
         {
-            auto waitersCount = m_waitersCount.load();
-            if (waitersCount > 0)
+            AutoSpinLock guard(m_lock);
+
+            while (!IsListEmpty(&m_waiters))
+            {
+                wake(RemoveHeadList(&m_waiters));
+            }
+        }
+
+    private:
+        struct WaitBlock
+        {
+            WaitBlock() : event(NotificationEvent, false)
             {
-                m_semaphore.release(waitersCount);
             }
+
+            LIST_ENTRY entry;
+            Event      event;
+            bool       notified = false;
+        };
+
+        template<class Lock>
+        Status waitBlock(Lock& lock, _In_opt_ const ULONGLONG* deadline)
+        {
+            static_assert(std::is_same_v<typename Lock::mutex_type, Mutex>, "Lock must hold the condition variable's Mutex");
+            ASSERT(lock.owns_lock());
+
+            // The block is queued before the mutex is released, so a notification that follows a state
+            // change made under the mutex can't be missed
+            WaitBlock block;
+
+            {
+                AutoSpinLock guard(m_lock);
+                InsertTailList(&m_waiters, &block.entry);
+            }
+
+            lock.unlock();
+
+            if (deadline)
+            {
+                const auto now = static_cast<ULONGLONG>(KeQueryInterruptTime());
+
+                LARGE_INTEGER timeout;
+                timeout.QuadPart = -static_cast<LONGLONG>(*deadline > now ? *deadline - now : 0);
+
+                block.event.wait(&timeout);
+            }
+            else
+            {
+                block.event.wait();
+            }
+
+            bool notified;
+
+            {
+                // A notifier that has dequeued the block sets the event under the spin lock, so after it's
+                // released the block is not touched anymore and can leave the stack
+                AutoSpinLock guard(m_lock);
+
+                notified = block.notified;
+                if (!notified)
+                {
+                    RemoveEntryList(&block.entry);
+                }
+            }
+
+            lock.lock();
+
+            // A notification that raced with the timeout is consumed, so it's not lost for other waiters
+            return notified ? Status::Success : Status::Timeout;
+        }
+
+        static void wake(_In_ PLIST_ENTRY entry)
+        {
+            WaitBlock* block = CONTAINING_RECORD(entry, WaitBlock, entry);
+
+            block->notified = true;
+            block->event.set();
+        }
+
+        static ULONGLONG deadlineOf(LONGLONG timeout)
+        {
+            return static_cast<ULONGLONG>(KeQueryInterruptTime()) + static_cast<ULONGLONG>((std::max)(timeout, 0LL));
         }
 
     private:
-        std::atomic_long m_waitersCount = 0;
-        Semaphore m_semaphore;
+        SpinLock   m_lock;
+        LIST_ENTRY m_waiters;
     };
 }
@@ -0,0 +1,262 @@
+#pragma once
+#include <kf/stl/new>
+#include "EResource.h"
+#include "Event.h"
+#include "ReaderShards.h"
+#include "SList.h"
+#include "Thread.h"
+#include <mutex>
+#include <utility>
+
+namespace kf
+{
+    //////////////////////////////////////////////////////////////////////////
+    // Epoch - epoch-based reclamation for structures that are read without a lock (an RCU replacement).
+    //
+    // A reader holds a Guard while it uses objects reachable from the structure. The guard is counted in a
+    // padded counter of the current epoch of its CPU, so readers on different CPUs don't write a shared
+    // cache line. A writer unlinks an object and passes it to retire(), the object is deleted after a grace
+    // period: when every reader that entered before the unlink has left.
+    //
+    // synchronize() advances the epoch and waits for readers of the previous one. Retired objects are freed
+    // by reclaim(), which writers can call after retiring, or by the background thread started with start()
+    // that reclaims when kReclaimThreshold objects are pending or every kReclaimPeriod.
+    //
+    //     kf::Epoch m_epoch;
+    //     ...
+    //     status = m_epoch.initialize();
+    //     ...
+    //     {
+    //         kf::Epoch::Guard guard(m_epoch);
+    //         for (auto entry = readPointer(m_head); entry; entry = readPointer(entry->next)) { ... }
+    //     }
+    //     ...
+    //     unlink(entry); // under the writers' lock
+    //     m_epoch.retire(entry);
+    //
+    // Note: initialize() allocates counters per possible processor and must be called before the first guard,
+    // without it readers share one counter. Guards can be nested and held at IRQL <= DISPATCH_LEVEL, synchronize()
+    // and reclaim() run at PASSIVE_LEVEL and must not be called under a guard. Deleters run at PASSIVE_LEVEL on the
+    // reclaiming thread.
+
+    class Epoch
+    {
+    public:
+        static constexpr LONG kReclaimThreshold = 64;
+        static constexpr LONGLONG kReclaimPeriod = 10 * 10'000; // 10ms
+
+        //////////////////////////////////////////////////////////////////////////
+        // Guard - read-side critical section, objects retired while it's held are not freed until it's destroyed
+
+        class Guard
+        {
+        public:
+            _IRQL_requires_max_(DISPATCH_LEVEL)
+            explicit Guard(const Epoch& epoch) noexcept : m_readers(epoch.enter())
+            {
+            }
+
+            ~Guard()
+            {
+                detail::ReaderShards::leave(m_readers);
+            }
+
+            Guard(const Guard&) = delete;
+            Guard& operator=(const Guard&) = delete;
+
+        private:
+            volatile LONG* m_readers;
+        };
+
+        Epoch() : m_wakeup(SynchronizationEvent, false)
+        {
+        }
+
+        ~Epoch()
+        {
+            join();
+            ASSERT(m_retired.isEmpty());
+        }
+
+        Epoch(const Epoch&) = delete;
+        Epoch& operator=(const Epoch&) = delete;
+
+        _IRQL_requires_max_(DISPATCH_LEVEL)
+        NTSTATUS initialize() noexcept
+        {
+            return m_readers.initialize();
+        }
+
+        // Starts the background reclamation thread
+        _IRQL_requires_max_(PASSIVE_LEVEL)
+        NTSTATUS start(const ThreadOptions& options = {})
+        {
+            InterlockedExchange(&m_stopping, false);
+
+            return m_thread.start([](PVOID context)
+                {
+                    static_cast<Epoch*>(context)->threadRoutine();
+                    PsTerminateSystemThread(STATUS_SUCCESS);
+                },
+                this,
+                options);
+        }
+
+        // Stops the thread and frees all retired objects
+        _IRQL_requires_(PASSIVE_LEVEL)
+        void join()
+        {
+            InterlockedExchange(&m_stopping, true);
+
+            m_wakeup.set();
+            m_thread.join();
+
+            reclaim();
+        }
+
+        // Schedules deleter(ptr) after a grace period. If the call fails the object is not retired, the caller
+        // can synchronize() and delete it.
+        template<class T, class Deleter>
+        _IRQL_requires_max_(DISPATCH_LEVEL)
+        [[nodiscard]] NTSTATUS retire(_In_ T* ptr, Deleter deleter) noexcept
+        {
+            auto retired = new(NonPagedPoolNx) RetiredObject<T, Deleter>(ptr, std::move(deleter));
+            if (!retired)
+            {
+                return STATUS_INSUFFICIENT_RESOURCES;
+            }
+
+            m_retired.push(*retired);
+
+            // The first object starts the thread's period, the threshold one makes it reclaim right away
+            const LONG pending = InterlockedIncrement(&m_pendingCount);
+            if (pending == 1 || pending == kReclaimThreshold)
+            {
+                m_wakeup.set();
+            }
+
+            return STATUS_SUCCESS;
+        }
+
+        // Schedules `delete ptr` after a grace period
+        template<class T>
+        _IRQL_requires_max_(DISPATCH_LEVEL)
+        [[nodiscard]] NTSTATUS retire(_In_ T* ptr) noexcept
+        {
+            return retire(ptr, [](T* object) { delete object; });
+        }
+
+        // Returns after every guard that was held at the moment of the call is released.
+        // Concurrent calls are serialized.
+        _IRQL_requires_(PASSIVE_LEVEL)
+        void synchronize() noexcept
+        {
+            std::unique_lock lock(m_synchronizeLock);
+
+            // The full barrier orders the caller's unlinks before the flip: a guard of the new epoch
+            // can't reach an unlinked object
+            const LONG epoch = InterlockedIncrement(&m_epoch) - 1;
+
+            m_readers.waitForReaders(epoch & 1);
+        }
+
+        // Frees objects retired before the call, returns their number
+        _IRQL_requires_(PASSIVE_LEVEL)
+        ULONG reclaim() noexcept
+        {
+            auto chain = m_retired.flush();
+            if (chain.isEmpty())
+            {
+                return 0;
+            }
+
+            synchronize();
+
+            ULONG count = 0;
+
+            // Objects are freed in the retire order
+            chain.reverse();
+
+            while (auto retired = chain.pop())
+            {
+                retired->reclaim(retired);
+                ++count;
+            }
+
+            InterlockedAdd(&m_pendingCount, -static_cast<LONG>(count));
+
+            return count;
+        }
+
+        // The number of retired objects that are not freed yet, approximate if retire() runs concurrently
+        LONG pendingCount() const noexcept
+        {
+            return ReadNoFence(&m_pendingCount);
+        }
+
+    private:
+        struct Retired
+        {
+            using ReclaimRoutine = void (*)(Retired*) noexcept;
+
+            explicit Retired(ReclaimRoutine reclaim) noexcept : reclaim(reclaim)
+            {
+            }
+
+            SLIST_ENTRY entry = {};
+            ReclaimRoutine reclaim;
+        };
+
+        template<class T, class Deleter>
+        struct RetiredObject : Retired
+        {
+            RetiredObject(T* ptr, Deleter&& deleter) noexcept : Retired(&reclaimObject), ptr(ptr), deleter(std::move(deleter))
+            {
+            }
+
+            static void reclaimObject(Retired* retired) noexcept
+            {
+                auto self = static_cast<RetiredObject*>(retired);
+
+                self->deleter(self->ptr);
+                delete self;
+            }
+
+            T* ptr;
+            Deleter deleter;
+        };
+
+        volatile LONG* enter() const noexcept
+        {
+            // synchronize() either waits for this reader or has flipped the epoch before it loads any pointer
+            return m_readers.enter(m_epoch);
+        }
+
+        void threadRoutine()
+        {
+            while (!ReadNoFence(&m_stopping))
+            {
+                if (!pendingCount())
+                {
+                    m_wakeup.wait();
+                    continue;
+                }
+
+                LARGE_INTEGER timeout{ .QuadPart = -kReclaimPeriod };
+                m_wakeup.wait(&timeout);
+
+                reclaim();
+            }
+        }
+
+    private:
+        mutable detail::ReaderShards m_readers;
+        volatile LONG m_epoch = 0;
+        volatile LONG m_pendingCount = 0;
+        volatile LONG m_stopping = false;
+        SList<Retired, &Retired::entry> m_retired;
+        EResource m_synchronizeLock;
+        Event m_wakeup;
+        Thread m_thread;
+    };
+}
@@ -1,14 +1,59 @@
 #pragma once
 #include <functional>
+#include <type_traits>
 #include <utility>
 #include <kf/stl/new>
+#include "PoolNodeAllocator.h"
 
 namespace kf
 {
+    namespace detail
+    {
+        // Comparer that allows lookup by a key of another type, like std::less<> does
+        template<class Comparer>
+        concept TransparentComparer = requires { typename Comparer::is_transparent; };
+
+        // Calls a forEach callback, the callback can return false to stop the enumeration
+        template<class Function, class... Args>
+        bool invokeForEach(Function& function, Args&... args)
+        {
+            if constexpr (std::is_same_v<std::invoke_result_t<Function&, Args&...>, bool>)
+            {
+                return function(args...);
+            }
+            else
+            {
+                function(args...);
+                return true;
+            }
+        }
+
+        // Replaces a map value by emplace. The new value is built before the old one is released, so args
+        // can refer into the old value. A value that can't be moved is rebuilt in place and args must not
+        // refer into it.
+        template<class V, class... Args>
+        void replaceValue(V& value, Args&&... args)
+        {
+            if constexpr (std::is_move_assignable_v<V>)
+            {
+                V replacement(std::forward<Args>(args)...);
+                value = std::move(replacement);
+            }
+            else
+            {
+                value.~V();
+                new(&value) V(std::forward<Args>(args)...);
+            }
+        }
+    }
+
     //////////////////////////////////////////////////////////////////////////
     // GenercTableAvl
+    //
+    // NodeAllocator provides memory for table nodes: `void* allocate(size_t)` and `void deallocate(void*)`,
+    // see PoolNodeAllocator, SlabNodeAllocator and ArenaNodeAllocator. Stateful allocators are passed to the constructor.
 
-    template<class T, POOL_TYPE poolType, class LessComparer=std::less<T>>
+    template<class T, POOL_TYPE poolType, class LessComparer=std::less<T>, class NodeAllocator=PoolNodeAllocator<poolType>>
     class GenericTableAvl
     {
     public:
@@ -20,7 +65,12 @@ namespace kf
             init();
         }
 
-        GenericTableAvl(_Inout_ GenericTableAvl&& another) noexcept
+        explicit GenericTableAvl(_Inout_ NodeAllocator&& nodeAllocator) : m_nodeAllocator(std::move(nodeAllocator))
+        {
+            init();
+        }
+
+        GenericTableAvl(_Inout_ GenericTableAvl&& another) noexcept : m_nodeAllocator(std::move(another.m_nodeAllocator))
         {
             moveInit(another);
         }
@@ -55,6 +105,48 @@ namespace kf
             return STATUS_SUCCESS;
         }
 
+        //
+        // Lookup by a key without constructing T. compareKey(elem) returns GenericLessThan if the key
+        // is less than elem, GenericGreaterThan if it is greater and GenericEqual if they match.
+        //
+
+        template<class CompareKey>
+        T* find(CompareKey compareKey)
+        {
+            RTL_BALANCED_LINKS* nodeOrParent = nullptr;
+            return findFull(compareKey, nodeOrParent) == TableFoundNode ? fromLinks(nodeOrParent) : nullptr;
+        }
+
+        // Returns the element matching the key or inserts a new node and calls construct(void* buffer)
+        // to create the element right in it. Both cases take a single tree descent.
+        // Returns nullptr if there is not enough memory for a new node.
+        template<class CompareKey, class Construct>
+        T* findOrConstruct(CompareKey compareKey, Construct construct, _Out_opt_ bool* newElement = nullptr)
+        {
+            RTL_BALANCED_LINKS* nodeOrParent = nullptr;
+            TABLE_SEARCH_RESULT searchResult = findFull(compareKey, nodeOrParent);
+
+            if (newElement)
+            {
+                *newElement = searchResult != TableFoundNode;
+            }
+
+            if (searchResult == TableFoundNode)
+            {
+                return fromLinks(nodeOrParent);
+            }
+
+            // The table copies the placeholder into the new node, the element is constructed over it
+            void* buffer = ::RtlInsertElementGenericTableFullAvl(&m_table, const_cast<std::byte*>(kPlaceholder), sizeof(T), nullptr, nodeOrParent, searchResult);
+            if (!buffer)
+            {
+                return nullptr;
+            }
+
+            construct(buffer);
+            return static_cast<T*>(buffer);
+        }
+
         bool isEmpty() const
         {
             return !!::RtlIsGenericTableEmptyAvl(const_cast<RTL_AVL_TABLE*>(&m_table));
@@ -80,6 +172,12 @@ namespace kf
             return !!::RtlDeleteElementGenericTableAvl(&m_table, const_cast<T*>(&elem));
         }
 
+        // Deletes an element of this table that is already found, without another tree descent
+        void deleteFoundElement(_In_ const T& elem)
+        {
+            ::RtlDeleteElementGenericTableAvlEx(&m_table, toLinks(elem));
+        }
+
         ULONG number() const
         {
             return ::RtlNumberGenericTableElementsAvl(const_cast<RTL_AVL_TABLE*>(&m_table));
@@ -90,6 +188,113 @@ namespace kf
             return static_cast<T*>(::RtlEnumerateGenericTableWithoutSplayingAvl(&m_table, &restartKey));
         }
 
+        //
+        // Ordered access, walks RTL_BALANCED_LINKS of the table directly and doesn't modify it
+        //
+
+        T* first()
+        {
+            auto links = root();
+            if (!links)
+            {
+                return nullptr;
+            }
+
+            while (links->LeftChild)
+            {
+                links = links->LeftChild;
+            }
+
+            return fromLinks(links);
+        }
+
+        T* last()
+        {
+            auto links = root();
+            if (!links)
+            {
+                return nullptr;
+            }
+
+            while (links->RightChild)
+            {
+                links = links->RightChild;
+            }
+
+            return fromLinks(links);
+        }
+
+        T* next(_In_ const T& elem)
+        {
+            auto links = toLinks(elem);
+
+            if (links->RightChild)
+            {
+                links = links->RightChild;
+
+                while (links->LeftChild)
+                {
+                    links = links->LeftChild;
+                }
+
+                return fromLinks(links);
+            }
+
+            while (links->Parent != &m_table.BalancedRoot && links == links->Parent->RightChild)
+            {
+                links = links->Parent;
+            }
+
+            return links->Parent != &m_table.BalancedRoot ? fromLinks(links->Parent) : nullptr;
+        }
+
+        T* prev(_In_ const T& elem)
+        {
+            auto links = toLinks(elem);
+
+            if (links->LeftChild)
+            {
+                links = links->LeftChild;
+
+                while (links->RightChild)
+                {
+                    links = links->RightChild;
+                }
+
+                return fromLinks(links);
+            }
+
+            while (links->Parent != &m_table.BalancedRoot && links == links->Parent->LeftChild)
+            {
+                links = links->Parent;
+            }
+
+            return links->Parent != &m_table.BalancedRoot ? fromLinks(links->Parent) : nullptr;
+        }
+
+        // Returns the first element for which isBefore(elem) is false, elements must be partitioned by isBefore
+        // in the table order (as for std::partition_point). Allows to find bounds by a key of any type.
+        template<class Predicate>
+        T* partitionPoint(Predicate isBefore)
+        {
+            RTL_BALANCED_LINKS* result = nullptr;
+
+            for (auto links = root(); links;)
+            {
+                if (isBefore(*fromLinks(links)))
+                {
+                    links = links->RightChild;
+                }
+                else
+                {
+                    result = links;
+                    links = links->LeftChild;
+                }
+            }
+
+            return result ? fromLinks(result) : nullptr;
+        }
+
         void clear()
         {
             for(;;)
@@ -110,6 +315,8 @@ namespace kf
             if (this != &another)
             {
                 clear();
+
+                m_nodeAllocator = std::move(another.m_nodeAllocator);
                 moveInit(another);
             }
 
@@ -117,6 +324,56 @@ namespace kf
         }
 
     private:
+        // Any readable memory of the element size, see findOrConstruct
+        alignas(T) static inline const std::byte kPlaceholder[sizeof(T)] = {};
+
+        RTL_BALANCED_LINKS* root() const
+        {
+            return m_table.BalancedRoot.RightChild;
+        }
+
+        // Table element is stored right after the node header
+        static T* fromLinks(_In_ RTL_BALANCED_LINKS* links)
+        {
+            return reinterpret_cast<T*>(links + 1);
+        }
+
+        static RTL_BALANCED_LINKS* toLinks(_In_ const T& elem)
+        {
+            return reinterpret_cast<RTL_BALANCED_LINKS*>(const_cast<T*>(&elem)) - 1;
+        }
+
+        // Same as RtlLookupElementGenericTableFullAvl but compares by a key, so the result can be passed
+        // to RtlInsertElementGenericTableFullAvl
+        template<class CompareKey>
+        TABLE_SEARCH_RESULT findFull(CompareKey& compareKey, _Out_ RTL_BALANCED_LINKS*& nodeOrParent)
+        {
+            auto links = root();
+            if (!links)
+            {
+                return TableEmptyTree;
+            }
+
+            for (;;)
+            {
+                nodeOrParent = links;
+
+                RTL_GENERIC_COMPARE_RESULTS result = compareKey(*fromLinks(links));
+                if (result == GenericEqual)
+                {
+                    return TableFoundNode;
+                }
+
+                auto child = result == GenericLessThan ? links->LeftChild : links->RightChild;
+                if (!child)
+                {
+                    return result == GenericLessThan ? TableInsertAsLeft : TableInsertAsRight;
+                }
+
+                links = child;
+            }
+        }
+
         void init()
         {
             ::RtlInitializeGenericTableAvl(&m_table, &compareRoutine, &allocateRoutine, &freeRoutine, this);
@@ -150,17 +407,17 @@ namespace kf
         _IRQL_requires_same_
         _Function_class_(RTL_AVL_ALLOCATE_ROUTINE)
         __drv_allocatesMem(Mem)
-        static void* NTAPI allocateRoutine(_In_ RTL_AVL_TABLE*, _In_ CLONG byteSize)
+        static void* NTAPI allocateRoutine(_In_ RTL_AVL_TABLE* table, _In_ CLONG byteSize)
         {
-            return operator new(byteSize, poolType);
+            return static_cast<GenericTableAvl*>(table->TableContext)->m_nodeAllocator.allocate(byteSize);
         }
 
         _IRQL_requires_same_
         _Function_class_(RTL_AVL_FREE_ROUTINE)
-        static void NTAPI freeRoutine(_In_ RTL_AVL_TABLE*, _In_ __drv_freesMem(Mem) _Post_invalid_ void* buffer)
+        static void NTAPI freeRoutine(_In_ RTL_AVL_TABLE* table, _In_ __drv_freesMem(Mem) _Post_invalid_ void* buffer)
         {
-            reinterpret_cast<T*>(static_cast<RTL_BALANCED_LINKS*>(buffer) + 1)->~T();
-            operator delete(buffer);
+            fromLinks(static_cast<RTL_BALANCED_LINKS*>(buffer))->~T();
+            static_cast<GenericTableAvl*>(table->TableContext)->m_nodeAllocator.deallocate(buffer);
         }
 
         _IRQL_requires_same_
@@ -188,5 +445,6 @@ namespace kf
 
     private:
         RTL_AVL_TABLE m_table;
+        NodeAllocator m_nodeAllocator;
     };
 }
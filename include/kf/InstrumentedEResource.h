@@ -0,0 +1,81 @@
+#pragma once
+#include "EResource.h"
+#include "LockStats.h"
+
+namespace kf
+{
+    namespace detail
+    {
+        //////////////////////////////////////////////////////////////////////////
+        // InstrumentedResource - EResource or FltResource whose Lockable and SharedLockable routines
+        // report contention to LockStats. Hold times are recorded for exclusive acquisitions only.
+        //
+        // The resource is inherited privately, so it can't be acquired bypassing the probe. Only the
+        // PERESOURCE conversion and read-only queries are exposed.
+
+        template<class TResource>
+        class InstrumentedResource : private LockProbe<>, private TResource
+        {
+        public:
+            explicit InstrumentedResource(_In_z_ const char* name) : LockProbe(name)
+            {
+            }
+
+            using TResource::operator PERESOURCE;
+            using TResource::isAcquiredExclusive;
+            using TResource::isAcquiredShared;
+            using TResource::getExclusiveWaiterCount;
+            using TResource::getSharedWaiterCount;
+            using TResource::getOwnerCount;
+
+            // Lockable
+            _Acquires_lock_(*this)
+            void lock()
+            {
+                KeEnterCriticalRegion();
+
+                acquire([this] { return !!::ExAcquireResourceExclusiveLite(*this, false); },
+                    [this] { ::ExAcquireResourceExclusiveLite(*this, true); },
+                    true);
+            }
+
+            _Releases_lock_(*this)
+            void unlock()
+            {
+                releaseExclusive();
+                ::ExReleaseResourceLite(*this);
+                KeLeaveCriticalRegion();
+            }
+
+            bool try_lock() = delete;
+
+            // SharedLockable
+            _Acquires_lock_(*this)
+            void lock_shared()
+            {
+                KeEnterCriticalRegion();
+
+                acquire([this] { return !!::ExAcquireResourceSharedLite(*this, false); },
+                    [this] { ::ExAcquireResourceSharedLite(*this, true); },
+                    false);
+            }
+
+            _Releases_lock_(*this)
+            void unlock_shared()
+            {
+                ::ExReleaseResourceLite(*this);
+                KeLeaveCriticalRegion();
+            }
+
+            bool try_lock_shared() = delete;
+        };
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // InstrumentedEResource - EResource that reports its contention to LockStats, use it with
+    // std::unique_lock and std::shared_lock:
+    //
+    //     kf::InstrumentedEResource m_lock{ "InstanceList" };
+
+    using InstrumentedEResource = detail::InstrumentedResource<EResource>;
+}
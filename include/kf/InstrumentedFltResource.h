@@ -0,0 +1,14 @@
+#pragma once
+#include "FltResource.h"
+#include "InstrumentedEResource.h"
+
+namespace kf
+{
+    //////////////////////////////////////////////////////////////////////////
+    // InstrumentedFltResource - FltResource that reports its contention to LockStats.
+    //
+    // FltAcquireResourceExclusive/Shared can't try the lock, so the instrumented routines enter a critical
+    // region and acquire the resource the same way they do.
+
+    using InstrumentedFltResource = detail::InstrumentedResource<FltResource>;
+}
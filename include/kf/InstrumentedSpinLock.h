@@ -0,0 +1,53 @@
+#pragma once
+#include "LockStats.h"
+
+namespace kf
+{
+    //////////////////////////////////////////////////////////////////////////
+    // InstrumentedSpinLock - spin lock that reports its contention to LockStats.
+    //
+    // It's Lockable, use it with std::lock_guard or std::unique_lock instead of SpinLock and AutoSpinLock:
+    //
+    //     kf::InstrumentedSpinLock m_lock{ "ContextTable" };
+    //     ...
+    //     std::lock_guard lock(m_lock);
+    //
+    // When LockStats is compiled out it's a plain KSPIN_LOCK with the IRQL of its owner.
+
+    class InstrumentedSpinLock : private detail::LockProbe<>
+    {
+    public:
+        explicit InstrumentedSpinLock(_In_z_ const char* name) : LockProbe(name)
+        {
+            KeInitializeSpinLock(&m_spinLock);
+        }
+
+        _IRQL_requires_max_(DISPATCH_LEVEL)
+        _IRQL_raises_(DISPATCH_LEVEL)
+        void lock()
+        {
+            const KIRQL oldIrql = KeRaiseIrqlToDpcLevel();
+
+            acquire([this] { return !!KeTryToAcquireSpinLockAtDpcLevel(&m_spinLock); },
+                [this] { KeAcquireSpinLockAtDpcLevel(&m_spinLock); },
+                true);
+
+            m_oldIrql = oldIrql;
+        }
+
+        _IRQL_requires_(DISPATCH_LEVEL)
+        void unlock()
+        {
+            releaseExclusive();
+            KeReleaseSpinLock(&m_spinLock, m_oldIrql);
+        }
+
+    private:
+        InstrumentedSpinLock(const InstrumentedSpinLock&) = delete;
+        InstrumentedSpinLock& operator=(const InstrumentedSpinLock&) = delete;
+
+    private:
+        KSPIN_LOCK m_spinLock;
+        KIRQL      m_oldIrql = PASSIVE_LEVEL;
+    };
+}
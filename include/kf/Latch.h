@@ -0,0 +1,53 @@
+#pragma once
+#include "Event.h"
+
+namespace kf
+{
+    //////////////////////////////////////////////////////////////////////////
+    // Latch - single-use downward counter like std::latch, waiters are released when it reaches zero.
+    //
+    // countDown() can be called at IRQL <= DISPATCH_LEVEL, wait() at IRQL <= APC_LEVEL.
+
+    class Latch
+    {
+    public:
+        explicit Latch(LONG count) : m_count(count), m_event(NotificationEvent, count == 0)
+        {
+            ASSERT(count >= 0);
+        }
+
+        Latch(const Latch&) = delete;
+        Latch& operator=(const Latch&) = delete;
+
+        void countDown(LONG update = 1)
+        {
+            const LONG count = InterlockedAdd(&m_count, -update);
+            ASSERT(count >= 0);
+
+            if (count == 0)
+            {
+                m_event.set();
+            }
+        }
+
+        bool tryWait()
+        {
+            return ReadAcquire(&m_count) == 0;
+        }
+
+        NTSTATUS wait(_In_opt_ const LARGE_INTEGER* timeout = nullptr)
+        {
+            return m_event.wait(timeout);
+        }
+
+        NTSTATUS arriveAndWait(LONG update = 1)
+        {
+            countDown(update);
+            return wait();
+        }
+
+    private:
+        volatile LONG m_count;
+        Event m_event;
+    };
+}
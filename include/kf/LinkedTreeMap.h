@@ -10,11 +10,16 @@ namespace kf
     // LinkedTreeMap - map container for NT kernel with predictable iteration order,
     // inspired by https://docs.oracle.com/javase/8/docs/api/java/util/LinkedHashMap.html
 
-    template<class K, class V, POOL_TYPE poolType, class LessComparer=std::less<K>>
+    template<class K, class V, POOL_TYPE poolType, class LessComparer=std::less<K>, class NodeAllocator=PoolNodeAllocator<poolType>>
     class LinkedTreeMap
     {
     public:
         LinkedTreeMap() noexcept = default;
+
+        explicit LinkedTreeMap(_Inout_ NodeAllocator&& nodeAllocator) : m_table(std::move(nodeAllocator))
+        {
+        }
+
         LinkedTreeMap(_Inout_ LinkedTreeMap&& another) noexcept = default;
         LinkedTreeMap& operator=(_Inout_ LinkedTreeMap&& another) noexcept = default;
 
@@ -34,37 +39,79 @@ namespace kf
 
         NTSTATUS put(const K& key, V&& value)
         {
-            Node node(key, std::move(value));
+            return emplace(key, std::move(value)) ? STATUS_SUCCESS : STATUS_INSUFFICIENT_RESOURCES;
+        }
 
-            Node* prevNode = m_table.lookupElement(node);
-            if (prevNode)
-            {
-                m_links.remove(*prevNode);
-            }
+        //
+        // In-place insertion: the key is looked up once and the value is constructed right in the tree node.
+        // Returns the value stored for the key or nullptr if there is not enough memory.
+        //
 
-            NTSTATUS status = m_table.insertElement(std::move(node));
-            if (!NT_SUCCESS(status))
-            {
-                return status;
-            }
+        // Constructs the value from args, an existing value for the key is replaced. Args can refer into
+        // the existing value unless V can't be move assigned, then it's destroyed and rebuilt in place.
+        // The key becomes the last one in the iteration order, as with put.
+        template<class... Args>
+        V* emplace(const K& key, Args&&... args)
+        {
+            return emplaceInternal(key, std::forward<Args>(args)...);
+        }
+
+        template<class... Args>
+        V* emplace(K&& key, Args&&... args)
+        {
+            return emplaceInternal(std::move(key), std::forward<Args>(args)...);
+        }
+
+        // Constructs the value from args only if there is no such key, otherwise returns the existing value
+        // and neither key nor args are moved from. The iteration order of an existing key is not changed.
+        template<class... Args>
+        V* tryEmplace(const K& key, Args&&... args)
+        {
+            return valueOf(tryEmplaceInternal(key, nullptr, std::forward<Args>(args)...));
+        }
 
-            Node* newNode = m_table.lookupElement(Node::fromKey(key));
-            ASSERT(newNode);
+        template<class... Args>
+        V* tryEmplace(K&& key, Args&&... args)
+        {
+            return valueOf(tryEmplaceInternal(std::move(key), nullptr, std::forward<Args>(args)...));
+        }
 
-            m_links.addLast(*newNode);
+        // The same as tryEmplace, also returns true if the value is inserted and false if the key exists
+        template<class... Args>
+        std::pair<V*, bool> tryEmplaceEx(const K& key, Args&&... args)
+        {
+            bool inserted = false;
+            Node* node = tryEmplaceInternal(key, &inserted, std::forward<Args>(args)...);
 
-            return status;
+            return { valueOf(node), inserted };
         }
 
-        V* get(const K& key)
+        template<class... Args>
+        std::pair<V*, bool> tryEmplaceEx(K&& key, Args&&... args)
         {
-            Node* node = m_table.lookupElement(Node::fromKey(key));
-            if (node)
-            {
-                return &node->m_value;
-            }
+            bool inserted = false;
+            Node* node = tryEmplaceInternal(std::move(key), &inserted, std::forward<Args>(args)...);
 
-            return nullptr;
+            return { valueOf(node), inserted };
+        }
+
+        // Assigns the value to the existing one or inserts it if there is no such key.
+        // The key becomes the last one in the iteration order, as with put.
+        template<class M>
+        V* insertOrAssign(const K& key, M&& value)
+        {
+            return insertOrAssignInternal(key, std::forward<M>(value));
+        }
+
+        template<class M>
+        V* insertOrAssign(K&& key, M&& value)
+        {
+            return insertOrAssignInternal(std::move(key), std::forward<M>(value));
+        }
+
+        V* get(const K& key)
+        {
+            return valueOf(findInternal(key));
         }
 
         const V* get(const K& key) const
@@ -104,7 +151,7 @@ namespace kf
 
         bool containsKey(const K& key) const
         {
-            return m_table.lookupElement(Node::fromKey(key)) != nullptr;
+            return const_cast<LinkedTreeMap*>(this)->findInternal(key) != nullptr;
         }
 
         int size() const
@@ -119,25 +166,49 @@ namespace kf
 
         bool remove(const K& key)
         {
-            auto node = m_table.lookupElement(Node::fromKey(key));
+            auto node = findInternal(key);
             if (node == nullptr)
             {
                 return false;
             }
 
             m_links.remove(*node);
-            return m_table.deleteElement(*node);
+            m_table.deleteFoundElement(*node);
+
+            return true;
+        }
+
+        //
+        // Important! Use only the value returned by other map methods.
+        // The usage of the value that doesn't exist in map will lead to undefined behavior.
+        //
+
+        static const K& keyByObject(const V* value)
+        {
+            return nodeByObject(value)->m_key;
+        }
+
+        bool removeByObject(const V* value)
+        {
+            Node* node = nodeByObject(value);
+
+            m_links.remove(*node);
+            m_table.deleteFoundElement(*node);
+
+            return true;
+        }
+
+        // Makes the entry the last one in the iteration order in O(1), e.g. to keep access order
+        void moveToLast(const V* value)
+        {
+            moveToLast(*nodeByObject(value));
         }
 
     private:
         struct Node
         {
-            static const Node& fromKey(const K& key)
-            {
-                return reinterpret_cast<const Node&>(key);
-            }
-
-            Node(const K& key, V&& value) : m_key(key), m_value(std::move(value))
+            template<class Key, class... Args>
+            Node(std::piecewise_construct_t, Key&& key, Args&&... args) : m_key(std::forward<Key>(key)), m_value(std::forward<Args>(args)...)
             {
             }
 
@@ -154,8 +225,97 @@ namespace kf
             DoubleLinkedListEntry m_listEntry;
         };
 
+        static V* valueOf(Node* node)
+        {
+            return node ? &node->m_value : nullptr;
+        }
+
+        static Node* nodeByObject(const V* value)
+        {
+            return CONTAINING_RECORD(const_cast<V*>(value), Node, m_value);
+        }
+
+        static RTL_GENERIC_COMPARE_RESULTS compareKey(const K& key, const Node& node)
+        {
+            LessComparer lessComparer;
+            return lessComparer(key, node.m_key) ? GenericLessThan : lessComparer(node.m_key, key) ? GenericGreaterThan : GenericEqual;
+        }
+
+        Node* findInternal(const K& key)
+        {
+            return m_table.find([&](const Node& node) { return compareKey(key, node); });
+        }
+
+        template<class Key, class... Args>
+        Node* tryEmplaceInternal(Key&& key, _Out_opt_ bool* inserted, Args&&... args)
+        {
+            bool newNode = false;
+
+            Node* node = m_table.findOrConstruct(
+                [&](const Node& another)
+                {
+                    return compareKey(key, another);
+                },
+                [&](void* buffer)
+                {
+                    new(buffer) Node(std::piecewise_construct, std::forward<Key>(key), std::forward<Args>(args)...);
+                },
+                &newNode);
+
+            if (node && newNode)
+            {
+                m_links.addLast(*node);
+            }
+
+            if (inserted)
+            {
+                *inserted = newNode;
+            }
+
+            return node;
+        }
+
+        void moveToLast(Node& node)
+        {
+            m_links.remove(node);
+            m_links.addLast(node);
+        }
+
+        template<class Key, class... Args>
+        V* emplaceInternal(Key&& key, Args&&... args)
+        {
+            bool inserted = false;
+
+            // Args are not consumed if the key exists, so they are still intact for the replacement
+            Node* node = tryEmplaceInternal(std::forward<Key>(key), &inserted, std::forward<Args>(args)...);
+
+            if (node && !inserted)
+            {
+                detail::replaceValue(node->m_value, std::forward<Args>(args)...);
+
+                moveToLast(*node);
+            }
+
+            return valueOf(node);
+        }
+
+        template<class Key, class M>
+        V* insertOrAssignInternal(Key&& key, M&& value)
+        {
+            bool inserted = false;
+
+            Node* node = tryEmplaceInternal(std::forward<Key>(key), &inserted, std::forward<M>(value));
+            if (node && !inserted)
+            {
+                node->m_value = std::forward<M>(value);
+                moveToLast(*node);
+            }
+
+            return valueOf(node);
+        }
+
     private:
-        GenericTableAvl<Node, poolType> m_table;
+        GenericTableAvl<Node, poolType, std::less<Node>, NodeAllocator> m_table;
         DoubleLinkedList<Node, &Node::m_listEntry> m_links;
     };
 }
@@ -0,0 +1,121 @@
+#pragma once
+
+namespace kf
+{
+    //////////////////////////////////////////////////////////////////////////
+    // Lock policies for containers that lock their parts internally (see ConcurrentHashMap).
+    // A policy provides a Lock type and SharedGuard/ExclusiveGuard RAII types that lock it.
+
+    //////////////////////////////////////////////////////////////////////////
+    // SpinLockPolicy - reader/writer spin lock (EX_SPIN_LOCK), holders run at DISPATCH_LEVEL.
+    // Use it for short operations and for data used at IRQL <= DISPATCH_LEVEL (non-paged pool only).
+
+    struct SpinLockPolicy
+    {
+        struct Lock
+        {
+            EX_SPIN_LOCK m_spinLock = 0;
+        };
+
+        class SharedGuard
+        {
+        public:
+            explicit SharedGuard(_Inout_ Lock& lock) : m_lock(lock), m_oldIrql(::ExAcquireSpinLockShared(&lock.m_spinLock))
+            {
+            }
+
+            ~SharedGuard()
+            {
+                ::ExReleaseSpinLockShared(&m_lock.m_spinLock, m_oldIrql);
+            }
+
+            SharedGuard(const SharedGuard&) = delete;
+            SharedGuard& operator=(const SharedGuard&) = delete;
+
+        private:
+            Lock&   m_lock;
+            KIRQL   m_oldIrql;
+        };
+
+        class ExclusiveGuard
+        {
+        public:
+            explicit ExclusiveGuard(_Inout_ Lock& lock) : m_lock(lock), m_oldIrql(::ExAcquireSpinLockExclusive(&lock.m_spinLock))
+            {
+            }
+
+            ~ExclusiveGuard()
+            {
+                ::ExReleaseSpinLockExclusive(&m_lock.m_spinLock, m_oldIrql);
+            }
+
+            ExclusiveGuard(const ExclusiveGuard&) = delete;
+            ExclusiveGuard& operator=(const ExclusiveGuard&) = delete;
+
+        private:
+            Lock&   m_lock;
+            KIRQL   m_oldIrql;
+        };
+    };
+
+    //////////////////////////////////////////////////////////////////////////
+    // PushLockPolicy - push lock (EX_PUSH_LOCK), waiters sleep instead of spinning.
+    // Holders run at IRQL <= APC_LEVEL inside a critical region, so paged data can be used.
+
+    struct PushLockPolicy
+    {
+        struct Lock
+        {
+            Lock()
+            {
+                ::ExInitializePushLock(&m_pushLock);
+            }
+
+            EX_PUSH_LOCK m_pushLock;
+        };
+
+        class SharedGuard
+        {
+        public:
+            explicit SharedGuard(_Inout_ Lock& lock) : m_lock(lock)
+            {
+                ::KeEnterCriticalRegion();
+                ::ExAcquirePushLockSharedEx(&m_lock.m_pushLock, EX_DEFAULT_PUSH_LOCK_FLAGS);
+            }
+
+            ~SharedGuard()
+            {
+                ::ExReleasePushLockSharedEx(&m_lock.m_pushLock, EX_DEFAULT_PUSH_LOCK_FLAGS);
+                ::KeLeaveCriticalRegion();
+            }
+
+            SharedGuard(const SharedGuard&) = delete;
+            SharedGuard& operator=(const SharedGuard&) = delete;
+
+        private:
+            Lock& m_lock;
+        };
+
+        class ExclusiveGuard
+        {
+        public:
+            explicit ExclusiveGuard(_Inout_ Lock& lock) : m_lock(lock)
+            {
+                ::KeEnterCriticalRegion();
+                ::ExAcquirePushLockExclusiveEx(&m_lock.m_pushLock, EX_DEFAULT_PUSH_LOCK_FLAGS);
+            }
+
+            ~ExclusiveGuard()
+            {
+                ::ExReleasePushLockExclusiveEx(&m_lock.m_pushLock, EX_DEFAULT_PUSH_LOCK_FLAGS);
+                ::KeLeaveCriticalRegion();
+            }
+
+            ExclusiveGuard(const ExclusiveGuard&) = delete;
+            ExclusiveGuard& operator=(const ExclusiveGuard&) = delete;
+
+        private:
+            Lock& m_lock;
+        };
+    };
+}
@@ -0,0 +1,388 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+
+// Define KF_LOCK_STATS to 1 for the whole driver to compile in lock contention profiling
+#ifndef KF_LOCK_STATS
+#define KF_LOCK_STATS 0
+#endif
+
+namespace kf
+{
+    //////////////////////////////////////////////////////////////////////////
+    // LockStats - opt-in contention profiling of instrumented locks to find out which lock is hot.
+    //
+    // InstrumentedSpinLock, InstrumentedEResource and InstrumentedFltResource take a lock name and report
+    // every acquisition here. Locks with the same name share counters, so all instances of a lock member
+    // are profiled together. Times are in time stamp counter cycles (ReadTimeStampCounter).
+    //
+    // Profiling is compiled in with KF_LOCK_STATS and started with initialize(). When it's compiled out
+    // instrumented locks are the same size and do the same work as the plain ones. Counters are per CPU
+    // and are updated with interlocked operations on the current CPU's cache lines only.
+    //
+    // snapshot() enumerates locks with their summed counters, reset() zeroes the counters at runtime.
+    // Snapshot is several KB, don't put it on the stack.
+
+    class LockStats
+    {
+    public:
+        static constexpr bool kEnabled = KF_LOCK_STATS != 0;
+        static constexpr size_t kMaxLocks = 64;
+        static constexpr size_t kMaxNameLength = 31;
+        static constexpr size_t kHistogramBuckets = 16;
+        static constexpr ULONG kOtherSlot = 0; // counts locks that don't fit kMaxLocks
+
+        struct LockInfo
+        {
+            char name[kMaxNameLength + 1];
+            LONG64 acquisitions;
+            LONG64 contentions; // acquisitions that had to wait
+            LONG64 totalWaitCycles;
+            LONG64 maxWaitCycles;
+            LONG64 totalHoldCycles;
+            LONG64 holdHistogram[kHistogramBuckets]; // bucket i counts exclusive holds up to (64 << i) cycles, the last one counts longer ones too
+        };
+
+        struct Snapshot
+        {
+            ULONG lockCount;
+            LockInfo locks[kMaxLocks];
+        };
+
+        _IRQL_requires_max_(APC_LEVEL)
+        static NTSTATUS initialize() noexcept
+        {
+            if constexpr (kEnabled)
+            {
+                if (s_counters)
+                {
+                    return STATUS_SUCCESS;
+                }
+
+                const ULONG cpuCount = ::KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS);
+
+                // The pool aligns only blocks of PAGE_SIZE or more to a page, the block size is a multiple of it,
+                // so every Counters starts at a cache line
+                static_assert(kMaxLocks * sizeof(Counters) % PAGE_SIZE == 0, "Counters of a CPU must take whole pages");
+
+// 28160: Must succeed pool allocations are forbidden. Allocation failures cause a system crash.
+// 4996: ExAllocatePoolWithTag is deprecated, use ExAllocatePool2
+#pragma warning(suppress: 28160 4996)
+                auto counters = static_cast<Counters*>(::ExAllocatePoolWithTag(NonPagedPoolNx, cpuCount * kMaxLocks * sizeof(Counters), kPoolTag));
+                if (!counters)
+                {
+                    return STATUS_INSUFFICIENT_RESOURCES;
+                }
+
+                RtlZeroMemory(counters, cpuCount * kMaxLocks * sizeof(Counters));
+
+                s_cpuCount = cpuCount;
+                publish(counters);
+
+                return STATUS_SUCCESS;
+            }
+            else
+            {
+                return STATUS_NOT_SUPPORTED;
+            }
+        }
+
+        // Stops profiling. Must not run concurrently with lock acquisitions, call it on driver unload.
+        _IRQL_requires_max_(APC_LEVEL)
+        static void uninitialize() noexcept
+        {
+            if (auto counters = static_cast<Counters*>(InterlockedExchangePointer(reinterpret_cast<PVOID volatile*>(&s_counters), nullptr)))
+            {
+                ::ExFreePoolWithTag(counters, kPoolTag);
+            }
+        }
+
+        static bool isActive() noexcept
+        {
+            return kEnabled && s_counters;
+        }
+
+        // Returns the counters slot of the name, it can be called before initialize(). The name must be
+        // a string literal or live as long as the driver.
+        static ULONG registerLock(_In_z_ const char* name) noexcept
+        {
+            const ULONG hash = nameHash(name);
+
+            for (ULONG i = 0; i < kMaxLocks - 1; ++i)
+            {
+                const ULONG slot = 1 + (hash + i) % (kMaxLocks - 1);
+                const char* current = static_cast<const char*>(ReadPointerAcquire(&s_names[slot]));
+
+                if (!current)
+                {
+                    current = static_cast<const char*>(InterlockedCompareExchangePointer(&s_names[slot], const_cast<char*>(name), nullptr));
+                    if (!current)
+                    {
+                        return slot;
+                    }
+                }
+
+                if (isSameName(current, name))
+                {
+                    return slot;
+                }
+            }
+
+            return kOtherSlot;
+        }
+
+        static void onAcquire(ULONG slot, bool contended, ULONG64 waitCycles) noexcept
+        {
+            if constexpr (kEnabled)
+            {
+                Counters* counters = currentCounters(slot);
+                if (!counters)
+                {
+                    return;
+                }
+
+                InterlockedIncrement64(&counters->acquisitions);
+
+                if (contended)
+                {
+                    InterlockedIncrement64(&counters->contentions);
+                    InterlockedAdd64(&counters->totalWaitCycles, static_cast<LONG64>(waitCycles));
+
+                    for (LONG64 max = ReadNoFence64(&counters->maxWaitCycles); max < static_cast<LONG64>(waitCycles);)
+                    {
+                        const LONG64 observed = InterlockedCompareExchange64(&counters->maxWaitCycles, static_cast<LONG64>(waitCycles), max);
+                        if (observed == max)
+                        {
+                            break;
+                        }
+
+                        max = observed;
+                    }
+                }
+            }
+        }
+
+        static void onRelease(ULONG slot, ULONG64 holdCycles) noexcept
+        {
+            if constexpr (kEnabled)
+            {
+                if (Counters* counters = currentCounters(slot))
+                {
+                    InterlockedAdd64(&counters->totalHoldCycles, static_cast<LONG64>(holdCycles));
+                    InterlockedIncrement64(&counters->holdHistogram[histogramBucket(holdCycles)]);
+                }
+            }
+        }
+
+        // Sums per-CPU counters. Counters are read without stopping acquisitions, so a snapshot is not atomic,
+        // but every counter is consistent on its own.
+        static void snapshot(_Out_ Snapshot& snapshot) noexcept
+        {
+            RtlZeroMemory(&snapshot, sizeof(snapshot));
+
+            Counters* counters = s_counters;
+            if (!counters)
+            {
+                return;
+            }
+
+            for (ULONG slot = 0; slot < kMaxLocks; ++slot)
+            {
+                const char* name = slot == kOtherSlot ? "<other>" : static_cast<const char*>(ReadPointerAcquire(&s_names[slot]));
+                if (!name)
+                {
+                    continue;
+                }
+
+                LockInfo& info = snapshot.locks[snapshot.lockCount];
+
+                for (ULONG cpu = 0; cpu < s_cpuCount; ++cpu)
+                {
+                    const Counters& cpuCounters = counters[cpu * kMaxLocks + slot];
+
+                    info.acquisitions += ReadNoFence64(&cpuCounters.acquisitions);
+                    info.contentions += ReadNoFence64(&cpuCounters.contentions);
+                    info.totalWaitCycles += ReadNoFence64(&cpuCounters.totalWaitCycles);
+                    info.maxWaitCycles = (std::max)(info.maxWaitCycles, static_cast<LONG64>(ReadNoFence64(&cpuCounters.maxWaitCycles)));
+                    info.totalHoldCycles += ReadNoFence64(&cpuCounters.totalHoldCycles);
+
+                    for (size_t bucket = 0; bucket < kHistogramBuckets; ++bucket)
+                    {
+                        info.holdHistogram[bucket] += ReadNoFence64(&cpuCounters.holdHistogram[bucket]);
+                    }
+                }
+
+                if (slot == kOtherSlot && !info.acquisitions)
+                {
+                    RtlZeroMemory(&info, sizeof(info));
+                    continue;
+                }
+
+                for (size_t i = 0; i < kMaxNameLength && name[i]; ++i)
+                {
+                    info.name[i] = name[i];
+                }
+
+                ++snapshot.lockCount;
+            }
+        }
+
+        // Zeroes the counters, registered names are kept. Acquisitions that run concurrently may be partially counted.
+        static void reset() noexcept
+        {
+            if (Counters* counters = s_counters)
+            {
+                RtlZeroMemory(counters, s_cpuCount * kMaxLocks * sizeof(Counters));
+            }
+        }
+
+        static size_t histogramBucket(ULONG64 cycles) noexcept
+        {
+            const size_t bucket = cycles > 64 ? std::bit_width(cycles - 1) - 6 : 0;
+            return bucket < kHistogramBuckets ? bucket : kHistogramBuckets - 1;
+        }
+
+    private:
+        static constexpr ULONG kPoolTag = 'sL+K';
+
+        // The padding keeps counters of different CPUs in different cache lines
+        struct Counters
+        {
+            LONG64 acquisitions;
+            LONG64 contentions;
+            LONG64 totalWaitCycles;
+            LONG64 maxWaitCycles;
+            LONG64 totalHoldCycles;
+            LONG64 holdHistogram[kHistogramBuckets];
+            char padding[SYSTEM_CACHE_ALIGNMENT_SIZE - (5 + kHistogramBuckets) * sizeof(LONG64) % SYSTEM_CACHE_ALIGNMENT_SIZE];
+        };
+
+        static_assert(sizeof(Counters) % SYSTEM_CACHE_ALIGNMENT_SIZE == 0, "Counters must be a multiple of the cache line size");
+
+        // Concurrent initialize() calls allocate their own blocks, the first published one is used
+        static void publish(_In_ Counters* counters) noexcept
+        {
+            if (InterlockedCompareExchangePointer(reinterpret_cast<PVOID volatile*>(&s_counters), counters, nullptr))
+            {
+                ::ExFreePoolWithTag(counters, kPoolTag);
+            }
+        }
+
+        static Counters* currentCounters(ULONG slot) noexcept
+        {
+            Counters* counters = s_counters;
+            if (!counters)
+            {
+                return nullptr;
+            }
+
+            return &counters[::KeGetCurrentProcessorNumberEx(nullptr) * kMaxLocks + slot];
+        }
+
+        static ULONG nameHash(_In_z_ const char* name) noexcept
+        {
+            // FNV-1a
+            ULONG hash = 2166136261u;
+
+            for (size_t i = 0; i < kMaxNameLength && name[i]; ++i)
+            {
+                hash = (hash ^ static_cast<UCHAR>(name[i])) * 16777619u;
+            }
+
+            return hash;
+        }
+
+        // Names are compared up to kMaxNameLength as that's what a snapshot keeps
+        static bool isSameName(_In_z_ const char* first, _In_z_ const char* second) noexcept
+        {
+            for (size_t i = 0; i < kMaxNameLength; ++i)
+            {
+                if (first[i] != second[i])
+                {
+                    return false;
+                }
+
+                if (!first[i])
+                {
+                    break;
+                }
+            }
+
+            return true;
+        }
+
+    private:
+        static inline Counters* volatile s_counters = nullptr;
+        static inline ULONG s_cpuCount = 0;
+        static inline PVOID volatile s_names[kMaxLocks] = {}; // const char*
+    };
+
+    namespace detail
+    {
+        //////////////////////////////////////////////////////////////////////////
+        // LockProbe - reports acquisitions of an instrumented lock to LockStats, empty when it's compiled out
+
+        template<bool kEnabled = LockStats::kEnabled>
+        class LockProbe
+        {
+        protected:
+            explicit LockProbe(_In_z_ const char* name) noexcept : m_slot(LockStats::registerLock(name))
+            {
+            }
+
+            // Tries the lock first to tell a contended acquisition and to time its wait
+            template<class TryAcquire, class Acquire>
+            void acquire(TryAcquire&& tryAcquire, Acquire&& acquire, bool exclusive) noexcept
+            {
+                bool contended = false;
+                ULONG64 waitCycles = 0;
+
+                if (!tryAcquire())
+                {
+                    const ULONG64 start = ReadTimeStampCounter();
+                    acquire();
+
+                    contended = true;
+                    waitCycles = ReadTimeStampCounter() - start;
+                }
+
+                // Only the exclusive owner is single and can keep its acquisition time in the lock
+                if (exclusive)
+                {
+                    m_acquireTime = ReadTimeStampCounter();
+                }
+
+                LockStats::onAcquire(m_slot, contended, waitCycles);
+            }
+
+            // Must be called while the lock is still held
+            void releaseExclusive() noexcept
+            {
+                LockStats::onRelease(m_slot, ReadTimeStampCounter() - m_acquireTime);
+            }
+
+        private:
+            ULONG   m_slot;
+            ULONG64 m_acquireTime = 0;
+        };
+
+        template<>
+        class LockProbe<false>
+        {
+        protected:
+            explicit LockProbe(_In_z_ const char*) noexcept
+            {
+            }
+
+            template<class TryAcquire, class Acquire>
+            void acquire(TryAcquire&&, Acquire&& acquire, bool) noexcept
+            {
+                acquire();
+            }
+
+            void releaseExclusive() noexcept
+            {
+            }
+        };
+    }
+}
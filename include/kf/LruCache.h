@@ -0,0 +1,219 @@
+#pragma once
+#include "LinkedTreeMap.h"
+
+namespace kf
+{
+    //////////////////////////////////////////////////////////////////////////
+    // LruCache - bounded cache that evicts the least recently used entries, built on LinkedTreeMap.
+    //
+    // Entries are kept in access order: get and put make an entry the most recently used one in O(1).
+    // The capacity is measured by EntrySize(key, value): the number of entries by default or, for example,
+    // bytes with a functor that returns the memory used by an entry. When a put exceeds the capacity,
+    // the least recently used entries are passed to OnEvict(key, value) and removed. The functors are kept
+    // by value, pass std::ref to keep a reference to a functor with an external state.
+    //
+    // Note: the cache is not synchronized, use an external lock.
+
+    struct LruCacheIgnoreEvicted
+    {
+        template<class K, class V>
+        void operator()(const K&, V&) const
+        {
+        }
+    };
+
+    struct LruCacheEntryCount
+    {
+        template<class K, class V>
+        size_t operator()(const K&, const V&) const
+        {
+            return 1;
+        }
+    };
+
+    template<class K, class V, POOL_TYPE poolType, class OnEvict = LruCacheIgnoreEvicted, class EntrySize = LruCacheEntryCount, class LessComparer = std::less<K>, class NodeAllocator = PoolNodeAllocator<poolType>>
+    class LruCache
+    {
+    public:
+        struct Stats
+        {
+            ULONG64 hits;
+            ULONG64 misses;
+            ULONG64 evictions;
+        };
+
+    public:
+        explicit LruCache(size_t capacity, OnEvict onEvict = OnEvict(), EntrySize entrySize = EntrySize())
+            : m_capacity(capacity)
+            , m_onEvict(std::move(onEvict))
+            , m_entrySize(std::move(entrySize))
+        {
+        }
+
+        LruCache(const LruCache&) = delete;
+        LruCache& operator=(const LruCache&) = delete;
+
+        NTSTATUS put(const K& key, const V& value)
+        {
+            V tmp = value;
+            return put(key, std::move(tmp));
+        }
+
+        // Inserts or replaces the value and makes it the most recently used one, then evicts the least
+        // recently used entries until the cache fits its capacity. Returns STATUS_INVALID_PARAMETER
+        // if the entry alone doesn't fit the capacity.
+        NTSTATUS put(const K& key, V&& value)
+        {
+            const size_t size = m_entrySize(key, static_cast<const V&>(value));
+            if (size > m_capacity)
+            {
+                return STATUS_INVALID_PARAMETER;
+            }
+
+            // Single lookup: the value is not moved from if the key exists
+            auto [entry, inserted] = m_map.tryEmplaceEx(key, std::move(value), size);
+            if (!entry)
+            {
+                return STATUS_INSUFFICIENT_RESOURCES;
+            }
+
+            if (!inserted)
+            {
+                m_usage -= entry->size;
+
+                entry->value = std::move(value);
+                entry->size = size;
+
+                m_map.moveToLast(entry);
+            }
+
+            m_usage += size;
+            evict();
+
+            return STATUS_SUCCESS;
+        }
+
+        // Returns the value and makes it the most recently used one, counts a hit or a miss
+        V* get(const K& key)
+        {
+            Entry* entry = m_map.get(key);
+            if (!entry)
+            {
+                ++m_stats.misses;
+                return nullptr;
+            }
+
+            ++m_stats.hits;
+            m_map.moveToLast(entry);
+
+            return &entry->value;
+        }
+
+        // Returns the value without changing the access order and statistics
+        const V* peek(const K& key) const
+        {
+            const Entry* entry = m_map.get(key);
+            return entry ? &entry->value : nullptr;
+        }
+
+        bool containsKey(const K& key) const
+        {
+            return m_map.containsKey(key);
+        }
+
+        // Removes the entry without calling OnEvict
+        bool remove(const K& key)
+        {
+            Entry* entry = m_map.get(key);
+            if (!entry)
+            {
+                return false;
+            }
+
+            m_usage -= entry->size;
+            return m_map.removeByObject(entry);
+        }
+
+        // Removes all entries without calling OnEvict
+        void clear()
+        {
+            m_map.clear();
+            m_usage = 0;
+        }
+
+        int size() const
+        {
+            return m_map.size();
+        }
+
+        bool isEmpty() const
+        {
+            return m_map.isEmpty();
+        }
+
+        size_t capacity() const
+        {
+            return m_capacity;
+        }
+
+        // Sum of EntrySize for all entries
+        size_t usage() const
+        {
+            return m_usage;
+        }
+
+        // Changes the capacity, evicts the least recently used entries if the cache doesn't fit it anymore
+        void setCapacity(size_t capacity)
+        {
+            m_capacity = capacity;
+            evict();
+        }
+
+        const Stats& stats() const
+        {
+            return m_stats;
+        }
+
+        void resetStats()
+        {
+            m_stats = {};
+        }
+
+    private:
+        struct Entry
+        {
+            Entry(V&& value, size_t size) : value(std::move(value)), size(size)
+            {
+            }
+
+            V value;
+            size_t size;
+        };
+
+        void evict()
+        {
+            while (m_usage > m_capacity)
+            {
+                Entry* lru = m_map.getByIndex(0);
+                ASSERT(lru);
+
+                m_onEvict(Map::keyByObject(lru), lru->value);
+
+                m_usage -= lru->size;
+                m_map.removeByObject(lru);
+
+                ++m_stats.evictions;
+            }
+        }
+
+    private:
+        using Map = LinkedTreeMap<K, Entry, poolType, LessComparer, NodeAllocator>;
+
+        Map         m_map;
+        size_t      m_capacity;
+        size_t      m_usage = 0;
+        OnEvict     m_onEvict;
+        EntrySize   m_entrySize;
+        Stats       m_stats = {};
+    };
+}
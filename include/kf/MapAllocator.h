@@ -1,16 +1,131 @@
 #pragma once
 #include <kf/stl/memory>
+#include <limits>
+#include <utility>
 
 namespace kf
 {
-    // TODO: refactor
-
-    struct AllocatorState
+    //////////////////////////////////////////////////////////////////////////
+    // MapNodePool - free list of node-sized blocks shared by all copies of a MapAllocator.
+    //
+    // Blocks are carved from chunks allocated by reserve() and are never returned to the pool one by one:
+    // a released node goes to the free list and is reused, chunks are freed when the pool is destroyed.
+
+    template<POOL_TYPE poolType>
+    class MapNodePool
     {
-        std::unique_ptr<char[]> buffer;
-        size_t size;
+    public:
+        MapNodePool() noexcept = default;
+
+        ~MapNodePool()
+        {
+            while (m_chunks)
+            {
+                operator delete(std::exchange(m_chunks, m_chunks->next));
+            }
+        }
+
+        MapNodePool(const MapNodePool&) = delete;
+        MapNodePool& operator=(const MapNodePool&) = delete;
+
+        // Makes sure that the next count node allocations of nodeSize bytes don't fail
+        [[nodiscard]] bool reserve(size_t nodeSize, size_t count) noexcept
+        {
+            if (!m_nodeSize)
+            {
+                m_nodeSize = ALIGN_UP_BY(nodeSize > sizeof(FreeNode) ? nodeSize : sizeof(FreeNode), MEMORY_ALLOCATION_ALIGNMENT);
+            }
+
+            ASSERT(nodeSize <= m_nodeSize);
+            if (nodeSize > m_nodeSize)
+            {
+                return false;
+            }
+
+            return m_freeCount >= count || addChunk(count - m_freeCount);
+        }
+
+        _Must_inspect_result_
+        void* allocate(size_t byteSize) noexcept
+        {
+            if (!m_freeList && !reserve(byteSize, 1))
+            {
+                return nullptr;
+            }
+
+            ASSERT(byteSize <= m_nodeSize);
+
+            --m_freeCount;
+            return std::exchange(m_freeList, m_freeList->next);
+        }
+
+        void deallocate(void* node) noexcept
+        {
+            auto freeNode = static_cast<FreeNode*>(node);
+            freeNode->next = m_freeList;
+            m_freeList = freeNode;
+
+            ++m_freeCount;
+        }
+
+        size_t freeCount() const noexcept
+        {
+            return m_freeCount;
+        }
+
+    private:
+        struct FreeNode
+        {
+            FreeNode* next;
+        };
+
+        // The padding keeps nodes that follow the header aligned as the pool allocation is
+        struct ChunkHeader
+        {
+            ChunkHeader* next;
+            char padding[MEMORY_ALLOCATION_ALIGNMENT - sizeof(ChunkHeader*)];
+        };
+
+        static_assert(sizeof(ChunkHeader) % MEMORY_ALLOCATION_ALIGNMENT == 0, "Nodes must stay aligned");
+
+        bool addChunk(size_t count) noexcept
+        {
+            if (count > (std::numeric_limits<size_t>::max() - sizeof(ChunkHeader)) / m_nodeSize)
+            {
+                return false;
+            }
+
+            auto chunk = static_cast<ChunkHeader*>(operator new(sizeof(ChunkHeader) + m_nodeSize * count, poolType));
+            if (!chunk)
+            {
+                return false;
+            }
+
+            chunk->next = m_chunks;
+            m_chunks = chunk;
+
+            auto node = reinterpret_cast<std::byte*>(chunk + 1);
+
+            for (size_t i = 0; i < count; ++i, node += m_nodeSize)
+            {
+                deallocate(node);
+            }
+
+            return true;
+        }
+
+    private:
+        ChunkHeader* m_chunks = nullptr;
+        FreeNode* m_freeList = nullptr;
+        size_t m_nodeSize = 0;
+        size_t m_freeCount = 0;
     };
 
+    //////////////////////////////////////////////////////////////////////////
+    // MapAllocator - default kf::map allocator, allocates nodes from a MapNodePool shared by its copies.
+    //
+    // prepareMemory reserves nodes in advance, so std::map never sees an allocation failure.
+
     template<typename T, POOL_TYPE poolType>
     class MapAllocator
     {
@@ -30,61 +145,44 @@ namespace kf
 
         template<typename U>
         MapAllocator(const MapAllocator<U, poolType>& other)
-            : m_state(other.m_state)
+            : m_pool(other.m_pool)
         {
         }
 
         [[nodiscard]] bool initialize()
         {
-            m_state = make_shared<AllocatorState, poolType>();
-            return m_state != nullptr;
+            m_pool = make_shared<MapNodePool<poolType>, poolType>();
+            return m_pool != nullptr;
         }
 
         T* allocate(std::size_t n)
         {
-            if (!m_state || !m_state->buffer)
-            {
-                return nullptr;
-            }
-
-            if (m_state->size < n)
+            ASSERT(n == 1);
+            if (!m_pool || n != 1)
             {
                 return nullptr;
             }
 
-            auto buffer = reinterpret_cast<T*>(m_state->buffer.release());
-            m_state->size = 0;
-            return buffer;
+            return static_cast<T*>(m_pool->allocate(sizeof(T)));
         }
 
         void deallocate(T* buf, std::size_t)
         {
-            operator delete(buf);
+            m_pool->deallocate(buf);
         }
 
         [[nodiscard]] bool prepareMemory(std::size_t size)
         {
-            if (!m_state)
-            {
-                return false;
-            }
-
-            if (m_state->buffer && m_state->size == size)
-            {
-                return true;
-            }
-
-            m_state->buffer.reset(new(poolType) char[size]);
-            if (!m_state->buffer)
-            {
-                return false;
-            }
-            m_state->size = size;
+            return prepareMemory(size, 1);
+        }
 
-            return true;
+        // Makes sure that the next count node allocations don't fail, the missing nodes are allocated at once
+        [[nodiscard]] bool prepareMemory(std::size_t size, std::size_t count)
+        {
+            return m_pool && m_pool->reserve(size, count);
         }
 
     private:
-        std::shared_ptr<AllocatorState> m_state;
+        std::shared_ptr<MapNodePool<poolType>> m_pool;
     };
 }
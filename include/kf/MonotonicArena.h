@@ -0,0 +1,361 @@
+#pragma once
+#include <kf/stl/new>
+#include <bit>
+#include <limits>
+#include <span>
+#include <type_traits>
+
+namespace kf
+{
+    //////////////////////////////////////////////////////////////////////////
+    // MonotonicArena - region allocator for request-scoped working sets (for example, parsing of an IRP).
+    //
+    // Memory is carved from a chain of pool chunks and is released all at once by release() or on destruction,
+    // so everything can be allocated freely and freed with one call. Deallocation of an individual block is a no-op
+    // unless it is the last one allocated, then it's given back (together with tryExpand it lets a growing vector
+    // reuse its space). Chunks grow geometrically starting from chunkSize, a large allocation gets a separate chunk.
+    // An optional initial buffer (for example, on the stack) is used before any pool allocation.
+    //
+    // Use ArenaAllocator<T> for kf::vector, kf::map and UString, and ArenaNodeAllocator for GenericTableAvl,
+    // TreeMap, TreeSet and LinkedTreeMap.
+    //
+    // Note: the arena is not synchronized, objects allocated from it must not outlive it.
+
+    class MonotonicArena
+    {
+    public:
+        explicit MonotonicArena(POOL_TYPE poolType, size_t chunkSize = PAGE_SIZE) noexcept
+            : MonotonicArena(poolType, {}, chunkSize)
+        {
+        }
+
+        MonotonicArena(POOL_TYPE poolType, std::span<std::byte> initialBuffer, size_t chunkSize = PAGE_SIZE) noexcept
+            : m_poolType(poolType)
+            , m_initialBuffer(initialBuffer)
+            , m_chunkSize(chunkSize > sizeof(Chunk) ? chunkSize : PAGE_SIZE)
+        {
+            release();
+        }
+
+        ~MonotonicArena()
+        {
+            release();
+        }
+
+        MonotonicArena(const MonotonicArena&) = delete;
+        MonotonicArena& operator=(const MonotonicArena&) = delete;
+
+        _Must_inspect_result_
+        void* allocate(_In_ size_t size, _In_ size_t alignment = MEMORY_ALLOCATION_ALIGNMENT) noexcept
+        {
+            ASSERT(std::has_single_bit(alignment));
+
+            if (void* p = allocateFromCurrent(size, alignment))
+            {
+                return p;
+            }
+
+            if (size > kMaxSize - alignment)
+            {
+                return nullptr;
+            }
+
+            const size_t requiredSize = size + alignment - 1;
+
+            if (requiredSize > m_nextChunkSize - sizeof(Chunk))
+            {
+                // Keep the current chunk as the large block would waste most of its free space
+                return allocateSeparateChunk(requiredSize, alignment);
+            }
+
+            if (!addChunk(m_nextChunkSize - sizeof(Chunk)))
+            {
+                return nullptr;
+            }
+
+            return allocateFromCurrent(size, alignment);
+        }
+
+        void deallocate(_In_opt_ void* p, _In_ size_t size) noexcept
+        {
+            // Only the last allocation can be given back
+            if (p && static_cast<std::byte*>(p) + size == m_current)
+            {
+                m_current = static_cast<std::byte*>(p);
+            }
+        }
+
+        // Grows the last allocation in place if the current chunk has enough free space
+        bool tryExpand(_In_ void* p, _In_ size_t oldSize, _In_ size_t newSize) noexcept
+        {
+            auto begin = static_cast<std::byte*>(p);
+
+            if (begin + oldSize != m_current || newSize > static_cast<size_t>(m_end - begin))
+            {
+                return false;
+            }
+
+            m_current = begin + newSize;
+            return true;
+        }
+
+        // Makes sure that the next allocation of size bytes with the given alignment doesn't fail
+        _Must_inspect_result_
+        bool reserve(_In_ size_t size, _In_ size_t alignment = MEMORY_ALLOCATION_ALIGNMENT) noexcept
+        {
+            if (fitsCurrent(size, alignment))
+            {
+                return true;
+            }
+
+            if (size > kMaxSize - alignment)
+            {
+                return false;
+            }
+
+            const size_t requiredSize = size + alignment - 1;
+
+            return addChunk(requiredSize > m_nextChunkSize - sizeof(Chunk) ? requiredSize : m_nextChunkSize - sizeof(Chunk));
+        }
+
+        // Frees all chunks, all memory allocated from the arena becomes invalid
+        void release() noexcept
+        {
+            while (m_chunks)
+            {
+                operator delete(std::exchange(m_chunks, m_chunks->next));
+            }
+
+            m_current = m_initialBuffer.data();
+            m_end = m_current + m_initialBuffer.size();
+            m_nextChunkSize = m_chunkSize;
+            m_chunkCount = 0;
+        }
+
+        size_t chunkCount() const noexcept
+        {
+            return m_chunkCount;
+        }
+
+        POOL_TYPE poolType() const noexcept
+        {
+            return m_poolType;
+        }
+
+    private:
+        // The padding keeps the data that follows the header aligned as the pool allocation is
+        struct Chunk
+        {
+            Chunk* next;
+            char padding[MEMORY_ALLOCATION_ALIGNMENT - sizeof(Chunk*)];
+        };
+
+        static_assert(sizeof(Chunk) % MEMORY_ALLOCATION_ALIGNMENT == 0, "Chunk data must stay aligned");
+
+        static constexpr size_t kMaxSize = std::numeric_limits<size_t>::max() - sizeof(Chunk);
+        static constexpr size_t kMaxChunkSize = 256 * PAGE_SIZE;
+
+        static std::byte* alignUp(std::byte* p, size_t alignment) noexcept
+        {
+            return reinterpret_cast<std::byte*>(ALIGN_UP_BY(p, alignment));
+        }
+
+        bool fitsCurrent(size_t size, size_t alignment) const noexcept
+        {
+            if (!m_current)
+            {
+                return false;
+            }
+
+            std::byte* p = alignUp(m_current, alignment);
+            return p <= m_end && size <= static_cast<size_t>(m_end - p);
+        }
+
+        void* allocateFromCurrent(size_t size, size_t alignment) noexcept
+        {
+            if (!fitsCurrent(size, alignment))
+            {
+                return nullptr;
+            }
+
+            std::byte* p = alignUp(m_current, alignment);
+            m_current = p + size;
+
+            return p;
+        }
+
+        Chunk* newChunk(size_t dataSize) noexcept
+        {
+            auto chunk = static_cast<Chunk*>(operator new(sizeof(Chunk) + dataSize, m_poolType));
+            if (chunk)
+            {
+                ++m_chunkCount;
+            }
+
+            return chunk;
+        }
+
+        bool addChunk(size_t dataSize) noexcept
+        {
+            Chunk* chunk = newChunk(dataSize);
+            if (!chunk)
+            {
+                return false;
+            }
+
+            chunk->next = m_chunks;
+            m_chunks = chunk;
+
+            m_current = reinterpret_cast<std::byte*>(chunk + 1);
+            m_end = m_current + dataSize;
+
+            if (m_nextChunkSize < kMaxChunkSize)
+            {
+                m_nextChunkSize *= 2;
+            }
+
+            return true;
+        }
+
+        void* allocateSeparateChunk(size_t dataSize, size_t alignment) noexcept
+        {
+            Chunk* chunk = newChunk(dataSize);
+            if (!chunk)
+            {
+                return nullptr;
+            }
+
+            // Insert after the current chunk, so the free space of the current one is still used
+            if (m_chunks)
+            {
+                chunk->next = m_chunks->next;
+                m_chunks->next = chunk;
+            }
+            else
+            {
+                chunk->next = nullptr;
+                m_chunks = chunk;
+            }
+
+            return alignUp(reinterpret_cast<std::byte*>(chunk + 1), alignment);
+        }
+
+    private:
+        POOL_TYPE               m_poolType;
+        std::span<std::byte>    m_initialBuffer;
+        size_t                  m_chunkSize;
+        size_t                  m_nextChunkSize = 0;
+        size_t                  m_chunkCount = 0;
+        Chunk*                  m_chunks = nullptr;
+        std::byte*              m_current = nullptr;
+        std::byte*              m_end = nullptr;
+    };
+
+    //////////////////////////////////////////////////////////////////////////
+    // ArenaAllocator - allocator for kf::vector, kf::map, UString and other containers that allocates
+    // from a MonotonicArena. Copies and rebinds refer to the same arena.
+
+    template<class T>
+    class ArenaAllocator
+    {
+    public:
+        static_assert(!std::is_const_v<T>, "The C++ Standard forbids containers of const elements because allocator<const T> is ill-formed.");
+
+        using value_type = T;
+        using size_type = size_t;
+        using difference_type = ptrdiff_t;
+        using propagate_on_container_move_assignment = std::true_type;
+        using propagate_on_container_swap = std::true_type;
+
+        explicit ArenaAllocator(_In_ MonotonicArena& arena) noexcept : m_arena(&arena)
+        {
+        }
+
+        template<class U>
+        ArenaAllocator(const ArenaAllocator<U>& other) noexcept : m_arena(other.arena())
+        {
+        }
+
+        [[nodiscard]] T* allocate(const size_t count) noexcept
+        {
+            if (count > std::numeric_limits<size_t>::max() / sizeof(T))
+            {
+                return nullptr;
+            }
+
+            return static_cast<T*>(m_arena->allocate(count * sizeof(T), alignof(T)));
+        }
+
+        void deallocate(T* const p, const size_t count) noexcept
+        {
+            m_arena->deallocate(p, count * sizeof(T));
+        }
+
+        // Used by kf::vector, the last allocation of the arena can grow while the chunk has free space
+        bool try_expand_in_place(T* const p, const size_t oldCount, const size_t newCount) noexcept
+        {
+            if (newCount > std::numeric_limits<size_t>::max() / sizeof(T))
+            {
+                return false;
+            }
+
+            return m_arena->tryExpand(p, oldCount * sizeof(T), newCount * sizeof(T));
+        }
+
+        // Used by kf::map, makes sure that the next node allocation doesn't fail
+        [[nodiscard]] bool prepareMemory(const size_t size) noexcept
+        {
+            return m_arena->reserve(size);
+        }
+
+        // Used by kf::map::reserve and range insert, nodes are allocated one after another from the reserved space
+        [[nodiscard]] bool prepareMemory(const size_t size, const size_t count) noexcept
+        {
+            if (count > std::numeric_limits<size_t>::max() / size)
+            {
+                return false;
+            }
+
+            return m_arena->reserve(size * count);
+        }
+
+        MonotonicArena* arena() const noexcept
+        {
+            return m_arena;
+        }
+
+    private:
+        MonotonicArena* m_arena;
+    };
+
+    template<class T, class U>
+    bool operator==(const ArenaAllocator<T>& left, const ArenaAllocator<U>& right) noexcept
+    {
+        return left.arena() == right.arena();
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // ArenaNodeAllocator - node allocator for tree containers (GenericTableAvl, TreeMap, TreeSet, LinkedTreeMap)
+    // that allocates from a MonotonicArena. Removed nodes are not reused, their memory is released with the arena.
+
+    class ArenaNodeAllocator
+    {
+    public:
+        explicit ArenaNodeAllocator(_In_ MonotonicArena& arena) noexcept : m_arena(&arena)
+        {
+        }
+
+        _Must_inspect_result_
+        void* allocate(_In_ size_t byteSize) noexcept
+        {
+            return m_arena->allocate(byteSize);
+        }
+
+        void deallocate(_In_ void*) noexcept
+        {
+        }
+
+    private:
+        MonotonicArena* m_arena;
+    };
+}
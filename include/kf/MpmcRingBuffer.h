@@ -0,0 +1,177 @@
+#pragma once
+#include <bit>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+namespace kf
+{
+    //////////////////////////////////////////////////////////////////////////
+    // MpmcRingBuffer - bounded lock-free multi-producer multi-consumer FIFO queue (D. Vyukov's algorithm).
+    //
+    // Every slot has a sequence number that tells whether it's free for the producer of a given position
+    // or filled for its consumer, so producers and consumers only contend on their position counters.
+    // Storage is inline, tryPush() and tryPop() don't allocate and are usable at DISPATCH_LEVEL.
+    //
+    //     kf::MpmcRingBuffer<Event, 1024> m_events;
+    //     ...
+    //     if (!m_events.tryPush(event)) { /* full */ }
+    //     while (auto event = m_events.tryPop()) { ... }
+    //
+    // Note: capacity must be a power of two, T must be nothrow move constructible.
+
+    template<class T, size_t kCapacity>
+    class MpmcRingBuffer
+    {
+        static_assert(kCapacity >= 2 && std::has_single_bit(kCapacity), "Capacity must be a power of two");
+        static_assert(std::is_nothrow_move_constructible_v<T>, "T must be nothrow move constructible");
+
+    public:
+        MpmcRingBuffer() noexcept
+        {
+            for (size_t i = 0; i < kCapacity; ++i)
+            {
+                m_slots[i].sequence = static_cast<LONG64>(i);
+            }
+        }
+
+        ~MpmcRingBuffer()
+        {
+            while (tryPop())
+            {
+            }
+        }
+
+        MpmcRingBuffer(const MpmcRingBuffer&) = delete;
+        MpmcRingBuffer& operator=(const MpmcRingBuffer&) = delete;
+
+        static constexpr size_t capacity()
+        {
+            return kCapacity;
+        }
+
+        // Returns false if the buffer is full
+        template<class... Args>
+        _IRQL_requires_max_(DISPATCH_LEVEL)
+        _Must_inspect_result_
+        bool tryEmplace(Args&&... args) noexcept(std::is_nothrow_constructible_v<T, Args...>)
+        {
+            LONG64 position = ReadNoFence64(&m_pushPosition);
+
+            for (;;)
+            {
+                Slot& slot = m_slots[position & kMask];
+                const LONG64 difference = ReadAcquire64(&slot.sequence) - position;
+
+                if (difference == 0)
+                {
+                    const LONG64 observed = InterlockedCompareExchange64(&m_pushPosition, position + 1, position);
+                    if (observed == position)
+                    {
+                        new(slot.storage) T(std::forward<Args>(args)...);
+                        WriteRelease64(&slot.sequence, position + 1);
+
+                        return true;
+                    }
+
+                    position = observed;
+                }
+                else if (difference < 0)
+                {
+                    // The slot still holds the value pushed a lap ago
+                    return false;
+                }
+                else
+                {
+                    position = ReadNoFence64(&m_pushPosition);
+                }
+            }
+        }
+
+        _IRQL_requires_max_(DISPATCH_LEVEL)
+        _Must_inspect_result_
+        bool tryPush(const T& value) noexcept(std::is_nothrow_copy_constructible_v<T>)
+        {
+            return tryEmplace(value);
+        }
+
+        _IRQL_requires_max_(DISPATCH_LEVEL)
+        _Must_inspect_result_
+        bool tryPush(T&& value) noexcept
+        {
+            return tryEmplace(std::move(value));
+        }
+
+        // Returns an empty optional if the buffer is empty
+        _IRQL_requires_max_(DISPATCH_LEVEL)
+        std::optional<T> tryPop() noexcept
+        {
+            LONG64 position = ReadNoFence64(&m_popPosition);
+
+            for (;;)
+            {
+                Slot& slot = m_slots[position & kMask];
+                const LONG64 difference = ReadAcquire64(&slot.sequence) - (position + 1);
+
+                if (difference == 0)
+                {
+                    const LONG64 observed = InterlockedCompareExchange64(&m_popPosition, position + 1, position);
+                    if (observed == position)
+                    {
+                        T* value = std::launder(reinterpret_cast<T*>(slot.storage));
+                        std::optional<T> result(std::move(*value));
+                        std::destroy_at(value);
+
+                        // The slot is free for the producer of the next lap
+                        WriteRelease64(&slot.sequence, position + static_cast<LONG64>(kCapacity));
+
+                        return result;
+                    }
+
+                    position = observed;
+                }
+                else if (difference < 0)
+                {
+                    return {};
+                }
+                else
+                {
+                    position = ReadNoFence64(&m_popPosition);
+                }
+            }
+        }
+
+        // The number of elements at the moment of the call, can be stale by the time it returns
+        size_t size() const noexcept
+        {
+            const LONG64 popPosition = ReadNoFence64(&m_popPosition);
+            const LONG64 pushPosition = ReadNoFence64(&m_pushPosition);
+
+            return pushPosition > popPosition ? static_cast<size_t>(pushPosition - popPosition) : 0;
+        }
+
+        bool isEmpty() const noexcept
+        {
+            return size() == 0;
+        }
+
+    private:
+        static constexpr LONG64 kMask = static_cast<LONG64>(kCapacity - 1);
+
+        struct Slot
+        {
+            volatile LONG64 sequence;
+            alignas(T) std::byte storage[sizeof(T)];
+        };
+
+        // Producers and consumers work on different cache lines
+        volatile LONG64 m_pushPosition = 0;
+        char m_pushPadding[SYSTEM_CACHE_ALIGNMENT_SIZE - sizeof(LONG64)];
+        volatile LONG64 m_popPosition = 0;
+        char m_popPadding[SYSTEM_CACHE_ALIGNMENT_SIZE - sizeof(LONG64)];
+        Slot m_slots[kCapacity];
+    };
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+namespace kf
+{
+    struct MpscQueueEntry
+    {
+        MpscQueueEntry* volatile next = nullptr;
+    };
+
+    //////////////////////////////////////////////////////////////////////////
+    // MpscQueue - intrusive unbounded multi-producer single-consumer FIFO queue (D. Vyukov's algorithm).
+    //
+    // push() is wait-free and can be called concurrently from any number of threads, pop() and isEmpty()
+    // must be called by one consumer at a time. Neither allocates, so both are usable at DISPATCH_LEVEL.
+    //
+    //     struct Request
+    //     {
+    //         kf::MpscQueueEntry m_entry;
+    //         ...
+    //     };
+    //
+    //     kf::MpscQueue<Request, &Request::m_entry> m_queue;
+    //
+    // Note: pop() returns nullptr if a producer is between its two steps of push(), the element becomes
+    // visible as soon as that push() returns. Use isEmpty() to tell it from an empty queue.
+
+    template<class TElemType, MpscQueueEntry TElemType::* TEntryMember>
+    class MpscQueue
+    {
+    public:
+        MpscQueue() noexcept : m_head(&m_stub), m_tail(&m_stub)
+        {
+        }
+
+        ~MpscQueue()
+        {
+            ASSERT(isEmpty());
+        }
+
+        MpscQueue(const MpscQueue&) = delete;
+        MpscQueue& operator=(const MpscQueue&) = delete;
+
+        _IRQL_requires_max_(HIGH_LEVEL)
+        void push(_Inout_ TElemType& element) noexcept
+        {
+            push(toEntry(element));
+        }
+
+        // Consumer only
+        _IRQL_requires_max_(HIGH_LEVEL)
+        _Must_inspect_result_
+        TElemType* pop() noexcept
+        {
+            MpscQueueEntry* tail = m_tail;
+            MpscQueueEntry* next = readNext(tail);
+
+            if (tail == &m_stub)
+            {
+                if (!next)
+                {
+                    return nullptr;
+                }
+
+                m_tail = next;
+                tail = next;
+                next = readNext(next);
+            }
+
+            if (next)
+            {
+                m_tail = next;
+                return fromEntry(tail);
+            }
+
+            if (tail != ReadPointerAcquire(reinterpret_cast<PVOID const volatile*>(&m_head)))
+            {
+                // A producer has taken the head but hasn't linked it yet
+                return nullptr;
+            }
+
+            // The tail is the last element, the stub is pushed after it to keep the queue non-empty
+            push(&m_stub);
+
+            next = readNext(tail);
+            if (next)
+            {
+                m_tail = next;
+                return fromEntry(tail);
+            }
+
+            return nullptr;
+        }
+
+        // Consumer only, returns false while a push() is in progress
+        bool isEmpty() const noexcept
+        {
+            return m_tail == &m_stub && !readNext(&m_stub) && ReadPointerAcquire(reinterpret_cast<PVOID const volatile*>(&m_head)) == &m_stub;
+        }
+
+    private:
+        void push(_Inout_ MpscQueueEntry* entry) noexcept
+        {
+            WritePointerNoFence(reinterpret_cast<PVOID volatile*>(&entry->next), nullptr);
+
+            MpscQueueEntry* prev = static_cast<MpscQueueEntry*>(InterlockedExchangePointer(reinterpret_cast<PVOID volatile*>(&m_head), entry));
+            WritePointerRelease(reinterpret_cast<PVOID volatile*>(&prev->next), entry);
+        }
+
+        static MpscQueueEntry* readNext(_In_ const MpscQueueEntry* entry) noexcept
+        {
+            return static_cast<MpscQueueEntry*>(ReadPointerAcquire(reinterpret_cast<PVOID const volatile*>(&entry->next)));
+        }
+
+        static TElemType* fromEntry(_In_ MpscQueueEntry* entry) noexcept
+        {
+            // Implementation of CONTAINING_RECORD macro
+            return reinterpret_cast<TElemType*>(reinterpret_cast<char*>(entry) - reinterpret_cast<ULONG_PTR>(&(static_cast<TElemType*>(0)->*TEntryMember)));
+        }
+
+        static MpscQueueEntry* toEntry(_In_ TElemType& element) noexcept
+        {
+            return &(element.*TEntryMember);
+        }
+
+    private:
+        // Producers and the consumer work on different cache lines
+        MpscQueueEntry* volatile m_head;
+        char m_padding[SYSTEM_CACHE_ALIGNMENT_SIZE - sizeof(MpscQueueEntry*)];
+        MpscQueueEntry* m_tail;
+        MpscQueueEntry m_stub;
+    };
+}
@@ -0,0 +1,112 @@
+#pragma once
+#include <optional>
+
+namespace kf
+{
+    //////////////////////////////////////////////////////////////////////////
+    // Numa - processor and NUMA node topology helpers and node-local pool allocations.
+    //
+    // Processors are identified by system-wide indexes from 0 to processorCount() - 1.
+    //
+    // Note: a node that spans several processor groups is represented by its first group.
+
+    class Numa
+    {
+    public:
+        static ULONG processorCount()
+        {
+            return ::KeQueryActiveProcessorCountEx(ALL_PROCESSOR_GROUPS);
+        }
+
+        static USHORT nodeCount()
+        {
+            return ::KeQueryHighestNodeNumber() + 1;
+        }
+
+        static std::optional<GROUP_AFFINITY> processorAffinity(ULONG processorIndex)
+        {
+            PROCESSOR_NUMBER number;
+            if (!NT_SUCCESS(::KeGetProcessorNumberFromIndex(processorIndex, &number)))
+            {
+                return {};
+            }
+
+            GROUP_AFFINITY affinity = {};
+            affinity.Group = number.Group;
+            affinity.Mask = AFFINITY_MASK(number.Number);
+
+            return affinity;
+        }
+
+        static GROUP_AFFINITY nodeAffinity(USHORT node)
+        {
+            GROUP_AFFINITY affinity = {};
+            ::KeQueryNodeActiveAffinity(node, &affinity, nullptr);
+
+            return affinity;
+        }
+
+        // Returns 0 if the processor doesn't exist
+        static USHORT nodeOfProcessor(ULONG processorIndex)
+        {
+            const auto processor = processorAffinity(processorIndex);
+            if (!processor)
+            {
+                return 0;
+            }
+
+            for (USHORT node = 0; node < nodeCount(); ++node)
+            {
+                const GROUP_AFFINITY affinity = nodeAffinity(node);
+                if (affinity.Group == processor->Group && (affinity.Mask & processor->Mask))
+                {
+                    return node;
+                }
+            }
+
+            return 0;
+        }
+
+        // Allocates memory that is preferably backed by the node's physical pages, free it with ExFreePoolWithTag.
+        // ExAllocatePool3 is resolved at runtime, on systems without it this is the same as ExAllocatePoolWithTag.
+        _IRQL_requires_max_(PASSIVE_LEVEL)
+        _Must_inspect_result_
+        static void* allocate(POOL_TYPE poolType, size_t size, ULONG tag, USHORT node) noexcept
+        {
+            using ExAllocatePool3Routine = decltype(&::ExAllocatePool3);
+
+            UNICODE_STRING routineName = RTL_CONSTANT_STRING(L"ExAllocatePool3");
+            const auto allocatePool3 = reinterpret_cast<ExAllocatePool3Routine>(::MmGetSystemRoutineAddress(&routineName));
+            const auto flags = poolFlags(poolType);
+
+            if (!allocatePool3 || !flags)
+            {
+#pragma warning(suppress: 4996) // ExAllocatePoolWithTag is deprecated, use ExAllocatePool2
+                return ::ExAllocatePoolWithTag(poolType, size ? size : 1, tag);
+            }
+
+            POOL_EXTENDED_PARAMETER parameter = {};
+            parameter.Type = PoolExtendedParameterNumaNode;
+            parameter.PreferredNode = node;
+
+            // ExAllocatePoolWithTag doesn't zero memory either
+            return allocatePool3(*flags | POOL_FLAG_UNINITIALIZED, size ? size : 1, tag, &parameter, 1);
+        }
+
+    private:
+        static std::optional<POOL_FLAGS> poolFlags(POOL_TYPE poolType) noexcept
+        {
+            switch (poolType)
+            {
+            case NonPagedPoolNx:
+                return POOL_FLAG_NON_PAGED;
+            case NonPagedPoolExecute:
+                return POOL_FLAG_NON_PAGED_EXECUTE;
+            case PagedPool:
+                return POOL_FLAG_PAGED;
+            default:
+                return {};
+            }
+        }
+    };
+}
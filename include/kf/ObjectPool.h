@@ -0,0 +1,189 @@
+#pragma once
+#include <kf/stl/new>
+#include <algorithm>
+#include <new>
+#include <utility>
+
+namespace kf
+{
+    namespace detail
+    {
+        //////////////////////////////////////////////////////////////////////////
+        // BlockPool - cache of fixed-size pool blocks on an interlocked SList, the base of ObjectPool and BufferPool.
+        //
+        // The block size is fixed on construction, so the pool works before initialize(). lowWatermark blocks are
+        // allocated by initialize() and kept by trim(), released blocks above highWatermark are returned to the pool.
+        // Acquire and release are lock-free and can be called concurrently.
+
+        template<POOL_TYPE poolType>
+        class BlockPool
+        {
+        public:
+            BlockPool(size_t blockSize, USHORT highWatermark) noexcept
+                : m_blockSize(ALIGN_UP_BY((std::max)(blockSize, sizeof(SLIST_ENTRY)), MEMORY_ALLOCATION_ALIGNMENT))
+                , m_highWatermark(highWatermark)
+            {
+                InitializeSListHead(&m_freeList);
+            }
+
+            ~BlockPool()
+            {
+                freeCached(0);
+            }
+
+            BlockPool(const BlockPool&) = delete;
+            BlockPool& operator=(const BlockPool&) = delete;
+
+            _IRQL_requires_max_(APC_LEVEL)
+            NTSTATUS initialize(USHORT lowWatermark, USHORT highWatermark) noexcept
+            {
+                ASSERT(lowWatermark <= highWatermark);
+
+                m_lowWatermark = lowWatermark;
+                m_highWatermark = (std::max)(lowWatermark, highWatermark);
+
+                while (QueryDepthSList(&m_freeList) < m_lowWatermark)
+                {
+                    void* block = operator new(m_blockSize, poolType);
+                    if (!block)
+                    {
+                        return STATUS_INSUFFICIENT_RESOURCES;
+                    }
+
+                    InterlockedPushEntrySList(&m_freeList, static_cast<PSLIST_ENTRY>(block));
+                }
+
+                return STATUS_SUCCESS;
+            }
+
+            _Must_inspect_result_
+            void* allocate() noexcept
+            {
+                if (PSLIST_ENTRY entry = InterlockedPopEntrySList(&m_freeList))
+                {
+                    return entry;
+                }
+
+                return operator new(m_blockSize, poolType);
+            }
+
+            void deallocate(_In_opt_ void* block) noexcept
+            {
+                if (!block)
+                {
+                    return;
+                }
+
+                // The depth is checked without a lock, so the cache can exceed the watermark by a few blocks
+                if (QueryDepthSList(&m_freeList) >= m_highWatermark)
+                {
+                    operator delete(block);
+                    return;
+                }
+
+                InterlockedPushEntrySList(&m_freeList, static_cast<PSLIST_ENTRY>(block));
+            }
+
+            // Returns cached blocks above the low watermark to the pool
+            void trim() noexcept
+            {
+                freeCached(m_lowWatermark);
+            }
+
+            USHORT cachedCount() noexcept
+            {
+                return QueryDepthSList(&m_freeList);
+            }
+
+            size_t blockSize() const noexcept
+            {
+                return m_blockSize;
+            }
+
+        private:
+            void freeCached(USHORT keepCount) noexcept
+            {
+                while (QueryDepthSList(&m_freeList) > keepCount)
+                {
+                    PSLIST_ENTRY entry = InterlockedPopEntrySList(&m_freeList);
+                    if (!entry)
+                    {
+                        break;
+                    }
+
+                    operator delete(entry);
+                }
+            }
+
+        private:
+            SLIST_HEADER    m_freeList;
+            const size_t    m_blockSize;
+            USHORT          m_lowWatermark = 0;
+            USHORT          m_highWatermark;
+        };
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // ObjectPool - O(1) lock-free cache of objects of type T (for example, per-request contexts).
+    //
+    // acquire() constructs an object in a cached block or a new pool block, release() destroys it and caches the block
+    // while there are less than highWatermark cached blocks. initialize() preallocates lowWatermark blocks, without it
+    // the pool caches up to kDefaultHighWatermark blocks.
+
+    template<class T, POOL_TYPE poolType>
+    class ObjectPool
+    {
+    public:
+        static_assert(alignof(T) <= MEMORY_ALLOCATION_ALIGNMENT, "Pool allocations are not aligned enough");
+
+        static constexpr USHORT kDefaultHighWatermark = 64;
+
+        ObjectPool() noexcept : m_blocks(sizeof(T), kDefaultHighWatermark)
+        {
+        }
+
+        ObjectPool(const ObjectPool&) = delete;
+        ObjectPool& operator=(const ObjectPool&) = delete;
+
+        _IRQL_requires_max_(APC_LEVEL)
+        NTSTATUS initialize(USHORT lowWatermark = 0, USHORT highWatermark = kDefaultHighWatermark) noexcept
+        {
+            return m_blocks.initialize(lowWatermark, highWatermark);
+        }
+
+        template<class... Args>
+        _Must_inspect_result_
+        T* acquire(Args&&... args) noexcept
+        {
+            void* block = m_blocks.allocate();
+            if (!block)
+            {
+                return nullptr;
+            }
+
+            return new(block) T(std::forward<Args>(args)...);
+        }
+
+        void release(_In_opt_ T* object) noexcept
+        {
+            if (object)
+            {
+                object->~T();
+                m_blocks.deallocate(object);
+            }
+        }
+
+        void trim() noexcept
+        {
+            m_blocks.trim();
+        }
+
+        USHORT cachedCount() noexcept
+        {
+            return m_blocks.cachedCount();
+        }
+
+    private:
+        detail::BlockPool<poolType> m_blocks;
+    };
+}
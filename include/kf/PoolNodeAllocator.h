@@ -0,0 +1,73 @@
+#pragma once
+#include <kf/stl/new>
+#include <kf/AllocationStats.h>
+
+namespace kf
+{
+    namespace detail
+    {
+        //////////////////////////////////////////////////////////////////////////
+        // NodeSize - node size remembered for allocation accounting, empty when it's compiled out
+
+        template<bool kEnabled = AllocationStats::kEnabled>
+        class NodeSize
+        {
+        protected:
+            void rememberNodeSize(size_t byteSize) noexcept
+            {
+                m_nodeSize = byteSize;
+            }
+
+            size_t nodeSize() const noexcept
+            {
+                return m_nodeSize;
+            }
+
+        private:
+            size_t m_nodeSize = 0;
+        };
+
+        template<>
+        class NodeSize<false>
+        {
+        protected:
+            void rememberNodeSize(size_t) noexcept
+            {
+            }
+
+            size_t nodeSize() const noexcept
+            {
+                return 0;
+            }
+        };
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // PoolNodeAllocator - node allocator for tree containers (GenericTableAvl, TreeMap, TreeSet, LinkedTreeMap).
+    // Allocates every node separately from the pool with poolTag. It is the default node allocator.
+
+    template<POOL_TYPE poolType, ULONG poolTag = 'n++C'>
+    class PoolNodeAllocator : private detail::NodeSize<>
+    {
+    public:
+        PoolNodeAllocator() noexcept = default;
+        PoolNodeAllocator(_Inout_ PoolNodeAllocator&&) noexcept = default;
+        PoolNodeAllocator& operator=(_Inout_ PoolNodeAllocator&&) noexcept = default;
+
+        PoolNodeAllocator(const PoolNodeAllocator&) = delete;
+        PoolNodeAllocator& operator=(const PoolNodeAllocator&) = delete;
+
+        _Must_inspect_result_
+        void* allocate(_In_ size_t byteSize) noexcept
+        {
+            // A table allocates nodes of the same size, it's remembered for accounting
+            rememberNodeSize(byteSize);
+            return allocatePool(poolType, byteSize, poolTag);
+        }
+
+        void deallocate(_In_ void* node) noexcept
+        {
+            freePool(node, nodeSize(), poolTag);
+        }
+    };
+}
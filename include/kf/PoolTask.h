@@ -0,0 +1,88 @@
+#pragma once
+#include <kf/stl/new>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace kf
+{
+    namespace detail
+    {
+        //////////////////////////////////////////////////////////////////////////
+        // PoolTask - type-erased void() callable that is stored by value in ThreadPool and WorkQueue queues.
+        //
+        // Small trivially copyable callables (for example, lambdas that capture pointers and sizes) are kept inline,
+        // so submitting them doesn't allocate and a task can be copied by a stealing worker. Other callables
+        // are moved to a pool allocation.
+
+        class PoolTask
+        {
+        public:
+            static constexpr size_t kInlineSize = 6 * sizeof(void*);
+
+            template<class F>
+            static constexpr bool kIsInline = sizeof(F) <= kInlineSize && alignof(F) <= alignof(void*)
+                && std::is_trivially_copyable_v<F> && std::is_trivially_destructible_v<F>;
+
+            template<POOL_TYPE poolType, class F>
+            _Must_inspect_result_
+            bool assign(F&& callable) noexcept
+            {
+                using Callable = std::decay_t<F>;
+
+                if constexpr (kIsInline<Callable>)
+                {
+                    new(m_storage) Callable(std::forward<F>(callable));
+                    m_invoke = [](PoolTask& task) { (*task.storage<Callable>())(); };
+                    m_discard = nullptr;
+                }
+                else
+                {
+                    Callable* boxed = new(poolType) Callable(std::forward<F>(callable));
+                    if (!boxed)
+                    {
+                        return false;
+                    }
+
+                    new(m_storage) Callable*(boxed);
+                    m_invoke = [](PoolTask& task)
+                    {
+                        Callable* boxed = *task.storage<Callable*>();
+                        (*boxed)();
+                        delete boxed;
+                    };
+                    m_discard = [](PoolTask& task) { delete *task.storage<Callable*>(); };
+                }
+
+                return true;
+            }
+
+            // Must be called once for a task that was assigned
+            void operator()() noexcept
+            {
+                m_invoke(*this);
+            }
+
+            // Frees a task that will never be called
+            void discard() noexcept
+            {
+                if (m_discard)
+                {
+                    m_discard(*this);
+                }
+            }
+
+        private:
+            template<class T>
+            T* storage() noexcept
+            {
+                return std::launder(reinterpret_cast<T*>(m_storage));
+            }
+
+        private:
+            void (*m_invoke)(PoolTask&) = nullptr;
+            void (*m_discard)(PoolTask&) = nullptr;
+            alignas(void*) std::byte m_storage[kInlineSize];
+        };
+    }
+}
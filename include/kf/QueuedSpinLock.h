@@ -0,0 +1,45 @@
+#pragma once
+#include <wdm.h>
+
+namespace kf
+{
+    //////////////////////////////////////////////////////////////////////////
+    // QueuedSpinLock - spin lock acquired through in-stack queued handles.
+    //
+    // Waiters are granted the lock in FIFO order and every waiter spins on its own KLOCK_QUEUE_HANDLE
+    // instead of the shared lock word, so contention doesn't bounce one cache line between processors.
+    // Acquire it with AutoQueuedSpinLock, the handle must stay in place till the lock is released.
+    //
+    // Note: a lock must not be acquired with both queued and non-queued routines.
+
+    class QueuedSpinLock
+    {
+    public:
+        QueuedSpinLock()
+        {
+            KeInitializeSpinLock(&m_spinLock);
+        }
+
+        QueuedSpinLock(QueuedSpinLock&&)
+        {
+            KeInitializeSpinLock(&m_spinLock);
+        }
+
+        QueuedSpinLock& operator=(QueuedSpinLock&&)
+        {
+            return *this;
+        }
+
+        operator PKSPIN_LOCK()
+        {
+            return &m_spinLock;
+        }
+
+    private:
+        QueuedSpinLock(const QueuedSpinLock&) = delete;
+        QueuedSpinLock& operator=(const QueuedSpinLock&) = delete;
+
+    private:
+        KSPIN_LOCK m_spinLock;
+    };
+}
@@ -0,0 +1,138 @@
+#pragma once
+#include <kf/stl/new>
+
+namespace kf
+{
+    namespace detail
+    {
+        //////////////////////////////////////////////////////////////////////////
+        // ReaderShards - per-CPU counters of readers of two generations, the read side of VersionedPtr and Epoch.
+        //
+        // A reader is counted in the shard of its current CPU, shards are padded to a cache line, so readers on
+        // different CPUs don't write a shared cache line. A writer flips the generation and waits until the readers
+        // of the previous one leave.
+        //
+        // initialize() allocates a shard per possible processor. Until it's called, or if it fails, all readers
+        // share a single inline shard: it's correct but contended.
+
+        class ReaderShards
+        {
+        public:
+            ReaderShards() noexcept = default;
+
+            ~ReaderShards()
+            {
+                operator delete(m_buffer);
+            }
+
+            ReaderShards(const ReaderShards&) = delete;
+            ReaderShards& operator=(const ReaderShards&) = delete;
+
+            // Must be called before the first reader enters
+            _IRQL_requires_max_(DISPATCH_LEVEL)
+            NTSTATUS initialize() noexcept
+            {
+                ASSERT(!m_buffer);
+
+                const ULONG count = ::KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS);
+
+                // The pool aligns blocks to 16 bytes only, shards are aligned to a cache line by hand
+                void* buffer = operator new(count * sizeof(Shard) + SYSTEM_CACHE_ALIGNMENT_SIZE, NonPagedPoolNx);
+                if (!buffer)
+                {
+                    return STATUS_INSUFFICIENT_RESOURCES;
+                }
+
+                auto shards = static_cast<Shard*>(ALIGN_UP_POINTER_BY(buffer, SYSTEM_CACHE_ALIGNMENT_SIZE));
+                for (ULONG i = 0; i < count; ++i)
+                {
+                    new(&shards[i]) Shard();
+                }
+
+                m_buffer = buffer;
+                m_shards = shards;
+                m_count = count;
+
+                return STATUS_SUCCESS;
+            }
+
+            // Counts the caller as a reader of the current generation and returns the counter to decrement
+            // when it leaves. The full barrier of the increment orders it before the reader's loads.
+            _IRQL_requires_max_(DISPATCH_LEVEL)
+            volatile LONG* enter(const volatile LONG& generation) noexcept
+            {
+                for (;;)
+                {
+                    const LONG current = ReadNoFence(&generation);
+                    const ULONG cpu = ::KeGetCurrentProcessorNumberEx(nullptr);
+                    volatile LONG* readers = &m_shards[cpu < m_count ? cpu : 0].readers[current & 1];
+
+                    // The writer either waits for this reader or has flipped the generation before this reader
+                    // loads anything
+                    InterlockedIncrement(readers);
+
+                    if (ReadNoFence(&generation) == current)
+                    {
+                        return readers;
+                    }
+
+                    // The writer has flipped the generation and may not wait for this counter, retry with the new one
+                    InterlockedDecrement(readers);
+                }
+            }
+
+            static void leave(_In_ volatile LONG* readers) noexcept
+            {
+                InterlockedDecrement(readers);
+            }
+
+            // Waits until readers of the generation with the parity leave
+            _IRQL_requires_(PASSIVE_LEVEL)
+            void waitForReaders(LONG parity) const noexcept
+            {
+                for (ULONG spins = 0; readerCount(parity); ++spins)
+                {
+                    if (spins < kSpinCount)
+                    {
+                        YieldProcessor();
+                    }
+                    else
+                    {
+                        LARGE_INTEGER interval{ .QuadPart = -10'000LL }; // 1ms
+                        KeDelayExecutionThread(KernelMode, false, &interval);
+                    }
+                }
+            }
+
+        private:
+            static constexpr ULONG kSpinCount = 1024;
+
+            // A shard keeps readers of both generation parities, the padding keeps shards in different cache lines
+            struct Shard
+            {
+                volatile LONG readers[2] = {};
+                char padding[SYSTEM_CACHE_ALIGNMENT_SIZE - 2 * sizeof(LONG)];
+            };
+
+            static_assert(sizeof(Shard) == SYSTEM_CACHE_ALIGNMENT_SIZE, "A shard must take a cache line");
+
+            LONG readerCount(LONG parity) const noexcept
+            {
+                LONG count = 0;
+
+                for (ULONG i = 0; i < m_count; ++i)
+                {
+                    count += ReadNoFence(&m_shards[i].readers[parity]);
+                }
+
+                return count;
+            }
+
+        private:
+            Shard m_inlineShard;
+            Shard* m_shards = &m_inlineShard;
+            ULONG m_count = 1;
+            void* m_buffer = nullptr;
+        };
+    }
+}
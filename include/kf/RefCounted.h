@@ -0,0 +1,376 @@
+#pragma once
+#include <kf/Allocator.h>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace kf
+{
+    namespace detail
+    {
+        //////////////////////////////////////////////////////////////////////////
+        // RefCountHeader - reference counters at the beginning of a make_ref/allocate_ref block.
+        //
+        // Strong references share one weak reference, so the block lives while there are strong or weak ones.
+
+        class RefCountHeader
+        {
+        public:
+            using DestroyRoutine = void (*)(RefCountHeader*) noexcept;
+
+            RefCountHeader(DestroyRoutine destroyObject, DestroyRoutine freeBlock) noexcept
+                : m_destroyObject(destroyObject), m_freeBlock(freeBlock)
+            {
+            }
+
+            RefCountHeader(const RefCountHeader&) = delete;
+            RefCountHeader& operator=(const RefCountHeader&) = delete;
+
+            void addRef() noexcept
+            {
+                // A new reference is made from an existing one, so no ordering is needed
+                InterlockedIncrementNoFence(&m_strong);
+            }
+
+            void release() noexcept
+            {
+                // The full barrier orders the object accesses of this thread before the destruction in another one
+                if (!InterlockedDecrement(&m_strong))
+                {
+                    m_destroyObject(this);
+                    releaseWeak();
+                }
+            }
+
+            void addWeakRef() noexcept
+            {
+                InterlockedIncrementNoFence(&m_weak);
+            }
+
+            void releaseWeak() noexcept
+            {
+                if (!InterlockedDecrement(&m_weak))
+                {
+                    m_freeBlock(this);
+                }
+            }
+
+            // Takes a strong reference if the object is still alive
+            bool tryAddRef() noexcept
+            {
+                for (LONG count = ReadNoFence(&m_strong); count;)
+                {
+                    const LONG previous = InterlockedCompareExchange(&m_strong, count + 1, count);
+                    if (previous == count)
+                    {
+                        return true;
+                    }
+
+                    count = previous;
+                }
+
+                return false;
+            }
+
+            LONG useCount() const noexcept
+            {
+                return ReadNoFence(&m_strong);
+            }
+
+        private:
+            volatile LONG m_strong = 1;
+            volatile LONG m_weak = 1;
+            DestroyRoutine m_destroyObject;
+            DestroyRoutine m_freeBlock;
+        };
+
+        template<class T, class Allocator>
+        struct RefCountBlock : RefCountHeader
+        {
+            template<class... Args>
+            RefCountBlock(const Allocator& allocator, Args&&... args) noexcept
+                : RefCountHeader(&destroyObject, &freeBlock), allocator(allocator)
+            {
+                new(storage) T(std::forward<Args>(args)...);
+            }
+
+            T* object() noexcept
+            {
+                return std::launder(reinterpret_cast<T*>(storage));
+            }
+
+            static void destroyObject(RefCountHeader* header) noexcept
+            {
+                static_cast<RefCountBlock*>(header)->object()->~T();
+            }
+
+            static void freeBlock(RefCountHeader* header) noexcept
+            {
+                auto block = static_cast<RefCountBlock*>(header);
+                Allocator allocator = std::move(block->allocator);
+
+                block->~RefCountBlock();
+                allocator.deallocate(reinterpret_cast<std::byte*>(block), sizeof(RefCountBlock));
+            }
+
+            [[no_unique_address]] Allocator allocator;
+            alignas(T) std::byte storage[sizeof(T)];
+        };
+    }
+
+    template<class T>
+    class WeakRef;
+
+    //////////////////////////////////////////////////////////////////////////
+    // RefCounted - shared ownership pointer for objects created by make_ref/allocate_ref, a replacement of
+    // std::shared_ptr that doesn't depend on STL internals.
+    //
+    // The object and its counters are allocated in one block. Copies increment the counter without ordering,
+    // the last release uses a full barrier before the object is destroyed. WeakRef observes the object without
+    // keeping it alive, the block is freed when both strong and weak references are gone.
+    //
+    // Note: like std::shared_ptr, a single RefCounted instance must not be modified concurrently,
+    // copies of it can be used by different threads freely.
+
+    template<class T>
+    class RefCounted
+    {
+    public:
+        using element_type = T;
+
+        RefCounted() noexcept = default;
+
+        RefCounted(std::nullptr_t) noexcept
+        {
+        }
+
+        RefCounted(const RefCounted& another) noexcept : m_object(another.m_object), m_header(another.m_header)
+        {
+            if (m_header)
+            {
+                m_header->addRef();
+            }
+        }
+
+        RefCounted(_Inout_ RefCounted&& another) noexcept
+            : m_object(std::exchange(another.m_object, nullptr)), m_header(std::exchange(another.m_header, nullptr))
+        {
+        }
+
+        template<class Y> requires std::is_convertible_v<Y*, T*>
+        RefCounted(const RefCounted<Y>& another) noexcept : m_object(another.m_object), m_header(another.m_header)
+        {
+            if (m_header)
+            {
+                m_header->addRef();
+            }
+        }
+
+        template<class Y> requires std::is_convertible_v<Y*, T*>
+        RefCounted(_Inout_ RefCounted<Y>&& another) noexcept
+            : m_object(std::exchange(another.m_object, nullptr)), m_header(std::exchange(another.m_header, nullptr))
+        {
+        }
+
+        ~RefCounted()
+        {
+            reset();
+        }
+
+        RefCounted& operator=(const RefCounted& another) noexcept
+        {
+            RefCounted(another).swap(*this);
+            return *this;
+        }
+
+        RefCounted& operator=(_Inout_ RefCounted&& another) noexcept
+        {
+            RefCounted(std::move(another)).swap(*this);
+            return *this;
+        }
+
+        void reset() noexcept
+        {
+            if (m_header)
+            {
+                std::exchange(m_header, nullptr)->release();
+                m_object = nullptr;
+            }
+        }
+
+        void swap(RefCounted& another) noexcept
+        {
+            std::swap(m_object, another.m_object);
+            std::swap(m_header, another.m_header);
+        }
+
+        T* get() const noexcept
+        {
+            return m_object;
+        }
+
+        T& operator*() const noexcept
+        {
+            return *m_object;
+        }
+
+        T* operator->() const noexcept
+        {
+            return m_object;
+        }
+
+        explicit operator bool() const noexcept
+        {
+            return m_object != nullptr;
+        }
+
+        // The value is approximate if other threads copy or release references
+        LONG use_count() const noexcept
+        {
+            return m_header ? m_header->useCount() : 0;
+        }
+
+        friend bool operator==(const RefCounted& left, const RefCounted& right) noexcept
+        {
+            return left.m_object == right.m_object;
+        }
+
+        friend bool operator==(const RefCounted& left, std::nullptr_t) noexcept
+        {
+            return !left.m_object;
+        }
+
+    private:
+        template<class Y>
+        friend class RefCounted;
+
+        template<class Y>
+        friend class WeakRef;
+
+        template<class Y, class Allocator, class... Args>
+        friend RefCounted<Y> allocate_ref(const Allocator& allocator, Args&&... args) noexcept;
+
+        // Adopts a reference
+        RefCounted(T* object, detail::RefCountHeader* header) noexcept : m_object(object), m_header(header)
+        {
+        }
+
+    private:
+        T* m_object = nullptr;
+        detail::RefCountHeader* m_header = nullptr;
+    };
+
+    //////////////////////////////////////////////////////////////////////////
+    // WeakRef - non-owning reference to an object owned by RefCounted, lock() returns a strong reference
+    // if the object is still alive.
+
+    template<class T>
+    class WeakRef
+    {
+    public:
+        WeakRef() noexcept = default;
+
+        WeakRef(const RefCounted<T>& strong) noexcept : m_object(strong.m_object), m_header(strong.m_header)
+        {
+            if (m_header)
+            {
+                m_header->addWeakRef();
+            }
+        }
+
+        WeakRef(const WeakRef& another) noexcept : m_object(another.m_object), m_header(another.m_header)
+        {
+            if (m_header)
+            {
+                m_header->addWeakRef();
+            }
+        }
+
+        WeakRef(_Inout_ WeakRef&& another) noexcept
+            : m_object(std::exchange(another.m_object, nullptr)), m_header(std::exchange(another.m_header, nullptr))
+        {
+        }
+
+        ~WeakRef()
+        {
+            reset();
+        }
+
+        WeakRef& operator=(const WeakRef& another) noexcept
+        {
+            WeakRef(another).swap(*this);
+            return *this;
+        }
+
+        WeakRef& operator=(_Inout_ WeakRef&& another) noexcept
+        {
+            WeakRef(std::move(another)).swap(*this);
+            return *this;
+        }
+
+        void reset() noexcept
+        {
+            if (m_header)
+            {
+                std::exchange(m_header, nullptr)->releaseWeak();
+                m_object = nullptr;
+            }
+        }
+
+        void swap(WeakRef& another) noexcept
+        {
+            std::swap(m_object, another.m_object);
+            std::swap(m_header, another.m_header);
+        }
+
+        [[nodiscard]] RefCounted<T> lock() const noexcept
+        {
+            if (m_header && m_header->tryAddRef())
+            {
+                return RefCounted<T>(m_object, m_header);
+            }
+
+            return {};
+        }
+
+        bool expired() const noexcept
+        {
+            return !m_header || !m_header->useCount();
+        }
+
+    private:
+        T* m_object = nullptr;
+        detail::RefCountHeader* m_header = nullptr;
+    };
+
+    //////////////////////////////////////////////////////////////////////////
+    // allocate_ref - creates an object with its counters in one block from a byte allocator
+    // (for example, SlabAllocatorRef<std::byte>), the allocator is kept in the block to free it.
+    // Returns an empty RefCounted if the allocation fails.
+
+    template<class T, class Allocator, class... Args>
+    [[nodiscard]] RefCounted<T> allocate_ref(const Allocator& allocator, Args&&... args) noexcept
+    {
+        using Block = detail::RefCountBlock<T, Allocator>;
+        static_assert(alignof(Block) <= MEMORY_ALLOCATION_ALIGNMENT, "Pool allocations are not aligned enough");
+
+        Allocator blockAllocator = allocator;
+        void* memory = blockAllocator.allocate(sizeof(Block));
+        if (!memory)
+        {
+            return {};
+        }
+
+        auto block = new(memory) Block(blockAllocator, std::forward<Args>(args)...);
+        return RefCounted<T>(block->object(), block);
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // make_ref - creates an object with its counters in one pool allocation
+
+    template<class T, POOL_TYPE poolType, class... Args>
+    [[nodiscard]] RefCounted<T> make_ref(Args&&... args) noexcept
+    {
+        return allocate_ref<T>(Allocator<std::byte, poolType>(), std::forward<Args>(args)...);
+    }
+}
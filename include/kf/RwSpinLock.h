@@ -0,0 +1,122 @@
+#pragma once
+#include <wdm.h>
+
+namespace kf
+{
+    //////////////////////////////////////////////////////////////////////////
+    // RwSpinLock - reader-writer spin lock (EX_SPIN_LOCK), readers hold it concurrently.
+    //
+    // Lockable and SharedLockable, so it's used with std::unique_lock and std::shared_lock like EResource:
+    //
+    //     kf::RwSpinLock m_lock;
+    //     ...
+    //     std::unique_lock lock(m_lock);  // at IRQL <= DISPATCH_LEVEL
+    //     std::shared_lock lock(m_lock);  // at DISPATCH_LEVEL
+    //
+    // The exclusive owner is single, so lock() keeps its previous IRQL in the lock. Readers are many and
+    // have nowhere to keep theirs, so lock_shared() requires DISPATCH_LEVEL. Below it use acquireShared()
+    // or AutoRwSpinLockShared.
+
+    class RwSpinLock
+    {
+    public:
+        RwSpinLock() = default;
+
+        _IRQL_requires_max_(DISPATCH_LEVEL)
+        _IRQL_raises_(DISPATCH_LEVEL)
+        KIRQL acquireExclusive()
+        {
+            return ::ExAcquireSpinLockExclusive(&m_spinLock);
+        }
+
+        _IRQL_requires_(DISPATCH_LEVEL)
+        void releaseExclusive(_In_ _IRQL_restores_ KIRQL oldIrql)
+        {
+            ::ExReleaseSpinLockExclusive(&m_spinLock, oldIrql);
+        }
+
+        _IRQL_requires_max_(DISPATCH_LEVEL)
+        _IRQL_raises_(DISPATCH_LEVEL)
+        KIRQL acquireShared()
+        {
+            return ::ExAcquireSpinLockShared(&m_spinLock);
+        }
+
+        _IRQL_requires_(DISPATCH_LEVEL)
+        void releaseShared(_In_ _IRQL_restores_ KIRQL oldIrql)
+        {
+            ::ExReleaseSpinLockShared(&m_spinLock, oldIrql);
+        }
+
+        _IRQL_requires_(DISPATCH_LEVEL)
+        void acquireExclusiveAtDpcLevel()
+        {
+            ::ExAcquireSpinLockExclusiveAtDpcLevel(&m_spinLock);
+        }
+
+        _IRQL_requires_(DISPATCH_LEVEL)
+        void releaseExclusiveFromDpcLevel()
+        {
+            ::ExReleaseSpinLockExclusiveFromDpcLevel(&m_spinLock);
+        }
+
+        _IRQL_requires_(DISPATCH_LEVEL)
+        void acquireSharedAtDpcLevel()
+        {
+            ::ExAcquireSpinLockSharedAtDpcLevel(&m_spinLock);
+        }
+
+        _IRQL_requires_(DISPATCH_LEVEL)
+        void releaseSharedFromDpcLevel()
+        {
+            ::ExReleaseSpinLockSharedFromDpcLevel(&m_spinLock);
+        }
+
+        // Succeeds only if the caller is the single reader, on failure the lock is still held shared
+        _IRQL_requires_(DISPATCH_LEVEL)
+        bool tryConvertSharedToExclusive()
+        {
+            return !!::ExTryConvertSharedSpinLockExclusive(&m_spinLock);
+        }
+
+        // Lockable
+        _IRQL_requires_max_(DISPATCH_LEVEL)
+        _IRQL_raises_(DISPATCH_LEVEL)
+        void lock()
+        {
+            m_oldIrql = acquireExclusive();
+        }
+
+        _IRQL_requires_(DISPATCH_LEVEL)
+        void unlock()
+        {
+            releaseExclusive(m_oldIrql);
+        }
+
+        bool try_lock() = delete;
+
+        // SharedLockable
+        _IRQL_requires_(DISPATCH_LEVEL)
+        void lock_shared()
+        {
+            ASSERT(KeGetCurrentIrql() == DISPATCH_LEVEL);
+            acquireSharedAtDpcLevel();
+        }
+
+        _IRQL_requires_(DISPATCH_LEVEL)
+        void unlock_shared()
+        {
+            releaseSharedFromDpcLevel();
+        }
+
+        bool try_lock_shared() = delete;
+
+    private:
+        RwSpinLock(const RwSpinLock&) = delete;
+        RwSpinLock& operator=(const RwSpinLock&) = delete;
+
+    private:
+        EX_SPIN_LOCK m_spinLock = 0;
+        KIRQL        m_oldIrql = PASSIVE_LEVEL;
+    };
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+namespace kf
+{
+    //////////////////////////////////////////////////////////////////////////
+    // SList - typed wrapper of an interlocked singly linked list (SLIST_HEADER).
+    //
+    // Elements embed an SLIST_ENTRY, so push() and pop() don't allocate and are usable at any IRQL
+    // up to DISPATCH_LEVEL. The list is LIFO, flush() detaches all elements at once and returns them
+    // as a Chain that can be reversed to get them in the push order.
+    //
+    //     struct Buffer
+    //     {
+    //         SLIST_ENTRY m_entry;
+    //         ...
+    //     };
+    //
+    //     kf::SList<Buffer, &Buffer::m_entry> m_freeBuffers;
+    //
+    // Note: elements must be aligned on MEMORY_ALLOCATION_ALIGNMENT, pool allocations are. The list must
+    // be empty when it's destroyed, it doesn't own the elements.
+
+    template<class TElemType, SLIST_ENTRY TElemType::* TEntryMember>
+    class SList
+    {
+    public:
+        //////////////////////////////////////////////////////////////////////////
+        // Chain - elements detached from the list, owned by a single thread
+
+        class Chain
+        {
+        public:
+            Chain() noexcept = default;
+
+            explicit Chain(_In_opt_ PSLIST_ENTRY first) noexcept : m_first(first)
+            {
+            }
+
+            ~Chain()
+            {
+                ASSERT(isEmpty());
+            }
+
+            Chain(Chain&& other) noexcept : m_first(other.m_first)
+            {
+                other.m_first = nullptr;
+            }
+
+            Chain& operator=(Chain&& other) noexcept
+            {
+                ASSERT(isEmpty());
+
+                m_first = other.m_first;
+                other.m_first = nullptr;
+
+                return *this;
+            }
+
+            _Must_inspect_result_
+            TElemType* pop() noexcept
+            {
+                if (!m_first)
+                {
+                    return nullptr;
+                }
+
+                PSLIST_ENTRY entry = m_first;
+                m_first = entry->Next;
+
+                return fromEntry(entry);
+            }
+
+            // Reverses the order of elements, for a flushed chain it's the push order
+            Chain& reverse() noexcept
+            {
+                PSLIST_ENTRY reversed = nullptr;
+
+                while (m_first)
+                {
+                    PSLIST_ENTRY next = m_first->Next;
+                    m_first->Next = reversed;
+                    reversed = m_first;
+                    m_first = next;
+                }
+
+                m_first = reversed;
+                return *this;
+            }
+
+            bool isEmpty() const noexcept
+            {
+                return !m_first;
+            }
+
+        private:
+            PSLIST_ENTRY m_first = nullptr;
+        };
+
+    public:
+        SList() noexcept
+        {
+            ::InitializeSListHead(&m_head);
+        }
+
+        ~SList()
+        {
+            ASSERT(isEmpty());
+        }
+
+        SList(const SList&) = delete;
+        SList& operator=(const SList&) = delete;
+
+        // Returns true if the list was empty
+        _IRQL_requires_max_(DISPATCH_LEVEL)
+        bool push(_Inout_ TElemType& element) noexcept
+        {
+            return !::InterlockedPushEntrySList(&m_head, toEntry(element));
+        }
+
+        _IRQL_requires_max_(DISPATCH_LEVEL)
+        _Must_inspect_result_
+        TElemType* pop() noexcept
+        {
+            PSLIST_ENTRY entry = ::InterlockedPopEntrySList(&m_head);
+            return entry ? fromEntry(entry) : nullptr;
+        }
+
+        // Detaches all elements, the most recently pushed one is the first in the chain
+        _IRQL_requires_max_(DISPATCH_LEVEL)
+        _Must_inspect_result_
+        Chain flush() noexcept
+        {
+            return Chain(::InterlockedFlushSList(&m_head));
+        }
+
+        // The depth is approximate if the list is modified concurrently. It's 16-bit and wraps at 65536 elements,
+        // use isEmpty() to check for elements.
+        USHORT depth() const noexcept
+        {
+            return ::QueryDepthSList(const_cast<PSLIST_HEADER>(&m_head));
+        }
+
+        bool isEmpty() const noexcept
+        {
+            return !::RtlFirstEntrySList(&m_head);
+        }
+
+    private:
+        static TElemType* fromEntry(_In_ PSLIST_ENTRY entry) noexcept
+        {
+            // Implementation of CONTAINING_RECORD macro
+            return reinterpret_cast<TElemType*>(reinterpret_cast<char*>(entry) - reinterpret_cast<ULONG_PTR>(&(static_cast<TElemType*>(0)->*TEntryMember)));
+        }
+
+        static PSLIST_ENTRY toEntry(_In_ TElemType& element) noexcept
+        {
+            ASSERT((reinterpret_cast<ULONG_PTR>(&(element.*TEntryMember)) & (MEMORY_ALLOCATION_ALIGNMENT - 1)) == 0);
+            return &(element.*TEntryMember);
+        }
+
+    private:
+        SLIST_HEADER m_head;
+    };
+}
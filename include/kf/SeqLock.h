@@ -0,0 +1,95 @@
+#pragma once
+#include "SpinLock.h"
+#include "AutoSpinLock.h"
+#include <atomic>
+#include <type_traits>
+
+namespace kf
+{
+    //////////////////////////////////////////////////////////////////////////
+    // SeqLock - sequence lock for a small trivially copyable value that is read often and written rarely.
+    //
+    // Readers don't write shared memory: they copy the value between two reads of the sequence counter
+    // and retry if a writer has run in between. Writers are serialized by a spin lock and make
+    // the counter odd while they update the value.
+    //
+    //     kf::SeqLock<Policy> m_policy;
+    //     ...
+    //     const Policy policy = m_policy.read();
+    //     m_policy.update([&](Policy& policy) { policy.flags |= kFlag; });
+    //
+    // Note: read() spins while a writer is active, so the value must be small. Readers and writers
+    // run at IRQL <= DISPATCH_LEVEL, the writer holds a spin lock, so a reader can't preempt it on its CPU.
+
+    template<class T>
+    class SeqLock
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "T must be trivially copyable");
+
+    public:
+        SeqLock() noexcept(std::is_nothrow_default_constructible_v<T>) = default;
+
+        explicit SeqLock(const T& value) noexcept : m_value(value)
+        {
+        }
+
+        SeqLock(const SeqLock&) = delete;
+        SeqLock& operator=(const SeqLock&) = delete;
+
+        _IRQL_requires_max_(DISPATCH_LEVEL)
+        T read() const noexcept
+        {
+            for (;;)
+            {
+                const LONG sequence = ReadAcquire(&m_sequence);
+                if (sequence & 1)
+                {
+                    YieldProcessor();
+                    continue;
+                }
+
+                // The copy may be torn if a writer runs concurrently, it's discarded then
+                T value;
+                RtlCopyMemory(&value, const_cast<const T*>(&m_value), sizeof(T));
+
+                // Orders the loads of the value before the second load of the counter
+                std::atomic_thread_fence(std::memory_order_acquire);
+
+                if (ReadNoFence(&m_sequence) == sequence)
+                {
+                    return value;
+                }
+            }
+        }
+
+        _IRQL_requires_max_(DISPATCH_LEVEL)
+        void write(const T& value) noexcept
+        {
+            update([&value](T& current) { current = value; });
+        }
+
+        // Calls updater(T&) with the value while readers are kept out
+        template<class Updater>
+        _IRQL_requires_max_(DISPATCH_LEVEL)
+        void update(Updater&& updater) noexcept
+        {
+            AutoSpinLock guard(m_writerLock);
+
+            // Interlocked operations are full barriers, so the value is written only while the counter is odd
+            InterlockedIncrement(&m_sequence);
+            updater(m_value);
+            InterlockedIncrement(&m_sequence);
+        }
+
+        // The number of completed writes
+        LONG version() const noexcept
+        {
+            return ReadNoFence(&m_sequence) / 2;
+        }
+
+    private:
+        volatile LONG m_sequence = 0;
+        T             m_value = {};
+        SpinLock      m_writerLock;
+    };
+}
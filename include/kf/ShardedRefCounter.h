@@ -0,0 +1,160 @@
+#pragma once
+#include <kf/boost/intrusive_ptr.hpp>
+#include <kf/boost/intrusive_ref_counter.hpp>
+#include <limits>
+
+namespace kf
+{
+    //////////////////////////////////////////////////////////////////////////
+    // ShardedCounterPolicy - counter policy for boost::intrusive_ref_counter for objects that are referenced
+    // from every CPU (for example, per-volume contexts), inspired by percpu_ref of Linux.
+    //
+    // While the object is live, references are counted in kShardCount shards picked by the current CPU,
+    // so references taken on different CPUs don't share a cache line. In this mode the total count is unknown,
+    // so the object is never deleted. Teardown starts with killRef() on the owner's reference: it collapses
+    // the shards into a single count and releases the reference, from then on it's an ordinary counter
+    // and the last release deletes the object.
+    //
+    // Note: the object must have an owner reference that is released by killRef(), use_count() is approximate
+    // before that. The counter takes kShardCount cache lines.
+    //
+    //     struct VolumeContext : boost::intrusive_ref_counter<VolumeContext, kf::ShardedCounterPolicy<>> { ... };
+    //
+    //     boost::intrusive_ptr<VolumeContext> owner(new(NonPagedPoolNx) VolumeContext());
+    //     ...
+    //     kf::killRef(owner); // on volume detach
+
+    template<size_t kShardCount = 16>
+    struct ShardedCounterPolicy
+    {
+        static_assert(kShardCount > 0, "kShardCount must be greater than 0");
+
+        class type
+        {
+        public:
+            type(int) noexcept
+            {
+            }
+
+            type(const type&) = delete;
+            type& operator=(const type&) = delete;
+
+        private:
+            friend struct ShardedCounterPolicy;
+
+            // A shard keeps a signed 32-bit count in the low part and kCollapsed in the high part,
+            // the padding keeps counts of different shards in different cache lines
+            struct Shard
+            {
+                volatile LONG64 value = 0;
+                char padding[SYSTEM_CACHE_ALIGNMENT_SIZE - sizeof(LONG64)];
+            };
+
+            Shard m_shards[kShardCount];
+            volatile LONG m_count = 0;
+            volatile LONG m_collapsed = 0;
+        };
+
+        static unsigned int load(const type& counter) noexcept
+        {
+            if (ReadNoFence(&counter.m_collapsed))
+            {
+                return static_cast<unsigned int>(ReadNoFence(&counter.m_count));
+            }
+
+            LONG count = 0;
+
+            for (const auto& shard : counter.m_shards)
+            {
+                count += shardCount(ReadNoFence64(&shard.value));
+            }
+
+            return static_cast<unsigned int>(count);
+        }
+
+        static void increment(type& counter) noexcept
+        {
+            if (!updateShard(counter, 1))
+            {
+                InterlockedIncrementNoFence(&counter.m_count);
+            }
+        }
+
+        static unsigned int decrement(type& counter) noexcept
+        {
+            if (updateShard(counter, -1))
+            {
+                // The total is unknown until the counter is collapsed, so the object stays alive
+                return 1;
+            }
+
+            return static_cast<unsigned int>(InterlockedDecrement(&counter.m_count));
+        }
+
+        // Moves shard counts to the single count. The bias keeps the count above zero while shards are added,
+        // so a concurrent release can't see a transient zero.
+        static void collapse(type& counter) noexcept
+        {
+            if (InterlockedExchange(&counter.m_collapsed, 1))
+            {
+                return;
+            }
+
+            InterlockedAdd(&counter.m_count, kCollapseBias);
+
+            for (auto& shard : counter.m_shards)
+            {
+                // A shard with kCollapsed is never updated again, updates go to the single count
+                const LONG64 value = InterlockedOr64(&shard.value, kCollapsed);
+                InterlockedAdd(&counter.m_count, shardCount(value));
+            }
+
+            InterlockedAdd(&counter.m_count, -kCollapseBias);
+        }
+
+    private:
+        static constexpr LONG64 kCollapsed = 1LL << 32;
+        static constexpr LONG kCollapseBias = std::numeric_limits<LONG>::max() / 2;
+
+        static LONG shardCount(LONG64 value) noexcept
+        {
+            return static_cast<LONG>(static_cast<ULONG>(value));
+        }
+
+        static bool updateShard(type& counter, LONG delta) noexcept
+        {
+            auto& shard = counter.m_shards[::KeGetCurrentProcessorNumberEx(nullptr) % kShardCount];
+
+            for (LONG64 value = ReadNoFence64(&shard.value);;)
+            {
+                if (value & kCollapsed)
+                {
+                    return false;
+                }
+
+                const LONG64 newValue = static_cast<LONG64>(static_cast<ULONG>(shardCount(value) + delta));
+                const LONG64 previous = InterlockedCompareExchange64(&shard.value, newValue, value);
+                if (previous == value)
+                {
+                    return true;
+                }
+
+                value = previous;
+            }
+        }
+    };
+
+    //////////////////////////////////////////////////////////////////////////
+    // killRef - starts teardown of an object counted by ShardedCounterPolicy: collapses its counter
+    // and releases the owner's reference. The object is deleted when the last reference is released.
+
+    template<class T>
+    void killRef(_Inout_ boost::intrusive_ptr<T>& owner) noexcept
+    {
+        if (owner)
+        {
+            intrusive_ptr_collapse(owner.get());
+            owner.reset();
+        }
+    }
+}
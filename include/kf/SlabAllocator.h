@@ -0,0 +1,486 @@
+#pragma once
+#include <kf/stl/new>
+#include <algorithm>
+#include <limits>
+#include <span>
+#include <utility>
+
+namespace kf
+{
+    //////////////////////////////////////////////////////////////////////////
+    // SlabAllocator - size-class object cache for hot allocation sizes (context structs, path buffers, list nodes),
+    // inspired by "Magazines and Vmem" by J. Bonwick and J. Adams.
+    //
+    // Every size class has per-CPU caches of two magazines (fixed-size stacks of free objects) and a shared depot
+    // of magazines protected by a spin lock. Allocation and deallocation pop/push a magazine of the current CPU
+    // at DISPATCH_LEVEL without locks or interlocked operations, the depot is locked only to exchange a whole
+    // magazine. When the caches are empty objects are allocated from the pool one by one (with their own pool tag),
+    // when the depot is full freed objects are returned to the pool. Sizes larger than the largest class
+    // always go to the pool.
+    //
+    // Use SlabAllocatorRef<T> for kf::vector, kf::map, UString and VariableSizeStruct (it's a drop-in replacement
+    // for kf::Allocator), and SlabAllocatorNodeRef for GenericTableAvl, TreeMap, TreeSet and LinkedTreeMap.
+    //
+    // Note: allocate/deallocate can be called at IRQL <= DISPATCH_LEVEL for non-paged pool types
+    // and at IRQL <= APC_LEVEL for paged ones. The allocator must outlive all allocated objects.
+
+    class SlabAllocator
+    {
+    public:
+        static constexpr size_t kMaxSizeClasses = 8;
+        static constexpr size_t kMagazineSize = 15;
+        static constexpr size_t kDefaultSizeClasses[] = { 32, 64, 128, 256, 512 };
+
+        explicit SlabAllocator(POOL_TYPE poolType, ULONG poolTag = 'blS+') noexcept : m_poolType(poolType), m_poolTag(poolTag)
+        {
+        }
+
+        ~SlabAllocator()
+        {
+            release();
+        }
+
+        SlabAllocator(const SlabAllocator&) = delete;
+        SlabAllocator& operator=(const SlabAllocator&) = delete;
+
+        // Size classes must be ascending. depotMagazines is the number of magazines in the depot of every
+        // size class, 0 means one per CPU.
+        _IRQL_requires_max_(APC_LEVEL)
+        NTSTATUS initialize(std::span<const size_t> sizeClasses = kDefaultSizeClasses, size_t depotMagazines = 0) noexcept
+        {
+            ASSERT(!m_cpuCaches);
+
+            if (sizeClasses.empty() || sizeClasses.size() > kMaxSizeClasses || !std::is_sorted(sizeClasses.begin(), sizeClasses.end())
+                || sizeClasses.front() == 0 || std::adjacent_find(sizeClasses.begin(), sizeClasses.end()) != sizeClasses.end())
+            {
+                return STATUS_INVALID_PARAMETER;
+            }
+
+            const size_t classCount = sizeClasses.size();
+            const ULONG cpuCount = ::KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS);
+
+            if (!depotMagazines)
+            {
+                depotMagazines = cpuCount;
+            }
+
+            // Per-CPU caches are touched at DISPATCH_LEVEL, so they are always non-paged whatever the object pool is.
+            // The pool aligns only on MEMORY_ALLOCATION_ALIGNMENT, so the caches are aligned on a cache line by hand.
+            const size_t cacheCount = cpuCount * classCount;
+            void* cacheBuffer = operator new(cacheCount * sizeof(CpuCache) + SYSTEM_CACHE_ALIGNMENT_SIZE, NonPagedPoolNx);
+            if (!cacheBuffer)
+            {
+                return STATUS_INSUFFICIENT_RESOURCES;
+            }
+
+            const size_t magazinesPerClass = 2 * cpuCount + depotMagazines;
+            auto magazines = static_cast<Magazine*>(operator new(classCount * magazinesPerClass * sizeof(Magazine), NonPagedPoolNx));
+            if (!magazines)
+            {
+                operator delete(cacheBuffer);
+                return STATUS_INSUFFICIENT_RESOURCES;
+            }
+
+            // The allocator is usable only when both allocations succeeded: sizeClassOf() maps sizes to classes
+            // by m_classCount, which stays 0 until then
+            m_cpuCount = cpuCount;
+            m_cacheBuffer = cacheBuffer;
+            m_cpuCaches = reinterpret_cast<CpuCache*>(ALIGN_UP_POINTER_BY(cacheBuffer, SYSTEM_CACHE_ALIGNMENT_SIZE));
+            m_magazines = magazines;
+            m_classCount = classCount;
+            std::copy(sizeClasses.begin(), sizeClasses.end(), m_sizeClasses);
+
+            Magazine* magazine = m_magazines;
+
+            for (size_t cls = 0; cls < m_classCount; ++cls)
+            {
+                for (ULONG cpu = 0; cpu < m_cpuCount; ++cpu)
+                {
+                    CpuCache& cache = cpuCache(cpu, cls);
+                    cache.loaded = initMagazine(magazine++);
+                    cache.previous = initMagazine(magazine++);
+                }
+
+                Depot& depot = m_depots[cls];
+                ::KeInitializeSpinLock(&depot.lock);
+                depot.full = nullptr;
+                depot.empty = nullptr;
+
+                for (size_t i = 0; i < depotMagazines; ++i)
+                {
+                    Magazine* empty = initMagazine(magazine++);
+                    empty->next = depot.empty;
+                    depot.empty = empty;
+                }
+            }
+
+            return STATUS_SUCCESS;
+        }
+
+        _Must_inspect_result_
+        void* allocate(_In_ size_t size) noexcept
+        {
+            const size_t cls = sizeClassOf(size);
+            if (cls == kNoSizeClass)
+            {
+                return allocateFromPool(size);
+            }
+
+            if (void* object = allocateFromCache(cls))
+            {
+                return object;
+            }
+
+            return allocateFromPool(m_sizeClasses[cls]);
+        }
+
+        // size must be the same as passed to allocate
+        void deallocate(_In_opt_ void* object, _In_ size_t size) noexcept
+        {
+            if (!object)
+            {
+                return;
+            }
+
+            const size_t cls = sizeClassOf(size);
+            if (cls != kNoSizeClass && deallocateToCache(cls, object))
+            {
+                return;
+            }
+
+            freeToPool(object);
+        }
+
+        // Returns objects cached in the depot to the pool. Objects in per-CPU magazines stay cached.
+        _IRQL_requires_max_(APC_LEVEL)
+        void trim() noexcept
+        {
+            for (size_t cls = 0; cls < m_classCount; ++cls)
+            {
+                Depot& depot = m_depots[cls];
+
+                KIRQL oldIrql;
+                ::KeAcquireSpinLock(&depot.lock, &oldIrql);
+                Magazine* full = std::exchange(depot.full, nullptr);
+                ::KeReleaseSpinLock(&depot.lock, oldIrql);
+
+                if (!full)
+                {
+                    continue;
+                }
+
+                Magazine* last = full;
+
+                for (Magazine* magazine = full; magazine; magazine = magazine->next)
+                {
+                    freeObjects(magazine);
+                    last = magazine;
+                }
+
+                ::KeAcquireSpinLock(&depot.lock, &oldIrql);
+                last->next = depot.empty;
+                depot.empty = full;
+                ::KeReleaseSpinLock(&depot.lock, oldIrql);
+            }
+        }
+
+        size_t sizeClassCount() const noexcept
+        {
+            return m_classCount;
+        }
+
+        size_t sizeClass(size_t index) const noexcept
+        {
+            ASSERT(index < m_classCount);
+            return m_sizeClasses[index];
+        }
+
+        POOL_TYPE poolType() const noexcept
+        {
+            return m_poolType;
+        }
+
+    private:
+        static constexpr size_t kNoSizeClass = std::numeric_limits<size_t>::max();
+
+        struct Magazine
+        {
+            Magazine* next;
+            size_t count;
+            void* objects[kMagazineSize];
+        };
+
+        // Only the owning CPU accesses its cache, the padding prevents false sharing with other CPUs
+        struct CpuCache
+        {
+            Magazine* loaded;
+            Magazine* previous; // always full or empty
+            char padding[SYSTEM_CACHE_ALIGNMENT_SIZE - 2 * sizeof(Magazine*)];
+        };
+
+        static_assert(sizeof(CpuCache) == SYSTEM_CACHE_ALIGNMENT_SIZE, "A CPU cache must take one cache line");
+
+        struct Depot
+        {
+            KSPIN_LOCK lock;
+            Magazine* full;
+            Magazine* empty;
+        };
+
+        size_t sizeClassOf(size_t size) const noexcept
+        {
+            const auto it = std::lower_bound(m_sizeClasses, m_sizeClasses + m_classCount, size);
+            return it == m_sizeClasses + m_classCount ? kNoSizeClass : static_cast<size_t>(it - m_sizeClasses);
+        }
+
+        CpuCache& cpuCache(ULONG cpu, size_t cls) noexcept
+        {
+            return m_cpuCaches[cpu * m_classCount + cls];
+        }
+
+        void* allocateFromCache(size_t cls) noexcept
+        {
+            void* object = nullptr;
+
+            // The thread can't be preempted at DISPATCH_LEVEL, so the cache of the current CPU is used exclusively
+            const KIRQL oldIrql = ::KeRaiseIrqlToDpcLevel();
+            CpuCache& cache = cpuCache(::KeGetCurrentProcessorNumberEx(nullptr), cls);
+
+            if (!cache.loaded->count)
+            {
+                if (cache.previous->count)
+                {
+                    std::swap(cache.loaded, cache.previous);
+                }
+                else
+                {
+                    // Both are empty: give one back to the depot and load a full one
+                    Depot& depot = m_depots[cls];
+                    ::KeAcquireSpinLockAtDpcLevel(&depot.lock);
+
+                    if (Magazine* full = depot.full)
+                    {
+                        depot.full = full->next;
+
+                        cache.previous->next = depot.empty;
+                        depot.empty = cache.previous;
+
+                        cache.previous = cache.loaded;
+                        cache.loaded = full;
+                    }
+
+                    ::KeReleaseSpinLockFromDpcLevel(&depot.lock);
+                }
+            }
+
+            if (cache.loaded->count)
+            {
+                object = cache.loaded->objects[--cache.loaded->count];
+            }
+
+            ::KeLowerIrql(oldIrql);
+
+            return object;
+        }
+
+        bool deallocateToCache(size_t cls, void* object) noexcept
+        {
+            bool cached = false;
+
+            const KIRQL oldIrql = ::KeRaiseIrqlToDpcLevel();
+            CpuCache& cache = cpuCache(::KeGetCurrentProcessorNumberEx(nullptr), cls);
+
+            if (cache.loaded->count == kMagazineSize)
+            {
+                if (!cache.previous->count)
+                {
+                    std::swap(cache.loaded, cache.previous);
+                }
+                else
+                {
+                    // Both are full: give one to the depot and load an empty one
+                    Depot& depot = m_depots[cls];
+                    ::KeAcquireSpinLockAtDpcLevel(&depot.lock);
+
+                    if (Magazine* empty = depot.empty)
+                    {
+                        depot.empty = empty->next;
+
+                        cache.previous->next = depot.full;
+                        depot.full = cache.previous;
+
+                        cache.previous = cache.loaded;
+                        cache.loaded = empty;
+                    }
+
+                    ::KeReleaseSpinLockFromDpcLevel(&depot.lock);
+                }
+            }
+
+            if (cache.loaded->count < kMagazineSize)
+            {
+                cache.loaded->objects[cache.loaded->count++] = object;
+                cached = true;
+            }
+
+            ::KeLowerIrql(oldIrql);
+
+            return cached;
+        }
+
+        void* allocateFromPool(size_t size) noexcept
+        {
+// 28160: Must succeed pool allocations are forbidden. Allocation failures cause a system crash.
+// 4996: ExAllocatePoolWithTag is deprecated, use ExAllocatePool2
+#pragma warning(suppress: 28160 4996)
+            return ::ExAllocatePoolWithTag(m_poolType, size ? size : 1, m_poolTag);
+        }
+
+        void freeToPool(void* object) noexcept
+        {
+            ::ExFreePoolWithTag(object, m_poolTag);
+        }
+
+        void freeObjects(Magazine* magazine) noexcept
+        {
+            for (size_t i = 0; i < magazine->count; ++i)
+            {
+                freeToPool(magazine->objects[i]);
+            }
+
+            magazine->count = 0;
+        }
+
+        static Magazine* initMagazine(Magazine* magazine) noexcept
+        {
+            magazine->next = nullptr;
+            magazine->count = 0;
+
+            return magazine;
+        }
+
+        void release() noexcept
+        {
+            if (m_cpuCaches && m_magazines)
+            {
+                for (size_t cls = 0; cls < m_classCount; ++cls)
+                {
+                    for (ULONG cpu = 0; cpu < m_cpuCount; ++cpu)
+                    {
+                        freeObjects(cpuCache(cpu, cls).loaded);
+                        freeObjects(cpuCache(cpu, cls).previous);
+                    }
+
+                    for (Magazine* magazine = m_depots[cls].full; magazine; magazine = magazine->next)
+                    {
+                        freeObjects(magazine);
+                    }
+                }
+            }
+
+            operator delete(std::exchange(m_magazines, nullptr));
+            operator delete(std::exchange(m_cacheBuffer, nullptr));
+
+            m_cpuCaches = nullptr;
+            m_classCount = 0;
+        }
+
+    private:
+        POOL_TYPE   m_poolType;
+        ULONG       m_poolTag;
+        ULONG       m_cpuCount = 0;
+        size_t      m_classCount = 0;
+        size_t      m_sizeClasses[kMaxSizeClasses] = {};
+        Depot       m_depots[kMaxSizeClasses] = {};
+        void*       m_cacheBuffer = nullptr;
+        CpuCache*   m_cpuCaches = nullptr; // m_cacheBuffer aligned on a cache line
+        Magazine*   m_magazines = nullptr;
+    };
+
+    //////////////////////////////////////////////////////////////////////////
+    // SlabAllocatorRef - allocator for kf::vector, kf::map, UString, VariableSizeStruct and other containers
+    // that allocates from a SlabAllocator. Copies and rebinds refer to the same SlabAllocator.
+
+    template<class T>
+    class SlabAllocatorRef
+    {
+    public:
+        static_assert(!std::is_const_v<T>, "The C++ Standard forbids containers of const elements because allocator<const T> is ill-formed.");
+        static_assert(alignof(T) <= MEMORY_ALLOCATION_ALIGNMENT, "Pool allocations are not aligned enough");
+
+        using value_type = T;
+        using size_type = size_t;
+        using difference_type = ptrdiff_t;
+        using propagate_on_container_move_assignment = std::true_type;
+        using propagate_on_container_swap = std::true_type;
+
+        explicit SlabAllocatorRef(_In_ SlabAllocator& slab) noexcept : m_slab(&slab)
+        {
+        }
+
+        template<class U>
+        SlabAllocatorRef(const SlabAllocatorRef<U>& other) noexcept : m_slab(other.slab())
+        {
+        }
+
+        [[nodiscard]] T* allocate(const size_t count) noexcept
+        {
+            if (count > std::numeric_limits<size_t>::max() / sizeof(T))
+            {
+                return nullptr;
+            }
+
+            return static_cast<T*>(m_slab->allocate(count * sizeof(T)));
+        }
+
+        void deallocate(T* const p, const size_t count) noexcept
+        {
+            m_slab->deallocate(p, count * sizeof(T));
+        }
+
+        SlabAllocator* slab() const noexcept
+        {
+            return m_slab;
+        }
+
+    private:
+        SlabAllocator* m_slab;
+    };
+
+    template<class T, class U>
+    bool operator==(const SlabAllocatorRef<T>& left, const SlabAllocatorRef<U>& right) noexcept
+    {
+        return left.slab() == right.slab();
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // SlabAllocatorNodeRef - node allocator for tree containers (GenericTableAvl, TreeMap, TreeSet, LinkedTreeMap)
+    // that allocates from a SlabAllocator. A table allocates nodes of the same size, so it's remembered
+    // to return nodes to the right size class.
+
+    class SlabAllocatorNodeRef
+    {
+    public:
+        explicit SlabAllocatorNodeRef(_In_ SlabAllocator& slab) noexcept : m_slab(&slab)
+        {
+        }
+
+        _Must_inspect_result_
+        void* allocate(_In_ size_t byteSize) noexcept
+        {
+            ASSERT(!m_nodeSize || m_nodeSize == byteSize);
+            m_nodeSize = byteSize;
+
+            return m_slab->allocate(byteSize);
+        }
+
+        void deallocate(_In_ void* node) noexcept
+        {
+            m_slab->deallocate(node, m_nodeSize);
+        }
+
+    private:
+        SlabAllocator*  m_slab;
+        size_t          m_nodeSize = 0;
+    };
+}
@@ -0,0 +1,186 @@
+#pragma once
+#include <kf/stl/new>
+#include <utility>
+
+namespace kf
+{
+    //////////////////////////////////////////////////////////////////////////
+    // SlabNodeAllocator - node allocator for tree containers (GenericTableAvl, TreeMap, TreeSet, LinkedTreeMap).
+    //
+    // All nodes of one table have the same size, so instead of a pool allocation per node
+    // the allocator carves nodes from chunks of kNodesPerChunk nodes and keeps released nodes
+    // in a free list for reuse. Chunks are returned to the pool by trim() or on destruction.
+    //
+    // Note: the allocator belongs to a single table and is not synchronized, it relies on
+    // the same external synchronization as the table itself.
+
+    template<POOL_TYPE poolType, size_t kNodesPerChunk = 32>
+    class SlabNodeAllocator
+    {
+    public:
+        static_assert(kNodesPerChunk > 0, "kNodesPerChunk must be greater than 0");
+
+        SlabNodeAllocator() noexcept = default;
+
+        SlabNodeAllocator(_Inout_ SlabNodeAllocator&& another) noexcept
+        {
+            moveInit(another);
+        }
+
+        ~SlabNodeAllocator()
+        {
+            release();
+        }
+
+        SlabNodeAllocator& operator=(_Inout_ SlabNodeAllocator&& another) noexcept
+        {
+            if (this != &another)
+            {
+                release();
+                moveInit(another);
+            }
+
+            return *this;
+        }
+
+        SlabNodeAllocator(const SlabNodeAllocator&) = delete;
+        SlabNodeAllocator& operator=(const SlabNodeAllocator&) = delete;
+
+        _Must_inspect_result_
+        void* allocate(_In_ size_t byteSize) noexcept
+        {
+            if (!m_nodeSize)
+            {
+                m_nodeSize = ALIGN_UP_BY(byteSize > sizeof(FreeNode) ? byteSize : sizeof(FreeNode), MEMORY_ALLOCATION_ALIGNMENT);
+            }
+
+            ASSERT(byteSize <= m_nodeSize);
+            if (byteSize > m_nodeSize)
+            {
+                return nullptr;
+            }
+
+            void* node = nullptr;
+
+            if (m_freeList)
+            {
+                node = m_freeList;
+                m_freeList = m_freeList->next;
+            }
+            else
+            {
+                if (m_chunkCursor == m_chunkEnd && !addChunk())
+                {
+                    return nullptr;
+                }
+
+                node = m_chunkCursor;
+                m_chunkCursor += m_nodeSize;
+            }
+
+            ++m_nodeCount;
+            return node;
+        }
+
+        void deallocate(_In_ void* node) noexcept
+        {
+            ASSERT(m_nodeCount > 0);
+
+            auto freeNode = static_cast<FreeNode*>(node);
+            freeNode->next = m_freeList;
+            m_freeList = freeNode;
+
+            --m_nodeCount;
+        }
+
+        // Returns all chunks to the pool if there are no allocated nodes (for example after the table is cleared)
+        void trim() noexcept
+        {
+            if (!m_nodeCount)
+            {
+                release();
+            }
+        }
+
+        size_t nodeCount() const noexcept
+        {
+            return m_nodeCount;
+        }
+
+        size_t chunkCount() const noexcept
+        {
+            size_t count = 0;
+
+            for (auto chunk = m_chunks; chunk; chunk = chunk->next)
+            {
+                ++count;
+            }
+
+            return count;
+        }
+
+    private:
+        struct FreeNode
+        {
+            FreeNode* next;
+        };
+
+        // The padding keeps nodes that follow the header aligned as the pool allocation is
+        struct ChunkHeader
+        {
+            ChunkHeader* next;
+            char padding[MEMORY_ALLOCATION_ALIGNMENT - sizeof(ChunkHeader*)];
+        };
+
+        static_assert(sizeof(ChunkHeader) % MEMORY_ALLOCATION_ALIGNMENT == 0, "Nodes must stay aligned");
+
+        bool addChunk() noexcept
+        {
+            auto chunk = static_cast<ChunkHeader*>(operator new(sizeof(ChunkHeader) + m_nodeSize * kNodesPerChunk, poolType));
+            if (!chunk)
+            {
+                return false;
+            }
+
+            chunk->next = m_chunks;
+            m_chunks = chunk;
+
+            m_chunkCursor = reinterpret_cast<std::byte*>(chunk + 1);
+            m_chunkEnd = m_chunkCursor + m_nodeSize * kNodesPerChunk;
+
+            return true;
+        }
+
+        void release() noexcept
+        {
+            ASSERT(!m_nodeCount);
+
+            while (m_chunks)
+            {
+                operator delete(std::exchange(m_chunks, m_chunks->next));
+            }
+
+            m_freeList = nullptr;
+            m_chunkCursor = nullptr;
+            m_chunkEnd = nullptr;
+        }
+
+        void moveInit(SlabNodeAllocator& another) noexcept
+        {
+            m_chunks = std::exchange(another.m_chunks, nullptr);
+            m_freeList = std::exchange(another.m_freeList, nullptr);
+            m_chunkCursor = std::exchange(another.m_chunkCursor, nullptr);
+            m_chunkEnd = std::exchange(another.m_chunkEnd, nullptr);
+            m_nodeSize = std::exchange(another.m_nodeSize, 0);
+            m_nodeCount = std::exchange(another.m_nodeCount, 0);
+        }
+
+    private:
+        ChunkHeader* m_chunks = nullptr;
+        FreeNode* m_freeList = nullptr;
+        std::byte* m_chunkCursor = nullptr;
+        std::byte* m_chunkEnd = nullptr;
+        size_t m_nodeSize = 0;
+        size_t m_nodeCount = 0;
+    };
+}
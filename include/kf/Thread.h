@@ -1,9 +1,23 @@
 #pragma once
+#include <kf/stl/new>
 #include "ObjectAttributes.h"
 #include "Guard.h"
+#include <optional>
 
 namespace kf
 {
+    //////////////////////////////////////////////////////////////////////////
+    // ThreadOptions - placement and priority of a thread started by Thread::start, unset values keep system defaults
+
+    struct ThreadOptions
+    {
+        // Processor group and processors the thread is allowed to run on, see Numa for helpers
+        std::optional<GROUP_AFFINITY> affinity;
+
+        // Priority from LOW_PRIORITY + 1 to HIGH_PRIORITY
+        std::optional<KPRIORITY> priority;
+    };
+
     class Thread
     {
     public:
@@ -20,10 +34,22 @@ namespace kf
         Thread(const Thread&) = delete;
         Thread& operator=(const Thread&) = delete;
 
-        NTSTATUS start(KSTART_ROUTINE routine, PVOID context)
+        // The options are applied by the new thread itself before it calls the routine, so the routine runs
+        // with its placement and priority from the first instruction
+        NTSTATUS start(KSTART_ROUTINE routine, PVOID context, const ThreadOptions& options = {})
         {
             ASSERT(!m_threadObject);
 
+            StartContext* startContext = nullptr;
+            if (options.affinity || options.priority)
+            {
+                startContext = new(NonPagedPoolNx) StartContext{ routine, context, options };
+                if (!startContext)
+                {
+                    return STATUS_INSUFFICIENT_RESOURCES;
+                }
+            }
+
             ObjectAttributes oa;
 
             Guard::Handle threadHandle;
@@ -32,20 +58,16 @@ namespace kf
                 &oa,
                 nullptr,
                 nullptr,
-                routine,
-                context);
-            if (!NT_SUCCESS(status))
-            {
-                return status;
-            }
-
-            status = ObReferenceObjectByHandle(threadHandle, THREAD_ALL_ACCESS, *PsThreadType, KernelMode, reinterpret_cast<PVOID*>(&m_threadObject.get()), nullptr);
+                startContext ? &startWithOptions : routine,
+                startContext ? startContext : context);
             if (!NT_SUCCESS(status))
             {
+                delete startContext;
                 return status;
             }
 
-            return status;
+            // The running thread owns the start context
+            return ObReferenceObjectByHandle(threadHandle, THREAD_ALL_ACCESS, *PsThreadType, KernelMode, reinterpret_cast<PVOID*>(&m_threadObject.get()), nullptr);
         }
 
         // routine sould be NTSTATUS (T::*)()
@@ -64,6 +86,34 @@ namespace kf
             }
         }
 
+    private:
+        struct StartContext
+        {
+            KSTART_ROUTINE* routine;
+            PVOID context;
+            ThreadOptions options;
+        };
+
+        static void startWithOptions(PVOID rawStartContext)
+        {
+            auto startContext = static_cast<StartContext*>(rawStartContext);
+            const StartContext start = *startContext;
+            delete startContext;
+
+            if (start.options.affinity)
+            {
+                GROUP_AFFINITY affinity = *start.options.affinity;
+                KeSetSystemGroupAffinityThread(&affinity, nullptr);
+            }
+
+            if (start.options.priority)
+            {
+                KeSetPriorityThread(KeGetCurrentThread(), *start.options.priority);
+            }
+
+            start.routine(start.context);
+        }
+
     private:
         Guard::EThread m_threadObject;
     };
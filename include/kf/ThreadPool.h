@@ -1,33 +1,247 @@
 #pragma once
 #include "Thread.h"
+#include "Latch.h"
+#include "Semaphore.h"
+#include "SpinLock.h"
+#include "AutoSpinLock.h"
+#include "Numa.h"
+#include "PoolTask.h"
+#include <kf/stl/new>
+#include <algorithm>
+#include <bit>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
 
 namespace kf
 {
-    template<int kMaxCount = 64>
+    namespace detail
+    {
+        //////////////////////////////////////////////////////////////////////////
+        // WorkStealingDeque - bounded Chase-Lev deque of tasks (Le et al., "Correct and Efficient Work-Stealing
+        // for Weak Memory Models").
+        //
+        // The owner worker pushes and pops tasks at the bottom without locks, other workers steal the oldest task
+        // from the top with a single CAS. A thief copies the task before the CAS and drops the copy if it loses,
+        // so tasks are trivially copyable PoolTasks.
+
+        template<size_t kCapacity>
+        class WorkStealingDeque
+        {
+        public:
+            static_assert(std::has_single_bit(kCapacity), "kCapacity must be a power of two");
+
+            WorkStealingDeque() noexcept = default;
+
+            WorkStealingDeque(const WorkStealingDeque&) = delete;
+            WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+            // Owner only, returns false if the deque is full
+            bool push(const PoolTask& task) noexcept
+            {
+                const LONG64 bottom = ReadNoFence64(&m_bottom);
+                const LONG64 top = ReadAcquire64(&m_top);
+                if (bottom - top >= static_cast<LONG64>(kCapacity))
+                {
+                    return false;
+                }
+
+                m_tasks[bottom & kMask] = task;
+                WriteRelease64(&m_bottom, bottom + 1);
+                return true;
+            }
+
+            // Owner only, takes the newest task
+            bool pop(PoolTask& task) noexcept
+            {
+                const LONG64 bottom = ReadNoFence64(&m_bottom) - 1;
+
+                // The full barrier makes the reservation visible to thieves before top is read
+                InterlockedExchange64(&m_bottom, bottom);
+                const LONG64 top = ReadNoFence64(&m_top);
+
+                if (top > bottom)
+                {
+                    WriteNoFence64(&m_bottom, bottom + 1);
+                    return false;
+                }
+
+                task = m_tasks[bottom & kMask];
+                if (top < bottom)
+                {
+                    return true;
+                }
+
+                // The last task, race with thieves for it
+                const bool taken = InterlockedCompareExchange64(&m_top, top + 1, top) == top;
+                WriteNoFence64(&m_bottom, bottom + 1);
+                return taken;
+            }
+
+            // Any thread, takes the oldest task. Returns false if the deque is empty or another thread took the task.
+            bool steal(PoolTask& task) noexcept
+            {
+                const LONG64 top = ReadAcquire64(&m_top);
+                KeMemoryBarrier();
+                const LONG64 bottom = ReadAcquire64(&m_bottom);
+
+                if (top >= bottom)
+                {
+                    return false;
+                }
+
+                task = m_tasks[top & kMask];
+                return InterlockedCompareExchange64(&m_top, top + 1, top) == top;
+            }
+
+            bool empty() const noexcept
+            {
+                return ReadNoFence64(&m_top) >= ReadNoFence64(&m_bottom);
+            }
+
+        private:
+            static constexpr LONG64 kMask = kCapacity - 1;
+
+            // Thieves update top and the owner updates bottom, keep them in different cache lines
+            volatile LONG64 m_top = 0;
+            char            m_padding[SYSTEM_CACHE_ALIGNMENT_SIZE - sizeof(LONG64)];
+            volatile LONG64 m_bottom = 0;
+            PoolTask        m_tasks[kCapacity];
+        };
+
+        //////////////////////////////////////////////////////////////////////////
+        // TaskQueue - bounded FIFO of tasks under a spin lock, receives tasks submitted by non-worker threads
+
+        template<size_t kCapacity>
+        class TaskQueue
+        {
+        public:
+            TaskQueue() noexcept = default;
+
+            TaskQueue(const TaskQueue&) = delete;
+            TaskQueue& operator=(const TaskQueue&) = delete;
+
+            bool push(const PoolTask& task) noexcept
+            {
+                AutoSpinLock lock(m_lock);
+
+                if (m_count == kCapacity)
+                {
+                    return false;
+                }
+
+                m_tasks[(m_head + m_count) % kCapacity] = task;
+                WriteNoFence64(&m_count, m_count + 1);
+                return true;
+            }
+
+            bool pop(PoolTask& task) noexcept
+            {
+                // Idle workers poll the queue, don't take the lock if it's empty
+                if (!ReadNoFence64(&m_count))
+                {
+                    return false;
+                }
+
+                AutoSpinLock lock(m_lock);
+
+                if (!m_count)
+                {
+                    return false;
+                }
+
+                task = m_tasks[m_head];
+                m_head = (m_head + 1) % kCapacity;
+                WriteNoFence64(&m_count, m_count - 1);
+                return true;
+            }
+
+        private:
+            SpinLock        m_lock;
+            size_t          m_head = 0;
+            volatile LONG64 m_count = 0;
+            PoolTask        m_tasks[kCapacity];
+        };
+    }
+
+
+    //////////////////////////////////////////////////////////////////////////
+    // ThreadPoolOptions - size, placement and priority of ThreadPool threads
+
+    enum class ThreadPlacement
+    {
+        // The system schedules threads on any processor
+        None,
+        // Thread i runs on processor i % processor count
+        Processor,
+        // Thread i runs on any processor of the node of processor i % processor count
+        Node,
+    };
+
+    struct ThreadPoolOptions
+    {
+        // 0 means one thread per active processor
+        int count = 0;
+        ThreadPlacement placement = ThreadPlacement::None;
+        std::optional<KPRIORITY> priority;
+    };
+
+    //////////////////////////////////////////////////////////////////////////
+    // ThreadPool - system threads that either run the same routine (start(routine, context))
+    // or execute submitted tasks (start()).
+    //
+    // In the executor mode every worker owns a work-stealing deque: tasks submitted by a worker go to its deque,
+    // tasks submitted by other threads go to a shared queue, idle workers steal from each other and sleep
+    // on a semaphore when there is no work. parallel_for/parallel_reduce split a range into chunks that are
+    // processed by the workers and the calling thread, for example to hash a large file on all CPUs:
+    //
+    //     kf::ThreadPool pool({ .placement = kf::ThreadPlacement::Processor });
+    //     pool.start();
+    //     pool.parallel_for(0, blockCount, 16, [&](size_t first, size_t last) { hashBlocks(first, last); });
+    //
+    // With a placement the deque of a worker is allocated from the NUMA node of its processor.
+    //
+    // Note: join() (or the destructor) executes the remaining tasks before the workers exit.
+
     class ThreadPool
     {
     public:
-        ThreadPool(int count) : m_count(min(count, kMaxCount))
+        static constexpr size_t kDequeCapacity = 256;
+        static constexpr size_t kQueueCapacity = 1024;
+
+        ThreadPool(int count = 0) : ThreadPool(ThreadPoolOptions{ .count = count })
         {
         }
 
-        ThreadPool(ThreadPool&&) = default;
+        explicit ThreadPool(const ThreadPoolOptions& options)
+            : m_options(options)
+            , m_count(options.count > 0 ? options.count : static_cast<int>(Numa::processorCount()))
+            , m_wakeup(0, MAXLONG)
+        {
+        }
 
         ~ThreadPool()
         {
             join();
         }
 
-        ThreadPool& operator=(ThreadPool&&) = default;
-
+        // Workers refer to the pool, so it can't be moved
         ThreadPool(const ThreadPool&) = delete;
         ThreadPool& operator=(const ThreadPool&) = delete;
 
+        _IRQL_requires_max_(PASSIVE_LEVEL)
         NTSTATUS start(KSTART_ROUTINE routine, PVOID context)
         {
+            NTSTATUS status = allocateThreads();
+            if (!NT_SUCCESS(status))
+            {
+                return status;
+            }
+
             for (int i = 0; i < m_count; ++i)
             {
-                NTSTATUS status = m_threads[i].start(routine, context);
+                status = m_threads[i].start(routine, context, threadOptions(i));
                 if (!NT_SUCCESS(status))
                 {
                     return status;
@@ -44,16 +258,452 @@ namespace kf
             return start([](PVOID context) { PsTerminateSystemThread((static_cast<T*>(context)->*routine)()); }, obj);
         }
 
+        // Starts workers that execute submitted tasks
+        _IRQL_requires_max_(PASSIVE_LEVEL)
+        NTSTATUS start()
+        {
+            ASSERT(!m_queue);
+
+            NTSTATUS status = allocateThreads();
+            if (!NT_SUCCESS(status))
+            {
+                return status;
+            }
+
+            m_queue = new(NonPagedPoolNx) Queue();
+            m_workers = static_cast<Worker**>(operator new(sizeof(Worker*) * m_count, NonPagedPoolNx));
+            m_workerThreads = static_cast<PVOID volatile*>(operator new(sizeof(PVOID) * m_count, NonPagedPoolNx));
+            if (!m_queue || !m_workers || !m_workerThreads)
+            {
+                join();
+                return STATUS_INSUFFICIENT_RESOURCES;
+            }
+
+            RtlZeroMemory(m_workers, sizeof(Worker*) * m_count);
+            RtlZeroMemory(const_cast<PVOID*>(m_workerThreads), sizeof(PVOID) * m_count);
+
+            for (int i = 0; i < m_count; ++i)
+            {
+                void* memory = m_options.placement == ThreadPlacement::None
+                    ? operator new(sizeof(Worker), NonPagedPoolNx)
+                    : Numa::allocate(NonPagedPoolNx, sizeof(Worker), 'n++C', Numa::nodeOfProcessor(processorOf(i)));
+                if (!memory)
+                {
+                    join();
+                    return STATUS_INSUFFICIENT_RESOURCES;
+                }
+
+                m_workers[i] = new(memory) Worker(this, i);
+            }
+
+            for (int i = 0; i < m_count; ++i)
+            {
+                status = m_threads[i].start(&workerRoutine, m_workers[i], threadOptions(i));
+                if (!NT_SUCCESS(status))
+                {
+                    join();
+                    return status;
+                }
+            }
+
+            return STATUS_SUCCESS;
+        }
+
         void join()
         {
+            if (m_queue)
+            {
+                InterlockedExchange(&m_stopping, 1);
+                m_wakeup.release(m_count);
+            }
+
+            if (m_threads)
+            {
+                for (int i = 0; i < m_count; ++i)
+                {
+                    m_threads[i].~Thread();
+                }
+
+                operator delete(std::exchange(m_threads, nullptr));
+            }
+
+            if (m_workers)
+            {
+                for (int i = 0; i < m_count; ++i)
+                {
+                    delete m_workers[i];
+                }
+
+                operator delete(std::exchange(m_workers, nullptr));
+            }
+
+            operator delete(const_cast<PVOID*>(std::exchange(m_workerThreads, nullptr)));
+
+            delete std::exchange(m_queue, nullptr);
+            m_stopping = 0;
+        }
+
+        int count() const
+        {
+            return m_count;
+        }
+
+        // Queues callable for execution by a worker. Returns STATUS_INSUFFICIENT_RESOURCES if the queue is full
+        // and STATUS_INVALID_DEVICE_STATE if the pool is not started with start().
+        template<class F>
+        _IRQL_requires_max_(DISPATCH_LEVEL)
+        NTSTATUS submit(F&& callable) noexcept
+        {
+            if (!m_queue)
+            {
+                return STATUS_INVALID_DEVICE_STATE;
+            }
+
+            detail::PoolTask task;
+            if (!task.assign<NonPagedPoolNx>(std::forward<F>(callable)))
+            {
+                return STATUS_INSUFFICIENT_RESOURCES;
+            }
+
+            if (!push(task))
+            {
+                task.discard();
+                return STATUS_INSUFFICIENT_RESOURCES;
+            }
+
+            return STATUS_SUCCESS;
+        }
+
+        // Calls fn(first, last) for chunks of at most grain items of [begin, end) on the workers
+        // and the calling thread, returns when all chunks are processed
+        template<class F>
+        _IRQL_requires_max_(APC_LEVEL)
+        void parallel_for(size_t begin, size_t end, size_t grain, F&& fn)
+        {
+            if (begin >= end)
+            {
+                return;
+            }
+
+            ChunkRange range(begin, end, grain);
+
+            run(range.participantCount(m_count), [&](int)
+            {
+                for (size_t first, last; range.next(first, last);)
+                {
+                    fn(first, last);
+                }
+            });
+        }
+
+        // Returns reduce(...reduce(identity, map(first, last))...) over chunks of at most grain items of [begin, end).
+        // Chunks are distributed dynamically, so reduce must be associative and commutative.
+        template<class T, class Map, class Reduce>
+        _IRQL_requires_max_(APC_LEVEL)
+        T parallel_reduce(size_t begin, size_t end, size_t grain, T identity, Map&& map, Reduce&& reduce)
+        {
+            static_assert(alignof(T) <= MEMORY_ALLOCATION_ALIGNMENT, "Pool allocations are not aligned enough");
+
+            if (begin >= end)
+            {
+                return identity;
+            }
+
+            ChunkRange range(begin, end, grain);
+            int participantCount = range.participantCount(m_count);
+
+            // A partial result per participant, if there is no memory for them the calling thread does all the work
+            T local(identity);
+            T* partials = participantCount > 1 ? static_cast<T*>(operator new(sizeof(T) * participantCount, NonPagedPoolNx)) : nullptr;
+            if (partials)
+            {
+                for (int i = 0; i < participantCount; ++i)
+                {
+                    new(&partials[i]) T(identity);
+                }
+            }
+            else
+            {
+                participantCount = 1;
+                partials = &local;
+            }
+
+            run(participantCount, [&](int participant)
+            {
+                for (size_t first, last; range.next(first, last);)
+                {
+                    partials[participant] = reduce(std::move(partials[participant]), map(first, last));
+                }
+            });
+
+            T result = std::move(identity);
+
+            for (int i = 0; i < participantCount; ++i)
+            {
+                result = reduce(std::move(result), std::move(partials[i]));
+            }
+
+            if (partials != &local)
+            {
+                for (int i = 0; i < participantCount; ++i)
+                {
+                    partials[i].~T();
+                }
+
+                operator delete(partials);
+            }
+
+            return result;
+        }
+
+    private:
+        using Queue = detail::TaskQueue<kQueueCapacity>;
+
+        struct Worker
+        {
+            Worker(ThreadPool* pool, int index) : pool(pool), index(index)
+            {
+            }
+
+            ThreadPool* pool;
+            int index;
+            detail::WorkStealingDeque<kDequeCapacity> deque;
+        };
+
+        // Hands out chunks of a range to participants of parallel_for/parallel_reduce
+        class ChunkRange
+        {
+        public:
+            ChunkRange(size_t begin, size_t end, size_t grain) : m_begin(begin), m_size(end - begin), m_grain(grain ? grain : 1)
+            {
+            }
+
+            int participantCount(int workerCount) const
+            {
+                const size_t chunkCount = (m_size + m_grain - 1) / m_grain;
+                return static_cast<int>((std::min)(chunkCount, static_cast<size_t>(workerCount) + 1));
+            }
+
+            bool next(size_t& first, size_t& last)
+            {
+                const size_t offset = static_cast<size_t>(InterlockedExchangeAdd64(&m_next, static_cast<LONG64>(m_grain)));
+                if (offset >= m_size)
+                {
+                    return false;
+                }
+
+                first = m_begin + offset;
+                last = m_begin + (std::min)(offset + m_grain, m_size);
+                return true;
+            }
+
+        private:
+            const size_t m_begin;
+            const size_t m_size;
+            const size_t m_grain;
+            volatile LONG64 m_next = 0;
+        };
+
+        // Runs body(participant) on participantCount - 1 workers and on the calling thread as participant 0.
+        // Without workers the calling thread does all the work.
+        template<class Body>
+        void run(int participantCount, Body&& body)
+        {
+            if (!m_queue)
+            {
+                participantCount = 1;
+            }
+
+            Latch done(participantCount - 1);
+
+            for (int i = 1; i < participantCount; ++i)
+            {
+                const NTSTATUS status = submit([&body, &done, i]
+                {
+                    body(i);
+                    done.countDown();
+                });
+
+                if (!NT_SUCCESS(status))
+                {
+                    // The chunks are picked up by other participants
+                    done.countDown();
+                }
+            }
+
+            body(0);
+
+            // A worker that waits for nested work executes tasks meanwhile, otherwise all workers can end up waiting
+            if (Worker* self = currentWorker())
+            {
+                while (!done.tryWait())
+                {
+                    detail::PoolTask task;
+                    if (tryTake(*self, task))
+                    {
+                        task();
+                    }
+                    else
+                    {
+                        YieldProcessor();
+                    }
+                }
+            }
+
+            // The wait synchronizes with countDown() that may still be setting the event
+            done.wait();
+        }
+
+        NTSTATUS allocateThreads()
+        {
+            ASSERT(!m_threads);
+
+            m_threads = static_cast<Thread*>(operator new(sizeof(Thread) * m_count, NonPagedPoolNx));
+            if (!m_threads)
+            {
+                return STATUS_INSUFFICIENT_RESOURCES;
+            }
+
             for (int i = 0; i < m_count; ++i)
             {
-                m_threads[i].join();
+                new(&m_threads[i]) Thread();
+            }
+
+            return STATUS_SUCCESS;
+        }
+
+        ULONG processorOf(int index) const
+        {
+            return static_cast<ULONG>(index) % Numa::processorCount();
+        }
+
+        ThreadOptions threadOptions(int index) const
+        {
+            ThreadOptions options;
+            options.priority = m_options.priority;
+
+            switch (m_options.placement)
+            {
+            case ThreadPlacement::Processor:
+                options.affinity = Numa::processorAffinity(processorOf(index));
+                break;
+            case ThreadPlacement::Node:
+                options.affinity = Numa::nodeAffinity(Numa::nodeOfProcessor(processorOf(index)));
+                break;
+            default:
+                break;
             }
+
+            return options;
+        }
+
+        bool push(const detail::PoolTask& task) noexcept
+        {
+            Worker* self = currentWorker();
+            if (!(self && self->deque.push(task)) && !m_queue->push(task))
+            {
+                return false;
+            }
+
+            // Pairs with the barrier of InterlockedIncrement(&m_sleepingCount) in workerLoop
+            KeMemoryBarrier();
+            if (ReadNoFence(&m_sleepingCount) > 0)
+            {
+                m_wakeup.release();
+            }
+
+            return true;
+        }
+
+        bool tryTake(Worker& self, detail::PoolTask& task) noexcept
+        {
+            if (self.deque.pop(task) || m_queue->pop(task))
+            {
+                return true;
+            }
+
+            for (int i = 1; i < m_count; ++i)
+            {
+                if (m_workers[(self.index + i) % m_count]->deque.steal(task))
+                {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        // Threads are looked up in their own compact array: it's written once per worker, so unlike the workers
+        // it doesn't share cache lines with the deques that thieves write
+        Worker* currentWorker() const noexcept
+        {
+            if (!m_workerThreads)
+            {
+                return nullptr;
+            }
+
+            const PVOID thread = KeGetCurrentThread();
+
+            for (int i = 0; i < m_count; ++i)
+            {
+                if (m_workerThreads[i] == thread)
+                {
+                    return m_workers[i];
+                }
+            }
+
+            return nullptr;
+        }
+
+        void workerLoop(Worker& self)
+        {
+            for (detail::PoolTask task;;)
+            {
+                if (tryTake(self, task))
+                {
+                    task();
+                    continue;
+                }
+
+                InterlockedIncrement(&m_sleepingCount);
+
+                // Recheck after announcing the sleep, a task pushed before that is seen here
+                if (tryTake(self, task))
+                {
+                    InterlockedDecrement(&m_sleepingCount);
+                    task();
+                    continue;
+                }
+
+                if (ReadAcquire(&m_stopping))
+                {
+                    InterlockedDecrement(&m_sleepingCount);
+                    break;
+                }
+
+                m_wakeup.wait();
+                InterlockedDecrement(&m_sleepingCount);
+            }
+        }
+
+        static void workerRoutine(PVOID context)
+        {
+            auto worker = static_cast<Worker*>(context);
+            worker->pool->m_workerThreads[worker->index] = KeGetCurrentThread();
+            worker->pool->workerLoop(*worker);
+
+            PsTerminateSystemThread(STATUS_SUCCESS);
         }
 
     private:
-        Thread m_threads[kMaxCount];
-        int m_count;
+        ThreadPoolOptions   m_options;
+        int                 m_count;
+        Thread*             m_threads = nullptr;
+        Worker**            m_workers = nullptr;
+        PVOID volatile*     m_workerThreads = nullptr;
+        Queue*              m_queue = nullptr;
+        Semaphore           m_wakeup;
+        volatile LONG       m_sleepingCount = 0;
+        volatile LONG       m_stopping = 0;
     };
 }
@@ -0,0 +1,536 @@
+#pragma once
+#include "Thread.h"
+#include "Event.h"
+#include "SpinLock.h"
+#include "AutoSpinLock.h"
+#include <algorithm>
+#include <bit>
+
+namespace kf
+{
+    class TimerService;
+
+    //////////////////////////////////////////////////////////////////////////
+    // Timer - one-shot or periodic timer of a TimerService. The timer is owned by the caller, so scheduling
+    // doesn't allocate, and it must be canceled before it's destroyed.
+    //
+    //     kf::Timer m_agingTimer{ [](PVOID context) { static_cast<Cache*>(context)->age(); }, this };
+    //     ...
+    //     service.schedule(m_agingTimer, kAgingPeriod, kAgingPeriod, kAgingPeriod / 10);
+
+    class Timer
+    {
+    public:
+        using Callback = void (*)(PVOID context);
+
+        Timer(Callback callback, PVOID context) : m_callback(callback), m_context(context)
+        {
+            InitializeListHead(&m_link);
+        }
+
+        ~Timer()
+        {
+            ASSERT(m_state == State::Idle);
+        }
+
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+
+        // The value is approximate if the timer is scheduled or fires concurrently
+        bool isScheduled() const
+        {
+            return m_state != State::Idle;
+        }
+
+    private:
+        friend class TimerService;
+
+        enum class State
+        {
+            Idle,
+            Pending,
+            Expired, // in the batch of the thread, the callback hasn't started yet
+            Running, // the callback is executing
+        };
+
+        Callback    m_callback;
+        PVOID       m_context;
+        LIST_ENTRY  m_link;
+        State       m_state = State::Idle;
+        ULONG64     m_tick = 0;
+        UCHAR       m_level = 0;
+        UCHAR       m_slot = 0;
+        LONGLONG    m_dueTime = 0;
+        LONGLONG    m_period = 0;
+        LONGLONG    m_tolerance = 0;
+        bool        m_rearm = false;
+    };
+
+    //////////////////////////////////////////////////////////////////////////
+    // TimerService - runs callbacks of many Timers on a single system thread, a replacement of a TimerThread
+    // per periodic task.
+    //
+    // Timers are kept in a hierarchical timing wheel (Varghese and Lauck) of kLevelCount levels of kSlotCount
+    // slots, a level covers kSlotCount times longer interval than the previous one with the same number of slots.
+    // Schedule and cancel are O(1), timers of upper levels are moved down when the lower level wraps.
+    // The thread sleeps until the next occupied slot rather than waking up on every tick.
+    //
+    // Times are in 100ns units of the interrupt time, rounded up to the resolution. A timer with a tolerance
+    // fires at the tick within [dueTime, dueTime + tolerance] that is a multiple of the largest power of two,
+    // so timers with overlapping windows fire together. Periodic timers are scheduled from the previous due
+    // time rather than from the callback time, so they don't drift, missed periods are skipped.
+    //
+    // Note: callbacks run at PASSIVE_LEVEL one after another, a long callback delays other timers.
+    // Submit long work to a ThreadPool.
+
+    class TimerService
+    {
+    public:
+        static constexpr LONGLONG kDefaultResolution = 10 * 10'000; // 10ms
+        static constexpr ULONG kSlotBits = 6;
+        static constexpr ULONG kSlotCount = 1 << kSlotBits;
+        static constexpr ULONG kLevelCount = 4;
+
+        explicit TimerService(LONGLONG resolution = kDefaultResolution)
+            : m_resolution(resolution), m_wakeup(SynchronizationEvent, false), m_callbackDone(NotificationEvent, true)
+        {
+            ASSERT(resolution > 0);
+
+            for (auto& level : m_slots)
+            {
+                for (auto& slot : level)
+                {
+                    InitializeListHead(&slot);
+                }
+            }
+        }
+
+        ~TimerService()
+        {
+            join();
+        }
+
+        TimerService(const TimerService&) = delete;
+        TimerService& operator=(const TimerService&) = delete;
+
+        _IRQL_requires_max_(PASSIVE_LEVEL)
+        NTSTATUS start(const ThreadOptions& options = {})
+        {
+            m_startTime = static_cast<LONGLONG>(KeQueryInterruptTime());
+            m_currentTick = 0;
+            m_stopping = false;
+
+            return m_thread.start([](PVOID context)
+                {
+                    static_cast<TimerService*>(context)->threadRoutine();
+                    PsTerminateSystemThread(STATUS_SUCCESS);
+                },
+                this,
+                options);
+        }
+
+        // Stops the thread, pending timers are canceled
+        _IRQL_requires_max_(PASSIVE_LEVEL)
+        void join()
+        {
+            {
+                AutoSpinLock lock(m_lock);
+                m_stopping = true;
+            }
+
+            m_wakeup.set();
+            m_thread.join();
+
+            AutoSpinLock lock(m_lock);
+
+            for (ULONG level = 0; level < kLevelCount; ++level)
+            {
+                for (auto& slot : m_slots[level])
+                {
+                    while (!IsListEmpty(&slot))
+                    {
+                        auto timer = CONTAINING_RECORD(RemoveHeadList(&slot), Timer, m_link);
+                        InitializeListHead(&timer->m_link);
+                        timer->m_state = Timer::State::Idle;
+                    }
+                }
+
+                m_occupied[level] = 0;
+            }
+
+            m_pendingCount = 0;
+        }
+
+        // Schedules the timer to fire in dueTime and then every period if it's not 0, reschedules a pending timer.
+        // Times are relative in 100ns units, the service must be started.
+        _IRQL_requires_max_(DISPATCH_LEVEL)
+        void schedule(Timer& timer, LONGLONG dueTime, LONGLONG period = 0, LONGLONG tolerance = 0)
+        {
+            ASSERT(m_startTime);
+            ASSERT(dueTime >= 0 && period >= 0 && tolerance >= 0);
+
+            bool wakeup = false;
+
+            {
+                AutoSpinLock lock(m_lock);
+
+                timer.m_dueTime = static_cast<LONGLONG>(KeQueryInterruptTime()) + dueTime;
+                timer.m_period = period;
+                timer.m_tolerance = tolerance;
+
+                switch (timer.m_state)
+                {
+                case Timer::State::Running:
+                    // The thread places the timer after the callback
+                    timer.m_rearm = true;
+                    return;
+
+                case Timer::State::Pending:
+                    unlink(timer);
+                    break;
+
+                case Timer::State::Expired:
+                    // Takes the timer from the batch of the thread
+                    RemoveEntryList(&timer.m_link);
+                    break;
+
+                default:
+                    break;
+                }
+
+                timer.m_tick = tickOf(timer.m_dueTime, timer.m_tolerance);
+                place(timer);
+
+                wakeup = timer.m_tick < m_wakeupTick;
+            }
+
+            if (wakeup)
+            {
+                m_wakeup.set();
+            }
+        }
+
+        // Returns true if the timer was scheduled. If the callback is running on another thread, waits for it,
+        // so after return the callback doesn't run. Can be called from any timer callback, including its own.
+        _IRQL_requires_max_(APC_LEVEL)
+        bool cancel(Timer& timer)
+        {
+            for (bool scheduled = false;;)
+            {
+                {
+                    AutoSpinLock lock(m_lock);
+
+                    switch (timer.m_state)
+                    {
+                    case Timer::State::Idle:
+                        return scheduled;
+
+                    case Timer::State::Pending:
+                        unlink(timer);
+                        timer.m_state = Timer::State::Idle;
+                        return true;
+
+                    case Timer::State::Expired:
+                        // The callback hasn't started, take the timer from the batch of the thread
+                        RemoveEntryList(&timer.m_link);
+                        InitializeListHead(&timer.m_link);
+                        timer.m_state = Timer::State::Idle;
+                        return true;
+
+                    case Timer::State::Running:
+                        scheduled = scheduled || timer.m_rearm || timer.m_period;
+                        timer.m_rearm = false;
+                        timer.m_period = 0;
+
+                        // Only the timer's own callback runs on the thread now
+                        if (KeGetCurrentThread() == m_threadObject)
+                        {
+                            return scheduled;
+                        }
+
+                        break;
+                    }
+                }
+
+                // The event is set when the running callback returns, the state is checked again as another
+                // callback may be running by then
+                m_callbackDone.wait();
+            }
+        }
+
+        // The value is approximate if timers are scheduled or fire concurrently
+        ULONG pendingCount() const
+        {
+            return static_cast<ULONG>(ReadNoFence(&m_pendingCount));
+        }
+
+    private:
+        static constexpr ULONG64 kSlotMask = kSlotCount - 1;
+        static constexpr ULONG64 kMaxDelta = (1ULL << (kSlotBits * kLevelCount)) - 1;
+        static constexpr ULONG64 kNoTick = MAXULONG64;
+
+        // The first tick at or after the time
+        ULONG64 tickOf(LONGLONG time) const
+        {
+            const LONGLONG elapsed = time - m_startTime;
+            return elapsed <= 0 ? 0 : static_cast<ULONG64>((elapsed + m_resolution - 1) / m_resolution);
+        }
+
+        // The tick within the tolerance window that is a multiple of the largest power of two
+        ULONG64 tickOf(LONGLONG dueTime, LONGLONG tolerance) const
+        {
+            const ULONG64 first = tickOf(dueTime);
+            const ULONG64 last = (std::max)(first, static_cast<ULONG64>((dueTime + tolerance - m_startTime) / m_resolution));
+
+            ULONG64 tick = last;
+
+            for (ULONG alignment = 1; alignment < 64; ++alignment)
+            {
+                const ULONG64 candidate = last & ~((1ULL << alignment) - 1);
+                if (candidate < first)
+                {
+                    break;
+                }
+
+                tick = candidate;
+            }
+
+            return tick;
+        }
+
+        void place(Timer& timer)
+        {
+            const ULONG64 tick = (std::max)(timer.m_tick, m_currentTick);
+            const ULONG64 delta = (std::min)(tick - m_currentTick, kMaxDelta);
+
+            ULONG level = 0;
+            while (delta >> (kSlotBits * (level + 1)))
+            {
+                ++level;
+            }
+
+            const ULONG slot = static_cast<ULONG>(((m_currentTick + delta) >> (kSlotBits * level)) & kSlotMask);
+
+            InsertTailList(&m_slots[level][slot], &timer.m_link);
+            m_occupied[level] |= 1ULL << slot;
+            timer.m_level = static_cast<UCHAR>(level);
+            timer.m_slot = static_cast<UCHAR>(slot);
+            timer.m_state = Timer::State::Pending;
+            ++m_pendingCount;
+        }
+
+        void unlink(Timer& timer)
+        {
+            RemoveEntryList(&timer.m_link);
+            InitializeListHead(&timer.m_link);
+            --m_pendingCount;
+
+            if (IsListEmpty(&m_slots[timer.m_level][timer.m_slot]))
+            {
+                m_occupied[timer.m_level] &= ~(1ULL << timer.m_slot);
+            }
+        }
+
+        // The next tick that has expiring timers or moves timers down, kNoTick if there are no timers
+        ULONG64 nextEventTick() const
+        {
+            ULONG64 next = kNoTick;
+
+            if (m_occupied[0])
+            {
+                next = m_currentTick + std::countr_zero(std::rotr(m_occupied[0], static_cast<int>(m_currentTick & kSlotMask)));
+            }
+
+            for (ULONG level = 1; level < kLevelCount; ++level)
+            {
+                if (m_occupied[level])
+                {
+                    next = (std::min)(next, ALIGN_UP_BY(m_currentTick, kSlotCount));
+                    break;
+                }
+            }
+
+            return next;
+        }
+
+        // Moves timers of the slot of the level that starts at the tick to lower levels
+        void cascade(ULONG level, ULONG64 tick)
+        {
+            const ULONG slot = static_cast<ULONG>((tick >> (kSlotBits * level)) & kSlotMask);
+
+            if (!slot && level + 1 < kLevelCount)
+            {
+                cascade(level + 1, tick);
+            }
+
+            LIST_ENTRY timers;
+            moveSlot(level, slot, timers);
+
+            while (!IsListEmpty(&timers))
+            {
+                place(*CONTAINING_RECORD(RemoveHeadList(&timers), Timer, m_link));
+            }
+        }
+
+        void moveSlot(ULONG level, ULONG slot, LIST_ENTRY& timers)
+        {
+            InitializeListHead(&timers);
+
+            for (auto& head = m_slots[level][slot]; !IsListEmpty(&head);)
+            {
+                InsertTailList(&timers, RemoveHeadList(&head));
+                --m_pendingCount;
+            }
+
+            m_occupied[level] &= ~(1ULL << slot);
+        }
+
+        // Moves timers that expire by now to the list, called under the lock
+        void advance(ULONG64 now, LIST_ENTRY& expired)
+        {
+            for (;;)
+            {
+                const ULONG64 tick = nextEventTick();
+                if (tick > now)
+                {
+                    m_currentTick = now + 1;
+                    return;
+                }
+
+                m_currentTick = tick;
+
+                if (!(tick & kSlotMask))
+                {
+                    cascade(1, tick);
+                }
+
+                LIST_ENTRY timers;
+                moveSlot(0, static_cast<ULONG>(tick & kSlotMask), timers);
+
+                while (!IsListEmpty(&timers))
+                {
+                    auto timer = CONTAINING_RECORD(RemoveHeadList(&timers), Timer, m_link);
+                    timer->m_state = Timer::State::Expired;
+                    timer->m_rearm = false;
+                    InsertTailList(&expired, &timer->m_link);
+                }
+
+                m_currentTick = tick + 1;
+            }
+        }
+
+        // Places a timer after its callback, called under the lock
+        void reschedule(Timer& timer, LONGLONG now)
+        {
+            InitializeListHead(&timer.m_link);
+
+            if (!timer.m_rearm)
+            {
+                if (!timer.m_period)
+                {
+                    timer.m_state = Timer::State::Idle;
+                    return;
+                }
+
+                // Skip missed periods
+                timer.m_dueTime += timer.m_period;
+                if (timer.m_dueTime <= now)
+                {
+                    timer.m_dueTime += (now - timer.m_dueTime) / timer.m_period * timer.m_period + timer.m_period;
+                }
+            }
+
+            timer.m_rearm = false;
+            timer.m_tick = tickOf(timer.m_dueTime, timer.m_tolerance);
+            place(timer);
+        }
+
+        void threadRoutine()
+        {
+            m_threadObject = KeGetCurrentThread();
+
+            for (;;)
+            {
+                LIST_ENTRY expired;
+                InitializeListHead(&expired);
+
+                LARGE_INTEGER timeout;
+                bool infinite = false;
+                bool hasExpired = false;
+
+                {
+                    AutoSpinLock lock(m_lock);
+
+                    if (m_stopping)
+                    {
+                        break;
+                    }
+
+                    const LONGLONG now = static_cast<LONGLONG>(KeQueryInterruptTime());
+                    advance(static_cast<ULONG64>((now - m_startTime) / m_resolution), expired);
+
+                    hasExpired = !IsListEmpty(&expired);
+                    m_wakeupTick = hasExpired ? m_currentTick : nextEventTick();
+                    infinite = m_wakeupTick == kNoTick;
+                    timeout.QuadPart = infinite ? 0 : -(std::max)(m_startTime + static_cast<LONGLONG>(m_wakeupTick) * m_resolution - now, 0LL);
+                }
+
+                if (!hasExpired)
+                {
+                    m_wakeup.wait(infinite ? nullptr : &timeout);
+                    continue;
+                }
+
+                runExpired(expired);
+            }
+        }
+
+        // Runs callbacks of the batch one by one. The batch is changed under the lock, so callbacks and other
+        // threads can cancel or reschedule timers that haven't run yet.
+        void runExpired(LIST_ENTRY& expired)
+        {
+            for (;;)
+            {
+                Timer* timer = nullptr;
+
+                {
+                    AutoSpinLock lock(m_lock);
+
+                    if (IsListEmpty(&expired))
+                    {
+                        return;
+                    }
+
+                    timer = CONTAINING_RECORD(RemoveHeadList(&expired), Timer, m_link);
+                    InitializeListHead(&timer->m_link);
+                    timer->m_state = Timer::State::Running;
+                    m_callbackDone.clear();
+                }
+
+                timer->m_callback(timer->m_context);
+
+                {
+                    AutoSpinLock lock(m_lock);
+                    reschedule(*timer, static_cast<LONGLONG>(KeQueryInterruptTime()));
+                }
+
+                m_callbackDone.set();
+            }
+        }
+
+    private:
+        const LONGLONG  m_resolution;
+        LONGLONG        m_startTime = 0;
+        SpinLock        m_lock;
+        LIST_ENTRY      m_slots[kLevelCount][kSlotCount];
+        ULONG64         m_occupied[kLevelCount] = {};
+        ULONG64         m_currentTick = 0;
+        ULONG64         m_wakeupTick = kNoTick;
+        LONG            m_pendingCount = 0;
+        bool            m_stopping = false;
+        PVOID           m_threadObject = nullptr;
+        Event           m_wakeup;
+        Event           m_callbackDone;
+        Thread          m_thread;
+    };
+}
@@ -1,5 +1,7 @@
 #pragma once
 #include "GenericTableAvl.h"
+#include "TreeSetIterator.h"
+#include "TreeSetDescendingIterator.h"
 #include <functional>
 #include <utility>
 
@@ -7,15 +9,28 @@ namespace kf
 {
     ///////////////////////////////////////////////////////////////////////////////////////////////////
     // TreeMap - map container for NT kernel, inspired by http://docs.oracle.com/javase/7/docs/api/java/util/TreeMap.html
+    //
+    // If LessComparer is transparent (has is_transparent type, like std::less<>) then lookup methods
+    // also accept a key of any type comparable with K, so no temporary K has to be built.
 
-    template<class K, class V, POOL_TYPE poolType, class LessComparer=std::less<K>>
+    template<class K, class V, POOL_TYPE poolType, class LessComparer=std::less<K>, class NodeAllocator=PoolNodeAllocator<poolType>>
     class TreeMap
     {
+    public:
+        class Entry;
+
+        using Iterator = TreeSetIterator<Entry, poolType, std::less<Entry>, NodeAllocator>;
+        using DescendingIterator = TreeSetDescendingIterator<Entry, poolType, std::less<Entry>, NodeAllocator>;
+
     public:
         TreeMap()
         {
         }
 
+        explicit TreeMap(_Inout_ NodeAllocator&& nodeAllocator) : m_table(std::move(nodeAllocator))
+        {
+        }
+
         TreeMap(_Inout_ TreeMap&& another) noexcept : m_table(std::move(another.m_table))
         {
         }
@@ -33,26 +48,58 @@ namespace kf
 
         NTSTATUS put(const K& key, V&& value)
         {
-            Node node(key, std::move(value));
-            NTSTATUS status = m_table.insertElement(std::move(node));
+            return emplace(key, std::move(value)) ? STATUS_SUCCESS : STATUS_INSUFFICIENT_RESOURCES;
+        }
 
-            if (!NT_SUCCESS(status))
-            {
-                value = std::move(node.m_value);
-            }
+        //
+        // In-place insertion: the key is looked up once and the value is constructed right in the tree node.
+        // Returns the value stored for the key or nullptr if there is not enough memory.
+        //
 
-            return status;
+        // Constructs the value from args, an existing value for the key is replaced. Args can refer into
+        // the existing value unless V can't be move assigned, then it's destroyed and rebuilt in place
+        template<class... Args>
+        V* emplace(const K& key, Args&&... args)
+        {
+            return emplaceInternal(key, std::forward<Args>(args)...);
         }
 
-        V* get(const K& key)
+        template<class... Args>
+        V* emplace(K&& key, Args&&... args)
         {
-            Node* node = m_table.lookupElement(Node::fromKey(key));
-            if (node)
-            {
-                return &node->m_value;
-            }
+            return emplaceInternal(std::move(key), std::forward<Args>(args)...);
+        }
 
-            return nullptr;
+        // Constructs the value from args only if there is no such key, otherwise returns the existing value
+        // and neither key nor args are moved from
+        template<class... Args>
+        V* tryEmplace(const K& key, Args&&... args)
+        {
+            return tryEmplaceInternal(key, nullptr, std::forward<Args>(args)...);
+        }
+
+        template<class... Args>
+        V* tryEmplace(K&& key, Args&&... args)
+        {
+            return tryEmplaceInternal(std::move(key), nullptr, std::forward<Args>(args)...);
+        }
+
+        // Assigns the value to the existing one or inserts it if there is no such key
+        template<class M>
+        V* insertOrAssign(const K& key, M&& value)
+        {
+            return insertOrAssignInternal(key, std::forward<M>(value));
+        }
+
+        template<class M>
+        V* insertOrAssign(K&& key, M&& value)
+        {
+            return insertOrAssignInternal(std::move(key), std::forward<M>(value));
+        }
+
+        V* get(const K& key)
+        {
+            return valueOf(findInternal(key));
         }
 
         const V* get(const K& key) const
@@ -60,15 +107,21 @@ namespace kf
             return const_cast<TreeMap*>(this)->get(key);
         }
 
-        V* getByIndex(const ULONG index)
+        template<class Key> requires detail::TransparentComparer<LessComparer>
+        V* get(const Key& key)
         {
-            Node* node = m_table.getElement(index);
-            if (node)
-            {
-                return &node->m_value;
-            }
+            return valueOf(findInternal(key));
+        }
 
-            return nullptr;
+        template<class Key> requires detail::TransparentComparer<LessComparer>
+        const V* get(const Key& key) const
+        {
+            return const_cast<TreeMap*>(this)->get(key);
+        }
+
+        V* getByIndex(const ULONG index)
+        {
+            return valueOf(m_table.getElement(index));
         }
 
         const V* getByIndex(const ULONG index) const 
@@ -83,7 +136,13 @@ namespace kf
 
         bool containsKey(const K& key) const
         {
-            return m_table.lookupElement(Node::fromKey(key)) != nullptr;
+            return const_cast<TreeMap*>(this)->findInternal(key) != nullptr;
+        }
+
+        template<class Key> requires detail::TransparentComparer<LessComparer>
+        bool containsKey(const Key& key) const
+        {
+            return const_cast<TreeMap*>(this)->findInternal(key) != nullptr;
         }
 
         int size() const
@@ -98,15 +157,135 @@ namespace kf
 
         bool remove(const K& key)
         {
-            return m_table.deleteElement(Node::fromKey(key));
+            return removeEntry(findInternal(key));
+        }
+
+        template<class Key> requires detail::TransparentComparer<LessComparer>
+        bool remove(const Key& key)
+        {
+            return removeEntry(findInternal(key));
         }
 
         // Important! Use only the value returned by other map methods.
         // The usage of the value that doesn't exist in map will lead to undefined behavior.
         bool removeByObject(const V* value)
         {
-            Node* node = CONTAINING_RECORD(value, Node, m_value);
-            return m_table.deleteElement(*node);
+            Entry* entry = CONTAINING_RECORD(value, Entry, m_value);
+            return m_table.deleteElement(*entry);
+        }
+
+        //
+        // Navigation, returns nullptr if there is no such entry
+        //
+
+        Entry* firstEntry()
+        {
+            return m_table.first();
+        }
+
+        Entry* lastEntry()
+        {
+            return m_table.last();
+        }
+
+        // The entry with the least key greater than or equal to the given key
+        Entry* ceilingEntry(const K& key)
+        {
+            return ceilingInternal(key);
+        }
+
+        template<class Key> requires detail::TransparentComparer<LessComparer>
+        Entry* ceilingEntry(const Key& key)
+        {
+            return ceilingInternal(key);
+        }
+
+        // The entry with the least key strictly greater than the given key
+        Entry* higherEntry(const K& key)
+        {
+            return higherInternal(key);
+        }
+
+        template<class Key> requires detail::TransparentComparer<LessComparer>
+        Entry* higherEntry(const Key& key)
+        {
+            return higherInternal(key);
+        }
+
+        // The entry with the greatest key less than or equal to the given key
+        Entry* floorEntry(const K& key)
+        {
+            return floorInternal(key);
+        }
+
+        template<class Key> requires detail::TransparentComparer<LessComparer>
+        Entry* floorEntry(const Key& key)
+        {
+            return floorInternal(key);
+        }
+
+        // The entry with the greatest key strictly less than the given key
+        Entry* lowerEntry(const K& key)
+        {
+            return lowerInternal(key);
+        }
+
+        template<class Key> requires detail::TransparentComparer<LessComparer>
+        Entry* lowerEntry(const Key& key)
+        {
+            return lowerInternal(key);
+        }
+
+        //
+        // Iteration over entries, the entry returned by next() can be removed from the map
+        //
+
+        Iterator iterator()
+        {
+            return Iterator(m_table);
+        }
+
+        // Ascending iteration starting from ceilingEntry(from)
+        Iterator iterator(const K& from)
+        {
+            return Iterator(m_table, ceilingInternal(from));
+        }
+
+        template<class Key> requires detail::TransparentComparer<LessComparer>
+        Iterator iterator(const Key& from)
+        {
+            return Iterator(m_table, ceilingInternal(from));
+        }
+
+        DescendingIterator descendingIterator()
+        {
+            return DescendingIterator(m_table);
+        }
+
+        // Descending iteration starting from floorEntry(from)
+        DescendingIterator descendingIterator(const K& from)
+        {
+            return DescendingIterator(m_table, floorInternal(from));
+        }
+
+        template<class Key> requires detail::TransparentComparer<LessComparer>
+        DescendingIterator descendingIterator(const Key& from)
+        {
+            return DescendingIterator(m_table, floorInternal(from));
+        }
+
+        // Calls function(const K&, V&) for keys in [from, to) in ascending order.
+        // The enumeration stops if the function returns false.
+        template<class Function>
+        void forEachInRange(const K& from, const K& to, Function function)
+        {
+            forEachInRangeInternal(from, to, function);
+        }
+
+        template<class Key, class Function> requires detail::TransparentComparer<LessComparer>
+        void forEachInRange(const Key& from, const Key& to, Function function)
+        {
+            forEachInRangeInternal(from, to, function);
         }
 
         TreeMap& operator=(_Inout_ TreeMap&& another) noexcept
@@ -115,37 +294,172 @@ namespace kf
             return *this;
         }
 
-    private:
-        TreeMap(const TreeMap&);
-        TreeMap& operator=(const TreeMap&);
-
-    private:
-        struct Node
+    public:
+        class Entry
         {
-            static const Node& fromKey(const K& key)
+        public:
+            template<class Key, class... Args>
+            Entry(std::piecewise_construct_t, Key&& key, Args&&... args) : m_key(std::forward<Key>(key)), m_value(std::forward<Args>(args)...)
             {
-                return reinterpret_cast<const Node&>(key);
             }
 
-            Node(const K& key, V&& value) : m_key(key), m_value(std::move(value))
+            Entry(Entry&& another) noexcept : m_key(std::move(another.m_key)), m_value(std::move(another.m_value))
             {
             }
 
-            Node(Node&& another) noexcept : m_key(std::move(another.m_key)), m_value(std::move(another.m_value))
+            const K& key() const
             {
+                return m_key;
             }
 
-            bool operator<(const Node& another) const
+            V& value()
+            {
+                return m_value;
+            }
+
+            const V& value() const
+            {
+                return m_value;
+            }
+
+            bool operator<(const Entry& another) const
             {
                 LessComparer lessComparer;
                 return lessComparer(m_key, another.m_key);
             }
 
+        private:
+            friend class TreeMap;
+
             K m_key;
             V m_value;
         };
 
     private:
-        GenericTableAvl<Node, poolType> m_table;
+        TreeMap(const TreeMap&);
+        TreeMap& operator=(const TreeMap&);
+
+        static V* valueOf(Entry* entry)
+        {
+            return entry ? &entry->m_value : nullptr;
+        }
+
+        bool removeEntry(Entry* entry)
+        {
+            if (!entry)
+            {
+                return false;
+            }
+
+            m_table.deleteFoundElement(*entry);
+            return true;
+        }
+
+        template<class Key>
+        static RTL_GENERIC_COMPARE_RESULTS compareKey(const Key& key, const Entry& entry)
+        {
+            LessComparer lessComparer;
+            return lessComparer(key, entry.m_key) ? GenericLessThan : lessComparer(entry.m_key, key) ? GenericGreaterThan : GenericEqual;
+        }
+
+        template<class Key, class... Args>
+        V* tryEmplaceInternal(Key&& key, _Out_opt_ bool* inserted, Args&&... args)
+        {
+            Entry* entry = m_table.findOrConstruct(
+                [&](const Entry& another) { return compareKey(key, another); },
+                [&](void* buffer)
+                {
+                    new(buffer) Entry(std::piecewise_construct, std::forward<Key>(key), std::forward<Args>(args)...);
+                },
+                inserted);
+
+            return valueOf(entry);
+        }
+
+        template<class Key, class... Args>
+        V* emplaceInternal(Key&& key, Args&&... args)
+        {
+            bool inserted = false;
+
+            // Args are not consumed if the key exists, so they are still intact for the replacement
+            V* value = tryEmplaceInternal(std::forward<Key>(key), &inserted, std::forward<Args>(args)...);
+
+            if (value && !inserted)
+            {
+                detail::replaceValue(*value, std::forward<Args>(args)...);
+            }
+
+            return value;
+        }
+
+        template<class Key, class M>
+        V* insertOrAssignInternal(Key&& key, M&& value)
+        {
+            bool inserted = false;
+
+            V* existing = tryEmplaceInternal(std::forward<Key>(key), &inserted, std::forward<M>(value));
+            if (existing && !inserted)
+            {
+                *existing = std::forward<M>(value);
+            }
+
+            return existing;
+        }
+
+        template<class Key>
+        Entry* findInternal(const Key& key)
+        {
+            // Stops at the matching node instead of descending to a leaf as the bounds do
+            return m_table.find([&](const Entry& entry) { return compareKey(key, entry); });
+        }
+
+        template<class Key>
+        Entry* ceilingInternal(const Key& key)
+        {
+            LessComparer lessComparer;
+            return m_table.partitionPoint([&](const Entry& entry) { return lessComparer(entry.m_key, key); });
+        }
+
+        template<class Key>
+        Entry* higherInternal(const Key& key)
+        {
+            LessComparer lessComparer;
+            return m_table.partitionPoint([&](const Entry& entry) { return !lessComparer(key, entry.m_key); });
+        }
+
+        template<class Key>
+        Entry* floorInternal(const Key& key)
+        {
+            Entry* higher = higherInternal(key);
+            return higher ? m_table.prev(*higher) : m_table.last();
+        }
+
+        template<class Key>
+        Entry* lowerInternal(const Key& key)
+        {
+            Entry* ceiling = ceilingInternal(key);
+            return ceiling ? m_table.prev(*ceiling) : m_table.last();
+        }
+
+        template<class Key, class Function>
+        void forEachInRangeInternal(const Key& from, const Key& to, Function& function)
+        {
+            LessComparer lessComparer;
+
+            for (Entry* entry = ceilingInternal(from); entry && lessComparer(entry->m_key, to);)
+            {
+                Entry* next = m_table.next(*entry);
+
+                if (!detail::invokeForEach(function, static_cast<const K&>(entry->m_key), entry->m_value))
+                {
+                    break;
+                }
+
+                entry = next;
+            }
+        }
+
+    private:
+        GenericTableAvl<Entry, poolType, std::less<Entry>, NodeAllocator> m_table;
     };
 }
@@ -1,6 +1,7 @@
 #pragma once
 #include "GenericTableAvl.h"
 #include "TreeSetIterator.h"
+#include "TreeSetDescendingIterator.h"
 #include <functional>
 #include <utility>
 
@@ -8,15 +9,26 @@ namespace kf
 {
     ///////////////////////////////////////////////////////////////////////////////////////////////////
     // TreeSet - set container for NT kernel, inspired by http://docs.oracle.com/javase/7/docs/api/java/util/TreeSet.html
+    //
+    // If LessComparer is transparent (has is_transparent type, like std::less<>) then lookup methods
+    // also accept a key of any type comparable with E, so no temporary E has to be built.
 
-    template<class E, POOL_TYPE poolType, class LessComparer=std::less<E>>
+    template<class E, POOL_TYPE poolType, class LessComparer=std::less<E>, class NodeAllocator=PoolNodeAllocator<poolType>>
     class TreeSet
     {
+    public:
+        using Iterator = TreeSetIterator<E, poolType, LessComparer, NodeAllocator>;
+        using DescendingIterator = TreeSetDescendingIterator<E, poolType, LessComparer, NodeAllocator>;
+
     public:
         TreeSet()
         {
         }
 
+        explicit TreeSet(_Inout_ NodeAllocator&& nodeAllocator) : m_table(std::move(nodeAllocator))
+        {
+        }
+
         TreeSet(_Inout_ TreeSet&& another) : m_table(std::move(another.m_table))
         {
         }
@@ -46,11 +58,29 @@ namespace kf
             return m_table.lookupElement(elem) != nullptr;
         }
 
+        template<class Key> requires detail::TransparentComparer<LessComparer>
+        bool contains(const Key& key) const
+        {
+            return find(key) != nullptr;
+        }
+
         E* find(const E& elem) const
         {
             return const_cast<E*>(m_table.lookupElement(elem));
         }
 
+        template<class Key> requires detail::TransparentComparer<LessComparer>
+        E* find(const Key& key) const
+        {
+            // Stops at the matching node instead of descending to a leaf as the bounds do
+            LessComparer lessComparer;
+
+            return table().find([&](const E& elem)
+                {
+                    return lessComparer(key, elem) ? GenericLessThan : lessComparer(elem, key) ? GenericGreaterThan : GenericEqual;
+                });
+        }
+
         int size() const
         {
             return m_table.number();
@@ -66,9 +96,131 @@ namespace kf
             return m_table.deleteElement(elem);
         }
 
-        TreeSetIterator<E, poolType> iterator()
+        template<class Key> requires detail::TransparentComparer<LessComparer>
+        bool remove(const Key& key)
+        {
+            E* elem = find(key);
+            if (!elem)
+            {
+                return false;
+            }
+
+            m_table.deleteFoundElement(*elem);
+            return true;
+        }
+
+        //
+        // Navigation, returns nullptr if there is no such element
+        //
+
+        E* first() const
+        {
+            return table().first();
+        }
+
+        E* last() const
+        {
+            return table().last();
+        }
+
+        // The least element greater than or equal to the given one
+        E* ceiling(const E& elem) const
+        {
+            return ceilingInternal(elem);
+        }
+
+        template<class Key> requires detail::TransparentComparer<LessComparer>
+        E* ceiling(const Key& key) const
+        {
+            return ceilingInternal(key);
+        }
+
+        // The least element strictly greater than the given one
+        E* higher(const E& elem) const
+        {
+            return higherInternal(elem);
+        }
+
+        template<class Key> requires detail::TransparentComparer<LessComparer>
+        E* higher(const Key& key) const
+        {
+            return higherInternal(key);
+        }
+
+        // The greatest element less than or equal to the given one
+        E* floor(const E& elem) const
+        {
+            return floorInternal(elem);
+        }
+
+        template<class Key> requires detail::TransparentComparer<LessComparer>
+        E* floor(const Key& key) const
+        {
+            return floorInternal(key);
+        }
+
+        // The greatest element strictly less than the given one
+        E* lower(const E& elem) const
+        {
+            return lowerInternal(elem);
+        }
+
+        template<class Key> requires detail::TransparentComparer<LessComparer>
+        E* lower(const Key& key) const
+        {
+            return lowerInternal(key);
+        }
+
+        //
+        // Iteration
+        //
+
+        Iterator iterator()
+        {
+            return Iterator(m_table);
+        }
+
+        // Ascending iteration starting from ceiling(from)
+        Iterator iterator(const E& from)
+        {
+            return Iterator(m_table, ceilingInternal(from));
+        }
+
+        template<class Key> requires detail::TransparentComparer<LessComparer>
+        Iterator iterator(const Key& from)
+        {
+            return Iterator(m_table, ceilingInternal(from));
+        }
+
+        DescendingIterator descendingIterator()
         {
-            return TreeSetIterator<E, poolType>(m_table);
+            return DescendingIterator(m_table);
+        }
+
+        // Descending iteration starting from floor(from)
+        DescendingIterator descendingIterator(const E& from)
+        {
+            return DescendingIterator(m_table, floorInternal(from));
+        }
+
+        template<class Key> requires detail::TransparentComparer<LessComparer>
+        DescendingIterator descendingIterator(const Key& from)
+        {
+            return DescendingIterator(m_table, floorInternal(from));
+        }
+
+        // Calls function(E&) for elements in [from, to) in ascending order.
+        // The enumeration stops if the function returns false.
+        template<class Function>
+        void forEachInRange(const E& from, const E& to, Function function)
+        {
+            forEachInRangeInternal(from, to, function);
+        }
+
+        template<class Key, class Function> requires detail::TransparentComparer<LessComparer>
+        void forEachInRange(const Key& from, const Key& to, Function function)
+        {
+            forEachInRangeInternal(from, to, function);
         }
 
         TreeSet& operator=(_Inout_ TreeSet&& another)
@@ -81,7 +233,58 @@ namespace kf
         TreeSet(const TreeSet&);
         TreeSet& operator=(const TreeSet&);
 
+        GenericTableAvl<E, poolType, LessComparer, NodeAllocator>& table() const
+        {
+            return const_cast<GenericTableAvl<E, poolType, LessComparer, NodeAllocator>&>(m_table);
+        }
+
+        template<class Key>
+        E* ceilingInternal(const Key& key) const
+        {
+            LessComparer lessComparer;
+            return table().partitionPoint([&](const E& elem) { return lessComparer(elem, key); });
+        }
+
+        template<class Key>
+        E* higherInternal(const Key& key) const
+        {
+            LessComparer lessComparer;
+            return table().partitionPoint([&](const E& elem) { return !lessComparer(key, elem); });
+        }
+
+        template<class Key>
+        E* floorInternal(const Key& key) const
+        {
+            E* higher = higherInternal(key);
+            return higher ? table().prev(*higher) : table().last();
+        }
+
+        template<class Key>
+        E* lowerInternal(const Key& key) const
+        {
+            E* ceiling = ceilingInternal(key);
+            return ceiling ? table().prev(*ceiling) : table().last();
+        }
+
+        template<class Key, class Function>
+        void forEachInRangeInternal(const Key& from, const Key& to, Function& function)
+        {
+            LessComparer lessComparer;
+
+            for (E* elem = ceilingInternal(from); elem && lessComparer(*elem, to);)
+            {
+                E* next = m_table.next(*elem);
+
+                if (!detail::invokeForEach(function, *elem))
+                {
+                    break;
+                }
+
+                elem = next;
+            }
+        }
+
     private:
-        GenericTableAvl<E, poolType> m_table;
+        GenericTableAvl<E, poolType, LessComparer, NodeAllocator> m_table;
     };
 }
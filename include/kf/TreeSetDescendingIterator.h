@@ -0,0 +1,40 @@
+#pragma once
+#include "GenericTableAvl.h"
+
+namespace kf
+{
+    ///////////////////////////////////////////////////////////////////////////////////////////////////
+    // TreeSetDescendingIterator - walks set elements in descending order, see TreeSetIterator
+
+    template<class E, POOL_TYPE poolType, class LessComparer=std::less<E>, class NodeAllocator=PoolNodeAllocator<poolType>>
+    class TreeSetDescendingIterator
+    {
+    public:
+        TreeSetDescendingIterator(GenericTableAvl<E, poolType, LessComparer, NodeAllocator>& table) : m_table(table), m_next(table.last())
+        {
+        }
+
+        // Starts from the given element of the table, nullptr means an empty iteration
+        TreeSetDescendingIterator(GenericTableAvl<E, poolType, LessComparer, NodeAllocator>& table, E* first) : m_table(table), m_next(first)
+        {
+        }
+
+        bool hasNext() const
+        {
+            return !!m_next;
+        }
+
+        E& next()
+        {
+            ASSERT(hasNext());
+
+            auto next = m_next;
+            m_next = m_table.prev(*next);
+            return *next;
+        }
+
+    private:
+        GenericTableAvl<E, poolType, LessComparer, NodeAllocator>&  m_table;
+        E*                                                          m_next;
+    };
+}
@@ -5,40 +5,39 @@ namespace kf
 {
     ///////////////////////////////////////////////////////////////////////////////////////////////////
     // TreeSetIterator - iterator for set container for NT kernel, inspired by http://docs.oracle.com/javase/7/docs/api/java/util/TreeSet.html
+    //
+    // Walks elements in ascending order. The element returned by next() can be removed from the set
+    // without invalidating the iterator.
 
-    template<class E, POOL_TYPE poolType>
+    template<class E, POOL_TYPE poolType, class LessComparer=std::less<E>, class NodeAllocator=PoolNodeAllocator<poolType>>
     class TreeSetIterator
     {
     public:
-        TreeSetIterator(GenericTableAvl<E, poolType>& table) : m_table(table), m_restartKey(), m_next()
+        TreeSetIterator(GenericTableAvl<E, poolType, LessComparer, NodeAllocator>& table) : m_table(table), m_next(table.first())
         {
         }
 
-        bool hasNext()
+        // Starts from the given element of the table, nullptr means an empty iteration
+        TreeSetIterator(GenericTableAvl<E, poolType, LessComparer, NodeAllocator>& table, E* first) : m_table(table), m_next(first)
         {
-            if (!m_next)
-            {
-                m_next = m_table.enumerateWithoutSplaying(m_restartKey);
-            }
+        }
 
+        bool hasNext() const
+        {
             return !!m_next;
         }
 
         E& next()
         {
-            if (!m_next)
-            {
-                m_next = m_table.enumerateWithoutSplaying(m_restartKey);
-            }
+            ASSERT(hasNext());
 
             auto next = m_next;
-            m_next = nullptr;
+            m_next = m_table.next(*next);
             return *next;
         }
 
     private:
-        GenericTableAvl<E, poolType>&   m_table;
-        PVOID                           m_restartKey;
-        E*                              m_next;
-    };                                            
-}
\ No newline at end of file
+        GenericTableAvl<E, poolType, LessComparer, NodeAllocator>&  m_table;
+        E*                                                          m_next;
+    };
+}
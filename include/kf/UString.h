@@ -1,21 +1,49 @@
 #pragma once
 #include "USimpleString.h"
+#include "AllocationStats.h"
 #include <utility>
 
 namespace kf
 {
+    ///////////////////////////////////////////////////////////////////////////////////////////////////
+    // UStringAllocator - default UString allocator, allocates buffers from the pool with poolTag
+
+    template<POOL_TYPE poolType, ULONG poolTag = '++SU'>
+    class UStringAllocator
+    {
+    public:
+        using value_type = std::byte;
+
+        std::byte* allocate(_In_ size_t byteSize) noexcept
+        {
+            return static_cast<std::byte*>(allocatePool(poolType, byteSize, poolTag));
+        }
+
+        void deallocate(_In_ std::byte* buffer, size_t byteSize) noexcept
+        {
+            freePool(buffer, byteSize, poolTag);
+        }
+    };
+
     ///////////////////////////////////////////////////////////////////////////////////////////////////
     // UString - owning string for NT kernel
+    //
+    // Allocator provides buffers: `std::byte* allocate(size_t)` and `void deallocate(std::byte*, size_t)`,
+    // for example, ArenaAllocator<std::byte>. Stateful allocators are passed to the constructor.
 
-    template<POOL_TYPE poolType>
-    class UString : public USimpleString
+    template<POOL_TYPE poolType, class Allocator = UStringAllocator<poolType>>
+    class UString : private Allocator, public USimpleString // Allocator is the first base to take no space if it's empty
     {
     public:
         UString() : m_buffer(nullptr)
         {
         }
 
-        UString(_Inout_ UString&& another) : USimpleString(std::move(another))
+        explicit UString(const Allocator& allocator) : Allocator(allocator), m_buffer(nullptr)
+        {
+        }
+
+        UString(_Inout_ UString&& another) : Allocator(another.allocator()), USimpleString(std::move(another))
         {
             m_buffer = another.m_buffer;
             another.m_buffer = nullptr;
@@ -75,10 +103,7 @@ namespace kf
 
             if (newByteLength > 0)
             {
-// 28160: Must succeed pool allocations are forbidden. Allocation failures cause a system crash.
-// 4996: ExAllocatePoolWithTag is deprecated, use ExAllocatePool2
-#pragma warning(suppress: 28160 4996) 
-                newBuffer = ::ExAllocatePoolWithTag(poolType, newByteLength, PoolTag);
+                newBuffer = allocator().allocate(newByteLength);
 
                 if (!newBuffer)
                 {
@@ -111,7 +136,7 @@ namespace kf
         {
             if (m_buffer)
             {
-                ::ExFreePoolWithTag(m_buffer, PoolTag);
+                allocator().deallocate(static_cast<std::byte*>(m_buffer), maxByteLength());
                 m_buffer = nullptr;
 
                 empty();
@@ -124,6 +149,7 @@ namespace kf
             {
                 free();
 
+                allocator() = another.allocator();
                 USimpleString::operator=(std::move(another));
 
                 m_buffer = another.m_buffer;
@@ -137,8 +163,10 @@ namespace kf
         UString(const UString&);
         UString& operator=(const UString&);
 
-    private:
-        enum { PoolTag = '++SU' };
+        Allocator& allocator()
+        {
+            return *this;
+        }
 
     private:
         void* m_buffer;
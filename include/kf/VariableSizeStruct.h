@@ -1,16 +1,22 @@
 #pragma once
 #include <kf/stl/new>
+#include <kf/Allocator.h>
 
 namespace kf
 {
-    template<class T, POOL_TYPE poolType>
-    class VariableSizeStruct
+    // Allocator is any byte allocator with allocate(count)/deallocate(p, count), for example kf::SlabAllocatorRef<std::byte>
+    template<class T, POOL_TYPE poolType, class Allocator = kf::Allocator<std::byte, poolType>>
+    class VariableSizeStruct : private Allocator
     {
     public:
         VariableSizeStruct(__in const VariableSizeStruct&) = delete;
         VariableSizeStruct& operator=(const VariableSizeStruct&) = delete;
         VariableSizeStruct() = default;
 
+        explicit VariableSizeStruct(const Allocator& allocator) : Allocator(allocator)
+        {
+        }
+
         template<class... Args>
         VariableSizeStruct(int bytes, Args&&... args)
         {
@@ -27,12 +33,14 @@ namespace kf
         {
             free();
 
-            m_buffer = reinterpret_cast<T*>(new(poolType) std::byte[bytes]);
+            m_buffer = reinterpret_cast<T*>(Allocator::allocate(bytes));
             if (!m_buffer)
             {
                 return STATUS_INSUFFICIENT_RESOURCES;
             }
 
+            m_bytes = bytes;
+
             new(m_buffer) T(std::forward<Args>(args)...);
             return STATUS_SUCCESS;
         }
@@ -42,7 +50,7 @@ namespace kf
             if (m_buffer)
             {
                 get()->~T();
-                delete[] reinterpret_cast<std::byte*>(m_buffer);
+                Allocator::deallocate(reinterpret_cast<std::byte*>(m_buffer), m_bytes);
                 m_buffer = nullptr;
             }
         }
@@ -74,5 +82,6 @@ namespace kf
 
     private:
         T* m_buffer = nullptr;
+        size_t m_bytes = 0;
     };
 }
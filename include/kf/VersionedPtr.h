@@ -0,0 +1,175 @@
+#pragma once
+#include "EResource.h"
+#include "RefCounted.h"
+#include "ReaderShards.h"
+#include <mutex>
+#include <utility>
+
+namespace kf
+{
+    //////////////////////////////////////////////////////////////////////////
+    // VersionedPtr - holder of an immutable RefCounted snapshot that is read often and replaced rarely
+    // (a configuration or a policy).
+    //
+    // pin() gives a reader the current snapshot without touching its reference counter: the reader is
+    // counted in a padded counter of its CPU instead, so readers on different CPUs don't share a written
+    // cache line. store() publishes a new snapshot and waits until readers that could have seen the old one
+    // unpin it, then releases it. Readers that need a snapshot longer than a pin call share().
+    //
+    //     kf::VersionedPtr<Policy> m_policy;
+    //     ...
+    //     status = m_policy.initialize();
+    //     ...
+    //     auto policy = m_policy.pin();
+    //     if (policy->isBlocked(fileName)) { ... }
+    //     ...
+    //     m_policy.store(kf::make_ref<Policy, NonPagedPoolNx>(newRules));
+    //
+    // Note: initialize() allocates a counter per possible processor and must be called before the first pin(),
+    // without it readers share one counter. Pins are short, store() waits for them. pin() can be called at
+    // IRQL <= DISPATCH_LEVEL, store() at PASSIVE_LEVEL, and a pin must not be held by the thread that calls store().
+
+    template<class T>
+    class VersionedPtr
+    {
+        struct Slot
+        {
+            RefCounted<const T> value;
+            ULONG64 version = 0;
+        };
+
+    public:
+        class Pin
+        {
+        public:
+            Pin(Pin&& another) noexcept
+                : m_slot(std::exchange(another.m_slot, nullptr)), m_readers(std::exchange(another.m_readers, nullptr))
+            {
+            }
+
+            ~Pin()
+            {
+                if (m_readers)
+                {
+                    detail::ReaderShards::leave(m_readers);
+                }
+            }
+
+            Pin(const Pin&) = delete;
+            Pin& operator=(const Pin&) = delete;
+            Pin& operator=(Pin&&) = delete;
+
+            const T* get() const noexcept
+            {
+                return m_slot->value.get();
+            }
+
+            const T& operator*() const noexcept
+            {
+                return *get();
+            }
+
+            const T* operator->() const noexcept
+            {
+                return get();
+            }
+
+            explicit operator bool() const noexcept
+            {
+                return get() != nullptr;
+            }
+
+            // The number of store() calls that preceded this snapshot
+            ULONG64 version() const noexcept
+            {
+                return m_slot->version;
+            }
+
+            // Takes a reference to the snapshot, so it can outlive the pin
+            RefCounted<const T> share() const noexcept
+            {
+                return m_slot->value;
+            }
+
+        private:
+            friend class VersionedPtr;
+
+            Pin(const Slot* slot, volatile LONG* readers) noexcept : m_slot(slot), m_readers(readers)
+            {
+            }
+
+        private:
+            const Slot* m_slot;
+            volatile LONG* m_readers;
+        };
+
+        explicit VersionedPtr(RefCounted<const T> value = nullptr) noexcept : m_current(&m_slots[0])
+        {
+            m_slots[0].value = std::move(value);
+        }
+
+        VersionedPtr(const VersionedPtr&) = delete;
+        VersionedPtr& operator=(const VersionedPtr&) = delete;
+
+        _IRQL_requires_max_(DISPATCH_LEVEL)
+        NTSTATUS initialize() noexcept
+        {
+            return m_readers.initialize();
+        }
+
+        _IRQL_requires_max_(DISPATCH_LEVEL)
+        [[nodiscard]] Pin pin() const noexcept
+        {
+            // store() either waits for this reader or has already published the new snapshot before it's loaded
+            volatile LONG* readers = m_readers.enter(m_generation);
+
+            return Pin(static_cast<const Slot*>(ReadPointerAcquire(&m_current)), readers);
+        }
+
+        // Takes a reference to the current snapshot
+        _IRQL_requires_max_(DISPATCH_LEVEL)
+        RefCounted<const T> load() const noexcept
+        {
+            return pin().share();
+        }
+
+        // Publishes the snapshot and returns after the previous one is released by this holder.
+        // Concurrent store() calls are serialized.
+        _IRQL_requires_(PASSIVE_LEVEL)
+        void store(RefCounted<const T> value) noexcept
+        {
+            RefCounted<const T> retired;
+
+            {
+                std::unique_lock lock(m_writerLock);
+
+                // The other slot is free: readers of it were waited for by the previous store()
+                Slot* previous = static_cast<Slot*>(m_current);
+                Slot* next = previous == &m_slots[0] ? &m_slots[1] : &m_slots[0];
+
+                next->value = std::move(value);
+                next->version = previous->version + 1;
+
+                InterlockedExchangePointer(&m_current, next);
+                const LONG generation = InterlockedIncrement(&m_generation) - 1;
+
+                m_readers.waitForReaders(generation & 1);
+
+                // The snapshot is released after the lock, so its destructor doesn't delay other writers
+                retired = std::move(previous->value);
+            }
+        }
+
+        ULONG64 version() const noexcept
+        {
+            return pin().version();
+        }
+
+    private:
+        mutable detail::ReaderShards m_readers;
+        PVOID volatile m_current; // Slot*
+        volatile LONG m_generation = 0;
+        Slot m_slots[2];
+        EResource m_writerLock;
+    };
+}
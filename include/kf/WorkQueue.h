@@ -0,0 +1,403 @@
+#pragma once
+#include "ObjectPool.h"
+#include "PoolTask.h"
+#include "Event.h"
+#include <algorithm>
+
+namespace kf
+{
+    //////////////////////////////////////////////////////////////////////////
+    // WorkQueue - runs submitted callables in batches on a single filter work item, a replacement of
+    // FltWorkItem::queue for bursts of small tasks (for example, post-operation processing).
+    //
+    // Producers push callables onto a lock-free SList, the first push to an idle queue queues the work item.
+    // The work item takes all queued callables at once and runs them in the submission order while the queue
+    // is not empty, after kRequeueThreshold callables it requeues itself to let other work items run.
+    // Nodes are cached in an ObjectPool and small callables are stored inline, so a submit usually doesn't
+    // allocate. submit() fails with STATUS_DEVICE_BUSY when maxDepth callables are queued.
+    //
+    //     kf::WorkQueue<NonPagedPoolNx> m_postOpQueue;
+    //     ...
+    //     m_postOpQueue.initialize(filter);
+    //     m_postOpQueue.submit([context] { context->process(); });
+    //
+    // Drivers that are not minifilters pass their driver or device object, the queue then runs on an I/O work item.
+    // Both kinds of work items keep the filter or the driver referenced while the routine runs, so the driver
+    // can't unload under a routine that has signaled the end of the rundown but hasn't returned yet.
+    //
+    // Note: rundown() or the destructor waits for the queued callables, it must be called before
+    // the filter is unregistered or the driver is unloaded.
+
+    template<POOL_TYPE poolType = NonPagedPoolNx>
+    class WorkQueue
+    {
+    public:
+        static constexpr LONG kDefaultMaxDepth = 64 * 1024;
+        static constexpr ULONG kRequeueThreshold = 1024;
+
+        struct Stats
+        {
+            ULONG64 submitted;
+            ULONG64 rejected;
+            ULONG64 executed;
+            ULONG64 batches;
+            LONG    depth;
+
+            // Time from submit to the start of the callable in 100ns units
+            ULONG64 totalLatency;
+            ULONG64 maxLatency;
+        };
+
+        WorkQueue() : m_drained(NotificationEvent, false)
+        {
+            InitializeSListHead(&m_list);
+        }
+
+        ~WorkQueue()
+        {
+            rundown();
+
+            if (m_workItem)
+            {
+                FltFreeGenericWorkItem(m_workItem);
+            }
+
+            if (m_ioWorkItem)
+            {
+                IoUninitializeWorkItem(m_ioWorkItem);
+                operator delete(m_ioWorkItem);
+            }
+        }
+
+        WorkQueue(const WorkQueue&) = delete;
+        WorkQueue& operator=(const WorkQueue&) = delete;
+
+        // Runs callables on a filter generic work item
+        _IRQL_requires_max_(APC_LEVEL)
+        NTSTATUS initialize(_In_ PFLT_FILTER filter, LONG maxDepth = kDefaultMaxDepth, WORK_QUEUE_TYPE queueType = DelayedWorkQueue)
+        {
+            ASSERT(filter);
+
+            return initializeQueue(filter, nullptr, maxDepth, queueType);
+        }
+
+        // Runs callables on an I/O work item of the driver
+        _IRQL_requires_max_(APC_LEVEL)
+        NTSTATUS initialize(_In_ PDRIVER_OBJECT driverObject, LONG maxDepth = kDefaultMaxDepth, WORK_QUEUE_TYPE queueType = DelayedWorkQueue)
+        {
+            ASSERT(driverObject);
+
+            return initializeQueue(nullptr, driverObject, maxDepth, queueType);
+        }
+
+        // Runs callables on an I/O work item of the device
+        _IRQL_requires_max_(APC_LEVEL)
+        NTSTATUS initialize(_In_ PDEVICE_OBJECT deviceObject, LONG maxDepth = kDefaultMaxDepth, WORK_QUEUE_TYPE queueType = DelayedWorkQueue)
+        {
+            ASSERT(deviceObject);
+
+            return initializeQueue(nullptr, deviceObject, maxDepth, queueType);
+        }
+
+        // Returns STATUS_DEVICE_BUSY if the queue is full and STATUS_DELETE_PENDING after rundown().
+        // If the work item can't be queued because the filter is unloading, the status is returned
+        // and the callable is discarded by rundown().
+        template<class F>
+        _IRQL_requires_max_(DISPATCH_LEVEL)
+        NTSTATUS submit(F&& routine) noexcept
+        {
+            ASSERT(m_initialized);
+
+            if (!addRef())
+            {
+                return STATUS_DELETE_PENDING;
+            }
+
+            NTSTATUS status = enqueue(std::forward<F>(routine));
+            if (NT_SUCCESS(status))
+            {
+                status = schedule();
+            }
+
+            release();
+            return status;
+        }
+
+        // Rejects new callables and waits for the queued ones
+        _IRQL_requires_max_(PASSIVE_LEVEL)
+        void rundown()
+        {
+            if (!m_initialized || InterlockedExchange(&m_closing, true))
+            {
+                return;
+            }
+
+            release();
+            m_drained.wait();
+
+            // Callables that were left after the work item failed to be queued
+            runBatch(InterlockedFlushSList(&m_list), false);
+        }
+
+        Stats stats() const
+        {
+            Stats stats;
+            stats.submitted = static_cast<ULONG64>(ReadNoFence64(&m_submitted));
+            stats.rejected = static_cast<ULONG64>(ReadNoFence64(&m_rejected));
+            stats.executed = static_cast<ULONG64>(ReadNoFence64(&m_executed));
+            stats.batches = static_cast<ULONG64>(ReadNoFence64(&m_batches));
+            stats.depth = ReadNoFence(&m_depth);
+            stats.totalLatency = static_cast<ULONG64>(ReadNoFence64(&m_totalLatency));
+            stats.maxLatency = static_cast<ULONG64>(ReadNoFence64(&m_maxLatency));
+
+            return stats;
+        }
+
+    private:
+        static constexpr USHORT kNodeCacheSize = 1024;
+
+        NTSTATUS initializeQueue(PFLT_FILTER filter, PVOID ioObject, LONG maxDepth, WORK_QUEUE_TYPE queueType)
+        {
+            ASSERT(!m_initialized);
+
+            m_filter = filter;
+            m_maxDepth = maxDepth;
+            m_queueType = queueType;
+
+            const NTSTATUS status = m_nodes.initialize(0, kNodeCacheSize);
+            if (!NT_SUCCESS(status))
+            {
+                return status;
+            }
+
+            if (filter)
+            {
+                m_workItem = FltAllocateGenericWorkItem();
+                if (!m_workItem)
+                {
+                    return STATUS_INSUFFICIENT_RESOURCES;
+                }
+            }
+            else
+            {
+                m_ioWorkItem = static_cast<PIO_WORKITEM>(operator new(IoSizeofWorkItem(), NonPagedPoolNx));
+                if (!m_ioWorkItem)
+                {
+                    return STATUS_INSUFFICIENT_RESOURCES;
+                }
+
+                IoInitializeWorkItem(ioObject, m_ioWorkItem);
+            }
+
+            m_initialized = true;
+            m_refCount = 1;
+            m_closing = false;
+            m_drained.clear();
+
+            return STATUS_SUCCESS;
+        }
+
+        struct Node
+        {
+            SLIST_ENTRY      entry;
+            LONGLONG         submitTime;
+            detail::PoolTask task;
+        };
+
+        template<class F>
+        NTSTATUS enqueue(F&& routine) noexcept
+        {
+            if (InterlockedIncrement(&m_depth) > m_maxDepth)
+            {
+                InterlockedDecrement(&m_depth);
+                InterlockedIncrement64(&m_rejected);
+                return STATUS_DEVICE_BUSY;
+            }
+
+            Node* node = m_nodes.acquire();
+            if (!node || !node->task.template assign<poolType>(std::forward<F>(routine)))
+            {
+                m_nodes.release(node);
+                InterlockedDecrement(&m_depth);
+                return STATUS_INSUFFICIENT_RESOURCES;
+            }
+
+            node->submitTime = static_cast<LONGLONG>(KeQueryInterruptTime());
+
+            InterlockedPushEntrySList(&m_list, &node->entry);
+            InterlockedIncrement64(&m_submitted);
+
+            return STATUS_SUCCESS;
+        }
+
+        NTSTATUS schedule() noexcept
+        {
+            if (InterlockedCompareExchange(&m_scheduled, true, false))
+            {
+                return STATUS_SUCCESS;
+            }
+
+            // The work item keeps a reference till its routine returns. It's taken even if the queue is closing,
+            // the caller's reference keeps rundown() waiting.
+            InterlockedIncrement(&m_refCount);
+
+            const NTSTATUS status = queueWorkItem();
+            if (!NT_SUCCESS(status))
+            {
+                InterlockedExchange(&m_scheduled, false);
+                release();
+            }
+
+            return status;
+        }
+
+        NTSTATUS queueWorkItem() noexcept
+        {
+            if (m_workItem)
+            {
+                return FltQueueGenericWorkItem(m_workItem, m_filter, &workItemRoutine, m_queueType, this);
+            }
+
+            IoQueueWorkItemEx(m_ioWorkItem, &ioWorkItemRoutine, m_queueType, this);
+            return STATUS_SUCCESS;
+        }
+
+        static void workItemRoutine(PFLT_GENERIC_WORKITEM, PVOID, PVOID context)
+        {
+            static_cast<WorkQueue*>(context)->drain();
+        }
+
+        static void ioWorkItemRoutine(PVOID, PVOID context, PIO_WORKITEM)
+        {
+            static_cast<WorkQueue*>(context)->drain();
+        }
+
+        void drain()
+        {
+            for (ULONG executed = 0;;)
+            {
+                PSLIST_ENTRY entries = InterlockedFlushSList(&m_list);
+                if (!entries)
+                {
+                    InterlockedExchange(&m_scheduled, false);
+
+                    // A callable pushed after the flush could see the queue as scheduled. The depth is 16-bit
+                    // and wraps at 64K entries, so the emptiness is checked by the first entry.
+                    if (!RtlFirstEntrySList(&m_list) || InterlockedCompareExchange(&m_scheduled, true, false))
+                    {
+                        break;
+                    }
+
+                    continue;
+                }
+
+                executed += runBatch(entries, true);
+
+                if (executed >= kRequeueThreshold && RtlFirstEntrySList(&m_list))
+                {
+                    // The reference is passed to the next run
+                    if (NT_SUCCESS(queueWorkItem()))
+                    {
+                        return;
+                    }
+
+                    executed = 0;
+                }
+            }
+
+            release();
+        }
+
+        // Runs or discards callables in the submission order and returns their number
+        ULONG runBatch(PSLIST_ENTRY entries, bool run)
+        {
+            // The SList is LIFO
+            PSLIST_ENTRY reversed = nullptr;
+
+            while (entries)
+            {
+                PSLIST_ENTRY next = entries->Next;
+                entries->Next = reversed;
+                reversed = entries;
+                entries = next;
+            }
+
+            ULONG count = 0;
+
+            for (PSLIST_ENTRY entry = reversed; entry; ++count)
+            {
+                Node* node = CONTAINING_RECORD(entry, Node, entry);
+                entry = entry->Next;
+
+                if (run)
+                {
+                    const LONG64 latency = static_cast<LONG64>(KeQueryInterruptTime()) - node->submitTime;
+                    const LONG64 maxLatency = m_maxLatency;
+
+                    // There is a single consumer, so the counters are only written here
+                    WriteNoFence64(&m_totalLatency, m_totalLatency + latency);
+                    WriteNoFence64(&m_maxLatency, (std::max)(maxLatency, latency));
+
+                    node->task();
+                    WriteNoFence64(&m_executed, m_executed + 1);
+                }
+                else
+                {
+                    node->task.discard();
+                }
+
+                m_nodes.release(node);
+                InterlockedDecrement(&m_depth);
+            }
+
+            if (count)
+            {
+                WriteNoFence64(&m_batches, m_batches + 1);
+            }
+
+            return count;
+        }
+
+        bool addRef() noexcept
+        {
+            InterlockedIncrement(&m_refCount);
+
+            if (ReadAcquire(&m_closing))
+            {
+                release();
+                return false;
+            }
+
+            return true;
+        }
+
+        void release() noexcept
+        {
+            if (!InterlockedDecrement(&m_refCount))
+            {
+                m_drained.set();
+            }
+        }
+
+    private:
+        PFLT_FILTER             m_filter = nullptr;
+        PFLT_GENERIC_WORKITEM   m_workItem = nullptr;
+        PIO_WORKITEM            m_ioWorkItem = nullptr;
+        bool                    m_initialized = false;
+        WORK_QUEUE_TYPE         m_queueType = DelayedWorkQueue;
+        LONG                    m_maxDepth = kDefaultMaxDepth;
+        SLIST_HEADER            m_list;
+        ObjectPool<Node, poolType> m_nodes;
+        Event                   m_drained;
+        volatile LONG           m_refCount = 0;
+        volatile LONG           m_closing = false;
+        volatile LONG           m_scheduled = false;
+        volatile LONG           m_depth = 0;
+        volatile LONG64         m_submitted = 0;
+        volatile LONG64         m_rejected = 0;
+        volatile LONG64         m_executed = 0;
+        volatile LONG64         m_batches = 0;
+        volatile LONG64         m_totalLatency = 0;
+        volatile LONG64         m_maxLatency = 0;
+    };
+}
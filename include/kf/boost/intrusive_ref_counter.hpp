@@ -62,6 +62,8 @@ template< typename DerivedT, typename CounterPolicyT >
 void intrusive_ptr_add_ref(const intrusive_ref_counter< DerivedT, CounterPolicyT >* p) BOOST_SP_NOEXCEPT;
 template< typename DerivedT, typename CounterPolicyT >
 void intrusive_ptr_release(const intrusive_ref_counter< DerivedT, CounterPolicyT >* p) BOOST_SP_NOEXCEPT;
+template< typename DerivedT, typename CounterPolicyT >
+void intrusive_ptr_collapse(const intrusive_ref_counter< DerivedT, CounterPolicyT >* p) BOOST_SP_NOEXCEPT;
 
 /*!
  * \brief A reference counter base class
@@ -125,6 +127,7 @@ protected:
 
     friend void intrusive_ptr_add_ref< DerivedT, CounterPolicyT >(const intrusive_ref_counter< DerivedT, CounterPolicyT >* p) BOOST_SP_NOEXCEPT;
     friend void intrusive_ptr_release< DerivedT, CounterPolicyT >(const intrusive_ref_counter< DerivedT, CounterPolicyT >* p) BOOST_SP_NOEXCEPT;
+    friend void intrusive_ptr_collapse< DerivedT, CounterPolicyT >(const intrusive_ref_counter< DerivedT, CounterPolicyT >* p) BOOST_SP_NOEXCEPT;
 };
 
 template< typename DerivedT, typename CounterPolicyT >
@@ -140,6 +143,16 @@ inline void intrusive_ptr_release(const intrusive_ref_counter< DerivedT, Counter
         delete static_cast< const DerivedT* >(p);
 }
 
+/*!
+ * Switches a sharded counter to a single count before teardown, only for policies that have \c collapse
+ * (see kf::ShardedCounterPolicy)
+ */
+template< typename DerivedT, typename CounterPolicyT >
+inline void intrusive_ptr_collapse(const intrusive_ref_counter< DerivedT, CounterPolicyT >* p) BOOST_SP_NOEXCEPT
+{
+    CounterPolicyT::collapse(p->m_ref_counter);
+}
+
 } // namespace sp_adl_block
 
 using sp_adl_block::intrusive_ref_counter;
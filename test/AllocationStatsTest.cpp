@@ -0,0 +1,158 @@
+#include "pch.h"
+#include <kf/AllocationStats.h>
+#include <kf/stl/vector>
+#include <kf/stl/memory>
+#include <kf/UString.h>
+#include <kf/TreeMap.h>
+#include <kf/VariableSizeStruct.h>
+#include <kf/ScopeExit.h>
+
+namespace
+{
+    using Snapshot = kf::AllocationStats::Snapshot;
+    using TagStats = kf::AllocationStats::TagStats;
+
+    TagStats findTag(const Snapshot& snapshot, ULONG tag)
+    {
+        for (ULONG i = 0; i < snapshot.tagCount; ++i)
+        {
+            if (snapshot.tags[i].tag == tag)
+            {
+                return snapshot.tags[i];
+            }
+        }
+
+        return {};
+    }
+
+    TagStats currentStats(ULONG tag)
+    {
+        auto snapshot = kf::make_unique<Snapshot, NonPagedPoolNx>();
+        REQUIRE(snapshot);
+
+        kf::AllocationStats::snapshot(*snapshot);
+        return findTag(*snapshot, tag);
+    }
+}
+
+#if !KF_ALLOCATION_STATS
+// Compiled out accounting must not change tagged allocators and containers that use them
+static_assert(!kf::AllocationStats::kEnabled);
+static_assert(std::is_empty_v<kf::Allocator<int, NonPagedPoolNx, 'cVtT'>>);
+static_assert(sizeof(kf::vector<int, NonPagedPoolNx, kf::Allocator<int, NonPagedPoolNx, 'cVtT'>>) == sizeof(kf::vector<int, NonPagedPoolNx>));
+static_assert(std::is_empty_v<kf::PoolNodeAllocator<PagedPool, 'rTtT'>>);
+static_assert(std::is_empty_v<kf::PoolNodeAllocator<PagedPool>>);
+#endif
+
+SCENARIO("kf::AllocationStats")
+{
+#if !KF_ALLOCATION_STATS
+    REQUIRE(kf::AllocationStats::initialize() == STATUS_NOT_SUPPORTED);
+#else
+    // Every run of the scenario starts with zero counters
+    REQUIRE_NT_SUCCESS(kf::AllocationStats::initialize());
+    SCOPE_EXIT{ kf::AllocationStats::uninitialize(); };
+
+    GIVEN("tagged pool allocations")
+    {
+        constexpr ULONG kTag = 'lAtT';
+
+        void* small = kf::allocatePool(NonPagedPoolNx, 10, kTag);
+        void* large = kf::allocatePool(NonPagedPoolNx, 1000, kTag);
+        REQUIRE(small);
+        REQUIRE(large);
+
+        const TagStats allocated = currentStats(kTag);
+
+        kf::freePool(small, 10, kTag);
+        kf::freePool(large, 1000, kTag);
+
+        const TagStats freed = currentStats(kTag);
+
+        THEN("live bytes, counts and histogram are tracked")
+        {
+            REQUIRE(allocated.allocations == 2);
+            REQUIRE(allocated.frees == 0);
+            REQUIRE(allocated.liveBytes == 1010);
+            REQUIRE(allocated.histogram[0] == 1);
+            REQUIRE(allocated.histogram[kf::AllocationStats::histogramBucket(1000)] == 1);
+        }
+
+        THEN("live bytes drop to zero when they are freed")
+        {
+            REQUIRE(freed.allocations == 2);
+            REQUIRE(freed.frees == 2);
+            REQUIRE(freed.liveBytes == 0);
+        }
+    }
+
+    GIVEN("histogram buckets")
+    {
+        THEN("sizes are bucketed by powers of two")
+        {
+            REQUIRE(kf::AllocationStats::histogramBucket(0) == 0);
+            REQUIRE(kf::AllocationStats::histogramBucket(16) == 0);
+            REQUIRE(kf::AllocationStats::histogramBucket(17) == 1);
+            REQUIRE(kf::AllocationStats::histogramBucket(32) == 1);
+            REQUIRE(kf::AllocationStats::histogramBucket(1024 * 1024) == kf::AllocationStats::kHistogramBuckets - 1);
+        }
+    }
+
+    GIVEN("two snapshots one second apart")
+    {
+        TagStats previous = {};
+        TagStats current = {};
+        current.allocations = 500;
+
+        THEN("the allocation rate is computed")
+        {
+            REQUIRE(kf::AllocationStats::allocationsPerSecond(previous, 0, current, 10'000'000) == 500);
+            REQUIRE(kf::AllocationStats::allocationsPerSecond(previous, 5, current, 5) == 0);
+        }
+    }
+
+    GIVEN("containers with their own tags")
+    {
+        constexpr ULONG kVectorTag = 'cVtT';
+        constexpr ULONG kStringTag = 'tStT';
+        constexpr ULONG kTreeTag = 'rTtT';
+        constexpr ULONG kStructTag = 'sVtT';
+
+        {
+            kf::vector<int, NonPagedPoolNx, kf::Allocator<int, NonPagedPoolNx, kVectorTag>> v;
+            for (int i = 0; i < 100; ++i)
+            {
+                REQUIRE_NT_SUCCESS(v.push_back(i));
+            }
+
+            kf::UString<PagedPool, kf::UStringAllocator<PagedPool, kStringTag>> str;
+            REQUIRE_NT_SUCCESS(str.init(L"tagged string"));
+
+            kf::TreeMap<int, int, PagedPool, std::less<int>, kf::PoolNodeAllocator<PagedPool, kTreeTag>> map;
+            for (int i = 0; i < 10; ++i)
+            {
+                REQUIRE_NT_SUCCESS(map.put(i, i));
+            }
+
+            kf::VariableSizeStruct<int, PagedPool, kf::Allocator<std::byte, PagedPool, kStructTag>> var;
+            REQUIRE_NT_SUCCESS(var.emplace(64, 1));
+
+            THEN("their memory is attributed to their tags")
+            {
+                REQUIRE(currentStats(kVectorTag).liveBytes >= static_cast<LONG64>(100 * sizeof(int)));
+                REQUIRE(currentStats(kStringTag).liveBytes > 0);
+                REQUIRE(currentStats(kTreeTag).allocations == 10);
+                REQUIRE(currentStats(kStructTag).liveBytes == 64);
+            }
+        }
+
+        THEN("nothing is live when the containers are destroyed")
+        {
+            REQUIRE(currentStats(kVectorTag).liveBytes == 0);
+            REQUIRE(currentStats(kStringTag).liveBytes == 0);
+            REQUIRE(currentStats(kTreeTag).liveBytes == 0);
+            REQUIRE(currentStats(kStructTag).liveBytes == 0);
+        }
+    }
+#endif
+}
@@ -0,0 +1,214 @@
+#include "pch.h"
+#include <kf/ConcurrentHashMap.h>
+#include <kf/Thread.h>
+
+namespace
+{
+    using IntConcurrentHashMap = kf::ConcurrentHashMap<int, int, NonPagedPoolNx, kf::SpinLockPolicy, 8>;
+
+    constexpr int kKeyCount = 100;
+    constexpr int kThreadCount = 4;
+    constexpr int kIterationCount = 2000;
+
+    template<class Map>
+    struct StressContext
+    {
+        Map* map;
+        int threadIndex;
+        LONG* failures;
+    };
+
+    // Every writer owns keys with (key % kThreadCount == threadIndex) and flips their values,
+    // readers check that a value always belongs to its key.
+    template<class Map>
+    NTSTATUS writerRoutine(StressContext<Map>* context)
+    {
+        for (int i = 0; i < kIterationCount; ++i)
+        {
+            const int key = (i % (kKeyCount / kThreadCount)) * kThreadCount + context->threadIndex;
+
+            if (i % 3 == 0)
+            {
+                context->map->remove(key);
+            }
+            else if (!NT_SUCCESS(context->map->put(key, key * 10)))
+            {
+                InterlockedIncrement(context->failures);
+            }
+        }
+
+        return STATUS_SUCCESS;
+    }
+
+    template<class Map>
+    NTSTATUS readerRoutine(StressContext<Map>* context)
+    {
+        for (int i = 0; i < kIterationCount; ++i)
+        {
+            const int key = i % kKeyCount;
+
+            auto value = context->map->get(key);
+            if (value && *value != key * 10)
+            {
+                InterlockedIncrement(context->failures);
+            }
+
+            context->map->forEach([&](const int& k, const int& v)
+                {
+                    if (v != k * 10)
+                    {
+                        InterlockedIncrement(context->failures);
+                    }
+
+                    return k < 10;
+                });
+        }
+
+        return STATUS_SUCCESS;
+    }
+
+    template<class Map>
+    void runStress(Map& map)
+    {
+        LONG failures = 0;
+        StressContext<Map> contexts[kThreadCount * 2];
+        kf::Thread threads[kThreadCount * 2];
+
+        for (int i = 0; i < kThreadCount * 2; ++i)
+        {
+            contexts[i] = { &map, i % kThreadCount, &failures };
+
+            NTSTATUS status = i < kThreadCount
+                ? threads[i].start([](PVOID context) { PsTerminateSystemThread(writerRoutine(static_cast<StressContext<Map>*>(context))); }, &contexts[i])
+                : threads[i].start([](PVOID context) { PsTerminateSystemThread(readerRoutine(static_cast<StressContext<Map>*>(context))); }, &contexts[i]);
+            REQUIRE_NT_SUCCESS(status);
+        }
+
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        REQUIRE(failures == 0);
+    }
+}
+
+SCENARIO("kf::ConcurrentHashMap")
+{
+    GIVEN("empty map")
+    {
+        IntConcurrentHashMap map;
+
+        THEN("it is empty")
+        {
+            REQUIRE(map.isEmpty());
+            REQUIRE(map.size() == 0);
+            REQUIRE(!map.containsKey(1));
+            REQUIRE(!map.get(1));
+            REQUIRE(!map.remove(1));
+        }
+
+        WHEN("values are put")
+        {
+            for (int key = 0; key < kKeyCount; ++key)
+            {
+                REQUIRE_NT_SUCCESS(map.put(key, key * 10));
+            }
+
+            THEN("they are spread over shards and accessible")
+            {
+                REQUIRE(map.size() == kKeyCount);
+
+                for (int key = 0; key < kKeyCount; ++key)
+                {
+                    REQUIRE(map.containsKey(key));
+                    REQUIRE(*map.get(key) == key * 10);
+                }
+            }
+
+            THEN("find calls the function for an existing key only")
+            {
+                int found = 0;
+                REQUIRE(map.find(5, [&](const int& value) { found = value; }));
+                REQUIRE(found == 50);
+                REQUIRE(!map.find(kKeyCount, [&](const int&) { found = 0; }));
+                REQUIRE(found == 50);
+            }
+
+            THEN("forEach visits all entries")
+            {
+                int count = 0;
+                map.forEach([&](const int& key, const int& value)
+                    {
+                        REQUIRE(value == key * 10);
+                        ++count;
+                    });
+
+                REQUIRE(count == kKeyCount);
+            }
+
+            THEN("forEach stops if the function returns false")
+            {
+                int count = 0;
+                map.forEach([&](const int&, const int&) { return ++count < 3; });
+
+                REQUIRE(count == 3);
+            }
+
+            THEN("values can be removed")
+            {
+                for (int key = 0; key < kKeyCount; ++key)
+                {
+                    REQUIRE(map.remove(key));
+                }
+
+                REQUIRE(map.isEmpty());
+            }
+
+            THEN("clear removes all values")
+            {
+                map.clear();
+                REQUIRE(map.isEmpty());
+            }
+        }
+
+        WHEN("computeIfAbsent is called")
+        {
+            int computeCount = 0;
+            auto compute = [&] { return ++computeCount; };
+
+            REQUIRE_NT_SUCCESS(map.computeIfAbsent(1, compute));
+            REQUIRE_NT_SUCCESS(map.computeIfAbsent(1, compute));
+
+            int value = 0;
+            REQUIRE_NT_SUCCESS(map.computeIfAbsent(1, compute, [&](int& existing) { value = existing; }));
+
+            THEN("the value is computed only once")
+            {
+                REQUIRE(computeCount == 1);
+                REQUIRE(value == 1);
+                REQUIRE(*map.get(1) == 1);
+            }
+        }
+    }
+
+    GIVEN("map with spin lock shards used by multiple threads")
+    {
+        IntConcurrentHashMap map;
+
+        THEN("readers always see consistent values")
+        {
+            runStress(map);
+        }
+    }
+
+    GIVEN("map with push lock shards used by multiple threads")
+    {
+        kf::ConcurrentHashMap<int, int, PagedPool, kf::PushLockPolicy, 8> map;
+
+        THEN("readers always see consistent values")
+        {
+            runStress(map);
+        }
+    }
+}
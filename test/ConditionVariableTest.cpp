@@ -0,0 +1,229 @@
+#include "pch.h"
+#include <kf/ConditionVariable.h>
+#include <kf/Thread.h>
+#include <mutex>
+#include <shared_mutex>
+
+namespace
+{
+    constexpr LONGLONG kMillisecond = 10'000;
+    constexpr int kWaiterCount = 4;
+
+    void sleep(LONGLONG time)
+    {
+        LARGE_INTEGER interval{ .QuadPart = -time };
+        KeDelayExecutionThread(KernelMode, false, &interval);
+    }
+
+    struct WaiterContext
+    {
+        kf::EResource* resource;
+        kf::ConditionVariable<kf::EResource>* cv;
+        volatile LONG waiting;
+        volatile LONG woken;
+        bool shared;
+    };
+
+    // Waits once without a predicate, so every return is a wakeup
+    void waiterRoutine(PVOID rawContext)
+    {
+        auto context = static_cast<WaiterContext*>(rawContext);
+
+        if (context->shared)
+        {
+            std::shared_lock lock(*context->resource);
+            InterlockedIncrement(&context->waiting);
+            context->cv->wait(lock);
+        }
+        else
+        {
+            std::unique_lock lock(*context->resource);
+            InterlockedIncrement(&context->waiting);
+            context->cv->wait(lock);
+        }
+
+        InterlockedIncrement(&context->woken);
+        PsTerminateSystemThread(STATUS_SUCCESS);
+    }
+
+    constexpr int kItemCount = 2000;
+
+    struct QueueContext
+    {
+        kf::EResource* resource;
+        kf::ConditionVariable<kf::EResource>* notEmpty;
+        int items;
+        int consumed;
+        LONG emptyWakeups;
+    };
+
+    void consumerRoutine(PVOID rawContext)
+    {
+        auto context = static_cast<QueueContext*>(rawContext);
+        std::unique_lock lock(*context->resource);
+
+        while (context->consumed < kItemCount)
+        {
+            // A wakeup that finds nothing to consume is wasted
+            while (!context->items)
+            {
+                context->notEmpty->wait(lock);
+
+                if (!context->items && context->consumed < kItemCount)
+                {
+                    ++context->emptyWakeups;
+                }
+            }
+
+            --context->items;
+            ++context->consumed;
+        }
+
+        PsTerminateSystemThread(STATUS_SUCCESS);
+    }
+}
+
+SCENARIO("kf::ConditionVariable")
+{
+    GIVEN("a condition variable and a resource")
+    {
+        kf::EResource resource;
+        kf::ConditionVariable<kf::EResource> cv;
+
+        WHEN("wait_for times out")
+        {
+            std::unique_lock lock(resource);
+
+            const auto start = KeQueryInterruptTime();
+            const auto status = cv.wait_for(lock, 20 * kMillisecond);
+            const auto elapsed = KeQueryInterruptTime() - start;
+
+            THEN("the lock is held again")
+            {
+                REQUIRE(status == kf::ConditionVariable<kf::EResource>::Status::Timeout);
+                REQUIRE(elapsed >= 20 * kMillisecond);
+                REQUIRE(lock.owns_lock());
+                REQUIRE(resource.isAcquiredExclusive());
+            }
+        }
+
+        WHEN("a predicate is false till the deadline")
+        {
+            std::unique_lock lock(resource);
+            const bool result = cv.wait_until(lock, KeQueryInterruptTime() + 10 * kMillisecond, [] { return false; });
+
+            THEN("wait_until returns false")
+            {
+                REQUIRE(!result);
+            }
+        }
+
+        WHEN("a predicate is already true")
+        {
+            std::unique_lock lock(resource);
+
+            THEN("wait_for returns without waiting")
+            {
+                REQUIRE(cv.wait_for(lock, 0, [] { return true; }));
+            }
+        }
+
+        WHEN("notifyOne is called with several waiters")
+        {
+            WaiterContext context = { &resource, &cv };
+            kf::Thread threads[kWaiterCount];
+
+            for (auto& thread : threads)
+            {
+                REQUIRE_NT_SUCCESS(thread.start(&waiterRoutine, &context));
+            }
+
+            while (context.waiting < kWaiterCount)
+            {
+                sleep(kMillisecond);
+            }
+
+            {
+                // Waiters are queued before they release the resource
+                std::unique_lock lock(resource);
+            }
+
+            cv.notifyOne();
+            sleep(30 * kMillisecond);
+            const LONG wokenByOne = context.woken;
+
+            cv.notifyAll();
+
+            for (auto& thread : threads)
+            {
+                thread.join();
+            }
+
+            THEN("exactly one waiter is woken")
+            {
+                REQUIRE(wokenByOne == 1);
+                REQUIRE(context.woken == kWaiterCount);
+            }
+        }
+
+        WHEN("waiters hold the resource shared")
+        {
+            WaiterContext context = { &resource, &cv, 0, 0, true };
+            kf::Thread threads[kWaiterCount];
+
+            for (auto& thread : threads)
+            {
+                REQUIRE_NT_SUCCESS(thread.start(&waiterRoutine, &context));
+            }
+
+            while (context.waiting < kWaiterCount)
+            {
+                sleep(kMillisecond);
+            }
+
+            {
+                std::unique_lock lock(resource);
+            }
+
+            cv.notifyAll();
+
+            for (auto& thread : threads)
+            {
+                thread.join();
+            }
+
+            THEN("all of them are woken and reacquire it shared")
+            {
+                REQUIRE(context.woken == kWaiterCount);
+                REQUIRE(!resource.isAcquiredExclusive());
+            }
+        }
+    }
+
+    GIVEN("a producer and a consumer")
+    {
+        // notifyOne under the lock wakes only a waiter that is queued, so the consumer never wakes up to an empty queue
+        kf::EResource resource;
+        kf::ConditionVariable<kf::EResource> notEmpty;
+        QueueContext context = { &resource, &notEmpty };
+
+        kf::Thread consumer;
+        REQUIRE_NT_SUCCESS(consumer.start(&consumerRoutine, &context));
+
+        for (int i = 0; i < kItemCount; ++i)
+        {
+            std::unique_lock lock(resource);
+            ++context.items;
+
+            notEmpty.notifyOne();
+        }
+
+        consumer.join();
+
+        THEN("every item is consumed without wasted wakeups")
+        {
+            REQUIRE(context.consumed == kItemCount);
+            REQUIRE(context.emptyWakeups == 0);
+        }
+    }
+}
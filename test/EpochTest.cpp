@@ -0,0 +1,257 @@
+#include "pch.h"
+#include <kf/Epoch.h>
+#include <kf/Event.h>
+#include <kf/Thread.h>
+#include "StressUtils.h"
+#include <kf/stl/new>
+
+namespace
+{
+    constexpr int kIterationCount = 2000;
+
+    volatile LONG g_liveNodes = 0;
+
+    struct Node
+    {
+        explicit Node(LONG64 generation) : generation(generation), doubled(generation * 2)
+        {
+            InterlockedIncrement(&g_liveNodes);
+        }
+
+        ~Node()
+        {
+            // Poisoned, so a reader of a freed node sees a torn one
+            doubled = -1;
+            InterlockedDecrement(&g_liveNodes);
+        }
+
+        LONG64 generation;
+        LONG64 doubled;
+    };
+
+    struct StressContext
+    {
+        kf::Epoch* epoch;
+        PVOID volatile current; // Node*
+        volatile LONG threadIndex;
+        volatile LONG64 reads;
+        volatile LONG64 retires;
+        volatile LONG tornReads;
+        volatile LONG failedRetires;
+    };
+
+    // Writers replace the current node and retire the old one, readers read it under a guard
+    void stressRoutine(PVOID rawContext)
+    {
+        auto context = static_cast<StressContext*>(rawContext);
+        const bool writer = stress::isWriter(context->threadIndex);
+
+        for (int i = 0; i < kIterationCount; ++i)
+        {
+            if (writer)
+            {
+                auto node = new(NonPagedPoolNx) Node(i);
+                if (!node)
+                {
+                    InterlockedIncrement(&context->failedRetires);
+                    continue;
+                }
+
+                auto old = static_cast<Node*>(InterlockedExchangePointer(&context->current, node));
+
+                if (!NT_SUCCESS(context->epoch->retire(old)))
+                {
+                    InterlockedIncrement(&context->failedRetires);
+                    context->epoch->synchronize();
+                    delete old;
+                }
+
+                // Every writer helps to reclaim from time to time, the background thread does the rest
+                if (i % 256 == 0)
+                {
+                    context->epoch->reclaim();
+                }
+            }
+            else
+            {
+                kf::Epoch::Guard guard(*context->epoch);
+
+                auto node = static_cast<const Node*>(ReadPointerAcquire(&context->current));
+                YieldProcessor();
+
+                if (node->doubled != node->generation * 2)
+                {
+                    InterlockedIncrement(&context->tornReads);
+                }
+            }
+        }
+
+        InterlockedAdd64(writer ? &context->retires : &context->reads, kIterationCount);
+
+        PsTerminateSystemThread(STATUS_SUCCESS);
+    }
+
+    struct ReaderContext
+    {
+        kf::Epoch* epoch;
+        kf::Event entered{ NotificationEvent, false };
+        kf::Event leave{ NotificationEvent, false };
+    };
+
+    void readerRoutine(PVOID rawContext)
+    {
+        auto context = static_cast<ReaderContext*>(rawContext);
+
+        {
+            kf::Epoch::Guard guard(*context->epoch);
+
+            context->entered.set();
+            context->leave.wait();
+        }
+
+        PsTerminateSystemThread(STATUS_SUCCESS);
+    }
+}
+
+SCENARIO("kf::Epoch")
+{
+    GIVEN("an epoch without the background thread")
+    {
+        // Not initialized, readers share one counter
+        kf::Epoch epoch;
+        LONG deleted = 0;
+
+        WHEN("objects are retired with a deleter and reclaimed")
+        {
+            const auto deleter = [&deleted](LONG* object) { ++deleted; *object = -1; };
+
+            LONG first = 1;
+            LONG second = 2;
+            REQUIRE_NT_SUCCESS(epoch.retire(&first, deleter));
+            REQUIRE_NT_SUCCESS(epoch.retire(&second, deleter));
+
+            const LONG pendingBefore = epoch.pendingCount();
+            const ULONG reclaimed = epoch.reclaim();
+
+            THEN("they are deleted only by the reclaim")
+            {
+                REQUIRE(pendingBefore == 2);
+                REQUIRE(reclaimed == 2);
+                REQUIRE(deleted == 2);
+                REQUIRE(first == -1);
+                REQUIRE(second == -1);
+                REQUIRE(epoch.pendingCount() == 0);
+                REQUIRE(epoch.reclaim() == 0);
+            }
+        }
+
+        WHEN("guards are nested and held at DISPATCH_LEVEL")
+        {
+            KIRQL oldIrql;
+            KeRaiseIrql(DISPATCH_LEVEL, &oldIrql);
+
+            {
+                kf::Epoch::Guard outer(epoch);
+                kf::Epoch::Guard inner(epoch);
+            }
+
+            KeLowerIrql(oldIrql);
+
+            THEN("a grace period completes after they are released")
+            {
+                epoch.synchronize();
+                REQUIRE(KeGetCurrentIrql() == PASSIVE_LEVEL);
+            }
+        }
+
+        WHEN("an object is retired with the default deleter and the epoch is destroyed")
+        {
+            {
+                kf::Epoch scopedEpoch;
+
+                auto node = new(NonPagedPoolNx) Node(1);
+                REQUIRE(node);
+                REQUIRE_NT_SUCCESS(scopedEpoch.retire(node));
+                REQUIRE(g_liveNodes == 1);
+            }
+
+            THEN("the object is deleted")
+            {
+                REQUIRE(g_liveNodes == 0);
+            }
+        }
+    }
+
+    GIVEN("an epoch with the background thread and a reader holding a guard")
+    {
+        kf::Epoch epoch;
+        REQUIRE_NT_SUCCESS(epoch.initialize());
+        REQUIRE_NT_SUCCESS(epoch.start());
+
+        ReaderContext readerContext;
+        readerContext.epoch = &epoch;
+
+        kf::Thread reader;
+        REQUIRE_NT_SUCCESS(reader.start(&readerRoutine, &readerContext));
+        readerContext.entered.wait();
+
+        WHEN("an object is retired")
+        {
+            auto node = new(NonPagedPoolNx) Node(1);
+            REQUIRE(node);
+            REQUIRE_NT_SUCCESS(epoch.retire(node));
+
+            // Several reclaim periods pass while the reader is inside
+            LARGE_INTEGER interval{ .QuadPart = -5 * kf::Epoch::kReclaimPeriod };
+            KeDelayExecutionThread(KernelMode, false, &interval);
+
+            const LONG liveWithReader = g_liveNodes;
+
+            readerContext.leave.set();
+            reader.join();
+
+            for (int i = 0; i < 1000 && epoch.pendingCount(); ++i)
+            {
+                KeDelayExecutionThread(KernelMode, false, &interval);
+            }
+
+            THEN("the thread deletes it only after the reader leaves")
+            {
+                REQUIRE(liveWithReader == 1);
+                REQUIRE(epoch.pendingCount() == 0);
+                REQUIRE(g_liveNodes == 0);
+            }
+        }
+
+        readerContext.leave.set();
+    }
+
+    GIVEN("an epoch with readers and retiring writers in 2 to 128 threads")
+    {
+        for (int threadCount : stress::kThreadCounts)
+        {
+            {
+                kf::Epoch epoch;
+                REQUIRE_NT_SUCCESS(epoch.initialize());
+                REQUIRE_NT_SUCCESS(epoch.start());
+
+                StressContext context = { &epoch, new(NonPagedPoolNx) Node(0) };
+                REQUIRE(context.current);
+                REQUIRE_NT_SUCCESS(stress::runThreads(threadCount, &stressRoutine, &context));
+
+                epoch.join();
+
+                REQUIRE(context.failedRetires == 0);
+                REQUIRE(context.tornReads == 0);
+                REQUIRE(context.reads == static_cast<LONG64>(stress::readerCount(threadCount)) * kIterationCount);
+                REQUIRE(context.retires == static_cast<LONG64>(stress::writerCount(threadCount)) * kIterationCount);
+                REQUIRE(epoch.pendingCount() == 0);
+                REQUIRE(g_liveNodes == 1);
+
+                delete static_cast<Node*>(context.current);
+            }
+
+            REQUIRE(g_liveNodes == 0);
+        }
+    }
+}
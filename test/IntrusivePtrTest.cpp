@@ -2,6 +2,8 @@
 #include <kf/stl/new>
 #include <kf/boost/intrusive_ptr.hpp>
 #include <kf/boost/intrusive_ref_counter.hpp>
+#include <kf/ShardedRefCounter.h>
+#include <kf/Thread.h>
 
 struct IntrusivePtrTestStruct : public boost::intrusive_ref_counter<IntrusivePtrTestStruct>
 {
@@ -215,3 +217,109 @@ SCENARIO("intrusive_ptr: destructor is called only once")
         }
     }
 }
+
+struct ShardedTestStruct : public boost::intrusive_ref_counter<ShardedTestStruct, kf::ShardedCounterPolicy<4>>
+{
+    UINT64 number = 0;
+
+    static inline LONG dtorCallCount = 0;
+
+    ~ShardedTestStruct()
+    {
+        InterlockedIncrement(&dtorCallCount);
+    }
+};
+
+using ShardedTestStructPtr = boost::intrusive_ptr<ShardedTestStruct>;
+
+SCENARIO("intrusive_ptr: sharded reference counter")
+{
+    ShardedTestStruct::dtorCallCount = 0;
+
+    GIVEN("an object with a sharded counter")
+    {
+        ShardedTestStructPtr owner(new(NonPagedPoolNx) ShardedTestStruct);
+        REQUIRE(owner);
+
+        WHEN("references are taken and released before teardown")
+        {
+            {
+                ShardedTestStructPtr ptr1 = owner;
+                ShardedTestStructPtr ptr2 = owner;
+                REQUIRE(owner->use_count() == 3);
+            }
+
+            THEN("the object is alive")
+            {
+                REQUIRE(owner->use_count() == 1);
+                REQUIRE(ShardedTestStruct::dtorCallCount == 0);
+            }
+
+            kf::killRef(owner);
+        }
+
+        WHEN("the owner reference is killed while another one exists")
+        {
+            ShardedTestStructPtr ptr = owner;
+            kf::killRef(owner);
+
+            THEN("the object is deleted with the last reference")
+            {
+                REQUIRE(!owner);
+                REQUIRE(ptr->use_count() == 1);
+                REQUIRE(ShardedTestStruct::dtorCallCount == 0);
+
+                ptr.reset();
+                REQUIRE(ShardedTestStruct::dtorCallCount == 1);
+            }
+        }
+
+        WHEN("the owner reference is the last one")
+        {
+            kf::killRef(owner);
+
+            THEN("the object is deleted")
+            {
+                REQUIRE(ShardedTestStruct::dtorCallCount == 1);
+            }
+        }
+    }
+
+    GIVEN("an object referenced from multiple threads")
+    {
+        constexpr int kThreadCount = 4;
+
+        ShardedTestStructPtr owner(new(NonPagedPoolNx) ShardedTestStruct);
+        kf::Thread threads[kThreadCount];
+
+        for (int i = 0; i < kThreadCount; ++i)
+        {
+            // The object may be killed while threads are still taking references
+            REQUIRE_NT_SUCCESS(threads[i].start([](PVOID context)
+                {
+                    // Adopts the reference passed by the test
+                    ShardedTestStructPtr ptr(static_cast<ShardedTestStruct*>(context), false);
+
+                    for (int j = 0; j < 20000; ++j)
+                    {
+                        ShardedTestStructPtr copy = ptr;
+                        copy.swap(ptr);
+                    }
+
+                    PsTerminateSystemThread(STATUS_SUCCESS);
+                }, ShardedTestStructPtr(owner).detach()));
+        }
+
+        kf::killRef(owner);
+
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        THEN("the object is deleted exactly once after all threads are done")
+        {
+            REQUIRE(ShardedTestStruct::dtorCallCount == 1);
+        }
+    }
+}
@@ -14,6 +14,25 @@ namespace
 
     constexpr std::array<int, 5> kKeys = { 1, 5, 3, 4, 2 };
     constexpr std::array<int, 5> kNonExistingKeys = { -1, 0, 6, 7, 8 };
+
+    // Value that is poisoned when destroyed, so reading a destroyed one is noticed
+    struct Poisoned
+    {
+        explicit Poisoned(int value) : value(value)
+        {
+        }
+
+        Poisoned(const Poisoned&) = default;
+        Poisoned& operator=(const Poisoned&) = default;
+
+        ~Poisoned()
+        {
+            // Volatile, so the store is not dropped as dead
+            *static_cast<volatile int*>(&value) = -1;
+        }
+
+        int value;
+    };
 }
 
 SCENARIO("LinkedTreeMap: all methods")
@@ -503,3 +522,111 @@ SCENARIO("LinkedTreeMap: ordering")
         }
     }
 }
+
+SCENARIO("LinkedTreeMap: in-place insertion")
+{
+    GIVEN("map with elements")
+    {
+        LinkedIntMap map;
+
+        for (int key : kKeys)
+        {
+            REQUIRE(map.tryEmplace(key, keyToValue(key)));
+        }
+
+        THEN("elements follow insertion order")
+        {
+            for (ULONG i = 0; i < kKeys.size(); ++i)
+            {
+                REQUIRE(*map.getByIndex(i) == keyToValue(kKeys[i]));
+            }
+        }
+
+        WHEN("tryEmplace is called for an existing key")
+        {
+            auto value = map.tryEmplace(kKeys[0], 0);
+
+            THEN("the existing value is returned and the order is not changed")
+            {
+                REQUIRE(value == map.get(kKeys[0]));
+                REQUIRE(*value == keyToValue(kKeys[0]));
+                REQUIRE(map.getByIndex(0) == value);
+                REQUIRE(map.size() == static_cast<int>(kKeys.size()));
+            }
+        }
+
+        WHEN("tryEmplaceEx is called for an existing and a new key")
+        {
+            auto [existing, existingInserted] = map.tryEmplaceEx(kKeys[0], 0);
+            auto [added, addedInserted] = map.tryEmplaceEx(-1, 0);
+
+            THEN("it tells whether the value is inserted")
+            {
+                REQUIRE(existing == map.get(kKeys[0]));
+                REQUIRE(!existingInserted);
+                REQUIRE(added == map.get(-1));
+                REQUIRE(addedInserted);
+                REQUIRE(*added == 0);
+            }
+        }
+
+        WHEN("emplace is called for an existing key")
+        {
+            auto value = map.emplace(kKeys[0], 0);
+
+            THEN("the value is replaced and moved to the end")
+            {
+                REQUIRE(value == map.get(kKeys[0]));
+                REQUIRE(*value == 0);
+                REQUIRE(map.getByIndex(static_cast<ULONG>(kKeys.size() - 1)) == value);
+                REQUIRE(*map.getByIndex(0) == keyToValue(kKeys[1]));
+            }
+        }
+
+        WHEN("insertOrAssign is called for an existing key")
+        {
+            auto value = map.insertOrAssign(kKeys[1], 0);
+
+            THEN("the value is assigned and moved to the end")
+            {
+                REQUIRE(value == map.get(kKeys[1]));
+                REQUIRE(*value == 0);
+                REQUIRE(map.getByIndex(static_cast<ULONG>(kKeys.size() - 1)) == value);
+                REQUIRE(map.size() == static_cast<int>(kKeys.size()));
+            }
+        }
+
+        WHEN("elements are removed after in-place insertion")
+        {
+            for (int key : kKeys)
+            {
+                REQUIRE(map.remove(key));
+            }
+
+            THEN("map is empty")
+            {
+                REQUIRE(map.isEmpty());
+                REQUIRE(!map.getByIndex(0));
+            }
+        }
+    }
+
+    GIVEN("map with a value that is poisoned when destroyed")
+    {
+        kf::LinkedTreeMap<int, Poisoned, PagedPool> map;
+        REQUIRE(map.emplace(1, 10));
+        REQUIRE(map.emplace(2, 20));
+
+        WHEN("emplace replaces a value with a copy of itself")
+        {
+            auto value = map.emplace(1, *map.get(1));
+
+            THEN("the copy is made before the old value is released")
+            {
+                REQUIRE(value == map.get(1));
+                REQUIRE(value->value == 10);
+                REQUIRE(map.getByIndex(1) == value);
+            }
+        }
+    }
+}
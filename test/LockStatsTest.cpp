@@ -0,0 +1,189 @@
+#include "pch.h"
+#include <fltKernel.h>
+#include <kf/InstrumentedSpinLock.h>
+#include <kf/InstrumentedFltResource.h>
+#include <kf/Thread.h>
+#include <kf/ScopeExit.h>
+#include <kf/stl/memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string_view>
+
+namespace
+{
+    using Snapshot = kf::LockStats::Snapshot;
+    using LockInfo = kf::LockStats::LockInfo;
+
+    constexpr int kThreadCount = 4;
+    constexpr int kIterationCount = 5000;
+
+    LockInfo currentStats(std::string_view name)
+    {
+        auto snapshot = kf::make_unique<Snapshot, NonPagedPoolNx>();
+        REQUIRE(snapshot);
+
+        kf::LockStats::snapshot(*snapshot);
+
+        for (ULONG i = 0; i < snapshot->lockCount; ++i)
+        {
+            if (snapshot->locks[i].name == name)
+            {
+                return snapshot->locks[i];
+            }
+        }
+
+        return {};
+    }
+
+    struct StressContext
+    {
+        kf::InstrumentedSpinLock* lock;
+        LONG counter;
+    };
+
+    void stressRoutine(PVOID rawContext)
+    {
+        auto context = static_cast<StressContext*>(rawContext);
+
+        for (int i = 0; i < kIterationCount; ++i)
+        {
+            std::lock_guard lock(*context->lock);
+
+            const LONG counter = context->counter;
+            YieldProcessor();
+            context->counter = counter + 1;
+        }
+
+        PsTerminateSystemThread(STATUS_SUCCESS);
+    }
+}
+
+// Instrumented resources can't be acquired through the plain resource, bypassing the probe
+static_assert(!std::is_convertible_v<kf::InstrumentedEResource*, kf::EResource*>);
+static_assert(!std::is_convertible_v<kf::InstrumentedFltResource*, kf::FltResource*>);
+
+#if !KF_LOCK_STATS
+// Compiled out profiling must not change instrumented locks
+static_assert(!kf::LockStats::kEnabled);
+static_assert(sizeof(kf::InstrumentedSpinLock) == sizeof(KSPIN_LOCK) + sizeof(PVOID)); // the lock and the owner's IRQL
+static_assert(sizeof(kf::InstrumentedEResource) == sizeof(kf::EResource));
+static_assert(sizeof(kf::InstrumentedFltResource) == sizeof(kf::FltResource));
+#endif
+
+SCENARIO("kf::LockStats")
+{
+#if !KF_LOCK_STATS
+    REQUIRE(kf::LockStats::initialize() == STATUS_NOT_SUPPORTED);
+#else
+    // Every run of the scenario starts with zero counters
+    REQUIRE_NT_SUCCESS(kf::LockStats::initialize());
+    SCOPE_EXIT{ kf::LockStats::uninitialize(); };
+
+    GIVEN("an uncontended spin lock")
+    {
+        kf::InstrumentedSpinLock lock("TestSpinLock");
+
+        for (int i = 0; i < 10; ++i)
+        {
+            std::lock_guard guard(lock);
+        }
+
+        const LockInfo stats = currentStats("TestSpinLock");
+
+        THEN("acquisitions and hold times are recorded")
+        {
+            LONG64 holds = 0;
+            for (auto count : stats.holdHistogram)
+            {
+                holds += count;
+            }
+
+            REQUIRE(stats.acquisitions == 10);
+            REQUIRE(stats.contentions == 0);
+            REQUIRE(stats.totalWaitCycles == 0);
+            REQUIRE(holds == 10);
+            REQUIRE(KeGetCurrentIrql() == PASSIVE_LEVEL);
+        }
+
+        WHEN("the counters are reset")
+        {
+            kf::LockStats::reset();
+
+            THEN("the lock is still enumerated with zero counters")
+            {
+                const LockInfo reset = currentStats("TestSpinLock");
+                REQUIRE(std::string_view(reset.name) == "TestSpinLock");
+                REQUIRE(reset.acquisitions == 0);
+            }
+        }
+    }
+
+    GIVEN("a spin lock contended by several threads")
+    {
+        kf::InstrumentedSpinLock lock("TestContendedLock");
+        StressContext context = { &lock, 0 };
+        kf::Thread threads[kThreadCount];
+
+        for (auto& thread : threads)
+        {
+            REQUIRE_NT_SUCCESS(thread.start(&stressRoutine, &context));
+        }
+
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        const LockInfo stats = currentStats("TestContendedLock");
+
+        THEN("contended acquisitions and their wait are recorded")
+        {
+            REQUIRE(context.counter == kThreadCount * kIterationCount);
+            REQUIRE(stats.acquisitions == kThreadCount * kIterationCount);
+            REQUIRE(stats.contentions <= stats.acquisitions);
+            REQUIRE(stats.maxWaitCycles <= stats.totalWaitCycles);
+        }
+    }
+
+    GIVEN("resources with the same name")
+    {
+        kf::InstrumentedEResource first("TestResource");
+        kf::InstrumentedFltResource second("TestResource");
+
+        {
+            std::unique_lock lock(first);
+        }
+
+        {
+            std::shared_lock lock(second);
+        }
+
+        {
+            std::shared_lock lock1(first);
+            std::shared_lock lock2(first);
+        }
+
+        const LockInfo stats = currentStats("TestResource");
+
+        THEN("they share the counters")
+        {
+            REQUIRE(stats.acquisitions == 4);
+            REQUIRE(stats.contentions == 0);
+            REQUIRE(!first.isAcquiredExclusive());
+            REQUIRE(second.getOwnerCount() == 0);
+        }
+    }
+
+    GIVEN("histogram buckets")
+    {
+        THEN("hold times are bucketed by powers of two")
+        {
+            REQUIRE(kf::LockStats::histogramBucket(0) == 0);
+            REQUIRE(kf::LockStats::histogramBucket(64) == 0);
+            REQUIRE(kf::LockStats::histogramBucket(65) == 1);
+            REQUIRE(kf::LockStats::histogramBucket(128) == 1);
+            REQUIRE(kf::LockStats::histogramBucket(MAXULONG64) == kf::LockStats::kHistogramBuckets - 1);
+        }
+    }
+#endif
+}
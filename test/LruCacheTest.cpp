@@ -0,0 +1,192 @@
+#include "pch.h"
+#include <kf/LruCache.h>
+
+namespace
+{
+    struct EvictedKeys
+    {
+        void operator()(const int& key, int&)
+        {
+            keys[count++] = key;
+        }
+
+        std::array<int, 8> keys{};
+        int count = 0;
+    };
+
+    // Treats the value as the entry size in bytes
+    struct ValueSize
+    {
+        size_t operator()(const int&, const int& value) const
+        {
+            return static_cast<size_t>(value);
+        }
+    };
+}
+
+SCENARIO("kf::LruCache")
+{
+    GIVEN("cache with capacity of 3 entries")
+    {
+        EvictedKeys evicted;
+        kf::LruCache<int, int, PagedPool, std::reference_wrapper<EvictedKeys>> cache(3, std::ref(evicted));
+
+        REQUIRE_NT_SUCCESS(cache.put(1, 10));
+        REQUIRE_NT_SUCCESS(cache.put(2, 20));
+        REQUIRE_NT_SUCCESS(cache.put(3, 30));
+
+        THEN("all entries are cached")
+        {
+            REQUIRE(cache.size() == 3);
+            REQUIRE(cache.usage() == 3);
+            REQUIRE(*cache.get(1) == 10);
+            REQUIRE(*cache.get(2) == 20);
+            REQUIRE(*cache.get(3) == 30);
+        }
+
+        WHEN("a new entry is put")
+        {
+            REQUIRE_NT_SUCCESS(cache.put(4, 40));
+
+            THEN("the least recently used entry is evicted")
+            {
+                REQUIRE(cache.size() == 3);
+                REQUIRE(!cache.containsKey(1));
+                REQUIRE(evicted.count == 1);
+                REQUIRE(evicted.keys[0] == 1);
+                REQUIRE(cache.stats().evictions == 1);
+            }
+        }
+
+        WHEN("an entry is accessed before a new entry is put")
+        {
+            REQUIRE(cache.get(1));
+            REQUIRE_NT_SUCCESS(cache.put(4, 40));
+
+            THEN("the accessed entry is kept")
+            {
+                REQUIRE(cache.containsKey(1));
+                REQUIRE(!cache.containsKey(2));
+                REQUIRE(evicted.keys[0] == 2);
+            }
+        }
+
+        WHEN("an entry is peeked before a new entry is put")
+        {
+            REQUIRE(*cache.peek(1) == 10);
+            REQUIRE_NT_SUCCESS(cache.put(4, 40));
+
+            THEN("the access order is not changed")
+            {
+                REQUIRE(!cache.containsKey(1));
+            }
+        }
+
+        WHEN("an existing entry is put")
+        {
+            REQUIRE_NT_SUCCESS(cache.put(1, 100));
+            REQUIRE_NT_SUCCESS(cache.put(4, 40));
+
+            THEN("the value is replaced and becomes the most recently used")
+            {
+                REQUIRE(cache.size() == 3);
+                REQUIRE(*cache.peek(1) == 100);
+                REQUIRE(!cache.containsKey(2));
+                REQUIRE(evicted.count == 1);
+            }
+        }
+
+        WHEN("entries are looked up")
+        {
+            REQUIRE(cache.get(1));
+            REQUIRE(cache.get(2));
+            REQUIRE(!cache.get(5));
+
+            THEN("hits and misses are counted")
+            {
+                REQUIRE(cache.stats().hits == 2);
+                REQUIRE(cache.stats().misses == 1);
+                REQUIRE(cache.stats().evictions == 0);
+            }
+
+            THEN("statistics can be reset")
+            {
+                cache.resetStats();
+                REQUIRE(cache.stats().hits == 0);
+                REQUIRE(cache.stats().misses == 0);
+            }
+        }
+
+        WHEN("an entry is removed")
+        {
+            REQUIRE(cache.remove(2));
+
+            THEN("it is not reported as evicted")
+            {
+                REQUIRE(cache.size() == 2);
+                REQUIRE(cache.usage() == 2);
+                REQUIRE(evicted.count == 0);
+            }
+        }
+
+        WHEN("capacity is reduced")
+        {
+            cache.setCapacity(1);
+
+            THEN("the least recently used entries are evicted")
+            {
+                REQUIRE(cache.size() == 1);
+                REQUIRE(cache.containsKey(3));
+                REQUIRE(evicted.count == 2);
+                REQUIRE(evicted.keys[0] == 1);
+                REQUIRE(evicted.keys[1] == 2);
+            }
+        }
+    }
+
+    GIVEN("cache with a byte budget")
+    {
+        kf::LruCache<int, int, PagedPool, kf::LruCacheIgnoreEvicted, ValueSize> cache(100);
+
+        REQUIRE_NT_SUCCESS(cache.put(1, 40));
+        REQUIRE_NT_SUCCESS(cache.put(2, 40));
+
+        THEN("usage is the sum of entry sizes")
+        {
+            REQUIRE(cache.usage() == 80);
+        }
+
+        WHEN("an entry that exceeds the budget is put")
+        {
+            REQUIRE_NT_SUCCESS(cache.put(3, 70));
+
+            THEN("as many entries are evicted as needed")
+            {
+                REQUIRE(cache.size() == 1);
+                REQUIRE(cache.usage() == 70);
+                REQUIRE(cache.containsKey(3));
+                REQUIRE(cache.stats().evictions == 2);
+            }
+        }
+
+        WHEN("an existing entry grows")
+        {
+            REQUIRE_NT_SUCCESS(cache.put(2, 70));
+
+            THEN("its old size is not counted")
+            {
+                REQUIRE(cache.size() == 1);
+                REQUIRE(cache.usage() == 70);
+            }
+        }
+
+        WHEN("an entry larger than the budget is put")
+        {
+            THEN("it is rejected and nothing is evicted")
+            {
+                REQUIRE(cache.put(3, 101) == STATUS_INVALID_PARAMETER);
+                REQUIRE(cache.size() == 2);
+            }
+        }
+    }
+}
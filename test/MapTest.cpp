@@ -147,3 +147,72 @@ SCENARIO("Map test: insert and find integers")
         }
     }
 }
+
+SCENARIO("Map test: reserve and range insert")
+{
+    kf::map<int, int, NonPagedPoolNx> map;
+    REQUIRE_NT_SUCCESS(map.initialize());
+
+    WHEN("Nodes are reserved")
+    {
+        REQUIRE_NT_SUCCESS(map.reserve(100));
+
+        THEN("Elements are inserted")
+        {
+            for (int i = 0; i < 100; ++i)
+            {
+                REQUIRE(map.emplace(i, i));
+            }
+
+            REQUIRE(map.size() == 100);
+        }
+
+        THEN("Reserving less than the size does nothing")
+        {
+            REQUIRE_NT_SUCCESS(map.reserve(0));
+        }
+    }
+
+    WHEN("A range is inserted")
+    {
+        const std::pair<const int, int> values[] = { { 1, 10 }, { 2, 20 }, { 3, 30 }, { 2, 200 } };
+        REQUIRE_NT_SUCCESS(map.insert(std::begin(values), std::end(values)));
+
+        THEN("All unique keys are inserted")
+        {
+            REQUIRE(map.size() == 3);
+            REQUIRE(map.find(1)->second == 10);
+            REQUIRE(map.find(2)->second == 20);
+            REQUIRE(map.find(3)->second == 30);
+        }
+
+        THEN("Another range can be inserted")
+        {
+            REQUIRE_NT_SUCCESS(map.insert(std::begin(values), std::end(values)));
+            REQUIRE(map.size() == 3);
+        }
+    }
+
+    WHEN("Elements are erased and inserted again")
+    {
+        for (int round = 0; round < 3; ++round)
+        {
+            for (int i = 0; i < 50; ++i)
+            {
+                REQUIRE(map.emplace(i, round));
+            }
+
+            for (int i = 0; i < 50; i += 2)
+            {
+                REQUIRE(map.erase(i) == 1);
+            }
+        }
+
+        THEN("Released nodes are reused")
+        {
+            REQUIRE(map.size() == 25);
+            REQUIRE(map.find(1)->second == 0);
+            REQUIRE(!map.contains(2));
+        }
+    }
+}
@@ -0,0 +1,281 @@
+#include "pch.h"
+#include <kf/MonotonicArena.h>
+#include <kf/stl/vector>
+#include <kf/stl/map>
+#include <kf/UString.h>
+#include <kf/TreeMap.h>
+#include <kf/TreeSet.h>
+#include <kf/LinkedTreeMap.h>
+
+SCENARIO("MonotonicArena")
+{
+    GIVEN("an arena with 4KB chunks")
+    {
+        kf::MonotonicArena arena(PagedPool, 4096);
+
+        WHEN("nothing is allocated")
+        {
+            THEN("there are no chunks")
+            {
+                REQUIRE(arena.chunkCount() == 0);
+            }
+        }
+
+        WHEN("small blocks are allocated")
+        {
+            void* p1 = arena.allocate(10);
+            void* p2 = arena.allocate(20, 64);
+
+            THEN("they come from a single chunk and are aligned")
+            {
+                REQUIRE(p1);
+                REQUIRE(p2);
+                REQUIRE(p1 != p2);
+                REQUIRE(reinterpret_cast<ULONG_PTR>(p1) % MEMORY_ALLOCATION_ALIGNMENT == 0);
+                REQUIRE(reinterpret_cast<ULONG_PTR>(p2) % 64 == 0);
+                REQUIRE(arena.chunkCount() == 1);
+            }
+        }
+
+        WHEN("the last block is deallocated")
+        {
+            void* p1 = arena.allocate(100);
+            arena.deallocate(p1, 100);
+            void* p2 = arena.allocate(100);
+
+            THEN("its memory is reused")
+            {
+                REQUIRE(p1 == p2);
+            }
+        }
+
+        WHEN("the last block is expanded")
+        {
+            void* p = arena.allocate(100);
+
+            THEN("it grows in place while the chunk has space")
+            {
+                REQUIRE(arena.tryExpand(p, 100, 200));
+                REQUIRE(!arena.tryExpand(p, 200, 1024 * 1024));
+                REQUIRE(arena.allocate(1) > p);
+                REQUIRE(!arena.tryExpand(p, 200, 300));
+            }
+        }
+
+        WHEN("blocks don't fit a single chunk")
+        {
+            for (int i = 0; i < 100; ++i)
+            {
+                REQUIRE(arena.allocate(1000));
+            }
+
+            THEN("new chunks grow geometrically")
+            {
+                REQUIRE(arena.chunkCount() > 1);
+                REQUIRE(arena.chunkCount() < 10);
+            }
+        }
+
+        WHEN("a large block is allocated")
+        {
+            void* small = arena.allocate(16);
+            void* large = arena.allocate(100000);
+            void* next = arena.allocate(16);
+
+            THEN("it gets a separate chunk and the current one is still used")
+            {
+                REQUIRE(large);
+                REQUIRE(arena.chunkCount() == 2);
+                REQUIRE(static_cast<std::byte*>(next) == static_cast<std::byte*>(small) + 16);
+            }
+        }
+
+        WHEN("the arena is released")
+        {
+            REQUIRE(arena.allocate(100000));
+            REQUIRE(arena.allocate(100));
+            arena.release();
+
+            THEN("all chunks are freed")
+            {
+                REQUIRE(arena.chunkCount() == 0);
+            }
+        }
+    }
+
+    GIVEN("an arena with an initial buffer")
+    {
+        std::byte buffer[256];
+        kf::MonotonicArena arena(PagedPool, buffer);
+
+        WHEN("blocks fit the buffer")
+        {
+            void* p = arena.allocate(100);
+
+            THEN("there is no pool allocation")
+            {
+                REQUIRE(p >= buffer);
+                REQUIRE(p < buffer + sizeof(buffer));
+                REQUIRE(arena.chunkCount() == 0);
+            }
+        }
+
+        WHEN("blocks don't fit the buffer")
+        {
+            REQUIRE(arena.allocate(200));
+            REQUIRE(arena.allocate(200));
+
+            THEN("chunks are allocated")
+            {
+                REQUIRE(arena.chunkCount() == 1);
+            }
+        }
+    }
+}
+
+SCENARIO("ArenaAllocator")
+{
+    kf::MonotonicArena arena(PagedPool);
+
+    GIVEN("vector with ArenaAllocator")
+    {
+        kf::vector<int, PagedPool, kf::ArenaAllocator<int>> v{ kf::ArenaAllocator<int>(arena) };
+
+        WHEN("elements are added")
+        {
+            REQUIRE_NT_SUCCESS(v.push_back(1));
+            const int* data = v.data();
+
+            for (int i = 2; i <= 100; ++i)
+            {
+                REQUIRE_NT_SUCCESS(v.push_back(i));
+            }
+
+            THEN("the buffer grows in place in the arena")
+            {
+                REQUIRE(v.size() == 100);
+                REQUIRE(v.data() == data);
+                REQUIRE(v[99] == 100);
+                REQUIRE(arena.chunkCount() == 1);
+            }
+        }
+    }
+
+    GIVEN("map with ArenaAllocator")
+    {
+        using Allocator = kf::ArenaAllocator<std::pair<const int, int>>;
+
+        kf::map<int, int, PagedPool, std::less<int>, Allocator> map;
+        REQUIRE_NT_SUCCESS(map.initialize(Allocator(arena)));
+
+        WHEN("elements are added")
+        {
+            for (int i = 0; i < 100; ++i)
+            {
+                REQUIRE(map.emplace(i, i * 2));
+            }
+
+            THEN("they can be found")
+            {
+                REQUIRE(map.size() == 100);
+                REQUIRE(map.find(50)->second == 100);
+                REQUIRE(arena.chunkCount() > 0);
+            }
+        }
+    }
+
+    GIVEN("UString with ArenaAllocator")
+    {
+        kf::UString<PagedPool, kf::ArenaAllocator<std::byte>> str{ kf::ArenaAllocator<std::byte>(arena) };
+
+        WHEN("it's initialized")
+        {
+            REQUIRE_NT_SUCCESS(str.init(L"arena string"));
+
+            THEN("the buffer is allocated from the arena")
+            {
+                REQUIRE(str.equals(L"arena string"));
+                REQUIRE(arena.chunkCount() == 1);
+            }
+        }
+
+        WHEN("it's moved")
+        {
+            REQUIRE_NT_SUCCESS(str.init(L"moved"));
+            auto other = std::move(str);
+
+            THEN("the buffer is moved")
+            {
+                REQUIRE(other.equals(L"moved"));
+                REQUIRE(str.isEmpty());
+            }
+        }
+    }
+
+    GIVEN("TreeMap with ArenaNodeAllocator")
+    {
+        kf::TreeMap<int, int, PagedPool, std::less<int>, kf::ArenaNodeAllocator> map{ kf::ArenaNodeAllocator(arena) };
+
+        WHEN("elements are added and removed")
+        {
+            for (int i = 0; i < 100; ++i)
+            {
+                REQUIRE_NT_SUCCESS(map.put(i, i));
+            }
+
+            REQUIRE(map.remove(10));
+
+            THEN("the map works")
+            {
+                REQUIRE(map.size() == 99);
+                REQUIRE(!map.containsKey(10));
+                REQUIRE(*map.get(20) == 20);
+            }
+        }
+
+        WHEN("the map is moved")
+        {
+            for (int i = 0; i < 10; ++i)
+            {
+                REQUIRE_NT_SUCCESS(map.put(i, i));
+            }
+
+            auto other = std::move(map);
+            REQUIRE_NT_SUCCESS(other.put(10, 10));
+            REQUIRE(other.remove(0));
+
+            THEN("the moved map keeps allocating nodes from the arena")
+            {
+                REQUIRE(map.isEmpty());
+                REQUIRE(other.size() == 10);
+                REQUIRE(*other.get(10) == 10);
+                REQUIRE(arena.chunkCount() == 1);
+            }
+        }
+    }
+
+    GIVEN("TreeSet and LinkedTreeMap with ArenaNodeAllocator")
+    {
+        kf::TreeSet<int, PagedPool, std::less<int>, kf::ArenaNodeAllocator> set{ kf::ArenaNodeAllocator(arena) };
+        kf::LinkedTreeMap<int, int, PagedPool, std::less<int>, kf::ArenaNodeAllocator> linkedMap{ kf::ArenaNodeAllocator(arena) };
+
+        WHEN("they are moved")
+        {
+            REQUIRE_NT_SUCCESS(set.add(1));
+            REQUIRE_NT_SUCCESS(linkedMap.put(1, 1));
+
+            auto otherSet = std::move(set);
+            auto otherLinkedMap = std::move(linkedMap);
+
+            REQUIRE_NT_SUCCESS(otherSet.add(2));
+            REQUIRE_NT_SUCCESS(otherLinkedMap.put(2, 2));
+
+            THEN("the moved containers keep their elements")
+            {
+                REQUIRE(otherSet.size() == 2);
+                REQUIRE(otherLinkedMap.size() == 2);
+                REQUIRE(*otherLinkedMap.get(1) == 1);
+            }
+        }
+    }
+}
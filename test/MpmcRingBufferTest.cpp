@@ -0,0 +1,186 @@
+#include "pch.h"
+#include <kf/MpmcRingBuffer.h>
+#include <kf/Thread.h>
+
+namespace
+{
+    constexpr int kThreadCount = 4;
+    constexpr int kPushCount = 20000;
+
+    using Buffer = kf::MpmcRingBuffer<LONG64, 256>;
+
+    struct StressContext
+    {
+        Buffer* buffer;
+        volatile LONG64* sum;
+        volatile LONG* popped;
+    };
+
+    void producerRoutine(StressContext* context)
+    {
+        for (int i = 1; i <= kPushCount; ++i)
+        {
+            while (!context->buffer->tryPush(static_cast<LONG64>(i)))
+            {
+                YieldProcessor();
+            }
+        }
+    }
+
+    void consumerRoutine(StressContext* context)
+    {
+        while (ReadNoFence(context->popped) < kThreadCount * kPushCount)
+        {
+            if (auto value = context->buffer->tryPop())
+            {
+                InterlockedAdd64(context->sum, *value);
+                InterlockedIncrement(context->popped);
+            }
+            else
+            {
+                YieldProcessor();
+            }
+        }
+    }
+
+    struct Counted
+    {
+        static inline int s_alive = 0;
+
+        Counted() noexcept
+        {
+            ++s_alive;
+        }
+
+        Counted(Counted&&) noexcept
+        {
+            ++s_alive;
+        }
+
+        ~Counted()
+        {
+            --s_alive;
+        }
+    };
+}
+
+SCENARIO("kf::MpmcRingBuffer")
+{
+    GIVEN("an empty buffer")
+    {
+        kf::MpmcRingBuffer<int, 4> buffer;
+
+        THEN("it's empty")
+        {
+            REQUIRE(buffer.isEmpty());
+            REQUIRE(buffer.capacity() == 4);
+            REQUIRE(!buffer.tryPop());
+        }
+
+        WHEN("it's filled")
+        {
+            for (int i = 0; i < 4; ++i)
+            {
+                REQUIRE(buffer.tryPush(i));
+            }
+
+            THEN("further pushes fail")
+            {
+                REQUIRE(buffer.size() == 4);
+                REQUIRE(!buffer.tryPush(4));
+            }
+
+            THEN("elements are popped in the push order")
+            {
+                for (int i = 0; i < 4; ++i)
+                {
+                    auto value = buffer.tryPop();
+                    REQUIRE(value);
+                    REQUIRE(*value == i);
+                }
+
+                REQUIRE(!buffer.tryPop());
+            }
+        }
+
+        WHEN("it wraps around several times")
+        {
+            bool ordered = true;
+
+            for (int i = 0; i < 100; ++i)
+            {
+                REQUIRE(buffer.tryPush(i));
+                REQUIRE(buffer.tryPush(i + 1000));
+
+                ordered = ordered && buffer.tryPop() == i && buffer.tryPop() == i + 1000;
+            }
+
+            THEN("the order is preserved")
+            {
+                REQUIRE(ordered);
+                REQUIRE(buffer.isEmpty());
+            }
+        }
+    }
+
+    GIVEN("a buffer of non-trivial objects")
+    {
+        {
+            kf::MpmcRingBuffer<Counted, 8> buffer;
+
+            REQUIRE(buffer.tryEmplace());
+            REQUIRE(buffer.tryEmplace());
+            REQUIRE(buffer.tryPop());
+        }
+
+        THEN("the remaining objects are destroyed with the buffer")
+        {
+            REQUIRE(Counted::s_alive == 0);
+        }
+    }
+
+    GIVEN("multiple producers and consumers")
+    {
+        Buffer buffer;
+        volatile LONG64 sum = 0;
+        volatile LONG popped = 0;
+
+        StressContext contexts[kThreadCount];
+        kf::Thread producers[kThreadCount];
+        kf::Thread consumers[kThreadCount];
+
+        for (int i = 0; i < kThreadCount; ++i)
+        {
+            contexts[i] = { &buffer, &sum, &popped };
+
+            REQUIRE_NT_SUCCESS(consumers[i].start([](PVOID context)
+                {
+                    consumerRoutine(static_cast<StressContext*>(context));
+                    PsTerminateSystemThread(STATUS_SUCCESS);
+                },
+                &contexts[i]));
+
+            REQUIRE_NT_SUCCESS(producers[i].start([](PVOID context)
+                {
+                    producerRoutine(static_cast<StressContext*>(context));
+                    PsTerminateSystemThread(STATUS_SUCCESS);
+                },
+                &contexts[i]));
+        }
+
+        for (int i = 0; i < kThreadCount; ++i)
+        {
+            producers[i].join();
+            consumers[i].join();
+        }
+
+        THEN("every element is popped once")
+        {
+            constexpr LONG64 kProducerSum = static_cast<LONG64>(kPushCount) * (kPushCount + 1) / 2;
+
+            REQUIRE(popped == kThreadCount * kPushCount);
+            REQUIRE(sum == kThreadCount * kProducerSum);
+            REQUIRE(buffer.isEmpty());
+        }
+    }
+}
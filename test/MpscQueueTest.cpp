@@ -0,0 +1,151 @@
+#include "pch.h"
+#include <kf/MpscQueue.h>
+#include <kf/Thread.h>
+#include <kf/stl/new>
+
+namespace
+{
+    constexpr int kProducerCount = 4;
+    constexpr int kPushCount = 10000;
+
+    struct Item
+    {
+        int producer = 0;
+        int value = 0;
+        kf::MpscQueueEntry entry;
+    };
+
+    using ItemQueue = kf::MpscQueue<Item, &Item::entry>;
+
+    struct ProducerContext
+    {
+        ItemQueue* queue;
+        Item* items;
+    };
+
+    void producerRoutine(ProducerContext* context)
+    {
+        for (int i = 0; i < kPushCount; ++i)
+        {
+            context->queue->push(context->items[i]);
+        }
+    }
+}
+
+SCENARIO("kf::MpscQueue")
+{
+    GIVEN("an empty queue")
+    {
+        ItemQueue queue;
+
+        THEN("it's empty")
+        {
+            REQUIRE(queue.isEmpty());
+            REQUIRE(queue.pop() == nullptr);
+        }
+
+        WHEN("elements are pushed")
+        {
+            Item items[3];
+
+            for (int i = 0; i < 3; ++i)
+            {
+                items[i].value = i;
+                queue.push(items[i]);
+            }
+
+            THEN("they are popped in the same order")
+            {
+                REQUIRE(!queue.isEmpty());
+
+                for (int i = 0; i < 3; ++i)
+                {
+                    Item* item = queue.pop();
+                    REQUIRE(item == &items[i]);
+                }
+
+                REQUIRE(queue.pop() == nullptr);
+                REQUIRE(queue.isEmpty());
+            }
+        }
+
+        WHEN("the queue is drained and refilled")
+        {
+            Item first;
+            Item second;
+
+            queue.push(first);
+            REQUIRE(queue.pop() == &first);
+            REQUIRE(queue.isEmpty());
+
+            queue.push(second);
+            queue.push(first);
+
+            THEN("the stub is reused correctly")
+            {
+                REQUIRE(queue.pop() == &second);
+                REQUIRE(queue.pop() == &first);
+                REQUIRE(queue.isEmpty());
+            }
+        }
+    }
+
+    GIVEN("multiple producers and a single consumer")
+    {
+        ItemQueue queue;
+
+        auto items = static_cast<Item*>(operator new(sizeof(Item) * kProducerCount * kPushCount, NonPagedPoolNx));
+        REQUIRE(items);
+
+        ProducerContext contexts[kProducerCount];
+        kf::Thread threads[kProducerCount];
+
+        for (int producer = 0; producer < kProducerCount; ++producer)
+        {
+            for (int i = 0; i < kPushCount; ++i)
+            {
+                new(&items[producer * kPushCount + i]) Item{ producer, i };
+            }
+
+            contexts[producer] = { &queue, &items[producer * kPushCount] };
+            REQUIRE_NT_SUCCESS(threads[producer].start([](PVOID context)
+                {
+                    producerRoutine(static_cast<ProducerContext*>(context));
+                    PsTerminateSystemThread(STATUS_SUCCESS);
+                },
+                &contexts[producer]));
+        }
+
+        int popped = 0;
+        int lastValue[kProducerCount] = { -1, -1, -1, -1 };
+        bool ordered = true;
+
+        while (popped < kProducerCount * kPushCount)
+        {
+            if (Item* item = queue.pop())
+            {
+                ordered = ordered && item->value == lastValue[item->producer] + 1;
+                lastValue[item->producer] = item->value;
+                ++popped;
+            }
+            else
+            {
+                YieldProcessor();
+            }
+        }
+
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        const bool empty = queue.isEmpty();
+        operator delete(items);
+
+        THEN("every element is popped once in the per-producer order")
+        {
+            REQUIRE(ordered);
+            REQUIRE(empty);
+        }
+    }
+}
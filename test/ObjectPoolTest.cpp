@@ -0,0 +1,225 @@
+#include "pch.h"
+#include <kf/ObjectPool.h>
+#include <kf/BufferPool.h>
+#include <kf/VariableSizeStruct.h>
+#include <kf/Thread.h>
+
+namespace
+{
+    struct PoolContext
+    {
+        PoolContext(int id) : id(id)
+        {
+        }
+
+        int id;
+        char data[100];
+    };
+
+    struct PoolMessage
+    {
+        ULONG size;
+        UCHAR data[1];
+    };
+}
+
+SCENARIO("kf::ObjectPool")
+{
+    GIVEN("a pool with watermarks 2 and 4")
+    {
+        kf::ObjectPool<PoolContext, NonPagedPoolNx> pool;
+        REQUIRE_NT_SUCCESS(pool.initialize(2, 4));
+
+        THEN("low watermark blocks are preallocated")
+        {
+            REQUIRE(pool.cachedCount() == 2);
+        }
+
+        WHEN("an object is acquired and released")
+        {
+            PoolContext* context = pool.acquire(5);
+            REQUIRE(context);
+            REQUIRE(context->id == 5);
+            pool.release(context);
+
+            THEN("its block is reused")
+            {
+                PoolContext* another = pool.acquire(6);
+                REQUIRE(another == context);
+                REQUIRE(another->id == 6);
+                pool.release(another);
+            }
+        }
+
+        WHEN("more objects than the high watermark are released")
+        {
+            PoolContext* contexts[10] = {};
+
+            for (int i = 0; i < 10; ++i)
+            {
+                contexts[i] = pool.acquire(i);
+                REQUIRE(contexts[i]);
+            }
+
+            for (auto context : contexts)
+            {
+                pool.release(context);
+            }
+
+            THEN("only the high watermark is cached")
+            {
+                REQUIRE(pool.cachedCount() == 4);
+            }
+
+            THEN("trim keeps the low watermark")
+            {
+                pool.trim();
+                REQUIRE(pool.cachedCount() == 2);
+            }
+        }
+    }
+
+    GIVEN("a pool that is not initialized")
+    {
+        kf::ObjectPool<PoolContext, NonPagedPoolNx> pool;
+
+        WHEN("an object is acquired and released")
+        {
+            PoolContext* context = pool.acquire(7);
+            REQUIRE(context);
+            RtlFillMemory(context->data, sizeof(context->data), 0xcc);
+            pool.release(context);
+
+            THEN("its block has the object size and is cached")
+            {
+                REQUIRE(pool.cachedCount() == 1);
+            }
+        }
+    }
+
+    GIVEN("a pool used by multiple threads")
+    {
+        constexpr int kThreadCount = 4;
+
+        kf::ObjectPool<PoolContext, NonPagedPoolNx> pool;
+        REQUIRE_NT_SUCCESS(pool.initialize(0, 8));
+
+        struct StressContext
+        {
+            kf::ObjectPool<PoolContext, NonPagedPoolNx>* pool;
+            LONG failures;
+        } stress = { &pool, 0 };
+
+        kf::Thread threads[kThreadCount];
+
+        for (auto& thread : threads)
+        {
+            REQUIRE_NT_SUCCESS(thread.start([](PVOID context)
+                {
+                    auto stress = static_cast<StressContext*>(context);
+
+                    for (int i = 0; i < 5000; ++i)
+                    {
+                        PoolContext* object = stress->pool->acquire(i);
+                        if (!object || object->id != i)
+                        {
+                            InterlockedIncrement(&stress->failures);
+                            continue;
+                        }
+
+                        stress->pool->release(object);
+                    }
+
+                    PsTerminateSystemThread(STATUS_SUCCESS);
+                }, &stress));
+        }
+
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        THEN("all objects are valid and the cache is bounded")
+        {
+            REQUIRE(stress.failures == 0);
+            REQUIRE(pool.cachedCount() <= 8 + kThreadCount);
+        }
+    }
+}
+
+SCENARIO("kf::BufferPool")
+{
+    kf::BufferPool<PagedPool> pool;
+    REQUIRE_NT_SUCCESS(pool.initialize(1, 2));
+
+    GIVEN("buffers of similar sizes")
+    {
+        std::byte* buffer = pool.allocate(100);
+        REQUIRE(buffer);
+        pool.deallocate(buffer, 100);
+
+        THEN("they share a size class")
+        {
+            std::byte* another = pool.allocate(120);
+            REQUIRE(another == buffer);
+            pool.deallocate(another, 120);
+        }
+
+        THEN("smaller buffers come from another class")
+        {
+            std::byte* small = pool.allocate(10);
+            REQUIRE(small);
+            REQUIRE(small != buffer);
+            pool.deallocate(small, 10);
+        }
+    }
+
+    GIVEN("a pool that is not initialized")
+    {
+        kf::BufferPool<PagedPool> uninitialized;
+
+        WHEN("a buffer is allocated and released")
+        {
+            std::byte* buffer = uninitialized.allocate(4096);
+            REQUIRE(buffer);
+            RtlFillMemory(buffer, 4096, 0xcc);
+            uninitialized.deallocate(buffer, 4096);
+
+            THEN("it has the size of its class and is cached")
+            {
+                REQUIRE(uninitialized.cachedCount(4096) == 1);
+            }
+        }
+    }
+
+    GIVEN("a buffer larger than the largest class")
+    {
+        std::byte* buffer = pool.allocate(10000);
+
+        THEN("it's allocated from the pool")
+        {
+            REQUIRE(buffer);
+            REQUIRE(pool.cachedCount(10000) == 0);
+            pool.deallocate(buffer, 10000);
+        }
+    }
+
+    GIVEN("VariableSizeStruct with a buffer pool")
+    {
+        kf::VariableSizeStruct<PoolMessage, PagedPool, kf::BufferPoolAllocator<PagedPool>> message(pool);
+
+        WHEN("it's emplaced repeatedly with similar sizes")
+        {
+            REQUIRE_NT_SUCCESS(message.emplace(200, PoolMessage{ 200 }));
+            PoolMessage* first = message.get();
+
+            REQUIRE_NT_SUCCESS(message.emplace(220, PoolMessage{ 220 }));
+
+            THEN("the buffer is reused")
+            {
+                REQUIRE(message.get() == first);
+                REQUIRE(message->size == 220);
+            }
+        }
+    }
+}
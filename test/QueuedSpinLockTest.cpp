@@ -0,0 +1,86 @@
+#include "pch.h"
+#include <kf/AutoQueuedSpinLock.h>
+#include "StressUtils.h"
+
+namespace
+{
+    constexpr int kIterationCount = 2000;
+
+    struct StressContext
+    {
+        kf::QueuedSpinLock* lock;
+        LONG counter;
+    };
+
+    void stressRoutine(PVOID rawContext)
+    {
+        auto context = static_cast<StressContext*>(rawContext);
+
+        for (int i = 0; i < kIterationCount; ++i)
+        {
+            kf::AutoQueuedSpinLock guard(*context->lock);
+
+            // Not interlocked on purpose, the lock protects it
+            const LONG counter = context->counter;
+            YieldProcessor();
+            context->counter = counter + 1;
+        }
+
+        PsTerminateSystemThread(STATUS_SUCCESS);
+    }
+}
+
+SCENARIO("kf::QueuedSpinLock")
+{
+    GIVEN("a queued spin lock and PASSIVE_LEVEL on entry")
+    {
+        kf::QueuedSpinLock lock;
+
+        WHEN("AutoQueuedSpinLock enters a scope")
+        {
+            {
+                kf::AutoQueuedSpinLock guard(lock);
+
+                THEN("IRQL is DISPATCH_LEVEL while the lock is held")
+                {
+                    REQUIRE(KeGetCurrentIrql() == DISPATCH_LEVEL);
+                }
+            }
+
+            THEN("IRQL is restored after the lock is released")
+            {
+                REQUIRE(KeGetCurrentIrql() == PASSIVE_LEVEL);
+            }
+        }
+
+        WHEN("AutoQueuedSpinLockAtDpcLevel is used at DISPATCH_LEVEL")
+        {
+            KIRQL oldIrql;
+            KeRaiseIrql(DISPATCH_LEVEL, &oldIrql);
+
+            {
+                kf::AutoQueuedSpinLockAtDpcLevel guard(lock);
+            }
+
+            const KIRQL irql = KeGetCurrentIrql();
+            KeLowerIrql(oldIrql);
+
+            THEN("IRQL is not changed")
+            {
+                REQUIRE(irql == DISPATCH_LEVEL);
+            }
+        }
+    }
+
+    GIVEN("a queued spin lock contended by 2 to 128 threads")
+    {
+        kf::QueuedSpinLock lock;
+
+        for (int threadCount : stress::kThreadCounts)
+        {
+            StressContext context = { &lock, 0 };
+            REQUIRE_NT_SUCCESS(stress::runThreads(threadCount, &stressRoutine, &context));
+            REQUIRE(context.counter == threadCount * kIterationCount);
+        }
+    }
+}
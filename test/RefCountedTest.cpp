@@ -0,0 +1,199 @@
+#include "pch.h"
+#include <kf/RefCounted.h>
+#include <kf/SlabAllocator.h>
+#include <kf/Thread.h>
+
+namespace
+{
+    struct RefCountedBase
+    {
+        virtual ~RefCountedBase() = default;
+
+        int base = 1;
+    };
+
+    struct RefCountedObject : RefCountedBase
+    {
+        RefCountedObject(int value, LONG* dtorCount) : value(value), dtorCount(dtorCount)
+        {
+        }
+
+        ~RefCountedObject() override
+        {
+            InterlockedIncrement(dtorCount);
+        }
+
+        int value;
+        LONG* dtorCount;
+    };
+
+    constexpr int kThreadCount = 4;
+    constexpr int kIterationCount = 20000;
+
+    struct ChurnContext
+    {
+        const kf::RefCounted<RefCountedObject>* shared;
+        const kf::WeakRef<RefCountedObject>* weak;
+        LONG* failures;
+    };
+
+    // Copies and releases references to the same object from several threads
+    NTSTATUS churnRoutine(ChurnContext* context)
+    {
+        for (int i = 0; i < kIterationCount; ++i)
+        {
+            kf::RefCounted<RefCountedObject> copy = *context->shared;
+            auto locked = context->weak->lock();
+
+            if (!locked || copy->value != 42 || locked.get() != copy.get())
+            {
+                InterlockedIncrement(context->failures);
+            }
+        }
+
+        return STATUS_SUCCESS;
+    }
+}
+
+SCENARIO("kf::RefCounted")
+{
+    LONG dtorCount = 0;
+
+    GIVEN("an object created by make_ref")
+    {
+        auto object = kf::make_ref<RefCountedObject, NonPagedPoolNx>(42, &dtorCount);
+        REQUIRE(object);
+
+        THEN("it's initialized and has a single reference")
+        {
+            REQUIRE(object->value == 42);
+            REQUIRE(object.use_count() == 1);
+        }
+
+        WHEN("it's copied")
+        {
+            auto copy = object;
+
+            THEN("both refer to the same object")
+            {
+                REQUIRE(copy == object);
+                REQUIRE(object.use_count() == 2);
+            }
+        }
+
+        WHEN("it's moved")
+        {
+            auto moved = std::move(object);
+
+            THEN("the reference is transferred")
+            {
+                REQUIRE(!object);
+                REQUIRE(moved->value == 42);
+                REQUIRE(moved.use_count() == 1);
+            }
+        }
+
+        WHEN("it's converted to a base class")
+        {
+            kf::RefCounted<RefCountedBase> base = object;
+
+            THEN("it shares the reference")
+            {
+                REQUIRE(base->base == 1);
+                REQUIRE(object.use_count() == 2);
+            }
+        }
+
+        WHEN("the last reference is released")
+        {
+            auto copy = object;
+            object.reset();
+            REQUIRE(dtorCount == 0);
+            copy.reset();
+
+            THEN("the object is destroyed")
+            {
+                REQUIRE(dtorCount == 1);
+                REQUIRE(object == nullptr);
+            }
+        }
+    }
+
+    GIVEN("a weak reference")
+    {
+        auto object = kf::make_ref<RefCountedObject, NonPagedPoolNx>(42, &dtorCount);
+        kf::WeakRef<RefCountedObject> weak = object;
+
+        WHEN("the object is alive")
+        {
+            auto locked = weak.lock();
+
+            THEN("it can be locked")
+            {
+                REQUIRE(!weak.expired());
+                REQUIRE(locked.get() == object.get());
+                REQUIRE(object.use_count() == 2);
+            }
+        }
+
+        WHEN("the object is released")
+        {
+            object.reset();
+
+            THEN("the weak reference expires and the object is destroyed")
+            {
+                REQUIRE(dtorCount == 1);
+                REQUIRE(weak.expired());
+                REQUIRE(!weak.lock());
+            }
+        }
+    }
+
+    GIVEN("an object allocated from a slab")
+    {
+        kf::SlabAllocator slab(NonPagedPoolNx);
+        REQUIRE_NT_SUCCESS(slab.initialize());
+
+        {
+            auto object = kf::allocate_ref<RefCountedObject>(kf::SlabAllocatorRef<std::byte>(slab), 7, &dtorCount);
+            REQUIRE(object);
+            REQUIRE(object->value == 7);
+        }
+
+        THEN("it's destroyed and its block is returned to the slab")
+        {
+            REQUIRE(dtorCount == 1);
+        }
+    }
+
+    GIVEN("an object shared by multiple threads")
+    {
+        LONG failures = 0;
+
+        {
+            const auto shared = kf::make_ref<RefCountedObject, NonPagedPoolNx>(42, &dtorCount);
+            const kf::WeakRef<RefCountedObject> weak = shared;
+
+            ChurnContext context = { &shared, &weak, &failures };
+            kf::Thread threads[kThreadCount];
+
+            for (auto& thread : threads)
+            {
+                REQUIRE_NT_SUCCESS(thread.start([](PVOID context) { PsTerminateSystemThread(churnRoutine(static_cast<ChurnContext*>(context))); }, &context));
+            }
+
+            for (auto& thread : threads)
+            {
+                thread.join();
+            }
+
+            REQUIRE(shared.use_count() == 1);
+        }
+
+        THEN("references are balanced and the object is destroyed once")
+        {
+            REQUIRE(failures == 0);
+            REQUIRE(dtorCount == 1);
+        }
+    }
+}
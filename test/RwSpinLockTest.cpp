@@ -0,0 +1,150 @@
+#include "pch.h"
+#include <kf/AutoRwSpinLock.h>
+#include "StressUtils.h"
+#include <mutex>
+#include <shared_mutex>
+
+namespace
+{
+    constexpr int kIterationCount = 2000;
+
+    struct StressContext
+    {
+        kf::RwSpinLock* lock;
+        volatile LONG threadIndex;
+        LONG writes;
+        LONG first;
+        LONG second;
+        volatile LONG tornReads;
+    };
+
+    // Writers change both fields under the exclusive lock, readers check under the shared lock that they are equal
+    void stressRoutine(PVOID rawContext)
+    {
+        auto context = static_cast<StressContext*>(rawContext);
+        const bool writer = stress::isWriter(context->threadIndex);
+
+        for (int i = 0; i < kIterationCount; ++i)
+        {
+            if (writer)
+            {
+                std::unique_lock lock(*context->lock);
+
+                ++context->first;
+                YieldProcessor();
+                ++context->second;
+                ++context->writes;
+            }
+            else
+            {
+                kf::AutoRwSpinLockShared lock(*context->lock);
+
+                if (context->first != context->second)
+                {
+                    InterlockedIncrement(&context->tornReads);
+                }
+            }
+        }
+
+        PsTerminateSystemThread(STATUS_SUCCESS);
+    }
+}
+
+SCENARIO("kf::RwSpinLock")
+{
+    GIVEN("a reader-writer spin lock and PASSIVE_LEVEL on entry")
+    {
+        kf::RwSpinLock lock;
+
+        WHEN("std::unique_lock holds it")
+        {
+            KIRQL irql;
+
+            {
+                std::unique_lock guard(lock);
+                irql = KeGetCurrentIrql();
+            }
+
+            THEN("IRQL is DISPATCH_LEVEL while it's held and restored after")
+            {
+                REQUIRE(irql == DISPATCH_LEVEL);
+                REQUIRE(KeGetCurrentIrql() == PASSIVE_LEVEL);
+            }
+        }
+
+        WHEN("several shared guards hold it")
+        {
+            bool converted = true;
+
+            {
+                kf::AutoRwSpinLockShared first(lock);
+                kf::AutoRwSpinLockShared second(lock);
+
+                converted = lock.tryConvertSharedToExclusive();
+            }
+
+            THEN("they don't block each other and it can't be converted to exclusive")
+            {
+                REQUIRE(!converted);
+                REQUIRE(KeGetCurrentIrql() == PASSIVE_LEVEL);
+            }
+        }
+
+        WHEN("std::shared_lock holds it at DISPATCH_LEVEL")
+        {
+            KIRQL oldIrql;
+            KeRaiseIrql(DISPATCH_LEVEL, &oldIrql);
+
+            bool converted = false;
+
+            {
+                std::shared_lock guard(lock);
+                converted = lock.tryConvertSharedToExclusive();
+
+                if (converted)
+                {
+                    // The guard releases it as shared, so convert back by hand
+                    lock.releaseExclusiveFromDpcLevel();
+                    lock.acquireSharedAtDpcLevel();
+                }
+            }
+
+            KeLowerIrql(oldIrql);
+
+            THEN("the single reader can be converted to exclusive")
+            {
+                REQUIRE(converted);
+            }
+        }
+
+        WHEN("an exclusive guard holds it")
+        {
+            {
+                kf::AutoRwSpinLockExclusive guard(lock);
+                REQUIRE(KeGetCurrentIrql() == DISPATCH_LEVEL);
+            }
+
+            THEN("it can be acquired shared after")
+            {
+                kf::AutoRwSpinLockShared guard(lock);
+                REQUIRE(KeGetCurrentIrql() == DISPATCH_LEVEL);
+            }
+        }
+    }
+
+    GIVEN("a reader-writer spin lock contended by 2 to 128 threads")
+    {
+        kf::RwSpinLock lock;
+
+        for (int threadCount : stress::kThreadCounts)
+        {
+            StressContext context = { &lock };
+            REQUIRE_NT_SUCCESS(stress::runThreads(threadCount, &stressRoutine, &context));
+
+            REQUIRE(context.tornReads == 0);
+            REQUIRE(context.first == context.writes);
+            REQUIRE(context.second == context.writes);
+            REQUIRE(context.writes == stress::writerCount(threadCount) * kIterationCount);
+        }
+    }
+}
@@ -0,0 +1,178 @@
+#include "pch.h"
+#include <kf/SList.h>
+#include <kf/Thread.h>
+#include <kf/stl/new>
+
+namespace
+{
+    constexpr int kThreadCount = 4;
+    constexpr int kIterationCount = 20000;
+    constexpr int kItemCount = 64;
+
+    struct Item
+    {
+        SLIST_ENTRY entry;
+        int value = 0;
+        volatile LONG owners = 0;
+    };
+
+    using ItemList = kf::SList<Item, &Item::entry>;
+
+    struct StressContext
+    {
+        ItemList* list;
+        volatile LONG* failures;
+    };
+
+    // Every popped item must be owned by a single thread till it's pushed back
+    void stressRoutine(StressContext* context)
+    {
+        for (int i = 0; i < kIterationCount; ++i)
+        {
+            Item* item = context->list->pop();
+            if (!item)
+            {
+                continue;
+            }
+
+            if (InterlockedIncrement(&item->owners) != 1)
+            {
+                InterlockedIncrement(context->failures);
+            }
+
+            InterlockedDecrement(&item->owners);
+            context->list->push(*item);
+        }
+    }
+}
+
+SCENARIO("kf::SList")
+{
+    GIVEN("a list with elements")
+    {
+        ItemList list;
+        Item items[3];
+
+        REQUIRE(list.isEmpty());
+
+        for (int i = 0; i < 3; ++i)
+        {
+            items[i].value = i;
+            REQUIRE(list.push(items[i]) == (i == 0));
+        }
+
+        WHEN("elements are popped")
+        {
+            THEN("they are returned in LIFO order")
+            {
+                REQUIRE(list.depth() == 3);
+                REQUIRE(list.pop() == &items[2]);
+                REQUIRE(list.pop() == &items[1]);
+                REQUIRE(list.pop() == &items[0]);
+                REQUIRE(list.pop() == nullptr);
+                REQUIRE(list.isEmpty());
+            }
+        }
+
+        WHEN("the list is flushed")
+        {
+            auto chain = list.flush();
+
+            THEN("the list is empty")
+            {
+                REQUIRE(list.isEmpty());
+                REQUIRE(chain.pop() == &items[2]);
+                REQUIRE(chain.pop() == &items[1]);
+                REQUIRE(chain.pop() == &items[0]);
+                REQUIRE(chain.isEmpty());
+            }
+
+            THEN("the reversed chain is in the push order")
+            {
+                chain.reverse();
+
+                for (int i = 0; i < 3; ++i)
+                {
+                    REQUIRE(chain.pop() == &items[i]);
+                }
+
+                REQUIRE(chain.pop() == nullptr);
+            }
+        }
+    }
+
+    GIVEN("a list with 65536 elements")
+    {
+        constexpr int kManyItemCount = 65536;
+
+        auto items = static_cast<Item*>(operator new(sizeof(Item) * kManyItemCount, NonPagedPoolNx));
+        REQUIRE(items);
+
+        ItemList list;
+
+        for (int i = 0; i < kManyItemCount; ++i)
+        {
+            list.push(*new(&items[i]) Item());
+        }
+
+        THEN("the depth wraps but the list is not empty")
+        {
+            REQUIRE(list.depth() == 0);
+            REQUIRE(!list.isEmpty());
+        }
+
+        // The elements are detached before they are freed
+        for (auto chain = list.flush(); chain.pop();)
+        {
+        }
+
+        operator delete(items);
+    }
+
+    GIVEN("a list shared by multiple threads")
+    {
+        ItemList list;
+        volatile LONG failures = 0;
+
+        auto items = static_cast<Item*>(operator new(sizeof(Item) * kItemCount, NonPagedPoolNx));
+        REQUIRE(items);
+
+        for (int i = 0; i < kItemCount; ++i)
+        {
+            list.push(*new(&items[i]) Item{});
+        }
+
+        StressContext context = { &list, &failures };
+        kf::Thread threads[kThreadCount];
+
+        for (auto& thread : threads)
+        {
+            REQUIRE_NT_SUCCESS(thread.start([](PVOID context)
+                {
+                    stressRoutine(static_cast<StressContext*>(context));
+                    PsTerminateSystemThread(STATUS_SUCCESS);
+                },
+                &context));
+        }
+
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        const USHORT depth = list.depth();
+
+        auto chain = list.flush();
+        while (chain.pop())
+        {
+        }
+
+        operator delete(items);
+
+        THEN("no element is owned by two threads at once")
+        {
+            REQUIRE(failures == 0);
+            REQUIRE(depth == kItemCount);
+        }
+    }
+}
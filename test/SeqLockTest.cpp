@@ -0,0 +1,130 @@
+#include "pch.h"
+#include <kf/SeqLock.h>
+#include "StressUtils.h"
+
+namespace
+{
+    constexpr int kIterationCount = 2000;
+
+    struct Policy
+    {
+        LONG64 generation;
+        LONG64 doubled;
+        ULONG flags;
+    };
+
+    struct StressContext
+    {
+        kf::SeqLock<Policy>* policy;
+        volatile LONG threadIndex;
+        volatile LONG64 reads;
+        volatile LONG tornReads;
+    };
+
+    // Writers bump the generation, readers check that a read never sees it apart from its double
+    void stressRoutine(PVOID rawContext)
+    {
+        auto context = static_cast<StressContext*>(rawContext);
+        const bool writer = stress::isWriter(context->threadIndex);
+
+        for (int i = 0; i < kIterationCount; ++i)
+        {
+            if (writer)
+            {
+                context->policy->update([](Policy& policy)
+                {
+                    ++policy.generation;
+                    YieldProcessor();
+                    policy.doubled = policy.generation * 2;
+                });
+            }
+            else
+            {
+                const Policy policy = context->policy->read();
+
+                if (policy.doubled != policy.generation * 2)
+                {
+                    InterlockedIncrement(&context->tornReads);
+                }
+            }
+        }
+
+        if (!writer)
+        {
+            InterlockedAdd64(&context->reads, kIterationCount);
+        }
+
+        PsTerminateSystemThread(STATUS_SUCCESS);
+    }
+}
+
+SCENARIO("kf::SeqLock")
+{
+    GIVEN("a sequence lock with an initial value")
+    {
+        kf::SeqLock<Policy> policy(Policy{ 1, 2, 0x10 });
+
+        WHEN("it's read")
+        {
+            const Policy value = policy.read();
+
+            THEN("the initial value is returned and no writes are counted")
+            {
+                REQUIRE(value.generation == 1);
+                REQUIRE(value.doubled == 2);
+                REQUIRE(value.flags == 0x10);
+                REQUIRE(policy.version() == 0);
+            }
+        }
+
+        WHEN("it's written and then updated")
+        {
+            policy.write(Policy{ 5, 10, 0 });
+            policy.update([](Policy& value) { value.flags |= 0x1; });
+
+            const Policy value = policy.read();
+
+            THEN("the read returns both changes and the version counts both writes")
+            {
+                REQUIRE(value.generation == 5);
+                REQUIRE(value.doubled == 10);
+                REQUIRE(value.flags == 0x1);
+                REQUIRE(policy.version() == 2);
+            }
+        }
+
+        WHEN("it's read at DISPATCH_LEVEL")
+        {
+            KIRQL oldIrql;
+            KeRaiseIrql(DISPATCH_LEVEL, &oldIrql);
+
+            const Policy value = policy.read();
+
+            KeLowerIrql(oldIrql);
+
+            THEN("the value is returned")
+            {
+                REQUIRE(value.generation == 1);
+            }
+        }
+    }
+
+    GIVEN("a sequence lock read by 2 to 128 threads while every fourth thread writes")
+    {
+        for (int threadCount : stress::kThreadCounts)
+        {
+            kf::SeqLock<Policy> policy;
+
+            StressContext context = { &policy };
+            REQUIRE_NT_SUCCESS(stress::runThreads(threadCount, &stressRoutine, &context));
+
+            const Policy value = policy.read();
+
+            REQUIRE(context.tornReads == 0);
+            REQUIRE(context.reads == static_cast<LONG64>(stress::readerCount(threadCount)) * kIterationCount);
+            REQUIRE(value.generation == stress::writerCount(threadCount) * kIterationCount);
+            REQUIRE(value.doubled == value.generation * 2);
+            REQUIRE(policy.version() == value.generation);
+        }
+    }
+}
@@ -0,0 +1,288 @@
+#include "pch.h"
+#include <kf/SlabAllocator.h>
+#include <kf/stl/vector>
+#include <kf/TreeMap.h>
+#include <kf/VariableSizeStruct.h>
+#include <kf/Thread.h>
+
+namespace
+{
+    constexpr int kThreadCount = 4;
+    constexpr int kIterationCount = 5000;
+    constexpr int kLiveObjectCount = 32;
+
+    struct StressContext
+    {
+        kf::SlabAllocator* slab;
+        int threadIndex;
+        LONG* failures;
+    };
+
+    // Every thread keeps a window of live objects of different sizes, fills them with its pattern and checks
+    // that nobody else has touched them before freeing
+    NTSTATUS stressRoutine(StressContext* context)
+    {
+        void* objects[kLiveObjectCount] = {};
+        size_t sizes[kLiveObjectCount] = {};
+        const auto pattern = static_cast<unsigned char>(0x10 + context->threadIndex);
+
+        for (int i = 0; i < kIterationCount; ++i)
+        {
+            const int slot = i % kLiveObjectCount;
+
+            if (objects[slot])
+            {
+                auto bytes = static_cast<unsigned char*>(objects[slot]);
+                if (bytes[0] != pattern || bytes[sizes[slot] - 1] != pattern)
+                {
+                    InterlockedIncrement(context->failures);
+                }
+
+                context->slab->deallocate(objects[slot], sizes[slot]);
+            }
+
+            sizes[slot] = 8 + (i * 37 + context->threadIndex * 11) % 600;
+            objects[slot] = context->slab->allocate(sizes[slot]);
+
+            if (!objects[slot])
+            {
+                InterlockedIncrement(context->failures);
+                continue;
+            }
+
+            memset(objects[slot], pattern, sizes[slot]);
+        }
+
+        for (int slot = 0; slot < kLiveObjectCount; ++slot)
+        {
+            context->slab->deallocate(objects[slot], sizes[slot]);
+        }
+
+        return STATUS_SUCCESS;
+    }
+
+    struct TestHeader
+    {
+        ULONG length;
+        WCHAR name[1];
+    };
+}
+
+SCENARIO("kf::SlabAllocator")
+{
+    GIVEN("a slab allocator with default size classes")
+    {
+        kf::SlabAllocator slab(NonPagedPoolNx);
+        REQUIRE_NT_SUCCESS(slab.initialize());
+
+        THEN("it has default size classes")
+        {
+            REQUIRE(slab.sizeClassCount() == 5);
+            REQUIRE(slab.sizeClass(0) == 32);
+            REQUIRE(slab.sizeClass(4) == 512);
+        }
+
+        WHEN("an object is freed and allocated again")
+        {
+            void* p1 = slab.allocate(40);
+            REQUIRE(p1);
+            slab.deallocate(p1, 40);
+
+            void* p2 = slab.allocate(64);
+
+            THEN("the cached object of the same size class is reused")
+            {
+                REQUIRE(p1 == p2);
+            }
+
+            slab.deallocate(p2, 64);
+        }
+
+        WHEN("objects of different size classes are freed")
+        {
+            void* small = slab.allocate(16);
+            void* large = slab.allocate(500);
+            slab.deallocate(small, 16);
+            slab.deallocate(large, 500);
+
+            THEN("they are not mixed")
+            {
+                REQUIRE(slab.allocate(16) == small);
+                REQUIRE(slab.allocate(500) == large);
+
+                slab.deallocate(small, 16);
+                slab.deallocate(large, 500);
+            }
+        }
+
+        WHEN("more objects than the per-CPU magazines hold are allocated and freed")
+        {
+            void* objects[200] = {};
+
+            for (auto& object : objects)
+            {
+                object = slab.allocate(100);
+                REQUIRE(object);
+                memset(object, 0xcc, 100);
+            }
+
+            for (auto object : objects)
+            {
+                slab.deallocate(object, 100);
+            }
+
+            THEN("they can be allocated again and trimmed")
+            {
+                for (auto& object : objects)
+                {
+                    object = slab.allocate(100);
+                    REQUIRE(object);
+                }
+
+                for (auto object : objects)
+                {
+                    slab.deallocate(object, 100);
+                }
+
+                slab.trim();
+
+                void* p = slab.allocate(100);
+                REQUIRE(p);
+                slab.deallocate(p, 100);
+            }
+        }
+
+        WHEN("a block larger than the largest size class is allocated")
+        {
+            void* p = slab.allocate(4096);
+
+            THEN("it comes from the pool")
+            {
+                REQUIRE(p);
+                memset(p, 0, 4096);
+                slab.deallocate(p, 4096);
+            }
+        }
+    }
+
+    GIVEN("invalid size classes")
+    {
+        kf::SlabAllocator slab(NonPagedPoolNx);
+
+        THEN("initialization fails")
+        {
+            const size_t unsorted[] = { 64, 32 };
+            REQUIRE(slab.initialize(unsorted) == STATUS_INVALID_PARAMETER);
+
+            const size_t duplicated[] = { 32, 32 };
+            REQUIRE(slab.initialize(duplicated) == STATUS_INVALID_PARAMETER);
+
+            const size_t tooMany[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+            REQUIRE(slab.initialize(tooMany) == STATUS_INVALID_PARAMETER);
+        }
+
+        THEN("the allocator has no size classes and falls back to the pool")
+        {
+            REQUIRE(slab.sizeClassCount() == 0);
+
+            void* p = slab.allocate(32);
+            REQUIRE(p);
+            slab.deallocate(p, 32);
+        }
+    }
+
+    GIVEN("a slab allocator used by multiple threads")
+    {
+        // The cross-CPU alloc/free pattern exercises the depot exchange
+        kf::SlabAllocator slab(NonPagedPoolNx);
+        REQUIRE_NT_SUCCESS(slab.initialize(kf::SlabAllocator::kDefaultSizeClasses, 2));
+
+        LONG failures = 0;
+        StressContext contexts[kThreadCount];
+        kf::Thread threads[kThreadCount];
+
+        for (int i = 0; i < kThreadCount; ++i)
+        {
+            contexts[i] = { &slab, i, &failures };
+            REQUIRE_NT_SUCCESS(threads[i].start([](PVOID context) { PsTerminateSystemThread(stressRoutine(static_cast<StressContext*>(context))); }, &contexts[i]));
+        }
+
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        THEN("all objects are valid")
+        {
+            REQUIRE(failures == 0);
+        }
+    }
+}
+
+SCENARIO("SlabAllocatorRef")
+{
+    kf::SlabAllocator slab(NonPagedPoolNx);
+    REQUIRE_NT_SUCCESS(slab.initialize());
+
+    GIVEN("vector with SlabAllocatorRef")
+    {
+        kf::vector<int, NonPagedPoolNx, kf::SlabAllocatorRef<int>> v{ kf::SlabAllocatorRef<int>(slab) };
+
+        WHEN("elements are added")
+        {
+            for (int i = 0; i < 100; ++i)
+            {
+                REQUIRE_NT_SUCCESS(v.push_back(i));
+            }
+
+            THEN("they are stored")
+            {
+                REQUIRE(v.size() == 100);
+                REQUIRE(v[99] == 99);
+            }
+        }
+    }
+
+    GIVEN("TreeMap with SlabAllocatorNodeRef")
+    {
+        kf::TreeMap<int, int, NonPagedPoolNx, std::less<int>, kf::SlabAllocatorNodeRef> map{ kf::SlabAllocatorNodeRef(slab) };
+
+        WHEN("elements are added and removed")
+        {
+            for (int i = 0; i < 100; ++i)
+            {
+                REQUIRE_NT_SUCCESS(map.put(i, i));
+            }
+
+            REQUIRE(map.remove(10));
+
+            THEN("the map works")
+            {
+                REQUIRE(map.size() == 99);
+                REQUIRE(!map.containsKey(10));
+                REQUIRE(*map.get(20) == 20);
+            }
+        }
+    }
+
+    GIVEN("VariableSizeStruct with SlabAllocatorRef")
+    {
+        kf::VariableSizeStruct<TestHeader, NonPagedPoolNx, kf::SlabAllocatorRef<std::byte>> header{ kf::SlabAllocatorRef<std::byte>(slab) };
+
+        WHEN("it's emplaced")
+        {
+            REQUIRE_NT_SUCCESS(header.emplace(sizeof(TestHeader) + 20 * sizeof(WCHAR), TestHeader{ 20 }));
+
+            THEN("the buffer is allocated from the slab")
+            {
+                REQUIRE(header->length == 20);
+                void* buffer = header.get();
+                header.free();
+
+                void* p = slab.allocate(sizeof(TestHeader) + 20 * sizeof(WCHAR));
+                REQUIRE(p == buffer);
+                slab.deallocate(p, sizeof(TestHeader) + 20 * sizeof(WCHAR));
+            }
+        }
+    }
+}
@@ -0,0 +1,188 @@
+#include "pch.h"
+#include <kf/SlabNodeAllocator.h>
+#include <kf/TreeMap.h>
+#include <kf/TreeSet.h>
+
+namespace
+{
+    constexpr size_t kNodesPerChunk = 4;
+    constexpr size_t kNodeSize = 2 * MEMORY_ALLOCATION_ALIGNMENT;
+
+    using TestAllocator = kf::SlabNodeAllocator<PagedPool, kNodesPerChunk>;
+}
+
+SCENARIO("kf::SlabNodeAllocator")
+{
+    GIVEN("an empty allocator")
+    {
+        TestAllocator allocator;
+
+        THEN("no chunks are allocated")
+        {
+            REQUIRE(allocator.nodeCount() == 0);
+            REQUIRE(allocator.chunkCount() == 0);
+        }
+
+        WHEN("nodes of one chunk are allocated")
+        {
+            std::array<void*, kNodesPerChunk> nodes{};
+            for (auto& node : nodes)
+            {
+                node = allocator.allocate(kNodeSize);
+                REQUIRE(node);
+            }
+
+            THEN("they are carved from one chunk next to each other")
+            {
+                REQUIRE(allocator.chunkCount() == 1);
+                REQUIRE(allocator.nodeCount() == kNodesPerChunk);
+
+                for (size_t i = 1; i < nodes.size(); ++i)
+                {
+                    REQUIRE(static_cast<std::byte*>(nodes[i]) - static_cast<std::byte*>(nodes[i - 1]) == kNodeSize);
+                }
+            }
+
+            THEN("the next node requires a new chunk")
+            {
+                void* node = allocator.allocate(kNodeSize);
+                REQUIRE(node);
+                REQUIRE(allocator.chunkCount() == 2);
+
+                allocator.deallocate(node);
+            }
+
+            THEN("a released node is reused")
+            {
+                allocator.deallocate(nodes[1]);
+                REQUIRE(allocator.nodeCount() == kNodesPerChunk - 1);
+
+                REQUIRE(allocator.allocate(kNodeSize) == nodes[1]);
+                REQUIRE(allocator.chunkCount() == 1);
+            }
+
+            THEN("trim keeps chunks while nodes are allocated")
+            {
+                allocator.trim();
+                REQUIRE(allocator.chunkCount() == 1);
+            }
+
+            THEN("allocator can be moved with allocated nodes")
+            {
+                TestAllocator another = std::move(allocator);
+                REQUIRE(allocator.chunkCount() == 0);
+                REQUIRE(another.chunkCount() == 1);
+                REQUIRE(another.nodeCount() == kNodesPerChunk);
+
+                allocator = std::move(another);
+                REQUIRE(allocator.nodeCount() == kNodesPerChunk);
+            }
+
+            for (auto node : nodes)
+            {
+                allocator.deallocate(node);
+            }
+
+            THEN("trim releases chunks when all nodes are released")
+            {
+                allocator.trim();
+                REQUIRE(allocator.nodeCount() == 0);
+                REQUIRE(allocator.chunkCount() == 0);
+            }
+        }
+    }
+}
+
+SCENARIO("kf::SlabNodeAllocator with tree containers")
+{
+    constexpr std::array kKeys = { 7, 1, 5, 3, 4, 2, 6, 0, 9, 8 };
+
+    GIVEN("TreeMap with slab node allocator")
+    {
+        kf::TreeMap<int, int, PagedPool, std::less<int>, TestAllocator> map;
+
+        for (int key : kKeys)
+        {
+            REQUIRE_NT_SUCCESS(map.put(key, key * 10));
+        }
+
+        THEN("all values are accessible")
+        {
+            REQUIRE(map.size() == static_cast<int>(kKeys.size()));
+
+            for (int key : kKeys)
+            {
+                auto value = map.get(key);
+                REQUIRE(value);
+                REQUIRE(*value == key * 10);
+            }
+        }
+
+        WHEN("elements are removed and inserted again")
+        {
+            for (int key : kKeys)
+            {
+                REQUIRE(map.remove(key));
+            }
+
+            for (int key : kKeys)
+            {
+                REQUIRE_NT_SUCCESS(map.put(key, key));
+            }
+
+            THEN("all values are accessible")
+            {
+                REQUIRE(map.size() == static_cast<int>(kKeys.size()));
+
+                for (int key : kKeys)
+                {
+                    auto value = map.get(key);
+                    REQUIRE(value);
+                    REQUIRE(*value == key);
+                }
+            }
+        }
+
+        WHEN("map is moved")
+        {
+            auto destinationMap = std::move(map);
+
+            THEN("moved elements are accessible and can be removed")
+            {
+                REQUIRE(map.isEmpty());
+
+                for (int key : kKeys)
+                {
+                    auto value = destinationMap.get(key);
+                    REQUIRE(value);
+                    REQUIRE(*value == key * 10);
+                    REQUIRE(destinationMap.remove(key));
+                }
+
+                REQUIRE(destinationMap.isEmpty());
+            }
+        }
+    }
+
+    GIVEN("TreeSet with slab node allocator")
+    {
+        kf::TreeSet<int, PagedPool, std::less<int>, TestAllocator> set;
+
+        for (int key : kKeys)
+        {
+            REQUIRE_NT_SUCCESS(set.add(key));
+        }
+
+        THEN("elements are enumerated in order")
+        {
+            int expected = 0;
+
+            for (auto it = set.iterator(); it.hasNext(); ++expected)
+            {
+                REQUIRE(it.next() == expected);
+            }
+
+            REQUIRE(expected == static_cast<int>(kKeys.size()));
+        }
+    }
+}
@@ -0,0 +1,172 @@
+#include "pch.h"
+#include <kf/stl/small_vector>
+#include <kf/SpanUtils.h>
+
+namespace
+{
+    bool isInside(const void* p, const void* object, size_t size)
+    {
+        return p >= object && p < static_cast<const std::byte*>(object) + size;
+    }
+}
+
+SCENARIO("small_vector")
+{
+    GIVEN("empty small_vector with 4 inline elements")
+    {
+        kf::small_vector<int, 4, PagedPool> v;
+
+        THEN("capacity is the inline capacity")
+        {
+            REQUIRE(v.empty());
+            REQUIRE(v.capacity() == 4);
+            REQUIRE(v.inline_capacity() == 4);
+        }
+
+        WHEN("elements fit the inline buffer")
+        {
+            for (int i = 0; i < 4; ++i)
+            {
+                REQUIRE_NT_SUCCESS(v.push_back(i));
+            }
+
+            THEN("they are stored inside the object")
+            {
+                REQUIRE(v.size() == 4);
+                REQUIRE(v.capacity() == 4);
+                REQUIRE(isInside(v.data(), &v, sizeof(v)));
+                REQUIRE(v[3] == 3);
+            }
+        }
+
+        WHEN("elements don't fit the inline buffer")
+        {
+            for (int i = 0; i < 10; ++i)
+            {
+                REQUIRE_NT_SUCCESS(v.push_back(i));
+            }
+
+            THEN("they spill to the pool")
+            {
+                REQUIRE(v.size() == 10);
+                REQUIRE(v.capacity() >= 10);
+                REQUIRE(!isInside(v.data(), &v, sizeof(v)));
+
+                for (int i = 0; i < 10; ++i)
+                {
+                    REQUIRE(v[i] == i);
+                }
+            }
+        }
+
+        WHEN("spilled elements are erased and shrink_to_fit is called")
+        {
+            for (int i = 0; i < 10; ++i)
+            {
+                REQUIRE_NT_SUCCESS(v.push_back(i));
+            }
+
+            v.erase(v.begin() + 2, v.end());
+            REQUIRE_NT_SUCCESS(v.shrink_to_fit());
+
+            THEN("elements return to the inline buffer")
+            {
+                REQUIRE(v.size() == 2);
+                REQUIRE(v.capacity() == 4);
+                REQUIRE(isInside(v.data(), &v, sizeof(v)));
+                REQUIRE(v[0] == 0);
+                REQUIRE(v[1] == 1);
+            }
+        }
+
+        WHEN("it's used as a span")
+        {
+            REQUIRE_NT_SUCCESS(v.assign({ 1, 2, 3 }));
+
+            std::span<int> span(v);
+            auto bytes = kf::span_cast<const std::byte>(span);
+
+            THEN("the span refers to the elements")
+            {
+                REQUIRE(span.size() == 3);
+                REQUIRE(span.data() == v.data());
+                REQUIRE(bytes.size() == 3 * sizeof(int));
+            }
+        }
+    }
+
+    GIVEN("small_vector with inline elements")
+    {
+        kf::small_vector<int, 4, PagedPool> v;
+        REQUIRE_NT_SUCCESS(v.assign({ 1, 2, 3 }));
+
+        WHEN("it's moved")
+        {
+            auto other = std::move(v);
+
+            THEN("elements are moved to the inline buffer of the new one")
+            {
+                REQUIRE(v.empty());
+                REQUIRE(other.size() == 3);
+                REQUIRE(isInside(other.data(), &other, sizeof(other)));
+                REQUIRE(other[2] == 3);
+            }
+        }
+
+        WHEN("it's swapped with an inline one")
+        {
+            kf::small_vector<int, 4, PagedPool> other;
+            REQUIRE_NT_SUCCESS(other.push_back(10));
+
+            v.swap(other);
+
+            THEN("elements are swapped")
+            {
+                REQUIRE(v.size() == 1);
+                REQUIRE(v[0] == 10);
+                REQUIRE(other.size() == 3);
+                REQUIRE(other[0] == 1);
+                REQUIRE(other[2] == 3);
+            }
+        }
+
+        WHEN("it's swapped with a spilled one")
+        {
+            kf::small_vector<int, 4, PagedPool> other;
+            REQUIRE_NT_SUCCESS(other.assign(10, 7));
+
+            const int* buffer = other.data();
+            v.swap(other);
+
+            THEN("the spilled buffer changes the owner")
+            {
+                REQUIRE(v.size() == 10);
+                REQUIRE(v.data() == buffer);
+                REQUIRE(other.size() == 3);
+                REQUIRE(isInside(other.data(), &other, sizeof(other)));
+                REQUIRE(other[0] == 1);
+            }
+        }
+    }
+
+    GIVEN("spilled small_vector")
+    {
+        kf::small_vector<int, 2, PagedPool> v;
+        REQUIRE_NT_SUCCESS(v.assign({ 1, 2, 3, 4, 5 }));
+
+        WHEN("it's moved")
+        {
+            const int* buffer = v.data();
+            kf::small_vector<int, 2, PagedPool> other;
+            other = std::move(v);
+
+            THEN("the buffer is moved without moving elements")
+            {
+                REQUIRE(other.data() == buffer);
+                REQUIRE(other.size() == 5);
+                REQUIRE(v.empty());
+                REQUIRE(v.capacity() == 2);
+            }
+        }
+    }
+}
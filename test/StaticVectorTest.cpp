@@ -0,0 +1,108 @@
+#include "pch.h"
+#include <kf/stl/static_vector>
+#include <kf/SpanUtils.h>
+
+SCENARIO("static_vector")
+{
+    GIVEN("empty static_vector with capacity 3")
+    {
+        kf::static_vector<int, 3> v;
+
+        THEN("capacity is fixed")
+        {
+            REQUIRE(v.empty());
+            REQUIRE(v.capacity() == 3);
+            REQUIRE(v.max_size() == 3);
+        }
+
+        WHEN("it's filled")
+        {
+            REQUIRE_NT_SUCCESS(v.push_back(1));
+            REQUIRE_NT_SUCCESS(v.push_back(2));
+            REQUIRE_NT_SUCCESS(v.push_back(3));
+
+            THEN("growth fails with STATUS_BUFFER_OVERFLOW")
+            {
+                REQUIRE(v.push_back(4) == STATUS_BUFFER_OVERFLOW);
+                REQUIRE(!v.emplace_back(4));
+                REQUIRE(!v.insert(v.begin(), 0));
+                REQUIRE(v.resize(4) == STATUS_BUFFER_OVERFLOW);
+                REQUIRE(v.reserve(4) == STATUS_BUFFER_OVERFLOW);
+                REQUIRE(v.assign(4, 0) == STATUS_BUFFER_OVERFLOW);
+            }
+
+            THEN("elements are not changed by failed operations")
+            {
+                REQUIRE(v.push_back(4) == STATUS_BUFFER_OVERFLOW);
+                REQUIRE(!v.insert(v.begin(), 0));
+
+                REQUIRE(v.size() == 3);
+                REQUIRE(v[0] == 1);
+                REQUIRE(v[2] == 3);
+            }
+        }
+
+        WHEN("it's full and an element is erased")
+        {
+            REQUIRE_NT_SUCCESS(v.assign({ 1, 2, 3 }));
+            v.erase(v.begin());
+
+            THEN("a new one can be inserted")
+            {
+                REQUIRE(v.insert(v.begin(), 10));
+                REQUIRE(v[0] == 10);
+                REQUIRE(v[1] == 2);
+                REQUIRE(v[2] == 3);
+            }
+        }
+
+        WHEN("data is copied into it with SpanUtils")
+        {
+            const int kArr[] = { 5, 6, 7, 8 };
+
+            REQUIRE_NT_SUCCESS(v.resize(v.capacity()));
+            auto copied = kf::copyTruncate(std::span<int>(v), std::span(kArr));
+
+            THEN("the data is truncated to the capacity")
+            {
+                REQUIRE(copied.size() == 3);
+                REQUIRE(v[0] == 5);
+                REQUIRE(v[2] == 7);
+            }
+        }
+    }
+
+    GIVEN("two static_vectors")
+    {
+        kf::static_vector<int, 4> v1;
+        REQUIRE_NT_SUCCESS(v1.assign({ 1, 2, 3 }));
+
+        kf::static_vector<int, 4> v2;
+        REQUIRE_NT_SUCCESS(v2.push_back(9));
+
+        WHEN("they are swapped")
+        {
+            v1.swap(v2);
+
+            THEN("elements are swapped")
+            {
+                REQUIRE(v1.size() == 1);
+                REQUIRE(v1[0] == 9);
+                REQUIRE(v2.size() == 3);
+                REQUIRE(v2[2] == 3);
+            }
+        }
+
+        WHEN("one is moved to another")
+        {
+            v2 = std::move(v1);
+
+            THEN("elements are moved")
+            {
+                REQUIRE(v1.empty());
+                REQUIRE(v2.size() == 3);
+                REQUIRE(v2[0] == 1);
+            }
+        }
+    }
+}
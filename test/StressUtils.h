@@ -0,0 +1,41 @@
+#pragma once
+#include <kf/ThreadPool.h>
+
+///////////////////////////////////////////////////////////
+// Helpers of multithreaded stress scenarios
+
+namespace stress
+{
+    // Thread counts a scenario is repeated with: from a pair of threads to more threads than processors
+    constexpr int kThreadCounts[] = { 2, 8, 32, 128 };
+
+    // Every fourth thread of a readers-writers scenario is a writer
+    constexpr int kWriterRatio = 4;
+
+    constexpr int writerCount(int threadCount)
+    {
+        return threadCount / kWriterRatio;
+    }
+
+    constexpr int readerCount(int threadCount)
+    {
+        return threadCount - writerCount(threadCount);
+    }
+
+    // Numbers the calling thread with threadIndex and tells if it's a writer
+    inline bool isWriter(volatile LONG& threadIndex)
+    {
+        return InterlockedIncrement(&threadIndex) % kWriterRatio == 0;
+    }
+
+    // Runs routine(context) on threadCount threads and waits until they exit, the routine terminates its thread
+    inline NTSTATUS runThreads(int threadCount, KSTART_ROUTINE routine, PVOID context)
+    {
+        kf::ThreadPool threads(threadCount);
+
+        const NTSTATUS status = threads.start(routine, context);
+        threads.join();
+
+        return status;
+    }
+}
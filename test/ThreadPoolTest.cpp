@@ -0,0 +1,240 @@
+#include "pch.h"
+#include <kf/ThreadPool.h>
+#include <kf/ScopeExit.h>
+
+namespace
+{
+    constexpr int kWorkerCount = 4;
+}
+
+SCENARIO("kf::ThreadPool")
+{
+    GIVEN("a started pool")
+    {
+        kf::ThreadPool pool(kWorkerCount);
+        REQUIRE_NT_SUCCESS(pool.start());
+
+        WHEN("many small tasks are submitted")
+        {
+            constexpr int kTaskCount = 1000;
+
+            volatile LONG executed = 0;
+            kf::Latch done(kTaskCount);
+
+            for (int i = 0; i < kTaskCount; ++i)
+            {
+                // The pool is bounded, retry while it's full
+                while (!NT_SUCCESS(pool.submit([&executed, &done] { InterlockedIncrement(&executed); done.countDown(); })))
+                {
+                    YieldProcessor();
+                }
+            }
+
+            REQUIRE_NT_SUCCESS(done.wait());
+
+            THEN("every task is executed once")
+            {
+                REQUIRE(executed == kTaskCount);
+            }
+        }
+
+        WHEN("a task with a large capture is submitted")
+        {
+            struct Payload
+            {
+                LONG values[32];
+            } payload = {};
+            payload.values[31] = 7;
+
+            LONG result = 0;
+            kf::Latch done(1);
+
+            REQUIRE_NT_SUCCESS(pool.submit([payload, &result, &done] { result = payload.values[31]; done.countDown(); }));
+            REQUIRE_NT_SUCCESS(done.wait());
+
+            THEN("it's executed with its capture")
+            {
+                REQUIRE(result == 7);
+            }
+        }
+
+        WHEN("parallel_for processes a range")
+        {
+            constexpr size_t kSize = 10000;
+
+            auto marks = static_cast<LONG*>(operator new(kSize * sizeof(LONG), NonPagedPoolNx));
+            REQUIRE(marks);
+            SCOPE_EXIT{ operator delete(marks); };
+            RtlZeroMemory(marks, kSize * sizeof(LONG));
+
+            pool.parallel_for(0, kSize, 64, [marks](size_t first, size_t last)
+            {
+                for (size_t i = first; i < last; ++i)
+                {
+                    InterlockedIncrement(&marks[i]);
+                }
+            });
+
+            THEN("every item is processed once")
+            {
+                bool once = true;
+
+                for (size_t i = 0; i < kSize; ++i)
+                {
+                    once = once && marks[i] == 1;
+                }
+
+                REQUIRE(once);
+            }
+        }
+
+        WHEN("parallel_reduce sums a range")
+        {
+            const auto sum = pool.parallel_reduce(size_t(1), size_t(100001), 100, 0ULL,
+                [](size_t first, size_t last)
+                {
+                    unsigned long long sum = 0;
+
+                    for (size_t i = first; i < last; ++i)
+                    {
+                        sum += i;
+                    }
+
+                    return sum;
+                },
+                [](unsigned long long left, unsigned long long right) { return left + right; });
+
+            THEN("the result is the same as a sequential sum")
+            {
+                REQUIRE(sum == 5000050000ULL);
+            }
+        }
+
+        WHEN("parallel_for is nested in a task")
+        {
+            volatile LONG64 total = 0;
+            kf::Latch done(kWorkerCount * 2);
+
+            for (int i = 0; i < kWorkerCount * 2; ++i)
+            {
+                REQUIRE_NT_SUCCESS(pool.submit([&pool, &total, &done]
+                {
+                    pool.parallel_for(0, 1000, 10, [&total](size_t first, size_t last)
+                    {
+                        InterlockedExchangeAdd64(&total, static_cast<LONG64>(last - first));
+                    });
+
+                    done.countDown();
+                }));
+            }
+
+            REQUIRE_NT_SUCCESS(done.wait());
+
+            THEN("workers don't deadlock and all items are processed")
+            {
+                REQUIRE(total == kWorkerCount * 2 * 1000);
+            }
+        }
+
+        WHEN("an empty range is processed")
+        {
+            bool called = false;
+            pool.parallel_for(5, 5, 1, [&called](size_t, size_t) { called = true; });
+
+            THEN("fn is not called")
+            {
+                REQUIRE(!called);
+            }
+        }
+    }
+
+    GIVEN("a pool with the default size and workers pinned to processors")
+    {
+        kf::ThreadPool pool({ .placement = kf::ThreadPlacement::Processor, .priority = LOW_REALTIME_PRIORITY });
+        REQUIRE_NT_SUCCESS(pool.start());
+
+        WHEN("parallel_reduce counts a range")
+        {
+            const auto count = pool.parallel_reduce(size_t(0), size_t(5000), 10, size_t(0),
+                [](size_t first, size_t last) { return last - first; },
+                [](size_t left, size_t right) { return left + right; });
+
+            THEN("there is a worker per active processor and all items are counted")
+            {
+                REQUIRE(pool.count() == static_cast<int>(kf::Numa::processorCount()));
+                REQUIRE(count == 5000);
+            }
+        }
+    }
+
+    GIVEN("a pool with workers placed on NUMA nodes")
+    {
+        kf::ThreadPool pool({ .count = kWorkerCount, .placement = kf::ThreadPlacement::Node });
+        REQUIRE_NT_SUCCESS(pool.start());
+
+        WHEN("a task is submitted")
+        {
+            kf::Latch done(1);
+            REQUIRE_NT_SUCCESS(pool.submit([&done] { done.countDown(); }));
+
+            THEN("it's executed")
+            {
+                REQUIRE_NT_SUCCESS(done.wait());
+            }
+        }
+    }
+
+    GIVEN("a pool that is not started")
+    {
+        kf::ThreadPool pool(kWorkerCount);
+
+        WHEN("a task is submitted")
+        {
+            bool executed = false;
+            const NTSTATUS status = pool.submit([&executed] { executed = true; });
+
+            THEN("it's rejected")
+            {
+                REQUIRE(status == STATUS_INVALID_DEVICE_STATE);
+                REQUIRE(!executed);
+            }
+        }
+
+        WHEN("parallel_reduce sums a range")
+        {
+            const auto sum = pool.parallel_reduce(size_t(1), size_t(1001), 10, 0ULL,
+                [](size_t first, size_t last)
+                {
+                    unsigned long long sum = 0;
+
+                    for (size_t i = first; i < last; ++i)
+                    {
+                        sum += i;
+                    }
+
+                    return sum;
+                },
+                [](unsigned long long left, unsigned long long right) { return left + right; });
+
+            THEN("the calling thread processes the whole range")
+            {
+                REQUIRE(sum == 500500ULL);
+            }
+        }
+    }
+
+    GIVEN("a pool that runs a routine")
+    {
+        volatile LONG started = 0;
+
+        {
+            kf::ThreadPool pool(kWorkerCount);
+            REQUIRE_NT_SUCCESS(pool.start([](PVOID context) { InterlockedIncrement(static_cast<volatile LONG*>(context)); PsTerminateSystemThread(STATUS_SUCCESS); }, const_cast<LONG*>(&started)));
+        }
+
+        THEN("the routine runs on every thread")
+        {
+            REQUIRE(started == kWorkerCount);
+        }
+    }
+}
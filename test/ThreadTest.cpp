@@ -1,5 +1,6 @@
 #include "pch.h"
 #include <kf/Thread.h>
+#include <kf/Numa.h>
 
 namespace
 {
@@ -14,6 +15,22 @@ namespace
         PsTerminateSystemThread(STATUS_SUCCESS);
     }
 
+    struct PlacementContext
+    {
+        PROCESSOR_NUMBER processor = {};
+        KPRIORITY priority = 0;
+    };
+
+    // Records where the routine starts before it does anything else
+    void placementProc(void* context)
+    {
+        auto placement = static_cast<PlacementContext*>(context);
+        KeGetCurrentProcessorNumberEx(&placement->processor);
+        placement->priority = KeQueryPriorityThread(KeGetCurrentThread());
+
+        PsTerminateSystemThread(STATUS_SUCCESS);
+    }
+
     struct TestObject
     {
         ThreadContext m_threadContext;
@@ -131,6 +148,27 @@ SCENARIO("kf::Thread basic lifecycle")
             }
         }
 
+        WHEN("start() is used with affinity and priority")
+        {
+            PlacementContext context;
+
+            kf::ThreadOptions options;
+            options.affinity = kf::Numa::processorAffinity(0);
+            options.priority = LOW_REALTIME_PRIORITY;
+
+            REQUIRE(options.affinity);
+            REQUIRE_NT_SUCCESS(thread.start(&placementProc, &context, options));
+
+            thread.join();
+
+            THEN("the routine runs with them from the start")
+            {
+                REQUIRE(context.processor.Group == options.affinity->Group);
+                REQUIRE(options.affinity->Mask & AFFINITY_MASK(context.processor.Number));
+                REQUIRE(context.priority == LOW_REALTIME_PRIORITY);
+            }
+        }
+
         WHEN("starting a thread with a long working function")
         {
             ThreadContext context;
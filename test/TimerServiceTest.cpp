@@ -0,0 +1,224 @@
+#include "pch.h"
+#include <kf/TimerService.h>
+#include <kf/Latch.h>
+#include <kf/stl/new>
+#include <memory>
+
+namespace
+{
+    constexpr LONGLONG kResolution = 10'000; // 1ms
+    constexpr LONGLONG kMillisecond = 10'000;
+
+    struct TimerContext
+    {
+        volatile LONG fired = 0;
+        LONGLONG firedTime = 0;
+        kf::Latch* done = nullptr;
+    };
+
+    void onTimer(PVOID rawContext)
+    {
+        auto context = static_cast<TimerContext*>(rawContext);
+        context->firedTime = static_cast<LONGLONG>(KeQueryInterruptTime());
+
+        if (InterlockedIncrement(&context->fired) == 1 && context->done)
+        {
+            context->done->countDown();
+        }
+    }
+
+    struct CancelingContext
+    {
+        kf::TimerService* service = nullptr;
+        kf::Timer* other = nullptr;
+        volatile LONG fired = 0;
+        bool canceled = false;
+    };
+
+    // Cancels the other timer of the pair, after that its callback must not run
+    void onCancelingTimer(PVOID rawContext)
+    {
+        auto context = static_cast<CancelingContext*>(rawContext);
+        InterlockedIncrement(&context->fired);
+        context->canceled = context->service->cancel(*context->other);
+    }
+
+    void sleep(LONGLONG time)
+    {
+        LARGE_INTEGER interval{ .QuadPart = -time };
+        KeDelayExecutionThread(KernelMode, false, &interval);
+    }
+}
+
+SCENARIO("kf::TimerService")
+{
+    GIVEN("a started service")
+    {
+        kf::TimerService service(kResolution);
+        REQUIRE_NT_SUCCESS(service.start());
+
+        WHEN("a one-shot timer is scheduled")
+        {
+            kf::Latch done(1);
+            TimerContext context{ .done = &done };
+            kf::Timer timer(&onTimer, &context);
+
+            const auto scheduledTime = static_cast<LONGLONG>(KeQueryInterruptTime());
+            service.schedule(timer, 20 * kMillisecond);
+            REQUIRE_NT_SUCCESS(done.wait());
+
+            // Waits for the callback to return
+            service.cancel(timer);
+
+            THEN("it fires once not earlier than its due time")
+            {
+                sleep(30 * kMillisecond);
+
+                REQUIRE(context.fired == 1);
+                REQUIRE(context.firedTime - scheduledTime >= 20 * kMillisecond);
+                REQUIRE(!timer.isScheduled());
+            }
+        }
+
+        WHEN("a timer beyond the first level is scheduled")
+        {
+            kf::Latch done(1);
+            TimerContext context{ .done = &done };
+            kf::Timer timer(&onTimer, &context);
+
+            const auto scheduledTime = static_cast<LONGLONG>(KeQueryInterruptTime());
+            service.schedule(timer, 150 * kMillisecond);
+            REQUIRE_NT_SUCCESS(done.wait());
+            service.cancel(timer);
+
+            THEN("it's moved down and fires in time")
+            {
+                REQUIRE(context.firedTime - scheduledTime >= 150 * kMillisecond);
+            }
+        }
+
+        WHEN("a periodic timer runs for several periods")
+        {
+            TimerContext context;
+            kf::Timer timer(&onTimer, &context);
+
+            service.schedule(timer, 10 * kMillisecond, 10 * kMillisecond);
+            sleep(105 * kMillisecond);
+
+            const bool wasScheduled = service.cancel(timer);
+            const LONG fired = context.fired;
+
+            THEN("it fires every period until it's canceled")
+            {
+                REQUIRE(wasScheduled);
+                REQUIRE(fired >= 5);
+                REQUIRE(fired <= 11);
+
+                sleep(30 * kMillisecond);
+                REQUIRE(context.fired == fired);
+            }
+        }
+
+        WHEN("a pending timer is canceled")
+        {
+            TimerContext context;
+            kf::Timer timer(&onTimer, &context);
+
+            service.schedule(timer, 50 * kMillisecond);
+            REQUIRE(service.pendingCount() == 1);
+            REQUIRE(service.cancel(timer));
+
+            THEN("it doesn't fire")
+            {
+                sleep(80 * kMillisecond);
+
+                REQUIRE(context.fired == 0);
+                REQUIRE(service.pendingCount() == 0);
+                REQUIRE(!service.cancel(timer));
+            }
+        }
+
+        WHEN("a callback cancels a timer that expires in the same batch")
+        {
+            CancelingContext first{ .service = &service };
+            CancelingContext second{ .service = &service };
+            kf::Timer firstTimer(&onCancelingTimer, &first);
+            kf::Timer secondTimer(&onCancelingTimer, &second);
+            first.other = &secondTimer;
+            second.other = &firstTimer;
+
+            // The tolerance coalesces both timers into one tick
+            service.schedule(firstTimer, 20 * kMillisecond, 0, 40 * kMillisecond);
+            service.schedule(secondTimer, 20 * kMillisecond, 0, 40 * kMillisecond);
+            sleep(100 * kMillisecond);
+
+            service.cancel(firstTimer);
+            service.cancel(secondTimer);
+
+            THEN("the callback that runs first cancels the other one")
+            {
+                REQUIRE(first.fired + second.fired == 1);
+                REQUIRE(first.canceled != second.canceled);
+            }
+        }
+
+        WHEN("timers with overlapping tolerance windows are scheduled")
+        {
+            kf::Latch done(2);
+            TimerContext first{ .done = &done };
+            TimerContext second{ .done = &done };
+            kf::Timer firstTimer(&onTimer, &first);
+            kf::Timer secondTimer(&onTimer, &second);
+
+            service.schedule(firstTimer, 30 * kMillisecond, 0, 40 * kMillisecond);
+            service.schedule(secondTimer, 40 * kMillisecond, 0, 40 * kMillisecond);
+            REQUIRE_NT_SUCCESS(done.wait());
+            service.cancel(firstTimer);
+            service.cancel(secondTimer);
+
+            THEN("they are coalesced and fire together")
+            {
+                const auto difference = first.firedTime - second.firedTime;
+                REQUIRE(difference < 5 * kMillisecond);
+                REQUIRE(difference > -5 * kMillisecond);
+            }
+        }
+
+        WHEN("many timers are scheduled")
+        {
+            constexpr int kTimerCount = 1000;
+
+            auto contexts = static_cast<TimerContext*>(operator new(sizeof(TimerContext) * kTimerCount, NonPagedPoolNx));
+            auto timers = static_cast<kf::Timer*>(operator new(sizeof(kf::Timer) * kTimerCount, NonPagedPoolNx));
+            REQUIRE(contexts);
+            REQUIRE(timers);
+
+            kf::Latch done(kTimerCount);
+
+            for (int i = 0; i < kTimerCount; ++i)
+            {
+                new(&contexts[i]) TimerContext{ .done = &done };
+                new(&timers[i]) kf::Timer(&onTimer, &contexts[i]);
+                service.schedule(timers[i], (i % 100) * kMillisecond);
+            }
+
+            REQUIRE_NT_SUCCESS(done.wait());
+
+            const ULONG pendingCount = service.pendingCount();
+
+            for (int i = 0; i < kTimerCount; ++i)
+            {
+                service.cancel(timers[i]);
+                std::destroy_at(&timers[i]);
+            }
+
+            operator delete(timers);
+            operator delete(contexts);
+
+            THEN("all of them fire")
+            {
+                REQUIRE(pendingCount == 0);
+            }
+        }
+    }
+}
@@ -531,4 +531,395 @@ SCENARIO("TreeMap: lifecycle check")
             }
         }
     }
-}
\ No newline at end of file
+}
+namespace
+{
+    constexpr std::array kSparseKeys = { 30, 10, 50, 20, 40 };
+}
+
+SCENARIO("TreeMap: navigation and range queries")
+{
+    IntTreeMap map;
+
+    GIVEN("empty map")
+    {
+        THEN("there are no entries to navigate")
+        {
+            REQUIRE(!map.firstEntry());
+            REQUIRE(!map.lastEntry());
+            REQUIRE(!map.ceilingEntry(10));
+            REQUIRE(!map.floorEntry(10));
+            REQUIRE(!map.higherEntry(10));
+            REQUIRE(!map.lowerEntry(10));
+            REQUIRE(!map.iterator().hasNext());
+            REQUIRE(!map.descendingIterator().hasNext());
+        }
+    }
+
+    GIVEN("map with sparse keys")
+    {
+        for (int key : kSparseKeys)
+        {
+            REQUIRE_NT_SUCCESS(map.put(key, keyToValue(key)));
+        }
+
+        THEN("first and last entries are valid")
+        {
+            REQUIRE(map.firstEntry()->key() == 10);
+            REQUIRE(map.lastEntry()->key() == 50);
+            REQUIRE(map.lastEntry()->value() == keyToValue(50));
+        }
+
+        THEN("bounds of an existing key are valid")
+        {
+            REQUIRE(map.ceilingEntry(30)->key() == 30);
+            REQUIRE(map.floorEntry(30)->key() == 30);
+            REQUIRE(map.higherEntry(30)->key() == 40);
+            REQUIRE(map.lowerEntry(30)->key() == 20);
+        }
+
+        THEN("bounds of a non-existing key are valid")
+        {
+            REQUIRE(map.ceilingEntry(25)->key() == 30);
+            REQUIRE(map.floorEntry(25)->key() == 20);
+            REQUIRE(map.higherEntry(25)->key() == 30);
+            REQUIRE(map.lowerEntry(25)->key() == 20);
+        }
+
+        THEN("bounds outside of the key range are valid")
+        {
+            REQUIRE(map.ceilingEntry(5)->key() == 10);
+            REQUIRE(!map.floorEntry(5));
+            REQUIRE(!map.lowerEntry(10));
+            REQUIRE(!map.ceilingEntry(55));
+            REQUIRE(map.floorEntry(55)->key() == 50);
+            REQUIRE(!map.higherEntry(50));
+        }
+
+        WHEN("map is iterated")
+        {
+            int count = 0;
+            int prevKey = 0;
+
+            for (auto it = map.iterator(); it.hasNext(); ++count)
+            {
+                auto& entry = it.next();
+                REQUIRE(entry.key() > prevKey);
+                REQUIRE(entry.value() == keyToValue(entry.key()));
+                prevKey = entry.key();
+            }
+
+            THEN("all entries are visited in ascending order")
+            {
+                REQUIRE(count == static_cast<int>(kSparseKeys.size()));
+            }
+        }
+
+        WHEN("map is iterated from a key")
+        {
+            auto it = map.iterator(25);
+
+            THEN("iteration starts from the ceiling entry")
+            {
+                REQUIRE(it.next().key() == 30);
+                REQUIRE(it.next().key() == 40);
+                REQUIRE(it.next().key() == 50);
+                REQUIRE(!it.hasNext());
+            }
+        }
+
+        WHEN("map is iterated in descending order from a key")
+        {
+            auto it = map.descendingIterator(35);
+
+            THEN("iteration starts from the floor entry")
+            {
+                REQUIRE(it.next().key() == 30);
+                REQUIRE(it.next().key() == 20);
+                REQUIRE(it.next().key() == 10);
+                REQUIRE(!it.hasNext());
+            }
+        }
+
+        WHEN("entries are removed during iteration")
+        {
+            for (auto it = map.iterator(); it.hasNext();)
+            {
+                REQUIRE(map.remove(it.next().key()));
+            }
+
+            THEN("map is empty")
+            {
+                REQUIRE(map.isEmpty());
+            }
+        }
+
+        WHEN("forEachInRange is called")
+        {
+            std::array<int, 5> keys{};
+            int count = 0;
+
+            map.forEachInRange(15, 40, [&](const int& key, int& value)
+                {
+                    keys[count++] = key;
+                    value = 0;
+                });
+
+            THEN("only keys in [from, to) are visited")
+            {
+                REQUIRE(count == 2);
+                REQUIRE(keys[0] == 20);
+                REQUIRE(keys[1] == 30);
+                REQUIRE(*map.get(20) == 0);
+                REQUIRE(*map.get(40) == keyToValue(40));
+            }
+        }
+
+        WHEN("forEachInRange callback returns false")
+        {
+            int count = 0;
+
+            map.forEachInRange(0, 100, [&](const int&, int&)
+                {
+                    return ++count < 2;
+                });
+
+            THEN("enumeration stops")
+            {
+                REQUIRE(count == 2);
+            }
+        }
+    }
+}
+
+namespace
+{
+    struct FileKey
+    {
+        int volumeId;
+        int fileId;
+    };
+
+    struct FileKeyLess
+    {
+        using is_transparent = void;
+
+        bool operator()(const FileKey& left, const FileKey& right) const
+        {
+            return left.volumeId < right.volumeId || (left.volumeId == right.volumeId && left.fileId < right.fileId);
+        }
+
+        bool operator()(int left, const FileKey& right) const
+        {
+            return left < right.volumeId;
+        }
+
+        bool operator()(const FileKey& left, int right) const
+        {
+            return left.volumeId < right;
+        }
+    };
+}
+
+SCENARIO("TreeMap: heterogeneous lookup")
+{
+    GIVEN("map with a transparent comparer")
+    {
+        kf::TreeMap<FileKey, int, PagedPool, FileKeyLess> map;
+
+        REQUIRE_NT_SUCCESS(map.put(FileKey{ 1, 10 }, 110));
+        REQUIRE_NT_SUCCESS(map.put(FileKey{ 2, 20 }, 220));
+        REQUIRE_NT_SUCCESS(map.put(FileKey{ 2, 10 }, 210));
+        REQUIRE_NT_SUCCESS(map.put(FileKey{ 3, 10 }, 310));
+
+        THEN("entries can be navigated by a key of another type")
+        {
+            REQUIRE(map.ceilingEntry(2)->value() == 210);
+            REQUIRE(map.lowerEntry(2)->value() == 110);
+            REQUIRE(map.floorEntry(2)->value() == 220);
+            REQUIRE(map.higherEntry(2)->value() == 310);
+            REQUIRE(!map.ceilingEntry(4));
+        }
+
+        THEN("range of a volume can be enumerated without constructing a key")
+        {
+            int count = 0;
+
+            map.forEachInRange(2, 3, [&](const FileKey& key, int&)
+                {
+                    REQUIRE(key.volumeId == 2);
+                    ++count;
+                });
+
+            REQUIRE(count == 2);
+        }
+
+        THEN("iteration can start from a key of another type")
+        {
+            auto it = map.iterator(2);
+            REQUIRE(it.next().value() == 210);
+            REQUIRE(it.next().value() == 220);
+        }
+    }
+}
+
+namespace
+{
+    // Value that can be constructed only in place
+    struct Point
+    {
+        Point(int x, int y) : x(x), y(y)
+        {
+        }
+
+        Point(const Point&) = delete;
+        Point& operator=(const Point&) = delete;
+
+        int x;
+        int y;
+    };
+
+    // Value that is poisoned when destroyed, so reading a destroyed one is noticed
+    struct Poisoned
+    {
+        explicit Poisoned(int value) : value(value)
+        {
+        }
+
+        Poisoned(const Poisoned&) = default;
+        Poisoned& operator=(const Poisoned&) = default;
+
+        ~Poisoned()
+        {
+            // Volatile, so the store is not dropped as dead
+            *static_cast<volatile int*>(&value) = -1;
+        }
+
+        int value;
+    };
+}
+
+SCENARIO("TreeMap: in-place insertion")
+{
+    GIVEN("empty map")
+    {
+        IntTreeMap map;
+
+        WHEN("tryEmplace is called for new keys")
+        {
+            for (int key : kKeys)
+            {
+                auto value = map.tryEmplace(key, keyToValue(key));
+                REQUIRE(value);
+                REQUIRE(*value == keyToValue(key));
+            }
+
+            THEN("all values are inserted")
+            {
+                REQUIRE(map.size() == static_cast<int>(kKeys.size()));
+
+                for (int key : kKeys)
+                {
+                    REQUIRE(*map.get(key) == keyToValue(key));
+                }
+            }
+
+            THEN("tryEmplace for an existing key returns the existing value")
+            {
+                auto value = map.tryEmplace(kKeys[0], 0);
+                REQUIRE(value == map.get(kKeys[0]));
+                REQUIRE(*value == keyToValue(kKeys[0]));
+                REQUIRE(map.size() == static_cast<int>(kKeys.size()));
+            }
+
+            THEN("emplace for an existing key replaces the value")
+            {
+                auto value = map.emplace(kKeys[0], 0);
+                REQUIRE(value == map.get(kKeys[0]));
+                REQUIRE(*value == 0);
+                REQUIRE(map.size() == static_cast<int>(kKeys.size()));
+            }
+
+            THEN("insertOrAssign for an existing key assigns the value")
+            {
+                auto value = map.insertOrAssign(kKeys[0], 0);
+                REQUIRE(value == map.get(kKeys[0]));
+                REQUIRE(*value == 0);
+                REQUIRE(map.size() == static_cast<int>(kKeys.size()));
+            }
+        }
+
+        WHEN("insertOrAssign is called for a new key")
+        {
+            auto value = map.insertOrAssign(1, 10);
+
+            THEN("the value is inserted")
+            {
+                REQUIRE(value);
+                REQUIRE(*map.get(1) == 10);
+            }
+        }
+    }
+
+    GIVEN("map with a value that can't be copied")
+    {
+        kf::TreeMap<int, Point, PagedPool> map;
+
+        WHEN("values are emplaced")
+        {
+            REQUIRE(map.tryEmplace(1, 10, 20));
+            REQUIRE(map.emplace(2, 30, 40));
+            REQUIRE(map.emplace(1, 50, 60));
+
+            THEN("values are constructed in place")
+            {
+                REQUIRE(map.size() == 2);
+                REQUIRE(map.get(1)->x == 50);
+                REQUIRE(map.get(1)->y == 60);
+                REQUIRE(map.get(2)->x == 30);
+                REQUIRE(map.get(2)->y == 40);
+            }
+        }
+    }
+
+    GIVEN("map with a value that is poisoned when destroyed")
+    {
+        kf::TreeMap<int, Poisoned, PagedPool> map;
+        REQUIRE(map.emplace(1, 10));
+
+        WHEN("emplace and put replace a value with a copy of itself")
+        {
+            auto emplaced = map.emplace(1, *map.get(1));
+            const int emplacedValue = emplaced->value;
+
+            REQUIRE_NT_SUCCESS(map.put(1, std::move(*map.get(1))));
+
+            THEN("the copy is made before the old value is released")
+            {
+                REQUIRE(emplaced == map.get(1));
+                REQUIRE(emplacedValue == 10);
+                REQUIRE(map.get(1)->value == 10);
+            }
+        }
+    }
+
+    GIVEN("map with LifecycleCounter values")
+    {
+        LifecycleCounter::resetCounters();
+
+        {
+            LifecycleCounterTreeMap map;
+
+            REQUIRE(map.tryEmplace(1));
+            REQUIRE(map.emplace(1));
+            REQUIRE(map.tryEmplace(1));
+            REQUIRE(map.insertOrAssign(2, LifecycleCounter{}));
+            REQUIRE(map.insertOrAssign(2, LifecycleCounter{}));
+        }
+
+        THEN("all objects are destructed")
+        {
+            REQUIRE(LifecycleCounter::areAllObjectsDestructed());
+        }
+    }
+}
@@ -468,3 +468,95 @@ SCENARIO("TreeSet: lifecycle check")
         }
     }
 }
+
+SCENARIO("TreeSet: navigation and range queries")
+{
+    IntTreeSet set;
+
+    GIVEN("empty set")
+    {
+        THEN("there are no elements to navigate")
+        {
+            REQUIRE(!set.first());
+            REQUIRE(!set.last());
+            REQUIRE(!set.ceiling(1));
+            REQUIRE(!set.floor(1));
+            REQUIRE(!set.higher(1));
+            REQUIRE(!set.lower(1));
+            REQUIRE(!set.descendingIterator().hasNext());
+        }
+    }
+
+    GIVEN("set with sparse elements")
+    {
+        for (int element : { 30, 10, 50, 20, 40 })
+        {
+            REQUIRE_NT_SUCCESS(set.add(element));
+        }
+
+        THEN("first and last elements are valid")
+        {
+            REQUIRE(*set.first() == 10);
+            REQUIRE(*set.last() == 50);
+        }
+
+        THEN("bounds are valid")
+        {
+            REQUIRE(*set.ceiling(30) == 30);
+            REQUIRE(*set.floor(30) == 30);
+            REQUIRE(*set.higher(30) == 40);
+            REQUIRE(*set.lower(30) == 20);
+
+            REQUIRE(*set.ceiling(25) == 30);
+            REQUIRE(*set.floor(25) == 20);
+
+            REQUIRE(!set.floor(5));
+            REQUIRE(!set.higher(50));
+        }
+
+        WHEN("set is iterated in descending order")
+        {
+            int count = 0;
+            int prevElement = 100;
+
+            for (auto it = set.descendingIterator(); it.hasNext(); ++count)
+            {
+                int element = it.next();
+                REQUIRE(element < prevElement);
+                prevElement = element;
+            }
+
+            THEN("all elements are visited")
+            {
+                REQUIRE(count == 5);
+            }
+        }
+
+        WHEN("set is iterated from an element")
+        {
+            auto it = set.iterator(40);
+            auto descendingIt = set.descendingIterator(15);
+
+            THEN("iteration starts from the bound element")
+            {
+                REQUIRE(it.next() == 40);
+                REQUIRE(it.next() == 50);
+                REQUIRE(!it.hasNext());
+
+                REQUIRE(descendingIt.next() == 10);
+                REQUIRE(!descendingIt.hasNext());
+            }
+        }
+
+        WHEN("forEachInRange is called")
+        {
+            int sum = 0;
+            set.forEachInRange(20, 50, [&](int& element) { sum += element; });
+
+            THEN("only elements in [from, to) are visited")
+            {
+                REQUIRE(sum == 20 + 30 + 40);
+            }
+        }
+    }
+}
@@ -874,4 +874,346 @@ SCENARIO("vector comprehensive iterator testing")
             }
         }
     }
-}
\ No newline at end of file
+}
+namespace
+{
+    // Counts moves, so the number of element relocations can be checked
+    struct MoveCounter
+    {
+        MoveCounter(int value) : value(value)
+        {
+        }
+
+        MoveCounter(const MoveCounter& other) : value(other.value)
+        {
+        }
+
+        MoveCounter(MoveCounter&& other) noexcept : value(other.value)
+        {
+            ++s_moveCount;
+        }
+
+        MoveCounter& operator=(MoveCounter&& other) noexcept
+        {
+            value = other.value;
+            ++s_moveCount;
+            return *this;
+        }
+
+        int value;
+
+        static inline int s_moveCount = 0;
+    };
+
+    struct RelocatableMoveCounter : MoveCounter
+    {
+        using MoveCounter::MoveCounter;
+    };
+
+    // Allocator that always grows a buffer in place inside of a preallocated arena
+    template<class T>
+    class ExpandingAllocator
+    {
+    public:
+        using value_type = T;
+
+        T* allocate(size_t) noexcept
+        {
+            return s_buffer;
+        }
+
+        void deallocate(T*, size_t) noexcept
+        {
+        }
+
+        bool try_expand_in_place(T* p, size_t, size_t newCount) noexcept
+        {
+            return p == s_buffer && newCount <= std::size(s_buffer);
+        }
+
+        static inline T s_buffer[64];
+    };
+
+    // Allocator from the pool that fails while s_failing is set
+    template<class T>
+    class FailingAllocator : public kf::Allocator<T, PagedPool>
+    {
+    public:
+        T* allocate(size_t n) noexcept
+        {
+            return s_failing ? nullptr : kf::Allocator<T, PagedPool>::allocate(n);
+        }
+
+        static inline bool s_failing = false;
+    };
+}
+
+template<>
+struct kf::is_trivially_relocatable<RelocatableMoveCounter> : std::true_type
+{
+};
+
+SCENARIO("vector growth")
+{
+    GIVEN("vector with elements that are not relocatable")
+    {
+        kf::vector<MoveCounter, PagedPool> v;
+        REQUIRE_NT_SUCCESS(v.reserve(4));
+
+        for (int i = 0; i < 4; ++i)
+        {
+            REQUIRE(v.emplace_back(i));
+        }
+
+        MoveCounter::s_moveCount = 0;
+
+        WHEN("an element is inserted in the middle and the vector grows")
+        {
+            REQUIRE(v.emplace(v.begin() + 2, 100));
+
+            THEN("every element is moved once")
+            {
+                REQUIRE(MoveCounter::s_moveCount == 5);
+                REQUIRE(v.size() == 5);
+                REQUIRE(v[0].value == 0);
+                REQUIRE(v[1].value == 1);
+                REQUIRE(v[2].value == 100);
+                REQUIRE(v[3].value == 2);
+                REQUIRE(v[4].value == 3);
+            }
+        }
+
+        WHEN("an element of the vector is appended and the vector grows")
+        {
+            REQUIRE_NT_SUCCESS(v.push_back(v[1]));
+
+            THEN("the element is copied before it is relocated")
+            {
+                REQUIRE(v.size() == 5);
+                REQUIRE(v[4].value == 1);
+            }
+        }
+
+        WHEN("an element of the vector is inserted in the middle")
+        {
+            REQUIRE_NT_SUCCESS(v.reserve(10));
+            REQUIRE(v.insert(v.begin(), v[3]));
+
+            THEN("the element is copied before it is shifted")
+            {
+                REQUIRE(v.size() == 5);
+                REQUIRE(v[0].value == 3);
+                REQUIRE(v[4].value == 3);
+            }
+        }
+    }
+
+    GIVEN("vector with relocatable elements")
+    {
+        kf::vector<RelocatableMoveCounter, PagedPool> v;
+
+        for (int i = 0; i < 4; ++i)
+        {
+            REQUIRE(v.emplace_back(i));
+        }
+
+        MoveCounter::s_moveCount = 0;
+
+        WHEN("the vector grows")
+        {
+            REQUIRE_NT_SUCCESS(v.reserve(100));
+            REQUIRE(v.insert(v.begin() + 1, 3, RelocatableMoveCounter(7)));
+
+            THEN("elements are relocated without moves")
+            {
+                REQUIRE(MoveCounter::s_moveCount == 0);
+                REQUIRE(v.size() == 7);
+                REQUIRE(v[0].value == 0);
+                REQUIRE(v[1].value == 7);
+                REQUIRE(v[3].value == 7);
+                REQUIRE(v[4].value == 1);
+                REQUIRE(v[6].value == 3);
+            }
+        }
+    }
+
+    GIVEN("vector with an allocator that grows in place")
+    {
+        kf::vector<int, PagedPool, ExpandingAllocator<int>> v;
+        REQUIRE_NT_SUCCESS(v.push_back(1));
+
+        const int* data = v.data();
+
+        WHEN("the vector grows")
+        {
+            for (int i = 2; i <= 10; ++i)
+            {
+                REQUIRE(v.insert(v.begin(), i));
+            }
+
+            THEN("the buffer is not reallocated")
+            {
+                REQUIRE(v.data() == data);
+                REQUIRE(v.size() == 10);
+                REQUIRE(v[0] == 10);
+                REQUIRE(v[9] == 1);
+            }
+        }
+    }
+}
+
+SCENARIO("vector bulk operations")
+{
+    GIVEN("vector of bytes")
+    {
+        kf::vector<std::byte, PagedPool> v;
+        REQUIRE_NT_SUCCESS(v.assign(4, std::byte{ 1 }));
+
+        WHEN("resize_uninitialized is called")
+        {
+            REQUIRE_NT_SUCCESS(v.resize_uninitialized(100));
+
+            THEN("size is changed and old elements are preserved")
+            {
+                REQUIRE(v.size() == 100);
+                REQUIRE(v[3] == std::byte{ 1 });
+            }
+        }
+
+        WHEN("resize_default_init shrinks the vector")
+        {
+            REQUIRE_NT_SUCCESS(v.resize_default_init(2));
+
+            THEN("size is changed")
+            {
+                REQUIRE(v.size() == 2);
+            }
+        }
+
+        WHEN("reserve_additional is called")
+        {
+            REQUIRE_NT_SUCCESS(v.reserve_additional(10));
+
+            THEN("there is room for new elements")
+            {
+                REQUIRE(v.size() == 4);
+                REQUIRE(v.capacity() >= 14);
+            }
+        }
+
+        WHEN("reserve_additional overflows")
+        {
+            THEN("it fails")
+            {
+                REQUIRE(!NT_SUCCESS(v.reserve_additional(v.max_size())));
+            }
+        }
+
+        WHEN("chunks are read into a buffer and appended")
+        {
+            constexpr size_t kChunkSize = 64 * 1024;
+            constexpr int kChunkCount = 8;
+
+            kf::vector<std::byte, PagedPool> chunk;
+
+            for (int i = 0; i < kChunkCount; ++i)
+            {
+                REQUIRE_NT_SUCCESS(chunk.resize_uninitialized(kChunkSize));
+                memset(chunk.data(), i, kChunkSize); // emulates ZwReadFile
+
+                REQUIRE_NT_SUCCESS(v.reserve_additional(chunk.size()));
+                REQUIRE_NT_SUCCESS(v.append(chunk));
+            }
+
+            THEN("all chunks are in the vector")
+            {
+                REQUIRE(v.size() == 4 + kChunkSize * kChunkCount);
+                REQUIRE(v[4] == std::byte{ 0 });
+                REQUIRE(v[4 + kChunkSize] == std::byte{ 1 });
+                REQUIRE(v.back() == std::byte{ kChunkCount - 1 });
+            }
+        }
+    }
+
+    GIVEN("vector of ints")
+    {
+        kf::vector<int, PagedPool> v;
+        REQUIRE_NT_SUCCESS(v.assign({ 1, 2, 3 }));
+
+        WHEN("its own elements are appended")
+        {
+            REQUIRE_NT_SUCCESS(v.shrink_to_fit());
+            REQUIRE_NT_SUCCESS(v.append(v));
+
+            THEN("the elements are copied before the buffer is reallocated")
+            {
+                REQUIRE(v.size() == 6);
+                REQUIRE(v[3] == 1);
+                REQUIRE(v[5] == 3);
+            }
+        }
+
+        WHEN("an array is appended")
+        {
+            const int kArr[] = { 4, 5 };
+            REQUIRE_NT_SUCCESS(v.append(kArr));
+
+            THEN("the elements are added to the end")
+            {
+                REQUIRE(v.size() == 5);
+                REQUIRE(v[3] == 4);
+                REQUIRE(v[4] == 5);
+            }
+        }
+
+        WHEN("an empty span is appended")
+        {
+            REQUIRE_NT_SUCCESS(v.append({}));
+
+            THEN("nothing is changed")
+            {
+                REQUIRE(v.size() == 3);
+            }
+        }
+    }
+
+    GIVEN("vector with an allocator that fails")
+    {
+        kf::vector<int, PagedPool, FailingAllocator<int>> v;
+        REQUIRE_NT_SUCCESS(v.assign({ 1, 2, 3 }));
+
+        FailingAllocator<int>::s_failing = true;
+
+        WHEN("more elements than the capacity are assigned")
+        {
+            const int kArr[16] = {};
+
+            const NTSTATUS fillStatus = v.assign(100, 7);
+            const NTSTATUS rangeStatus = v.assign(std::begin(kArr), std::end(kArr));
+
+            THEN("assignment fails and the old elements are kept")
+            {
+                REQUIRE(fillStatus == STATUS_INSUFFICIENT_RESOURCES);
+                REQUIRE(rangeStatus == STATUS_INSUFFICIENT_RESOURCES);
+                REQUIRE(v.size() == 3);
+                REQUIRE(v[0] == 1);
+                REQUIRE(v[1] == 2);
+                REQUIRE(v[2] == 3);
+            }
+        }
+
+        WHEN("elements that fit the capacity are assigned")
+        {
+            REQUIRE_NT_SUCCESS(v.assign(2, 7));
+
+            THEN("they are assigned in place")
+            {
+                REQUIRE(v.size() == 2);
+                REQUIRE(v[0] == 7);
+                REQUIRE(v[1] == 7);
+            }
+        }
+
+        FailingAllocator<int>::s_failing = false;
+    }
+}
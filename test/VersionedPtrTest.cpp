@@ -0,0 +1,200 @@
+#include "pch.h"
+#include <kf/VersionedPtr.h>
+#include "StressUtils.h"
+
+namespace
+{
+    constexpr int kIterationCount = 2000;
+    constexpr int kStoreCount = 200;
+
+    volatile LONG g_liveSnapshots = 0;
+
+    struct Snapshot
+    {
+        explicit Snapshot(LONG64 generation) : generation(generation), doubled(generation * 2)
+        {
+            InterlockedIncrement(&g_liveSnapshots);
+        }
+
+        ~Snapshot()
+        {
+            // Poisoned, so a reader of a released snapshot sees a torn one
+            doubled = -1;
+            InterlockedDecrement(&g_liveSnapshots);
+        }
+
+        LONG64 generation;
+        LONG64 doubled;
+    };
+
+    using SnapshotPtr = kf::VersionedPtr<Snapshot>;
+
+    struct StressContext
+    {
+        SnapshotPtr* snapshot;
+        volatile LONG threadIndex;
+        volatile LONG64 reads;
+        volatile LONG tornReads;
+        volatile LONG staleReads;
+        volatile LONG failedStores;
+    };
+
+    // The first thread stores new snapshots, the others pin the current one and check it's alive
+    // and never older than the one seen before
+    void stressRoutine(PVOID rawContext)
+    {
+        auto context = static_cast<StressContext*>(rawContext);
+        const bool writer = InterlockedIncrement(&context->threadIndex) == 1;
+
+        if (writer)
+        {
+            for (int i = 1; i <= kStoreCount; ++i)
+            {
+                auto snapshot = kf::make_ref<Snapshot, NonPagedPoolNx>(i);
+                if (!snapshot)
+                {
+                    InterlockedIncrement(&context->failedStores);
+                    break;
+                }
+
+                context->snapshot->store(std::move(snapshot));
+            }
+        }
+        else
+        {
+            LONG64 lastGeneration = 0;
+
+            for (int i = 0; i < kIterationCount; ++i)
+            {
+                auto pin = context->snapshot->pin();
+
+                if (pin->doubled != pin->generation * 2)
+                {
+                    InterlockedIncrement(&context->tornReads);
+                }
+
+                if (pin->generation < lastGeneration || static_cast<LONG64>(pin.version()) != pin->generation)
+                {
+                    InterlockedIncrement(&context->staleReads);
+                }
+
+                lastGeneration = pin->generation;
+            }
+
+            InterlockedAdd64(&context->reads, kIterationCount);
+        }
+
+        PsTerminateSystemThread(STATUS_SUCCESS);
+    }
+}
+
+SCENARIO("kf::VersionedPtr")
+{
+    GIVEN("an empty versioned pointer that isn't initialized")
+    {
+        // Readers share one counter until initialize()
+        SnapshotPtr snapshot;
+
+        WHEN("it's pinned")
+        {
+            auto pin = snapshot.pin();
+
+            THEN("the pin is empty and has version 0")
+            {
+                REQUIRE(!pin);
+                REQUIRE(pin.get() == nullptr);
+                REQUIRE(pin.version() == 0);
+                REQUIRE(!pin.share());
+            }
+        }
+    }
+
+    GIVEN("a versioned pointer with a snapshot")
+    {
+        auto initial = kf::make_ref<Snapshot, NonPagedPoolNx>(1);
+        REQUIRE(initial);
+
+        SnapshotPtr snapshot(initial);
+        REQUIRE_NT_SUCCESS(snapshot.initialize());
+        initial.reset();
+
+        WHEN("it's pinned at DISPATCH_LEVEL")
+        {
+            KIRQL oldIrql;
+            KeRaiseIrql(DISPATCH_LEVEL, &oldIrql);
+
+            LONG64 generation = 0;
+            LONG useCount = 0;
+
+            {
+                auto pin = snapshot.pin();
+                generation = pin->generation;
+                useCount = pin.share().use_count();
+            }
+
+            KeLowerIrql(oldIrql);
+
+            THEN("the snapshot is read without taking a reference")
+            {
+                REQUIRE(generation == 1);
+                REQUIRE(useCount == 2); // the holder's and the shared one
+            }
+        }
+
+        WHEN("a new snapshot is stored while a reference to the old one is kept")
+        {
+            auto old = snapshot.load();
+            snapshot.store(kf::make_ref<Snapshot, NonPagedPoolNx>(2));
+
+            auto pin = snapshot.pin();
+
+            THEN("readers see the new snapshot and the old one stays alive while it's referenced")
+            {
+                REQUIRE(pin->generation == 2);
+                REQUIRE(pin.version() == 1);
+                REQUIRE(snapshot.version() == 1);
+                REQUIRE(old->generation == 1);
+                REQUIRE(old.use_count() == 1);
+                REQUIRE(g_liveSnapshots == 2);
+            }
+        }
+
+        WHEN("snapshots are stored several times")
+        {
+            for (LONG64 i = 2; i <= 5; ++i)
+            {
+                snapshot.store(kf::make_ref<Snapshot, NonPagedPoolNx>(i));
+            }
+
+            THEN("only the last one is alive")
+            {
+                REQUIRE(snapshot.pin()->generation == 5);
+                REQUIRE(snapshot.version() == 4);
+                REQUIRE(g_liveSnapshots == 1);
+            }
+        }
+    }
+
+    GIVEN("a versioned pointer pinned by 2 to 128 threads while one thread stores snapshots")
+    {
+        for (int threadCount : stress::kThreadCounts)
+        {
+            {
+                SnapshotPtr snapshot(kf::make_ref<Snapshot, NonPagedPoolNx>(0));
+                REQUIRE_NT_SUCCESS(snapshot.initialize());
+
+                StressContext context = { &snapshot };
+                REQUIRE_NT_SUCCESS(stress::runThreads(threadCount, &stressRoutine, &context));
+
+                REQUIRE(context.failedStores == 0);
+                REQUIRE(context.tornReads == 0);
+                REQUIRE(context.staleReads == 0);
+                REQUIRE(context.reads == static_cast<LONG64>(threadCount - 1) * kIterationCount);
+                REQUIRE(snapshot.pin()->generation == kStoreCount);
+                REQUIRE(g_liveSnapshots == 1);
+            }
+
+            REQUIRE(g_liveSnapshots == 0);
+        }
+    }
+}
@@ -0,0 +1,262 @@
+#include "pch.h"
+#include <fltKernel.h>
+#include <kf/WorkQueue.h>
+#include <kf/Latch.h>
+#include <kf/Thread.h>
+
+namespace
+{
+    constexpr int kProducerCount = 4;
+    constexpr int kSubmitCount = 5000;
+
+    struct ProducerContext
+    {
+        kf::WorkQueue<NonPagedPoolNx>* queue;
+        volatile LONG* executed;
+    };
+
+    // The test driver has neither a device nor a filter of its own. Work items are queued on behalf of
+    // the Null device and of a registered filter, which stay referenced while a routine runs.
+    class NullDevice
+    {
+    public:
+        NullDevice()
+        {
+            UNICODE_STRING name = RTL_CONSTANT_STRING(L"\\Device\\Null");
+            m_status = IoGetDeviceObjectPointer(&name, FILE_READ_DATA, &m_file, &m_device);
+        }
+
+        ~NullDevice()
+        {
+            if (NT_SUCCESS(m_status) && m_file)
+            {
+                ObDereferenceObject(m_file);
+            }
+        }
+
+        NTSTATUS status() const
+        {
+            return m_status;
+        }
+
+        PDEVICE_OBJECT get() const
+        {
+            return m_device;
+        }
+
+    private:
+        NTSTATUS m_status;
+        PFILE_OBJECT m_file = nullptr;
+        PDEVICE_OBJECT m_device = nullptr;
+    };
+
+    class RegisteredFilter
+    {
+    public:
+        RegisteredFilter()
+        {
+            PFLT_FILTER filters[64] = {};
+            ULONG count = 0;
+
+            if (NT_SUCCESS(FltEnumerateFilters(filters, ARRAYSIZE(filters), &count)) && count)
+            {
+                m_filter = filters[0];
+
+                for (ULONG i = 1; i < count; ++i)
+                {
+                    FltObjectDereference(filters[i]);
+                }
+            }
+        }
+
+        ~RegisteredFilter()
+        {
+            if (m_filter)
+            {
+                FltObjectDereference(m_filter);
+            }
+        }
+
+        PFLT_FILTER get() const
+        {
+            return m_filter;
+        }
+
+    private:
+        PFLT_FILTER m_filter = nullptr;
+    };
+
+    // Submits from several threads, retrying while the queue is full
+    void producerRoutine(ProducerContext* context)
+    {
+        for (int i = 0; i < kSubmitCount; ++i)
+        {
+            for (;;)
+            {
+                const NTSTATUS status = context->queue->submit([executed = context->executed] { InterlockedIncrement(executed); });
+                if (status != STATUS_DEVICE_BUSY)
+                {
+                    break;
+                }
+
+                YieldProcessor();
+            }
+        }
+    }
+}
+
+SCENARIO("kf::WorkQueue")
+{
+    NullDevice device;
+    REQUIRE_NT_SUCCESS(device.status());
+
+    GIVEN("an initialized queue")
+    {
+        kf::WorkQueue<NonPagedPoolNx> queue;
+        REQUIRE_NT_SUCCESS(queue.initialize(device.get(), 16));
+
+        WHEN("callables are submitted")
+        {
+            constexpr int kCount = 10;
+
+            int order[kCount] = {};
+            volatile LONG position = 0;
+            kf::Latch done(kCount);
+
+            for (int i = 0; i < kCount; ++i)
+            {
+                REQUIRE_NT_SUCCESS(queue.submit([&order, &position, &done, i]
+                {
+                    order[InterlockedIncrement(&position) - 1] = i;
+                    done.countDown();
+                }));
+            }
+
+            REQUIRE_NT_SUCCESS(done.wait());
+
+            THEN("they are executed in the submission order")
+            {
+                for (int i = 0; i < kCount; ++i)
+                {
+                    REQUIRE(order[i] == i);
+                }
+            }
+
+            THEN("the counters are updated")
+            {
+                queue.rundown();
+
+                const auto stats = queue.stats();
+                REQUIRE(stats.submitted == kCount);
+                REQUIRE(stats.executed == kCount);
+                REQUIRE(stats.rejected == 0);
+                REQUIRE(stats.depth == 0);
+                REQUIRE(stats.batches >= 1);
+                REQUIRE(stats.maxLatency <= stats.totalLatency);
+            }
+        }
+
+        WHEN("the queue is full")
+        {
+            kf::Event release(NotificationEvent, false);
+            kf::Event started(NotificationEvent, false);
+
+            REQUIRE_NT_SUCCESS(queue.submit([&release, &started] { started.set(); release.wait(); }));
+            REQUIRE_NT_SUCCESS(started.wait());
+
+            int accepted = 0;
+            NTSTATUS status = STATUS_SUCCESS;
+
+            while (NT_SUCCESS(status = queue.submit([] {})))
+            {
+                ++accepted;
+            }
+
+            release.set();
+            queue.rundown();
+
+            THEN("submit reports back-pressure")
+            {
+                REQUIRE(status == STATUS_DEVICE_BUSY);
+                REQUIRE(accepted == 15);
+                REQUIRE(queue.stats().rejected == 1);
+            }
+        }
+
+        WHEN("the queue is run down")
+        {
+            LONG executed = 0;
+
+            REQUIRE_NT_SUCCESS(queue.submit([&executed] { ++executed; }));
+            queue.rundown();
+
+            THEN("queued callables are executed and new ones are rejected")
+            {
+                REQUIRE(executed == 1);
+                REQUIRE(queue.submit([] {}) == STATUS_DELETE_PENDING);
+            }
+        }
+    }
+
+    GIVEN("a queue on a filter work item")
+    {
+        RegisteredFilter filter;
+        REQUIRE(filter.get());
+
+        kf::WorkQueue<NonPagedPoolNx> queue;
+        REQUIRE_NT_SUCCESS(queue.initialize(filter.get(), 16));
+
+        WHEN("callables are submitted and the queue is run down")
+        {
+            constexpr int kCount = 10;
+
+            volatile LONG executed = 0;
+
+            for (int i = 0; i < kCount; ++i)
+            {
+                REQUIRE_NT_SUCCESS(queue.submit([&executed] { InterlockedIncrement(&executed); }));
+            }
+
+            queue.rundown();
+
+            THEN("they are executed")
+            {
+                REQUIRE(executed == kCount);
+                REQUIRE(queue.stats().executed == kCount);
+            }
+        }
+    }
+
+    GIVEN("a queue with multiple producers")
+    {
+        volatile LONG executed = 0;
+
+        {
+            kf::WorkQueue<NonPagedPoolNx> queue;
+            REQUIRE_NT_SUCCESS(queue.initialize(device.get(), 1024));
+
+            ProducerContext context = { &queue, &executed };
+            kf::Thread threads[kProducerCount];
+
+            for (auto& thread : threads)
+            {
+                REQUIRE_NT_SUCCESS(thread.start([](PVOID context)
+                    {
+                        producerRoutine(static_cast<ProducerContext*>(context));
+                        PsTerminateSystemThread(STATUS_SUCCESS);
+                    },
+                    &context));
+            }
+
+            for (auto& thread : threads)
+            {
+                thread.join();
+            }
+        }
+
+        THEN("every callable is executed once")
+        {
+            REQUIRE(executed == kProducerCount * kSubmitCount);
+        }
+    }
+}